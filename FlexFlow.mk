@@ -38,6 +38,25 @@ GEN_SRC		+= ${FF_HOME}/src/runtime/model.cc\
 		${FF_HOME}/src/runtime/initializer.cc\
 		${FF_HOME}/src/runtime/optimizer.cc\
 		${FF_HOME}/src/ops/embedding.cc\
+		${FF_HOME}/src/ops/linear.cc\
+		${FF_HOME}/src/ops/conv_2d.cc\
+		${FF_HOME}/src/ops/cpu_kernels.cc\
+		${FF_HOME}/src/ops/pool_2d.cc\
+		${FF_HOME}/src/ops/batch_norm.cc\
+		${FF_HOME}/src/ops/batch_matmul.cc\
+		${FF_HOME}/src/ops/attention.cc\
+		${FF_HOME}/src/ops/element_unary.cc\
+		${FF_HOME}/src/ops/element_binary.cc\
+		${FF_HOME}/src/ops/softmax.cc\
+		${FF_HOME}/src/ops/concat.cc\
+		${FF_HOME}/src/ops/split.cc\
+		${FF_HOME}/src/ops/flat.cc\
+		${FF_HOME}/src/ops/reshape.cc\
+		${FF_HOME}/src/ops/reverse.cc\
+		${FF_HOME}/src/ops/transpose.cc\
+		${FF_HOME}/src/ops/dropout.cc\
+		${FF_HOME}/src/loss_functions/loss_functions.cc\
+		${FF_HOME}/src/runtime/cpu_helper.cc\
 		${FF_HOME}/src/runtime/strategy.cc\
 		${FF_HOME}/src/runtime/simulator.cc\
 		${FF_HOME}/src/metrics_functions/metrics_functions.cc
@@ -75,6 +94,20 @@ NVCC_FLAGS	  += -DMAX_TENSOR_DIM=$(MAX_DIM)
 GASNET_FLAGS	+=
 # For Point and Rect typedefs
 CC_FLAGS	    += -std=c++11 #-DMAX_RETURN_SIZE=16777216
+CC_FLAGS	    += -fopenmp-simd
+# Use OpenMP threads in CPU tasks
+FF_USE_OPENMP ?= 0
+ifeq ($(strip $(FF_USE_OPENMP)),1)
+CC_FLAGS	    += -fopenmp
+LD_FLAGS      += -fopenmp
+endif
+# Use a CBLAS library for GEMMs in CPU tasks
+FF_USE_CBLAS ?= 0
+CBLAS_LIB ?= -lopenblas
+ifeq ($(strip $(FF_USE_CBLAS)),1)
+CC_FLAGS	    += -DFF_USE_CBLAS
+LD_FLAGS      += $(CBLAS_LIB)
+endif
 NVCC_FLAGS  	+= -std=c++11 #-DMAX_RETURN_SIZE=16777216
 
 #ifndef HDF5
@@ -293,7 +293,7 @@ void DataLoader::next_batch(FFModel& ff)
     IndexLauncher launcher(CUSTOM_GPU_TASK_ID_1, task_is,
                            TaskArgument(NULL,0), argmap,
                            Predicate::TRUE_PRED, false/*must*/, 0/*mapper_id*/,
-                           FFConfig::get_hash_id(""));
+                           ff.config.get_strategy_id(""));
     launcher.add_region_requirement(
         RegionRequirement(full_input.region, 0/*projection id*/,
                           READ_ONLY, EXCLUSIVE, full_input.region,
@@ -322,7 +322,7 @@ void DataLoader::next_batch(FFModel& ff)
     IndexLauncher launcher(CUSTOM_GPU_TASK_ID_2, task_is,
                            TaskArgument(NULL,0), argmap,
                            Predicate::TRUE_PRED, false/*must*/, 0/*mapper_id*/,
-                           FFConfig::get_hash_id(""));
+                           ff.config.get_strategy_id(""));
     launcher.add_region_requirement(
         RegionRequirement(full_label.region, 0/*projection id*/,
                           READ_ONLY, EXCLUSIVE, full_label.region,
@@ -16,6 +16,7 @@
 #include "dlrm.h"
 #include "hdf5.h"
 #include <sstream>
+#include <mutex>
 
 using namespace Legion;
 
@@ -334,29 +335,59 @@ DataLoader::DataLoader(FFModel& ff,
     const int dims[] = {num_samples, 1};
     full_label = ff.create_tensor<2>(dims, DT_FLOAT);
   }
-  // Load entire dataset
-  // TODO: Use index launcher instead of task launcher
-  TaskLauncher launcher(CUSTOM_CPU_TASK_ID_1,
-      TaskArgument(dlrm.dataset_path.c_str(), dlrm.dataset_path.length()+10));
+  // Load entire dataset, a block of samples per loader CPU
+  IndexSpace load_is = ff.create_load_is(num_samples);
+  IndexLauncher launcher(CUSTOM_CPU_TASK_ID_1, load_is,
+      TaskArgument(dlrm.dataset_path.c_str(), dlrm.dataset_path.length()+1),
+      ArgumentMap());
   // regions[0]: full_sparse_input
   launcher.add_region_requirement(
-      RegionRequirement(full_sparse_input.region,
-                        WRITE_ONLY, EXCLUSIVE, full_sparse_input.region,
-                        MAP_TO_FB_MEMORY));
+      RegionRequirement(ff.create_sample_partition(full_sparse_input, load_is),
+                        0/*projection id*/, WRITE_ONLY, EXCLUSIVE,
+                        full_sparse_input.region, MAP_TO_ZC_PARENT_MEMORY));
   launcher.add_field(0, FID_DATA);
   // regions[1]: full_dense_input
   launcher.add_region_requirement(
-      RegionRequirement(full_dense_input.region,
-                        WRITE_ONLY, EXCLUSIVE, full_dense_input.region,
-                        MAP_TO_ZC_MEMORY));
+      RegionRequirement(ff.create_sample_partition(full_dense_input, load_is),
+                        0/*projection id*/, WRITE_ONLY, EXCLUSIVE,
+                        full_dense_input.region, MAP_TO_ZC_PARENT_MEMORY));
   launcher.add_field(1, FID_DATA);
-  // regions[3]: full_label
+  // regions[2]: full_label
   launcher.add_region_requirement(
-      RegionRequirement(full_label.region,
-                        WRITE_ONLY, EXCLUSIVE, full_label.region,
-                        MAP_TO_ZC_MEMORY));
+      RegionRequirement(ff.create_sample_partition(full_label, load_is),
+                        0/*projection id*/, WRITE_ONLY, EXCLUSIVE,
+                        full_label.region, MAP_TO_ZC_PARENT_MEMORY));
   launcher.add_field(2, FID_DATA);
-  runtime->execute_task(ctx, launcher);
+  runtime->execute_index_space(ctx, launcher);
+  // Staged batches mirror the sparse inputs, the dense input and the label
+  std::vector<Tensor> batches(batch_sparse_inputs);
+  std::vector<std::string> pcnames;
+  for (size_t i = 0; i < batch_sparse_inputs.size(); i++)
+    pcnames.push_back("embedding"+std::to_string(i));
+  batches.push_back(batch_dense_input);
+  pcnames.push_back("");
+  batches.push_back(batch_label);
+  pcnames.push_back("");
+  prefetcher.init(ff, batches, pcnames);
+}
+
+// Reads rows [first, first + count) of a 1D or 2D dataset into ptr
+static void read_dataset_rows(hid_t dataset_id, hid_t space_id,
+                              hid_t mem_type_id, hsize_t first,
+                              hsize_t count, void* ptr)
+{
+  hsize_t dims[2], maxdims[2];
+  int ndims = H5Sget_simple_extent_dims(space_id, dims, maxdims);
+  assert(ndims == 1 || ndims == 2);
+  assert(first + count <= dims[0]);
+  hsize_t start[2] = {first, 0};
+  hsize_t block[2] = {count, ndims == 2 ? dims[1] : 1};
+  H5Sselect_hyperslab(space_id, H5S_SELECT_SET, start, NULL, block, NULL);
+  hid_t mem_space_id = H5Screate_simple(ndims, block, NULL);
+  herr_t ret = H5Dread(dataset_id, mem_type_id, mem_space_id, space_id,
+                       H5P_DEFAULT, ptr);
+  assert(ret >= 0);
+  H5Sclose(mem_space_id);
 }
 
 void DataLoader::load_entire_dataset(const Task *task,
@@ -383,7 +414,11 @@ void DataLoader::load_entire_dataset(const Task *task,
   int64_t* sparse_input_ptr = acc_sparse_input.ptr(rect_sparse_input.lo);
   float* dense_input_ptr = acc_dense_input.ptr(rect_dense_input.lo);
   float* label_input_ptr = acc_label_input.ptr(rect_label_input.lo);
+  // This point loads the block of samples [first, first + num_samples)
+  hsize_t first = rect_sparse_input.lo[1];
   int num_samples = rect_sparse_input.hi[1] - rect_sparse_input.lo[1] + 1;
+  assert(rect_dense_input.lo[1] == rect_sparse_input.lo[1]);
+  assert(rect_label_input.lo[1] == rect_sparse_input.lo[1]);
   int num_sparse_inputs = rect_sparse_input.hi[0] - rect_sparse_input.lo[0] + 1;
   assert(num_samples == rect_dense_input.hi[1] - rect_dense_input.lo[1] + 1);
   int num_dense_dims = rect_dense_input.hi[0] - rect_dense_input.lo[0] + 1;
@@ -399,7 +434,10 @@ void DataLoader::load_entire_dataset(const Task *task,
     for (size_t i = 0; i < rect_label_input.volume(); i++)
       label_input_ptr[i] = std::rand() % 2;
   } else {
-    hid_t file_id = H5Fopen(file_name.c_str(), H5F_ACC_RDWR, H5P_DEFAULT);
+    // HDF5 is not thread safe, so points on the same node take turns
+    static std::mutex hdf5_mutex;
+    std::lock_guard<std::mutex> lock(hdf5_mutex);
+    hid_t file_id = H5Fopen(file_name.c_str(), H5F_ACC_RDONLY, H5P_DEFAULT);
     // Load X_cat
     {
       log_app.print("Start loading sparse features from "
@@ -410,10 +448,10 @@ void DataLoader::load_entire_dataset(const Task *task,
       hid_t x_cat_type_id = H5Dget_type(x_cat_dataset_id);
       assert(H5Sget_simple_extent_dims(x_cat_space_id, dims, maxdims) == 2);
       assert(H5Tget_class(x_cat_type_id) == H5T_INTEGER);
-      assert(num_samples == (int)dims[0]);
+      assert(first + num_samples <= dims[0]);
       assert(num_sparse_inputs == (int)dims[1]);
-      H5Dread(x_cat_dataset_id, H5T_NATIVE_LLONG, H5S_ALL, H5S_ALL, H5P_DEFAULT,
-              sparse_input_ptr);
+      read_dataset_rows(x_cat_dataset_id, x_cat_space_id, H5T_NATIVE_LLONG,
+                        first, num_samples, sparse_input_ptr);
       H5Tclose(x_cat_type_id);
       H5Dclose(x_cat_dataset_id);
       H5Sclose(x_cat_space_id);
@@ -429,10 +467,10 @@ void DataLoader::load_entire_dataset(const Task *task,
       hid_t x_int_type_id = H5Dget_type(x_int_dataset_id);
       assert(H5Sget_simple_extent_dims(x_int_space_id, dims, maxdims) == 2);
       assert(H5Tget_class(x_int_type_id) == H5T_FLOAT);
-      num_samples = dims[0];
+      assert(first + num_samples <= dims[0]);
       assert(num_dense_dims == (int)dims[1]);
-      H5Dread(x_int_dataset_id, H5T_NATIVE_FLOAT, H5S_ALL, H5S_ALL, H5P_DEFAULT,
-              dense_input_ptr);
+      read_dataset_rows(x_int_dataset_id, x_int_space_id, H5T_NATIVE_FLOAT,
+                        first, num_samples, dense_input_ptr);
       H5Tclose(x_int_type_id);
       H5Dclose(x_int_dataset_id);
       H5Sclose(x_int_space_id);
@@ -447,22 +485,40 @@ void DataLoader::load_entire_dataset(const Task *task,
       hid_t y_space_id = H5Dget_space(y_dataset_id);
       hid_t y_type_id = H5Dget_type(y_dataset_id);
       H5Sget_simple_extent_dims(y_space_id, dims, maxdims);
-      assert(num_samples == (int)dims[0]);
+      assert(first + num_samples <= dims[0]);
       //assert(dims[1] == 1);
-      H5Dread(y_dataset_id, H5T_NATIVE_FLOAT, H5S_ALL, H5S_ALL, H5P_DEFAULT,
-              label_input_ptr);
+      read_dataset_rows(y_dataset_id, y_space_id, H5T_NATIVE_FLOAT,
+                        first, num_samples, label_input_ptr);
       H5Tclose(y_type_id);
       H5Dclose(y_dataset_id);
       H5Sclose(y_space_id);
       log_app.print("Finish loading labels");
     }
+    H5Fclose(file_id);
   }
 }
 
 void DataLoader::next_batch(FFModel& ff)
+{
+  prefetcher.next_batch(ff, *this);
+  // progress next_index
+  next_index += ff.config.batchSize;
+}
+
+long long DataLoader::batch_key(const FFModel& ff, int ahead)
+{
+  return BatchPrefetcher::epoch_batch_key(next_index, ahead, num_samples,
+                                         ff.config.batchSize);
+}
+
+void DataLoader::load_batch(FFModel& ff, long long key,
+                            const std::vector<Tensor>& tensors)
 {
   Context ctx = ff.config.lg_ctx;
   Runtime* runtime = ff.config.lg_hlr;
+  assert(tensors.size() == batch_sparse_inputs.size() + 2);
+  const Tensor& batch_dense_input = tensors[batch_sparse_inputs.size()];
+  const Tensor& batch_label = tensors[batch_sparse_inputs.size() + 1];
   // Load Sparse Inputs
   for (size_t i = 0; i < batch_sparse_inputs.size(); i++) {
     int hash = batch_sparse_inputs.size() * 1000 + i;
@@ -470,7 +526,7 @@ void DataLoader::next_batch(FFModel& ff)
     IndexSpaceT<2> task_is = IndexSpaceT<2>(ff.get_or_create_task_is(2, pc_name));
     Rect<2> rect = runtime->get_index_space_domain(ctx, task_is);
     ArgumentMap argmap;
-    int idx = next_index;
+    int idx = key;
     for (PointInRectIterator<2> it(rect); it(); it++) {
       SampleIdxs meta;
       assert(ff.config.batchSize % (rect.hi[1] - rect.lo[1] + 1) == 0);
@@ -484,7 +540,7 @@ void DataLoader::next_batch(FFModel& ff)
     IndexLauncher launcher(CUSTOM_GPU_TASK_ID_1, task_is,
                            TaskArgument(&hash, sizeof(int)), argmap,
                            Predicate::TRUE_PRED, false/*must*/, 0/*mapper_id*/,
-                           FFConfig::get_hash_id(pc_name));
+                           ff.config.get_strategy_id(pc_name));
 //#if 1
     // Full dataset in ZCM
     launcher.add_region_requirement(
@@ -494,8 +550,8 @@ void DataLoader::next_batch(FFModel& ff)
     launcher.add_field(0, FID_DATA);
 //#endif
     launcher.add_region_requirement(
-        RegionRequirement(batch_sparse_inputs[i].part, 0/*projection id*/,
-                          WRITE_ONLY, EXCLUSIVE, batch_sparse_inputs[i].region));
+        RegionRequirement(tensors[i].part, 0/*projection id*/,
+                          WRITE_ONLY, EXCLUSIVE, tensors[i].region));
     launcher.add_field(1, FID_DATA);
     //std::cout << "CUSTOM_CPU_TASK_ID_2" << std::endl;
     runtime->execute_index_space(ctx, launcher);
@@ -507,7 +563,7 @@ void DataLoader::next_batch(FFModel& ff)
     IndexSpaceT<2> task_is = IndexSpaceT<2>(ff.get_or_create_task_is(2, pc_name));
     Rect<2> rect = runtime->get_index_space_domain(ctx, task_is);
     ArgumentMap argmap;
-    int idx = next_index;
+    int idx = key;
     for (PointInRectIterator<2> it(rect); it(); it++) {
       SampleIdxs meta;
       assert(ff.config.batchSize % (rect.hi[1] - rect.lo[1] + 1) == 0);
@@ -519,7 +575,7 @@ void DataLoader::next_batch(FFModel& ff)
     IndexLauncher launcher(CUSTOM_GPU_TASK_ID_2, task_is,
                          TaskArgument(NULL, 0), argmap,
                          Predicate::TRUE_PRED, false/*must*/, 0/*mapper_id*/,
-                         FFConfig::get_hash_id(std::string(pc_name)));
+                         ff.config.get_strategy_id(std::string(pc_name)));
     // Full dataset in ZCM
     launcher.add_region_requirement(
         RegionRequirement(full_dense_input.region, 0/*projection id*/,
@@ -538,7 +594,7 @@ void DataLoader::next_batch(FFModel& ff)
     IndexSpaceT<2> task_is = IndexSpaceT<2>(ff.get_or_create_task_is(2, pc_name));
     Rect<2> rect = runtime->get_index_space_domain(ctx, task_is);
     ArgumentMap argmap;
-    int idx = next_index;
+    int idx = key;
     for (PointInRectIterator<2> it(rect); it(); it++) {
       SampleIdxs meta;
       assert(ff.config.batchSize % (rect.hi[1] - rect.lo[1] + 1) == 0);
@@ -550,7 +606,7 @@ void DataLoader::next_batch(FFModel& ff)
     IndexLauncher launcher(CUSTOM_GPU_TASK_ID_3, task_is,
                          TaskArgument(NULL, 0), argmap,
                          Predicate::TRUE_PRED, false/*must*/, 0/*mapper_id*/,
-                         FFConfig::get_hash_id(std::string(pc_name)));
+                         ff.config.get_strategy_id(std::string(pc_name)));
     // Full dataset in ZCM
     launcher.add_region_requirement(
         RegionRequirement(full_label.region, 0/*projection id*/,
@@ -563,8 +619,6 @@ void DataLoader::next_batch(FFModel& ff)
     launcher.add_field(1, FID_DATA);
     runtime->execute_index_space(ctx, launcher);
   }
-  // progress next_index
-  next_index += ff.config.batchSize;
 }
 
 void DataLoader::shuffle()
@@ -37,7 +37,7 @@ struct DLRMConfig {
   std::string arch_interaction_op, dataset_path;
 };
 
-class DataLoader {
+class DataLoader : public BatchPrefetcher::Source {
 public:
   DataLoader(FFModel& ff, const DLRMConfig& dlrm,
              const std::vector<Tensor>& _sparse_inputs,
@@ -45,6 +45,9 @@ public:
   void next_batch(FFModel& ff);
   void shuffle();
   void reset();
+  long long batch_key(const FFModel& ff, int ahead);
+  void load_batch(FFModel& ff, long long key,
+                  const std::vector<Tensor>& tensors);
   static void load_entire_dataset(const Task *task,
                                   const std::vector<PhysicalRegion> &regions,
                                   Context ctx,
@@ -70,6 +73,7 @@ public:
 private:
   std::vector<Tensor> batch_sparse_inputs;
   Tensor full_sparse_input, full_dense_input, batch_dense_input, full_label, batch_label;
+  BatchPrefetcher prefetcher;
 };
 
 struct SampleIdxs {
@@ -248,7 +248,7 @@ void DataLoader::next_batch(FFModel& ff)
     IndexLauncher launcher(CUSTOM_GPU_TASK_ID_2, task_is,
                          TaskArgument(NULL, 0), argmap,
                          Predicate::TRUE_PRED, false/*must*/, 0/*mapper_id*/,
-                         FFConfig::get_hash_id(std::string(pc_name)));
+                         ff.config.get_strategy_id(std::string(pc_name)));
     // Full dataset in ZCM
     launcher.add_region_requirement(
         RegionRequirement(full_input.region, 0/*projection id*/,
@@ -279,7 +279,7 @@ void DataLoader::next_batch(FFModel& ff)
     IndexLauncher launcher(CUSTOM_GPU_TASK_ID_2, task_is,
                          TaskArgument(NULL, 0), argmap,
                          Predicate::TRUE_PRED, false/*must*/, 0/*mapper_id*/,
-                         FFConfig::get_hash_id(std::string(pc_name)));
+                         ff.config.get_strategy_id(std::string(pc_name)));
     // Full dataset in ZCM
     launcher.add_region_requirement(
         RegionRequirement(full_label.region, 0/*projection id*/,
@@ -17,6 +17,7 @@
 #define _FLEXFLOW_CONFIG_H_
 #include <cstring>
 #include "legion.h"
+#include "ffconst.h"
 #include <cudnn.h>
 #include <cublas_v2.h>
 
@@ -35,6 +36,13 @@
 // Pre-assigned const flags
 #define MAP_TO_FB_MEMORY 0xABCD0000
 #define MAP_TO_ZC_MEMORY 0xABCE0000
+#define MAP_TO_SYS_MEMORY 0xABCF0000
+// Zero-copy memory, in one instance of the whole parent region shared by
+// the points of an index launch (e.g., loaders filling a dataset)
+#define MAP_TO_ZC_PARENT_MEMORY 0xABD00000
+// Task tag of loader launches whose points must stay on the launching
+// node (e.g., they read an attachment in its system memory)
+#define MAP_TO_LOCAL_NODE 0xABD10000
 
 using namespace Legion;
 
@@ -57,7 +65,7 @@ struct FFHandler {
 };
 
 bool load_strategies_from_file(const std::string& filename,
-         std::map<MappingTagID, ParallelConfig>& strategies);
+                               std::map<std::string, ParallelConfig>& strategies);
 
 bool save_strategies_to_file(const std::string& filename,
                              const std::map<std::string, ParallelConfig>& strategies);
@@ -71,13 +79,26 @@ public:
     DataParallelism_3D = 3,
     DataParallelism_4D = 4,
     DataParallelism_5D = 5,
+    // Tag for launches without an imported strategy, which use
+    // data parallelism over the dims of their launch domain
+    DataParallelism_ND = 6,
+    StrategyID_FIRST = 7,
+  };
+
+  // Families of CPU tasks whose slices may be stolen by idle CPUs
+  enum CPUStealFamily {
+    CPU_STEAL_NONE = 0,
+    CPU_STEAL_LOADER = 1, // data loading and custom CPU tasks
+    CPU_STEAL_INIT = 2, // weight initializers
+    CPU_STEAL_OPS = 4, // CPU variants of operators, loss and metrics
+    CPU_STEAL_ALL = 7,
   };
 
   FFConfig();
   //bool load_strategy_file(std::string filename);
   //bool save_strategy_file(std::string filename);
   void parse_args(char** argv, int argc);
-  static MappingTagID get_hash_id(const std::string& pcname);
+  MappingTagID get_strategy_id(const std::string& pcname) const;
   bool find_parallel_config(int ndims,
                             const std::string& pcname,
                             ParallelConfig& config) const;
@@ -99,13 +120,44 @@ public:
   bool enable_sample_parallel;
   bool enable_parameter_parallel;
   bool enable_attribute_parallel;
+  // Bitmask of CPUStealFamily
+  int cpu_steal_families;
+  // Use row-wise sparse gradients and updates for Embedding weights
+  bool sparse_embedding_grad;
+  // Run BatchNorm with its running statistics instead of batch statistics
+  bool inference;
+  // Update small dense parameters on the same device in one launch
+  bool multi_tensor_apply;
+  // Storage type of Adam's moments: DT_FLOAT, DT_HALF or DT_BFLOAT16
+  DataType adam_moment_type;
+  // Clip dense gradients to this global L2 norm (0 disables clipping)
+  float clip_grad_norm;
+  // Issue the updates of each layer right after its backward
+  bool overlap_backward_update;
+  // Small replicated gradients are packed into buckets of up to this many
+  // bytes and synchronized one bucket at a time (0 disables buckets).
+  // Overlapped updates of other parameters also wait until their pending
+  // gradients reach this size
+  size_t grad_bucket_size;
+  // Defer weight initialization to FFModel::init_layers, skipping weights
+  // that Parameter::set_weights overwrites before then
+  bool lazy_weight_init;
+  // Number of batches data loaders stage ahead of the current one
+  // (0 copies each batch when it is needed)
+  int prefetch_depth;
   std::string dataset_path;
   std::string import_strategy_file;
   std::string export_strategy_file;
-  // We use MappingTagID as the key since we will pass the tag to the mapper
-  std::map<MappingTagID, ParallelConfig> strategies;
+  // Strategy ids are only assigned by assign_strategy_ids, and the
+  // strategy of a tag is strategies[tag] since we pass the tag to the mapper
+  std::map<std::string, MappingTagID> strategy_ids;
+  std::vector<ParallelConfig> strategies;
 };
 
+void assign_strategy_ids(const std::map<std::string, ParallelConfig>& named_strategies,
+                         std::map<std::string, MappingTagID>& strategy_ids,
+                         std::vector<ParallelConfig>& strategies);
+
 struct ParaConfigCompare {
   bool operator()(const ParallelConfig& a, const ParallelConfig& b) const {
     if (a.nDims != b.nDims)
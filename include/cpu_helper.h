@@ -0,0 +1,288 @@
+#ifndef _FLEXFLOW_CPU_HELPER_H_
+#define _FLEXFLOW_CPU_HELPER_H_
+#include "legion.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+// CPU kernels are vectorized through omp simd (-fopenmp-simd), and are
+// multithreaded within a task only when built with ENABLE_OPENMP
+#ifdef _OPENMP
+#define CPU_PARALLEL_FOR _Pragma("omp parallel for schedule(static)")
+#define CPU_PARALLEL_FOR_SIMD _Pragma("omp parallel for simd schedule(static)")
+#define CPU_PARALLEL_FOR_REDUCTION(...) \
+    CPU_PRAGMA(omp parallel for schedule(static) reduction(__VA_ARGS__))
+#define CPU_PARALLEL_FOR_IF(cond) \
+    CPU_PRAGMA(omp parallel for schedule(static) if(cond))
+#define CPU_PARALLEL _Pragma("omp parallel")
+// Splits a loop across the threads of an enclosing CPU_PARALLEL region
+#define CPU_FOR _Pragma("omp for schedule(static)")
+#else
+#define CPU_PARALLEL_FOR
+#define CPU_PARALLEL_FOR_SIMD _Pragma("omp simd")
+#define CPU_PARALLEL_FOR_REDUCTION(...)
+#define CPU_PARALLEL_FOR_IF(cond)
+#define CPU_PARALLEL
+#define CPU_FOR
+#endif
+#define CPU_PRAGMA(x) _Pragma(#x)
+#define CPU_SIMD _Pragma("omp simd")
+#define CPU_SIMD_REDUCTION(...) CPU_PRAGMA(omp simd reduction(__VA_ARGS__))
+
+// Helpers that CUDA kernels share with the CPU variants, so both produce
+// the same values, are also compiled for the device
+#ifdef __CUDACC__
+#define CPU_HOST_DEVICE __host__ __device__
+#else
+#define CPU_HOST_DEVICE
+#endif
+
+using namespace Legion;
+
+// Memory-bound kernels below this many elements run on a single thread
+const coord_t CPU_PARALLEL_MIN_VOLUME = 1 << 15;
+
+inline int cpu_num_threads(void)
+{
+#ifdef _OPENMP
+  return omp_get_num_threads();
+#else
+  return 1;
+#endif
+}
+
+inline int cpu_max_threads(void)
+{
+#ifdef _OPENMP
+  return omp_get_max_threads();
+#else
+  return 1;
+#endif
+}
+
+inline int cpu_thread_id(void)
+{
+#ifdef _OPENMP
+  return omp_get_thread_num();
+#else
+  return 0;
+#endif
+}
+
+template<typename DT>
+inline void cpu_assign(DT* __restrict__ ptr, coord_t size, DT value)
+{
+  CPU_SIMD
+  for (coord_t i = 0; i < size; i++)
+    ptr[i] = value;
+}
+
+template<typename DT>
+inline void cpu_copy(DT* __restrict__ dst, const DT* __restrict__ src,
+                     coord_t size)
+{
+  CPU_SIMD
+  for (coord_t i = 0; i < size; i++)
+    dst[i] = src[i];
+}
+
+// dst[i] += src[i]
+inline void cpu_add(float* __restrict__ dst, const float* __restrict__ src,
+                    coord_t size)
+{
+  CPU_SIMD
+  for (coord_t i = 0; i < size; i++)
+    dst[i] += src[i];
+}
+
+// dst[i] += alpha * src[i]
+inline void cpu_axpy(float* __restrict__ dst, const float* __restrict__ src,
+                     float alpha, coord_t size)
+{
+  CPU_SIMD
+  for (coord_t i = 0; i < size; i++)
+    dst[i] += alpha * src[i];
+}
+
+inline void cpu_scale(float* __restrict__ ptr, coord_t size, float alpha)
+{
+  CPU_SIMD
+  for (coord_t i = 0; i < size; i++)
+    ptr[i] *= alpha;
+}
+
+// expf with a relative error below 2e-7 that the compiler can inline and
+// vectorize: exp(x) = 2^n * exp(r) with |r| <= ln(2)/2 and a degree-6
+// polynomial for exp(r). Inputs are clamped so 2^n stays a normal float
+inline float cpu_exp(float x)
+{
+  x = std::min(std::max(x, -87.3f), 88.3f);
+  float n = std::floor(x * 1.44269504f + 0.5f);
+  // Cody-Waite reduction with ln(2) split into a high and a low part
+  float r = x - n * 0.693359375f + n * 2.12194440e-4f;
+  float p = 1.9875691500e-4f;
+  p = p * r + 1.3981999507e-3f;
+  p = p * r + 8.3334519073e-3f;
+  p = p * r + 4.1665795894e-2f;
+  p = p * r + 1.6666665459e-1f;
+  p = p * r + 5.0000001201e-1f;
+  p = p * r * r + r + 1.0f;
+  int32_t bits = ((int32_t) n + 127) << 23;
+  float scale;
+  memcpy(&scale, &bits, sizeof(float));
+  return p * scale;
+}
+
+inline float cpu_sigmoid(float x)
+{
+  return 1.0f / (1.0f + cpu_exp(-x));
+}
+
+// Absolute error below 3e-7
+inline float cpu_tanh(float x)
+{
+  return 2.0f / (1.0f + cpu_exp(-2.0f * x)) - 1.0f;
+}
+
+// IEEE half <-> float with round-to-nearest-even, after F. Giesen's
+// branch-light conversions; NaNs stay NaNs and overflow becomes inf
+inline uint16_t cpu_float_to_half(float x)
+{
+  uint32_t u;
+  memcpy(&u, &x, sizeof(float));
+  uint32_t sign = (u >> 16) & 0x8000u;
+  u &= 0x7fffffffu;
+  uint16_t h;
+  if (u >= 0x47800000u) {
+    // At least 2^16 (or inf/nan)
+    h = (u > 0x7f800000u) ? 0x7e00 : 0x7c00;
+  } else if (u < 0x38800000u) {
+    // Below 2^-14: the float adder rounds into the half subnormal range
+    const uint32_t magic_bits = 0x3f000000u;
+    float f, magic;
+    memcpy(&f, &u, sizeof(float));
+    memcpy(&magic, &magic_bits, sizeof(float));
+    f += magic;
+    memcpy(&u, &f, sizeof(float));
+    h = (uint16_t)(u - magic_bits);
+  } else {
+    uint32_t mant_odd = (u >> 13) & 1;
+    u += 0xc8000fffu + mant_odd;
+    h = (uint16_t)(u >> 13);
+  }
+  return h | sign;
+}
+
+inline float cpu_half_to_float(uint16_t h)
+{
+  uint32_t u = (uint32_t)(h & 0x7fff) << 13;
+  uint32_t exp = u & 0x0f800000u;
+  u += 0x38000000u;
+  if (exp == 0x0f800000u) {
+    // inf/nan
+    u += 0x38000000u;
+  } else if (exp == 0) {
+    // Subnormal: renormalize through the float unit
+    const uint32_t magic_bits = 0x38800000u;
+    float f, magic;
+    u += 0x00800000u;
+    memcpy(&f, &u, sizeof(float));
+    memcpy(&magic, &magic_bits, sizeof(float));
+    f -= magic;
+    memcpy(&u, &f, sizeof(float));
+  }
+  u |= (uint32_t)(h & 0x8000) << 16;
+  float x;
+  memcpy(&x, &u, sizeof(float));
+  return x;
+}
+
+// bfloat16 is the upper half of a float, rounded to nearest even
+inline uint16_t cpu_float_to_bf16(float x)
+{
+  uint32_t u;
+  memcpy(&u, &x, sizeof(float));
+  if ((u & 0x7fffffffu) > 0x7f800000u)
+    return (uint16_t)((u >> 16) | 0x40);
+  u += 0x7fffu + ((u >> 16) & 1);
+  return (uint16_t)(u >> 16);
+}
+
+inline float cpu_bf16_to_float(uint16_t h)
+{
+  uint32_t u = (uint32_t) h << 16;
+  float x;
+  memcpy(&x, &u, sizeof(float));
+  return x;
+}
+
+// Philox4x32-10 (Salmon et al., SC'11). The four outputs depend only on
+// the key and the 128-bit counter (ctr_lo, ctr_hi), so any position of a
+// random stream can be generated independently of how work is split
+inline CPU_HOST_DEVICE void cpu_philox4x32(uint64_t key, uint64_t ctr_lo, uint64_t ctr_hi,
+                                           uint32_t out[4])
+{
+  uint32_t k0 = (uint32_t) key, k1 = (uint32_t) (key >> 32);
+  uint32_t c0 = (uint32_t) ctr_lo, c1 = (uint32_t) (ctr_lo >> 32);
+  uint32_t c2 = (uint32_t) ctr_hi, c3 = (uint32_t) (ctr_hi >> 32);
+  for (int r = 0; r < 10; r++) {
+    uint64_t p0 = (uint64_t) 0xD2511F53u * c0;
+    uint64_t p1 = (uint64_t) 0xCD9E8D57u * c2;
+    c0 = (uint32_t) (p1 >> 32) ^ c1 ^ k0;
+    c2 = (uint32_t) (p0 >> 32) ^ c3 ^ k1;
+    c1 = (uint32_t) p1;
+    c3 = (uint32_t) p0;
+    k0 += 0x9E3779B9u;
+    k1 += 0xBB67AE85u;
+  }
+  out[0] = c0;
+  out[1] = c1;
+  out[2] = c2;
+  out[3] = c3;
+}
+
+// Column-major GEMM with the same arguments as cublasSgemm:
+// C = alpha * op(A) * op(B) + beta * C, where op(X) = X^T if trans_x
+void cpu_sgemm(bool trans_a, bool trans_b, int m, int n, int k,
+               float alpha, const float* A, int lda,
+               const float* B, int ldb,
+               float beta, float* C, int ldc);
+
+// Same arguments as cublasSgemmStridedBatched; the i-th GEMM reads
+// A + i * stride_a and B + i * stride_b and writes C + i * stride_c
+void cpu_sgemm_strided_batched(bool trans_a, bool trans_b,
+                               int m, int n, int k, float alpha,
+                               const float* A, int lda, coord_t stride_a,
+                               const float* B, int ldb, coord_t stride_b,
+                               float beta, float* C, int ldc, coord_t stride_c,
+                               int batch);
+
+// dst[b * dst_stride + j] = src[b * src_stride + j] for every b <
+// num_blocks and j < blk_size, as bulk memcpys split across threads
+void cpu_copy_with_stride(float* dst, coord_t dst_stride,
+                          const float* src, coord_t src_stride,
+                          coord_t num_blocks, coord_t blk_size);
+
+// Same as cpu_copy_with_stride but accumulates into dst
+void cpu_add_with_stride(float* dst, coord_t dst_stride,
+                         const float* src, coord_t src_stride,
+                         coord_t num_blocks, coord_t blk_size);
+
+// Unfold a CHW image into a (channels*kernel_h*kernel_w) x (out_h*out_w)
+// row-major matrix, with zeros for the padded border
+void cpu_im2col(const float* im, int channels, int height, int width,
+                int kernel_h, int kernel_w, int pad_h, int pad_w,
+                int stride_h, int stride_w, int out_h, int out_w,
+                float* col);
+
+// Inverse of cpu_im2col: accumulate the columns back into the image
+void cpu_col2im(const float* col, int channels, int height, int width,
+                int kernel_h, int kernel_w, int pad_h, int pad_w,
+                int stride_h, int stride_w, int out_h, int out_w,
+                float* im);
+
+#endif
@@ -0,0 +1,45 @@
+#ifndef _FLEXFLOW_CPU_KERNELS_H_
+#define _FLEXFLOW_CPU_KERNELS_H_
+#include "cpu_helper.h"
+#include "ffconst.h"
+
+// Legion-free CPU kernels behind the operators' LOC_PROC variants, kept
+// apart from the task bodies so tests/cpu_kernels can check them directly
+
+struct Conv2DShape {
+  int input_n, input_c, input_h, input_w;
+  int output_c, output_h, output_w;
+  int kernel_h, kernel_w, stride_h, stride_w, pad_h, pad_w, groups;
+};
+
+struct Pool2DShape {
+  int num_planes, input_h, input_w, output_h, output_w;
+  int kernel_h, kernel_w, stride_h, stride_w, pad_h, pad_w;
+};
+
+// Tensors are NCHW and filters are (out_c, in_c/groups, kh, kw)
+void conv2d_forward_cpu(const Conv2DShape& s,
+                        const float* input, float* output,
+                        const float* kernel, const float* bias,
+                        bool relu);
+
+// All gradients are accumulated into their existing values, same as the
+// cuDNN variant
+void conv2d_backward_cpu(const Conv2DShape& s,
+                         const float* input, float* input_grad,
+                         const float* output, float* output_grad,
+                         const float* kernel, float* kernel_grad,
+                         float* bias_grad, bool relu);
+
+// Average pooling excludes the padded border from the count, matching
+// CUDNN_POOLING_AVERAGE_COUNT_EXCLUDE_PADDING
+void pool2d_forward_cpu(const Pool2DShape& s, PoolType type,
+                        const float* input, float* output);
+
+// Accumulates into input_grad; max pooling routes each gradient to the
+// first maximum of its window
+void pool2d_backward_cpu(const Pool2DShape& s, PoolType type,
+                         const float* input, float* input_grad,
+                         const float* output_grad);
+
+#endif
@@ -25,6 +25,8 @@ enum DataType {
   DT_INT32 = 42,
   DT_INT64 = 43,
   DT_BOOLEAN = 44,
+  DT_HALF = 45,
+  DT_BFLOAT16 = 46,
 };
 
 enum LossType {
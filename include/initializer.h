@@ -17,18 +17,75 @@
 #define _INITIALIZER_H_
 
 #include "legion.h"
+#include "cpu_helper.h"
 
 using namespace Legion;
 
 class FFModel;
 class Tensor;
 
+// Random initializers draw element g of a weight from the Philox stream
+// keyed on the seed at counter g/4, where g is the element's column-major
+// index in the whole weight region. Values therefore depend only on
+// (seed, g): not on how the weight is partitioned, how many threads fill
+// it, or whether the CPU or GPU variant runs
+struct InitIndexMap {
+  int num_dims;
+  coord_t offset;
+  coord_t extents[MAX_TENSOR_DIM], strides[MAX_TENSOR_DIM];
+  // Index in the weight region of the local-th element of the subregion
+  inline CPU_HOST_DEVICE coord_t global_index(coord_t local) const
+  {
+    coord_t g = offset;
+    for (int d = 0; d < num_dims; d++) {
+      g += (local % extents[d]) * strides[d];
+      local /= extents[d];
+    }
+    return g;
+  }
+};
+
+InitIndexMap get_init_index_map(const Task* task, int idx,
+                                Context ctx, Runtime* runtime);
+float get_glorot_scale(const Domain& weight_domain);
+
+// Uniform in [lo, hi) from the upper 24 bits of x. Both variants use an
+// explicit single-rounding FMA, so the result does not depend on whether
+// the host compiler contracts lo + u * (hi - lo)
+inline CPU_HOST_DEVICE float init_uniform(uint32_t x, float lo, float hi)
+{
+  float u = (float)(x >> 8) * 5.9604645e-8f;
+#ifdef __CUDA_ARCH__
+  return __fmaf_rn(u, hi - lo, lo);
+#else
+  return fmaf(u, hi - lo, lo);
+#endif
+}
+
+// Box-Muller on the uniform pair (lane / 2) of a Philox output; lanes
+// 2k and 2k+1 take the cosine and sine. CPU and GPU results agree up to
+// the few-ulp differences between their logf/sinf/cosf
+inline CPU_HOST_DEVICE float init_normal(const uint32_t r[4], int lane,
+                                         float mean, float stddev)
+{
+  int pair = lane & 2;
+  float u1 = (float)((r[pair] >> 8) + 1) * 5.9604645e-8f;
+  float u2 = (float)(r[pair + 1] >> 8) * 5.9604645e-8f;
+  float radius = sqrtf(-2.0f * logf(u1));
+  float theta = 6.2831853f * u2;
+  return mean + stddev * radius * ((lane & 1) ? sinf(theta) : cosf(theta));
+}
+
 class Initializer
 {
 public:
   Initializer(void);
   virtual ~Initializer(void);
-  virtual void init(Context ctx, Runtime* runtime, const Tensor* tensor) = 0;
+  // Weights with a disjoint partition are filled by one point task per
+  // shard, mapped with tag (the strategy of their op), so that each
+  // device only writes its own shard
+  virtual void init(Context ctx, Runtime* runtime, const Tensor* tensor,
+                    MappingTagID tag) = 0;
 };
 
 class GlorotUniform : public Initializer
@@ -36,10 +93,14 @@ class GlorotUniform : public Initializer
 public:
   GlorotUniform(int _seed);
   ~GlorotUniform(void);
-  void init(Context ctx, Runtime* runtime, const Tensor* tensor);
+  void init(Context ctx, Runtime* runtime, const Tensor* tensor,
+            MappingTagID tag);
   static void init_task(const Task *task,
                         const std::vector<PhysicalRegion> &regions,
                         Context ctx, Runtime *runtime);
+  static void init_task_cpu(const Task *task,
+                        const std::vector<PhysicalRegion> &regions,
+                        Context ctx, Runtime *runtime);
   int seed;
 };
 
@@ -48,7 +109,8 @@ class ZeroInitializer : public Initializer
 public:
   ZeroInitializer(void);
   ~ZeroInitializer(void);
-  void init(Context ctx, Runtime* runtime, const Tensor* tensor);
+  void init(Context ctx, Runtime* runtime, const Tensor* tensor,
+            MappingTagID tag);
   static void init_task(const Task *task,
                         const std::vector<PhysicalRegion> &regions,
                         Context ctx, Runtime *runtime);
@@ -62,10 +124,14 @@ class UniformInitializer : public Initializer
 public:
   UniformInitializer(int _seed, float _min, float _max);
   ~UniformInitializer(void);
-  void init(Context ctx, Runtime* runtime, const Tensor* tensor);
+  void init(Context ctx, Runtime* runtime, const Tensor* tensor,
+            MappingTagID tag);
   static void init_task(const Task *task,
                         const std::vector<PhysicalRegion>& regions,
                         Context ctx, Runtime *runtime);
+  static void init_task_cpu(const Task *task,
+                        const std::vector<PhysicalRegion>& regions,
+                        Context ctx, Runtime *runtime);
   int seed;
   float min_val, max_val;
 };
@@ -75,10 +141,14 @@ class NormInitializer : public Initializer
 public:
   NormInitializer(int _seed, float _mean, float _stddev);
   ~NormInitializer(void);
-  void init(Context ctx, Runtime* runtime, const Tensor* tensor);
+  void init(Context ctx, Runtime* runtime, const Tensor* tensor,
+            MappingTagID tag);
   static void init_task(const Task *task,
                         const std::vector<PhysicalRegion> &regions,
                         Context ctx, Runtime *runtime);
+  static void init_task_cpu(const Task *task,
+                        const std::vector<PhysicalRegion> &regions,
+                        Context ctx, Runtime *runtime);
   int seed;
   float mean, stddev;
 };
@@ -88,7 +158,8 @@ class ConstantInitializer : public Initializer
 public:
   ConstantInitializer(float _value);
   ~ConstantInitializer(void);
-  void init(Context ctx, Runtime* runtime, const Tensor* tensor);
+  void init(Context ctx, Runtime* runtime, const Tensor* tensor,
+            MappingTagID tag);
   static void init_task(const Task *task,
                         const std::vector<PhysicalRegion> &regions,
                         Context ctx, Runtime* runtime);
@@ -36,6 +36,13 @@ public:
   static void backward_task_with_dim(const Task *task,
                             const std::vector<PhysicalRegion> &regions,
                             Context ctx, Runtime *runtime);
+  static void backward_task_cpu(const Task *task,
+                                const std::vector<PhysicalRegion> &regions,
+                                Context ctx, Runtime *runtime);
+  template<int NDIM>
+  static void backward_task_cpu_with_dim(const Task *task,
+                                         const std::vector<PhysicalRegion> &regions,
+                                         Context ctx, Runtime *runtime);
   void backward(FFModel* model, const Tensor* logit, const Tensor* label);
   template<int NDIM>
   void backward_with_dim(FFModel* model, const Tensor* logit, const Tensor* label);
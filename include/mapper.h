@@ -30,7 +30,9 @@ public:
             std::map<Processor, Memory>* proc_fbmems,
             std::map<Processor, Memory>* proc_zcmems,
             std::vector<Processor>* cpus,
-            std::map<MappingTagID, ParallelConfig>* strategies);
+            std::map<Processor, Memory>* proc_numamems,
+            std::vector<ParallelConfig>* strategies,
+            int cpu_steal_families);
 public:
   virtual void slice_task(const MapperContext ctx,
                           const Task& task,
@@ -47,17 +49,54 @@ public:
                                                      Processor target_proc,
                                                      const RegionRequirement &req,
                                                      MemoryConstraint mc);
+  virtual LogicalRegion default_policy_select_instance_region(
+                                MapperContext ctx,
+                                Memory target_memory,
+                                const RegionRequirement &req,
+                                const LayoutConstraintSet &constraints,
+                                bool force_new_instances,
+                                bool meets_constraints);
   virtual void map_task(const MapperContext ctx,
                         const Task& task,
                         const MapTaskInput& input,
                         MapTaskOutput& output);
+  virtual void select_steal_targets(const MapperContext ctx,
+                                    const SelectStealingInput& input,
+                                    SelectStealingOutput& output);
+  virtual void permit_steal_request(const MapperContext ctx,
+                                    const StealRequestInput& input,
+                                    StealRequestOutput& output);
+  virtual void memoize_operation(const MapperContext ctx,
+                                 const Mappable& mappable,
+                                 const MemoizeInput& input,
+                                 MemoizeOutput& output);
+protected:
+  unsigned long long compute_mapping_hash(const Task& task);
+  Memory select_numa_domain(const Task& task);
+  Processor select_numa_cpu(Memory numa_mem, AddressSpace space);
+  bool is_cpu_stealable(TaskID task_id) const;
+  bool is_task_stealable(const Task& task, Processor proc) const;
+  bool is_mapping_stable(TaskID task_id) const;
 protected:
   std::vector<Processor>& gpus;
   std::map<Processor, Memory>& proc_fbmems, proc_zcmems;
   std::vector<Processor>& cpus;
-  std::map<unsigned long long, Processor> cache_update_tasks;
-  // We use MappingTagID has the key since we will pass the tag to the mapper
-  std::map<MappingTagID, ParallelConfig>& strategies;
+  // NUMA-local system memory of each CPU and GPU (NO_MEMORY if unknown)
+  std::map<Processor, Memory>& proc_numamems;
+  // CPUs grouped by their NUMA-local memory
+  std::map<Memory, std::vector<Processor> > numa_cpus;
+  std::map<Memory, unsigned> numa_next_cpu;
+  // Processors picked by select_task_options, keyed by compute_mapping_hash
+  // and cleared once it holds MAX_CACHED_TASK_PROCS entries
+  std::map<unsigned long long, Processor> cache_task_procs;
+  // Slices computed by slice_task, keyed by (tag, launch domain)
+  std::map<std::pair<MappingTagID, Domain>, std::vector<TaskSlice> > cache_slices;
+  // Slices of MAP_TO_LOCAL_NODE loader launches over the local CPUs
+  std::map<Domain, std::vector<TaskSlice> > cache_local_cpu_slices;
+  // Indexed by strategy id since we will pass the id as the tag to the mapper
+  std::vector<ParallelConfig>& strategies;
+  // Bitmask of FFConfig::CPUStealFamily
+  int cpu_steal_families;
 };
 
 void update_mappers(Machine machine, Runtime *rt, const std::set<Processor> &local_procs);
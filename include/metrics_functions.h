@@ -23,6 +23,9 @@ class Tensor;
 class FFModel;
 class Metrics;
 
+// Lower bound of probabilities passed to log() in cross-entropy metrics
+const float LOG_MIN_VALUE = 0.00000001f;
+
 class PerfMetrics
 {
 public:
@@ -50,6 +53,13 @@ public:
   static PerfMetrics compute_task_with_dim(const Task *task,
                                   const std::vector<PhysicalRegion> &regions,
                                   Context ctx, Runtime *runtime);
+  static PerfMetrics compute_task_cpu(const Task *task,
+                                      const std::vector<PhysicalRegion> &regions,
+                                      Context ctx, Runtime *runtime);
+  template<int NDIM>
+  static PerfMetrics compute_task_cpu_with_dim(const Task *task,
+                                               const std::vector<PhysicalRegion> &regions,
+                                               Context ctx, Runtime *runtime);
   void compute(FFModel* model, const Tensor* logit, const Tensor* label);
   template<int NDIM>
   void compute_with_dim(FFModel* model, const Tensor* logit, const Tensor* label);
@@ -62,6 +62,7 @@ enum TaskIDs {
   BATCHNORM_INIT_PARA_TASK_ID,
   BATCHNORM_FWD_TASK_ID,
   BATCHNORM_BWD_TASK_ID,
+  BATCHNORM_SET_STATS_TASK_ID,
   BATCHMATMUL_INIT_TASK_ID,
   BATCHMATMUL_FWD_TASK_ID,
   BATCHMATMUL_BWD_TASK_ID,
@@ -100,11 +101,21 @@ enum TaskIDs {
   METRICS_COMP_TASK_ID,
   UPDATE_METRICS_TASK_ID,
   DUMMY_TASK_ID,
+  // Data loader
+  COPY_BATCH_TASK_ID,
   // Loss
   LOSS_BWD_TASK_ID,
   // Optimizer
   SGD_UPD_TASK_ID,
   ADAM_UPD_TASK_ID,
+  SGD_SPARSE_UPD_TASK_ID,
+  ADAM_SPARSE_UPD_TASK_ID,
+  SGD_MULTI_UPD_TASK_ID,
+  ADAM_MULTI_UPD_TASK_ID,
+  GRAD_NORM_TASK_ID,
+  GRAD_BUCKET_PACK_TASK_ID,
+  SGD_BUCKET_UPD_TASK_ID,
+  ADAM_BUCKET_UPD_TASK_ID,
   // Initializer
   GLOROT_INIT_TASK_ID,
   ZERO_INIT_TASK_ID,
@@ -116,6 +127,10 @@ enum TaskIDs {
   // Python data loader
   PY_DL_FLOAT_LOAD_ENTIRE_CPU_TASK_ID,
   PY_DL_INT_LOAD_ENTIRE_CPU_TASK_ID,
+  PY_DL_FLOAT_LOAD_SHARD_CPU_TASK_ID,
+  PY_DL_INT_LOAD_SHARD_CPU_TASK_ID,
+  PY_DL_FLOAT_GATHER_BATCH_CPU_TASK_ID,
+  PY_DL_INT_GATHER_BATCH_CPU_TASK_ID,
   PY_DL_FLOAT_LOAD_BATCH_GPU_TASK_ID,
   PY_DL_INT_LOAD_BATCH_GPU_TASK_ID,
   // Custom tasks
@@ -190,7 +205,7 @@ struct Tensor {
 };
 
 struct Parameter : Tensor {
-  Parameter(void) {}
+  Parameter(void) : sparse_grad(false) {}
   template <typename T>
   bool set_weights(const FFModel& model,
                    const std::vector<int>& dims,
@@ -201,6 +216,12 @@ struct Parameter : Tensor {
   std::vector<int> get_dims();
   std::string pcname; // indicating how the parameter is parallelized
   // Op* op; // Pointer to the operator that owns this parameter
+  // Row-wise sparse gradients (Embedding weights only), which replace
+  // region_grad: sparse_grad_rows holds the unique rows touched by each
+  // sample partition (-1 for unused slots) and sparse_grad_values holds
+  // their gradients, one row of the weight per slot
+  bool sparse_grad;
+  Tensor sparse_grad_rows, sparse_grad_values;
 };
 
 class OpMeta {
@@ -408,11 +429,15 @@ public:
                                          Context ctx, Runtime *runtime);
   void reset_metrics();
   void init_layers();
+  void init_pending_weights() const;
+  void drop_pending_weight_init(LogicalRegion region) const;
   void prefetch();
   void forward();
   void compute_metrics();
   void backward();
   void update();
+  void update_params(const std::vector<const Parameter*>& params);
+  void create_grad_buckets();
   void compile(LossType loss_type, const std::vector<MetricsType>& metrics);
   void compile(Optimizer* optimizer, LossType loss_type, const std::vector<MetricsType>& metrics);
   void optimize(Simulator* simulator,
@@ -428,6 +453,12 @@ public:
   IndexSpace get_or_create_task_is(const Domain& domain);
   IndexSpace get_or_create_task_is(int ndims, const std::string& pcname);
   IndexSpace get_task_is(const Domain& domain) const;
+  // Data loading launches have one point per loader CPU (-ll:cpu) on each
+  // node, or only on the launching node with local_node, and each point
+  // owns a contiguous block of samples
+  IndexSpace create_load_is(int num_samples, bool local_node = false);
+  LogicalPartition create_sample_partition(const Tensor& tensor,
+                                           IndexSpace load_is);
 public:
   int op_global_guid;
   FFConfig config;
@@ -439,11 +470,69 @@ public:
   
   std::vector<Op*> layers;
   std::vector<Parameter> parameters;
+  // param_buckets[i] is the index in grad_buckets of the bucket that
+  // parameters[i] belongs to, or -1
+  std::vector<GradBucket> grad_buckets;
+  std::vector<int> param_buckets;
   FFHandler handlers[MAX_NUM_WORKERS];
   Future current_metrics;
   //DataLoader *dataLoader;
 private:
   std::map<ParallelConfig, IndexSpace, ParaConfigCompare> taskIs;
+  // Set by backward when it already issued this iteration's updates
+  bool updates_issued;
+  // Initializations deferred by config.lazy_weight_init. They are only
+  // issued lazily, so Parameter::set_weights/get_weights may resolve them
+  // through a const model
+  mutable std::vector<std::pair<Parameter, Initializer*> > pending_weight_inits;
+};
+
+// Stages the batches a data loader needs next (see FFConfig::prefetch_depth)
+// so that their copies out of zero-copy memory overlap with training. Each
+// slot holds one tensor per batch tensor that shares its index space and
+// partition, so a loader fills a slot with the same launches it uses for
+// the batch tensors. The batch tensors themselves never change, since the
+// Legion traces of a training loop must see the same regions in every
+// iteration; next_batch copies the staged batch into them on the device
+class BatchPrefetcher {
+public:
+  // Implemented by data loaders
+  class Source {
+  public:
+    virtual ~Source(void) {}
+    // Identifies the batch `ahead` batches after the current one (e.g., by
+    // its first sample), so that staged batches are checked after a reset
+    virtual long long batch_key(const FFModel& ff, int ahead) = 0;
+    // Launches the copies of the batch at key into tensors, which mirror
+    // the batch tensors
+    virtual void load_batch(FFModel& ff, long long key,
+                            const std::vector<Tensor>& tensors) = 0;
+  };
+  BatchPrefetcher(void);
+  void init(FFModel& ff, const std::vector<Tensor>& batches,
+            const std::vector<std::string>& pcnames);
+  // Brings the current batch of source into the batch tensors and stages
+  // the depth batches after it
+  void next_batch(FFModel& ff, Source& source);
+  // batch_key of loaders that walk num_samples in order from next_index:
+  // the first sample of the batch, where batches past the last one are
+  // the first ones of the next epoch
+  static long long epoch_batch_key(long long next_index, int ahead,
+                                   int num_samples, int batch_size);
+  static void copy_batch_task(const Task *task,
+                              const std::vector<PhysicalRegion> &regions,
+                              Context ctx, Runtime *runtime);
+private:
+  void copy_to_batches(FFModel& ff, int slot);
+public:
+  int depth;
+  std::vector<Tensor> batches;
+  std::vector<std::string> pcnames;
+  // slots[s][i] stages batches[i]; staged[s] is the key of the batch in
+  // slot s, or -1. The current batch is staged in slot position % depth
+  std::vector<std::vector<Tensor> > slots;
+  std::vector<long long> staged;
+  long long position;
 };
 
 class ElementBinaryMeta : public OpMeta {
@@ -477,6 +566,15 @@ public:
   static void backward_task(const Task *task,
                             const std::vector<PhysicalRegion> &regions,
                             Context ctx, HighLevelRuntime *runtime);
+  static OpMeta* init_task_cpu(const Task *task,
+                               const std::vector<PhysicalRegion> &regions,
+                               Context ctx, Runtime *runtime);
+  static void forward_task_cpu(const Task *task,
+                               const std::vector<PhysicalRegion> &regions,
+                               Context ctx, Runtime *runtime);
+  static void backward_task_cpu(const Task *task,
+                                const std::vector<PhysicalRegion> &regions,
+                                Context ctx, Runtime *runtime);
   bool measure_compute_time(Simulator* sim,
                             const ParallelConfig& pc,
                             float& forward_time,
@@ -528,6 +626,15 @@ public:
   static void backward_task(const Task *task,
                             const std::vector<PhysicalRegion> &regions,
                             Context ctx, HighLevelRuntime *runtime);
+  static OpMeta* init_task_cpu(const Task *task,
+                               const std::vector<PhysicalRegion> &regions,
+                               Context ctx, Runtime *runtime);
+  static void forward_task_cpu(const Task *task,
+                               const std::vector<PhysicalRegion> &regions,
+                               Context ctx, Runtime *runtime);
+  static void backward_task_cpu(const Task *task,
+                                const std::vector<PhysicalRegion> &regions,
+                                Context ctx, Runtime *runtime);
   bool measure_compute_time(Simulator* sim,
                             const ParallelConfig& pc,
                             float& forward_time,
@@ -584,6 +691,15 @@ public:
   static void backward_task(const Task *task,
                             const std::vector<PhysicalRegion> &regions,
                             Context ctx, HighLevelRuntime *runtime);
+  static OpMeta* init_task_cpu(const Task *task,
+                               const std::vector<PhysicalRegion> &regions,
+                               Context ctx, Runtime *runtime);
+  static void forward_task_cpu(const Task *task,
+                               const std::vector<PhysicalRegion> &regions,
+                               Context ctx, Runtime *runtime);
+  static void backward_task_cpu(const Task *task,
+                                const std::vector<PhysicalRegion> &regions,
+                                Context ctx, Runtime *runtime);
   void forward_kernel(const Conv2DMeta* m,
                       const float* input_ptr,
                       float* output_ptr,
@@ -619,6 +735,18 @@ public:
   size_t reserveSpaceSize, dropoutStateSize;
 };
 
+class DropoutCPUMeta : public OpMeta {
+public:
+  DropoutCPUMeta(FFHandler handle, coord_t volume);
+  ~DropoutCPUMeta(void);
+  // One keep bit per element, instead of cuDNN's reserve space
+  uint64_t *mask;
+  coord_t volume, numWords, counterBase;
+  unsigned long long seed, step;
+  uint32_t threshold;
+  float scale;
+};
+
 class Dropout : public Op {
 public:
   Dropout(FFModel& model,
@@ -642,6 +770,15 @@ public:
   static void backward_task(const Task *task,
                             const std::vector<PhysicalRegion> &regions,
                             Context ctx, Runtime *runtime);
+  static OpMeta* init_task_cpu(const Task *task,
+                               const std::vector<PhysicalRegion> &regions,
+                               Context ctx, Runtime *runtime);
+  static void forward_task_cpu(const Task *task,
+                               const std::vector<PhysicalRegion> &regions,
+                               Context ctx, Runtime *runtime);
+  static void backward_task_cpu(const Task *task,
+                                const std::vector<PhysicalRegion> &regions,
+                                Context ctx, Runtime *runtime);
   bool measure_compute_time(Simulator* sim,
                             const ParallelConfig& pc,
                             float& forward_time,
@@ -682,6 +819,15 @@ public:
   static void backward_task(const Task *task,
                             const std::vector<PhysicalRegion> &regions,
                             Context ctx, Runtime *runtime);
+  static OpMeta* init_task_cpu(const Task *task,
+                               const std::vector<PhysicalRegion> &regions,
+                               Context ctx, Runtime *runtime);
+  static void forward_task_cpu(const Task *task,
+                               const std::vector<PhysicalRegion> &regions,
+                               Context ctx, Runtime *runtime);
+  static void backward_task_cpu(const Task *task,
+                                const std::vector<PhysicalRegion> &regions,
+                                Context ctx, Runtime *runtime);
   bool measure_compute_time(Simulator* sim,
                             const ParallelConfig& pc,
                             float& forward_time,
@@ -714,10 +860,21 @@ public:
   //Parameter* get_parameter(int index) {assert(0);return NULL;}
   void create_weights(FFModel& model);
   void create_output_and_partition(FFModel& model);
+  // Overwrite the running mean/variance of every point (e.g., from a
+  // trained checkpoint); must be called after init()
+  void set_running_stats(const FFModel&,
+                         const std::vector<float>& mean,
+                         const std::vector<float>& var);
 
   static OpMeta* init_task(const Task *task,
                            const std::vector<PhysicalRegion> &regions,
                            Context ctx, Runtime *runtime);
+  static void set_stats_task(const Task *task,
+                             const std::vector<PhysicalRegion> &regions,
+                             Context ctx, Runtime *runtime);
+  static void set_stats_task_cpu(const Task *task,
+                                 const std::vector<PhysicalRegion> &regions,
+                                 Context ctx, Runtime *runtime);
   static void init_para_task(const Task *task,
                              const std::vector<PhysicalRegion> &regions,
                              Context ctx, Runtime *runtime);
@@ -727,13 +884,22 @@ public:
   static void backward_task(const Task *task,
                             const std::vector<PhysicalRegion> &regions,
                             Context ctx, Runtime *runtime);
+  static OpMeta* init_task_cpu(const Task *task,
+                               const std::vector<PhysicalRegion> &regions,
+                               Context ctx, Runtime *runtime);
+  static void forward_task_cpu(const Task *task,
+                               const std::vector<PhysicalRegion> &regions,
+                               Context ctx, Runtime *runtime);
+  static void backward_task_cpu(const Task *task,
+                                const std::vector<PhysicalRegion> &regions,
+                                Context ctx, Runtime *runtime);
   bool measure_compute_time(Simulator* sim,
                             const ParallelConfig& pc,
                             float& forward_time,
                             float& backward_time);
 public:
   //IndexSpaceT<4> task_is;
-  bool relu, profiling;
+  bool relu, profiling, inference;
   int num_replica;
   //Tensor locals[MAX_NUM_LOCALS];
 };
@@ -748,6 +914,17 @@ public:
   bool relu;
 };
 
+// Host-side statistics of the CPU variants; saveInvStd holds
+// 1/sqrt(var+eps) of the last training batch, as cuDNN's saveInvVariance
+class BatchNormCPUMeta : public OpMeta {
+public:
+  BatchNormCPUMeta(FFHandler handle, int num_channels);
+  ~BatchNormCPUMeta(void);
+  int numChannels;
+  float *runningMean, *runningVar, *saveMean, *saveInvStd;
+  bool relu;
+};
+
 class LinearMeta : public OpMeta {
 public:
   LinearMeta(FFHandler handle, int batch_size);
@@ -787,6 +964,18 @@ public:
   static void backward2_task(const Task *task,
                             const std::vector<PhysicalRegion> &regions,
                             Context ctx, Runtime *runtime);
+  static OpMeta* init_task_cpu(const Task *task,
+                               const std::vector<PhysicalRegion> &regions,
+                               Context ctx, Runtime *runtime);
+  static void forward_task_cpu(const Task *task,
+                               const std::vector<PhysicalRegion> &regions,
+                               Context ctx, Runtime *runtime);
+  static void backward_task_cpu(const Task *task,
+                                const std::vector<PhysicalRegion> &regions,
+                                Context ctx, Runtime *runtime);
+  static void backward2_task_cpu(const Task *task,
+                                 const std::vector<PhysicalRegion> &regions,
+                                 Context ctx, Runtime *runtime);
   void forward_kernel(const LinearMeta* m,
                       const float* input_ptr,
                       float* output_ptr,
@@ -834,6 +1023,18 @@ private:
   static void backward2_task_with_dim(const Task *task,
                                       const std::vector<PhysicalRegion> &regions,
                                       Context ctx, Runtime *runtime);
+  template<int NDIM>
+  static void forward_task_cpu_with_dim(const Task *task,
+                                        const std::vector<PhysicalRegion> &regions,
+                                        Context ctx, Runtime *runtime);
+  template<int NDIM>
+  static void backward_task_cpu_with_dim(const Task *task,
+                                         const std::vector<PhysicalRegion> &regions,
+                                         Context ctx, Runtime *runtime);
+  template<int NDIM>
+  static void backward2_task_cpu_with_dim(const Task *task,
+                                          const std::vector<PhysicalRegion> &regions,
+                                          Context ctx, Runtime *runtime);
 public:
   int in_channels, out_channels;
   Tensor replica;
@@ -868,6 +1069,15 @@ public:
   static void backward_task(const Task *task,
                             const std::vector<PhysicalRegion> &regions,
                             Context ctx, Runtime *runtime);
+  static OpMeta* init_task_cpu(const Task *task,
+                               const std::vector<PhysicalRegion> &regions,
+                               Context ctx, Runtime *runtime);
+  static void forward_task_cpu(const Task *task,
+                               const std::vector<PhysicalRegion> &regions,
+                               Context ctx, Runtime *runtime);
+  static void backward_task_cpu(const Task *task,
+                                const std::vector<PhysicalRegion> &regions,
+                                Context ctx, Runtime *runtime);
   void forward_kernel(const BatchMatmulMeta* meta,
                       float* o_ptr,
                       const float* a_ptr,
@@ -900,6 +1110,17 @@ public:
   bool profiling;
 };
 
+class EmbeddingMeta : public OpMeta {
+public:
+  EmbeddingMeta(FFHandler handle, int num_slots);
+  ~EmbeddingMeta(void);
+  // Device scratch for deduplicating the indices of sparse gradients,
+  // one entry per input index (NULL without sparse gradients)
+  int num_slots;
+  int64_t *sorted_rows;
+  int *sorted_slots, *unique_ids, *slot_to_unique;
+};
+
 class Embedding : public Op {
 public:
   Embedding(FFModel& model,
@@ -926,12 +1147,25 @@ public:
   static void backward_task(const Task *task,
                             const std::vector<PhysicalRegion> &regions,
                             Context ctx, Runtime *runtime);
+  static OpMeta* init_task_cpu(const Task *task,
+                               const std::vector<PhysicalRegion> &regions,
+                               Context ctx, Runtime *runtime);
   static void forward_task_cpu(const Task *task,
                                const std::vector<PhysicalRegion> &regions,
                                Context ctx, Runtime *runtime);
   static void backward_task_cpu(const Task *task,
                                 const std::vector<PhysicalRegion> &regions,
                                 Context ctx, Runtime *runtime);
+  static void backward_task_sparse(const Task *task,
+                                   const std::vector<PhysicalRegion> &regions,
+                                   Context ctx, Runtime *runtime);
+  static void backward_task_sparse_cpu(const Task *task,
+                                       const std::vector<PhysicalRegion> &regions,
+                                       Context ctx, Runtime *runtime);
+  static int compute_unique_rows(const int64_t* input,
+                                 coord_t num_slots,
+                                 int64_t* rows,
+                                 int* slot_to_unique);
   bool measure_compute_time(Simulator* sim,
                             const ParallelConfig& pc,
                             float& forward_time,
@@ -967,6 +1201,15 @@ public:
   static void backward_task(const Task *task,
                             const std::vector<PhysicalRegion> &regions,
                             Context ctx, Runtime *runtime);
+  static OpMeta* init_task_cpu(const Task *task,
+                               const std::vector<PhysicalRegion> &regions,
+                               Context ctx, Runtime *runtime);
+  static void forward_task_cpu(const Task *task,
+                               const std::vector<PhysicalRegion> &regions,
+                               Context ctx, Runtime *runtime);
+  static void backward_task_cpu(const Task *task,
+                                const std::vector<PhysicalRegion> &regions,
+                                Context ctx, Runtime *runtime);
   bool measure_compute_time(Simulator* sim,
                             const ParallelConfig& pc,
                             float& forward_time,
@@ -1010,6 +1253,15 @@ public:
   static void backward_task(const Task *task,
                             const std::vector<PhysicalRegion> &regions,
                             Context ctx, Runtime *runtime);
+  static OpMeta* init_task_cpu(const Task *task,
+                               const std::vector<PhysicalRegion> &regions,
+                               Context ctx, Runtime *runtime);
+  static void forward_task_cpu(const Task *task,
+                               const std::vector<PhysicalRegion> &regions,
+                               Context ctx, Runtime *runtime);
+  static void backward_task_cpu(const Task *task,
+                                const std::vector<PhysicalRegion> &regions,
+                                Context ctx, Runtime *runtime);
   bool measure_compute_time(Simulator* sim,
                             const ParallelConfig& pc,
                             float& forward_time,
@@ -1077,6 +1329,15 @@ public:
   static void backward_task(const Task *task,
                             const std::vector<PhysicalRegion> &regions,
                             Context ctx, Runtime *runtime);
+  static OpMeta* init_task_cpu(const Task *task,
+                               const std::vector<PhysicalRegion> &regions,
+                               Context ctx, Runtime *runtime);
+  static void forward_task_cpu(const Task *task,
+                               const std::vector<PhysicalRegion> &regions,
+                               Context ctx, Runtime *runtime);
+  static void backward_task_cpu(const Task *task,
+                                const std::vector<PhysicalRegion> &regions,
+                                Context ctx, Runtime *runtime);
   bool measure_compute_time(Simulator* sim,
                             const ParallelConfig& pc,
                             float& forward_time,
@@ -1115,6 +1376,15 @@ public:
   static void backward_task(const Task *task,
                             const std::vector<PhysicalRegion> &regions,
                             Context ctx, Runtime *runtime);
+  static OpMeta* init_task_cpu(const Task *task,
+                               const std::vector<PhysicalRegion> &regions,
+                               Context ctx, Runtime *runtime);
+  static void forward_task_cpu(const Task *task,
+                               const std::vector<PhysicalRegion> &regions,
+                               Context ctx, Runtime *runtime);
+  static void backward_task_cpu(const Task *task,
+                                const std::vector<PhysicalRegion> &regions,
+                                Context ctx, Runtime *runtime);
   bool measure_compute_time(Simulator* sim,
                             const ParallelConfig& pc,
                             float& forward_time,
@@ -1147,6 +1417,15 @@ public:
   static void backward_task(const Task *task,
                             const std::vector<PhysicalRegion> &regions,
                             Context ctx, Runtime *runtime);
+  static OpMeta* init_task_cpu(const Task *task,
+                               const std::vector<PhysicalRegion> &regions,
+                               Context ctx, Runtime *runtime);
+  static void forward_task_cpu(const Task *task,
+                               const std::vector<PhysicalRegion> &regions,
+                               Context ctx, Runtime *runtime);
+  static void backward_task_cpu(const Task *task,
+                                const std::vector<PhysicalRegion> &regions,
+                                Context ctx, Runtime *runtime);
   bool measure_compute_time(Simulator* sim,
                             const ParallelConfig& pc,
                             float& forward_time,
@@ -1179,6 +1458,15 @@ public:
   static void backward_task(const Task *task,
                             const std::vector<PhysicalRegion> &regions,
                             Context ctx, Runtime *runtime);
+  static OpMeta* init_task_cpu(const Task *task,
+                               const std::vector<PhysicalRegion> &regions,
+                               Context ctx, Runtime *runtime);
+  static void forward_task_cpu(const Task *task,
+                               const std::vector<PhysicalRegion> &regions,
+                               Context ctx, Runtime *runtime);
+  static void backward_task_cpu(const Task *task,
+                                const std::vector<PhysicalRegion> &regions,
+                                Context ctx, Runtime *runtime);
   bool measure_compute_time(Simulator* sim,
                             const ParallelConfig& pc,
                             float& forward_time,
@@ -1215,6 +1503,15 @@ public:
   static void backward_task(const Task *task,
                             const std::vector<PhysicalRegion> &regions,
                             Context ctx, Runtime *runtime);
+  static OpMeta* init_task_cpu(const Task *task,
+                               const std::vector<PhysicalRegion> &regions,
+                               Context ctx, Runtime *runtime);
+  static void forward_task_cpu(const Task *task,
+                               const std::vector<PhysicalRegion> &regions,
+                               Context ctx, Runtime *runtime);
+  static void backward_task_cpu(const Task *task,
+                                const std::vector<PhysicalRegion> &regions,
+                                Context ctx, Runtime *runtime);
   bool measure_compute_time(Simulator* sim,
                             const ParallelConfig& pc,
                             float& forward_time,
@@ -1249,6 +1546,15 @@ public:
   static void backward_task(const Task *task,
                             const std::vector<PhysicalRegion> &regions,
                             Context ctx, Runtime *runtime);
+  static OpMeta* init_task_cpu(const Task *task,
+                               const std::vector<PhysicalRegion> &regions,
+                               Context ctx, Runtime *runtime);
+  static void forward_task_cpu(const Task *task,
+                               const std::vector<PhysicalRegion> &regions,
+                               Context ctx, Runtime *runtime);
+  static void backward_task_cpu(const Task *task,
+                                const std::vector<PhysicalRegion> &regions,
+                                Context ctx, Runtime *runtime);
   bool measure_compute_time(Simulator* sim,
                             const ParallelConfig& pc,
                             float& forward_time,
@@ -17,12 +17,87 @@
 #define _FF_OPTIMIZER_H_
 
 #include "legion.h"
+#include "ffconst.h"
 
 using namespace Legion;
 
 class FFModel;
 class Parameter;
 
+// Multi-tensor apply: dense parameters with at most MULTI_TENSOR_MAX_VOLUME
+// elements that are updated on the same device share one update launch of
+// up to MULTI_TENSOR_MAX_PARAMS parameters
+#define MULTI_TENSOR_MAX_VOLUME (1 << 16)
+#define MULTI_TENSOR_MAX_PARAMS 64
+
+// Bucketing rules shared by FFModel::create_grad_buckets and the simulator.
+// A gradient of volume elements per replica is bucketed if it is small,
+// replicated and fits in a bucket on its own
+inline bool use_grad_bucket(size_t bucket_size, size_t volume,
+                            size_t num_replicas)
+{
+  return (bucket_size > 0) && (num_replicas > 1)
+      && (volume <= MULTI_TENSOR_MAX_VOLUME)
+      && (volume * num_replicas * sizeof(float) <= bucket_size);
+}
+
+// An open bucket of num_params gradients and bucket_bytes in total is
+// closed before a gradient of bytes is added to it
+inline bool grad_bucket_full(size_t bucket_size, size_t bucket_bytes,
+                             int num_params, size_t bytes)
+{
+  return (num_params > 0)
+      && ((bucket_bytes + bytes > bucket_size)
+         || (num_params == MULTI_TENSOR_MAX_PARAMS));
+}
+
+// Gradient bucket: the gradients of small replicated dense parameters that
+// share a task index space, packed into one region so that they are
+// synchronized with one transfer per device. Row c of region (row_volume
+// elements, c-th color of task_is in column-major order) holds the c-th
+// slices of the parameters' part_grad, one parameter after another
+struct GradBucket {
+  std::vector<const Parameter*> params;
+  LogicalRegion region;
+  LogicalPartition part;
+  IndexSpace task_is;
+  coord_t num_colors, row_volume;
+  // Per parameter: offset of its slices in a row, and their volume
+  std::vector<coord_t> row_offsets, slice_volumes;
+  // grad_offsets[k*num_colors+c]: offset of the c-th slice in region_grad
+  // of the k-th parameter
+  std::vector<coord_t> grad_offsets;
+};
+
+// The layout of a bucket as passed to tasks, after the optimizer
+struct GradBucketLayout {
+  int num_params;
+  coord_t num_colors, row_volume;
+  const coord_t *row_offsets, *slice_volumes, *grad_offsets;
+};
+
+// Scratch memory of the optimizer's GPU tasks on one processor. Buffers
+// are allocated on first use, grow to the largest request and are kept
+// across iterations, so updates do not allocate device memory
+class OptimizerMeta
+{
+public:
+  static OptimizerMeta* get(Processor proc);
+  // sorted_rows and sorted_slots hold at least num_slots entries
+  void reserve_sparse_rows(size_t num_slots);
+  int64_t* sorted_rows;
+  int* sorted_slots;
+  size_t sparse_capacity;
+  // bucket_grads holds at least volume floats
+  void reserve_bucket_grads(size_t volume);
+  float* bucket_grads;
+  size_t bucket_capacity;
+  // Device accumulator of grad_norm_task
+  float* norm_sum;
+private:
+  OptimizerMeta(void);
+};
+
 class Optimizer
 {
 public:
@@ -30,7 +105,30 @@ public:
   virtual void init(void) = 0;
   virtual void next(void) = 0;
   virtual void update(const Parameter* p) = 0;
+  virtual void update_multi(const std::vector<const Parameter*>& params) = 0;
+  // Packs the gradients of a bucket and updates its parameters from it
+  virtual void update_bucket(const GradBucket& bucket) = 0;
+  void pack_grad_bucket(const GradBucket& bucket);
+  static void pack_grad_bucket_task(const Task* task,
+                                    const std::vector<PhysicalRegion>& regions,
+                                    Context ctx, Runtime* runtime);
+  static void pack_grad_bucket_task_cpu(const Task* task,
+                                        const std::vector<PhysicalRegion>& regions,
+                                        Context ctx, Runtime* runtime);
+  // Squared L2 norm of the (replica-summed) dense gradients of params,
+  // computed on the device that updates them
+  Future compute_grad_norm(const std::vector<const Parameter*>& params);
+  static float grad_norm_task(const Task* task,
+                              const std::vector<PhysicalRegion>& regions,
+                              Context ctx, Runtime* runtime);
+  static float grad_norm_task_cpu(const Task* task,
+                                  const std::vector<PhysicalRegion>& regions,
+                                  Context ctx, Runtime* runtime);
   const FFModel* model;
+  float clip_grad_norm;
+  // Squared-norm futures of this iteration, added to every dense update
+  // launch when clipping by global norm
+  std::vector<Future> grad_norms;
 };
 
 class SGDOptimizer : public Optimizer
@@ -42,10 +140,33 @@ public:
   void init(void);
   void next(void);
   void update(const Parameter* p);
+  void update_multi(const std::vector<const Parameter*>& params);
+  void update_bucket(const GradBucket& bucket);
   void set_weight_decay(double _weight_decay);
   static void update_task(const Task* task,
                           const std::vector<PhysicalRegion>& regions,
                           Context ctx, Runtime* runtime);
+  static void update_task_cpu(const Task* task,
+                              const std::vector<PhysicalRegion>& regions,
+                              Context ctx, Runtime* runtime);
+  static void multi_update_task(const Task* task,
+                                const std::vector<PhysicalRegion>& regions,
+                                Context ctx, Runtime* runtime);
+  static void multi_update_task_cpu(const Task* task,
+                                    const std::vector<PhysicalRegion>& regions,
+                                    Context ctx, Runtime* runtime);
+  static void bucket_update_task(const Task* task,
+                                 const std::vector<PhysicalRegion>& regions,
+                                 Context ctx, Runtime* runtime);
+  static void bucket_update_task_cpu(const Task* task,
+                                     const std::vector<PhysicalRegion>& regions,
+                                     Context ctx, Runtime* runtime);
+  static void sparse_update_task(const Task* task,
+                                 const std::vector<PhysicalRegion>& regions,
+                                 Context ctx, Runtime* runtime);
+  static void sparse_update_task_cpu(const Task* task,
+                                     const std::vector<PhysicalRegion>& regions,
+                                     Context ctx, Runtime* runtime);
   double lr, momentum;
   bool nesterov;
   double weight_decay;
@@ -63,12 +184,54 @@ public:
   void init(void);
   void next(void);
   void update(const Parameter* p);
+  void update_multi(const std::vector<const Parameter*>& params);
+  void update_bucket(const GradBucket& bucket);
   void set_weight_decay(double _weight_decay);
   static void update_task(const Task* task,
                           const std::vector<PhysicalRegion>& regions,
                           Context ctx, Runtime* runtime);
+  static void update_task_cpu(const Task* task,
+                              const std::vector<PhysicalRegion>& regions,
+                              Context ctx, Runtime* runtime);
+  static void multi_update_task(const Task* task,
+                                const std::vector<PhysicalRegion>& regions,
+                                Context ctx, Runtime* runtime);
+  static void multi_update_task_cpu(const Task* task,
+                                    const std::vector<PhysicalRegion>& regions,
+                                    Context ctx, Runtime* runtime);
+  static void bucket_update_task(const Task* task,
+                                 const std::vector<PhysicalRegion>& regions,
+                                 Context ctx, Runtime* runtime);
+  static void bucket_update_task_cpu(const Task* task,
+                                     const std::vector<PhysicalRegion>& regions,
+                                     Context ctx, Runtime* runtime);
+  static void sparse_update_task(const Task* task,
+                                 const std::vector<PhysicalRegion>& regions,
+                                 Context ctx, Runtime* runtime);
+  static void sparse_update_task_cpu(const Task* task,
+                                     const std::vector<PhysicalRegion>& regions,
+                                     Context ctx, Runtime* runtime);
   double alpha, beta1, beta2, weight_decay, epsilon;
   double alpha_t, beta1_t, beta2_t;
+  // Storage type of the moments of dense parameters (math stays in fp32)
+  DataType moment_type;
   std::map<LogicalRegion, LogicalRegion> v_regions, m_regions;
 };
+
+// Factor that scales the gradients of a dense update task so that their
+// global norm is at most clip_norm, from the grad_norms futures of the task
+float get_grad_clip_scale(const Task* task, float clip_norm);
+
+// Task arguments of a bucket update: the optimizer (op_size bytes), then
+// the layout of the bucket
+void get_grad_bucket_args(const void* op, size_t op_size,
+                          const GradBucket& bucket, std::vector<char>& args);
+GradBucketLayout get_grad_bucket_layout(const Task* task, size_t op_size);
+
+// Groups the slots of row-wise sparse gradients by row: the gradients of
+// unique_rows[i] are in slots[offsets[i]] to slots[offsets[i+1]-1]
+void merge_sparse_grad_rows(const int64_t* rows, size_t num_slots,
+                            std::vector<int64_t>& unique_rows,
+                            std::vector<int>& offsets,
+                            std::vector<int>& slots);
 #endif
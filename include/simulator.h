@@ -18,6 +18,10 @@
 #include "ffconst.h"
 #include "config.h"
 
+// Fixed cost (in ms) of each weight synchronization transfer; bucketing
+// small gradients amortizes it over several weights
+#define SYNC_XFER_LATENCY 0.01f
+
 class Conv2DMeta;
 class LinearMeta;
 class Pool2DMeta;
@@ -86,6 +90,16 @@ public:
   std::map<size_t, SimTask*> hash_to_forward_task, hash_to_backward_task;
 };
 
+// Weight gradients synchronized as one transfer per source device
+struct SimGradBucket {
+  SimGradBucket(void): update_task(NULL), bytes(0), num_params(0) {}
+  SimTask* update_task;
+  std::map<int, SimTask*> packs;
+  std::map<int, size_t> volumes;
+  size_t bytes;
+  int num_params;
+};
+
 class Simulator {
 public:
   Simulator(const FFModel* model,
@@ -100,7 +114,12 @@ public:
   Device* get_gpu_to_dram_comm_device_by_id(int gpu_id);
   Device* get_dram_to_gpu_comm_device_by_id(int gpu_id);
   void add_task_dependencies_with_xfer(
-      SimTask* src_task, SimTask* dst_task, size_t intersect);
+      SimTask* src_task, SimTask* dst_task, size_t intersect,
+      float latency = 0.0f);
+  void add_weight_sync(std::map<std::vector<int>, SimGradBucket>& buckets,
+      size_t bucket_size, int update_device,
+      const std::vector<SimTask*>& srcs, size_t volume, SimTask* barrier);
+  void flush_grad_bucket(SimGradBucket& bucket);
   float measure_op_forward_time(Op* op, const ParallelConfig& config);
   float measure_op_backward_time(Op* op, const ParallelConfig& config);
   float simulate_runtime(const FFModel* model,
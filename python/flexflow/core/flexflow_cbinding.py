@@ -1546,6 +1546,36 @@ class FFModel(object):
 
     return dataloader
 
+  def create_data_loader_from_file(self, batch_tensor, filename, dtype=None, header_bytes=0):
+    """Create a MappedDataLoader instance that reads the samples from a
+    memory-mapped file, so that the dataset is never copied and its pages
+    are only read when batches are gathered.
+
+    :param batch_tensor: a batch-sized tensor. Usually it is a input tensor of the model.
+    :type batch_tensor: Tensor
+
+    :param filename: a `.npy` file, or a raw file of row-major samples shaped like a sample of :attr:`batch_tensor`.
+    :type filename: string
+
+    :param dtype: the data type of a raw file, `float32` or `int32`.
+    :type dtype: numpy dtype
+
+    :param header_bytes: the number of bytes preceding the samples of a raw file.
+    :type header_bytes: int
+
+    :returns:  MappedDataLoader -- returns a dataloader instance.
+    """
+    if filename.endswith(".npy"):
+      full_array = np.load(filename, mmap_mode='r')
+    else:
+      assert dtype != None, "dtype is required for raw files"
+      full_array = np.memmap(filename, dtype=dtype, mode='r', offset=header_bytes)
+      sample_shape = tuple(batch_tensor.dims[1:])
+      # Trailing bytes that do not make a whole sample are ignored
+      num_samples = full_array.shape[0] // int(np.prod(sample_shape))
+      full_array = full_array[:num_samples * int(np.prod(sample_shape))].reshape((num_samples,) + sample_shape)
+    return MappedDataLoader(self, batch_tensor, full_array)
+
   def __get_initializer_handle(self, initializer):
     if (initializer == None):
       null_initializer = Initializer(None)
@@ -1783,6 +1813,42 @@ class SingleDataLoader(object):
     """
     ffc.flexflow_single_dataloader_reset(self.handle)
 
+class StreamingDataLoader(SingleDataLoader):
+  """A :class:`SingleDataLoader` that streams a raw file of samples from disk
+  in shards of :attr:`shard_samples` samples, keeping at most
+  :attr:`num_buffers` shards in host memory. With :attr:`shuffle`, the shard
+  order is reshuffled every epoch."""
+  def __init__(self, ffmodel, input, filename, num_samples, data_type,
+               shard_samples, num_buffers=2, shuffle=False, header_bytes=0):
+    assert type(ffmodel) is FFModel, "StreamingDataLoader ffmodel is wrong"
+    assert type(input) is Tensor, "StreamingDataLoader input is wrong"
+    c_data_type = enum_to_int(DataType, data_type)
+    c_filename = ffi.new("char[]", filename.encode('utf-8'))
+    self.handle = ffc.flexflow_single_dataloader_create_streaming(ffmodel.handle, input.handle, c_filename, header_bytes, num_samples, shard_samples, num_buffers, shuffle, c_data_type)
+    self._handle = ffi.gc(self.handle, ffc.flexflow_single_dataloader_destroy)
+
+class MappedDataLoader(SingleDataLoader):
+  """A :class:`SingleDataLoader` that reads its samples in place from a
+  NumPy array, e.g. a memory-mapped `.npy` file, instead of copying the
+  whole dataset into its own buffer. The loader keeps a reference to
+  :attr:`array`, which must not be modified while it is used."""
+  def __init__(self, ffmodel, input, array):
+    assert type(ffmodel) is FFModel, "MappedDataLoader ffmodel is wrong"
+    assert type(input) is Tensor, "MappedDataLoader input is wrong"
+    assert array.flags['C_CONTIGUOUS'], "MappedDataLoader array is not contiguous"
+    assert tuple(array.shape[1:]) == tuple(input.dims[1:]), "MappedDataLoader array shape is wrong"
+    if (array.dtype == "float32"):
+      data_type = DataType.DT_FLOAT
+    elif (array.dtype == "int32"):
+      data_type = DataType.DT_INT32
+    else:
+      assert 0, "unsupported datatype"
+    c_data_type = enum_to_int(DataType, data_type)
+    raw_ptr = ffi.cast("void*", array.__array_interface__['data'][0])
+    self.array = array
+    self.handle = ffc.flexflow_single_dataloader_create_attached(ffmodel.handle, input.handle, raw_ptr, array.shape[0], c_data_type)
+    self._handle = ffi.gc(self.handle, ffc.flexflow_single_dataloader_destroy)
+
 class RegionNdarray(object):
   __slots__ = ['__array_interface__']
   def __init__(self, shape, data_type, base_ptr, strides, read_only):
@@ -21,6 +21,8 @@ class DataType(Enum):
   DT_INT32 = 42
   DT_INT64 = 43
   DT_BOOLEAN = 44
+  DT_HALF = 45
+  DT_BFLOAT16 = 46
 
 class LossType(Enum):
   LOSS_CATEGORICAL_CROSSENTROPY = 50
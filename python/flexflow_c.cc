@@ -1462,6 +1462,43 @@ flexflow_single_dataloader_create(
   return FFCObjectWrapper::wrap(dataloader);
 }
 
+flexflow_single_dataloader_t
+flexflow_single_dataloader_create_streaming(
+  flexflow_model_t ffmodel_,
+  flexflow_tensor_t input_,
+  const char *filename,
+  size_t header_bytes,
+  int num_samples,
+  int shard_samples,
+  int num_buffers,
+  bool shuffle,
+  enum DataType data_type)
+{
+  FFModel *ffmodel = FFCObjectWrapper::unwrap(ffmodel_);
+  Tensor *input = FFCObjectWrapper::unwrap(input_);
+  SingleDataLoader *dataloader = new SingleDataLoader(
+      *ffmodel, *input, std::string(filename), header_bytes, num_samples,
+      shard_samples, num_buffers, shuffle, data_type);
+  DEBUG_PRINT("[SingleDataLoader] streaming %s in %d shards", filename, dataloader->num_shards);
+  return FFCObjectWrapper::wrap(dataloader);
+}
+
+flexflow_single_dataloader_t
+flexflow_single_dataloader_create_attached(
+  flexflow_model_t ffmodel_,
+  flexflow_tensor_t input_,
+  void *data,
+  int num_samples,
+  enum DataType data_type)
+{
+  FFModel *ffmodel = FFCObjectWrapper::unwrap(ffmodel_);
+  Tensor *input = FFCObjectWrapper::unwrap(input_);
+  SingleDataLoader *dataloader = new SingleDataLoader(
+      *ffmodel, *input, data, num_samples, data_type);
+  DEBUG_PRINT("[SingleDataLoader] attached %p", data);
+  return FFCObjectWrapper::wrap(dataloader);
+}
+
 void
 flexflow_single_dataloader_destroy(
   flexflow_single_dataloader_t handle_)
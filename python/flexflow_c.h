@@ -702,6 +702,26 @@ flexflow_single_dataloader_create(
   int num_samples,
   enum DataType data_type);
 
+flexflow_single_dataloader_t
+flexflow_single_dataloader_create_streaming(
+  flexflow_model_t ffmodel,
+  flexflow_tensor_t input,
+  const char *filename,
+  size_t header_bytes,
+  int num_samples,
+  int shard_samples,
+  int num_buffers,
+  bool shuffle,
+  enum DataType data_type);
+
+flexflow_single_dataloader_t
+flexflow_single_dataloader_create_attached(
+  flexflow_model_t ffmodel,
+  flexflow_tensor_t input,
+  void *data,
+  int num_samples,
+  enum DataType data_type);
+
 void
 flexflow_single_dataloader_destroy(
   flexflow_single_dataloader_t handle);
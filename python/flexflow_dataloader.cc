@@ -16,6 +16,8 @@
 #include <sstream>
 #include <fstream>
 #include <string>
+#include <random>
+#include <algorithm>
 #include "flexflow_dataloader.h"
 
 ImgDataLoader::ImgDataLoader()
@@ -26,6 +28,20 @@ void ImgDataLoader::reset()
   next_index = 0;
 }
 
+long long ImgDataLoader::batch_key(const FFModel& ff, int ahead)
+{
+  return BatchPrefetcher::epoch_batch_key(next_index, ahead, num_samples,
+                                         ff.config.batchSize);
+}
+
+void ImgDataLoader::init_prefetcher(FFModel& ff)
+{
+  std::vector<Tensor> batches;
+  batches.push_back(batch_input);
+  batches.push_back(batch_label);
+  prefetcher.init(ff, batches, std::vector<std::string>(2, ""));
+}
+
 ImgDataLoader4D::ImgDataLoader4D(FFModel& ff, Tensor input, Tensor label,
                                  Tensor full_input_, Tensor full_label_,
                                  int num_samples_)
@@ -45,34 +61,41 @@ ImgDataLoader4D::ImgDataLoader4D(FFModel& ff, Tensor input, Tensor label,
     const int dims[] = {num_samples, label.adim[0]};
     full_label = ff.create_tensor<2>(dims, DT_INT32);
   }
-  // Load entire dataset
-  // TODO: Use index launcher instead of task launcher
-  TaskLauncher launcher(CUSTOM_CPU_TASK_ID_2,
-      TaskArgument(NULL, 0));
+  // Load entire dataset, a block of samples per loader CPU of this node:
+  // the NumPy source is attached to this node's system memory
+  IndexSpace load_is = ff.create_load_is(num_samples, true/*local_node*/);
+  IndexLauncher launcher(CUSTOM_CPU_TASK_ID_2, load_is,
+                         TaskArgument(NULL, 0), ArgumentMap(),
+                         Predicate::TRUE_PRED, false/*must*/, 0/*mapper_id*/,
+                         MAP_TO_LOCAL_NODE);
   // regions[0]: full_input
   launcher.add_region_requirement(
-      RegionRequirement(full_input.region, WRITE_ONLY,
-                        EXCLUSIVE, full_input.region,
-                        MAP_TO_ZC_MEMORY));
+      RegionRequirement(ff.create_sample_partition(full_input, load_is),
+                        0/*projection id*/, WRITE_ONLY, EXCLUSIVE,
+                        full_input.region, MAP_TO_ZC_PARENT_MEMORY));
   launcher.add_field(0, FID_DATA);
   // regions[1]: full_label
   launcher.add_region_requirement(
-      RegionRequirement(full_label.region, WRITE_ONLY,
-                        EXCLUSIVE, full_label.region,
-                        MAP_TO_ZC_MEMORY));
+      RegionRequirement(ff.create_sample_partition(full_label, load_is),
+                        0/*projection id*/, WRITE_ONLY, EXCLUSIVE,
+                        full_label.region, MAP_TO_ZC_PARENT_MEMORY));
   launcher.add_field(1, FID_DATA);
-  // regions[2]: full_input_
+  // regions[2]: full_input_, read in place
   launcher.add_region_requirement(
-      RegionRequirement(full_input_.region, READ_ONLY,
-                        EXCLUSIVE, full_input_.region));
+      RegionRequirement(ff.create_sample_partition(full_input_, load_is),
+                        0/*projection id*/, READ_ONLY, EXCLUSIVE,
+                        full_input_.region, MAP_TO_SYS_MEMORY));
   launcher.add_field(2, FID_DATA);
-  // regions[3]: full_label_
+  // regions[3]: full_label_, read in place
   launcher.add_region_requirement(
-      RegionRequirement(full_label_.region, READ_ONLY,
-                        EXCLUSIVE, full_label_.region));
+      RegionRequirement(ff.create_sample_partition(full_label_, load_is),
+                        0/*projection id*/, READ_ONLY, EXCLUSIVE,
+                        full_label_.region, MAP_TO_SYS_MEMORY));
   launcher.add_field(3, FID_DATA);
-  Future fu = runtime->execute_task(ctx, launcher);
-  fu.wait();
+  // The caller detaches full_input_ and full_label_ once we return
+  FutureMap fm = runtime->execute_index_space(ctx, launcher);
+  fm.wait_all_results();
+  init_prefetcher(ff);
   reset();
   next_batch(ff);
 }
@@ -88,6 +111,7 @@ ImgDataLoader4D::ImgDataLoader4D(FFModel& ff,
     printf("Use random dataset...");
     num_samples = 256 * 10 * ff.config.workersPerNode * ff.config.numNodes;
     printf("Number of random samples = %d\n", num_samples);
+    printf("Start generating random input samples\n");
   } else {
     printf("Start loading dataset from %s\n", alexnet.dataset_path.c_str());
     size_t filesize = get_file_size(alexnet.dataset_path);
@@ -106,24 +130,26 @@ ImgDataLoader4D::ImgDataLoader4D(FFModel& ff,
     const int dims[] = {num_samples, label.adim[0]};
     full_label = ff.create_tensor<2>(dims, DT_INT32);
   }
-  // Load entire dataset
-  // TODO: Use index launcher instead of task launcher
-  const NetConfig* ptr = &alexnet;
-  TaskLauncher launcher(CUSTOM_CPU_TASK_ID_1,
-      TaskArgument(&ptr, sizeof(NetConfig*)));
+  // Load entire dataset, a block of samples per loader CPU. Points may
+  // run on other nodes, so they get the dataset path rather than alexnet
+  IndexSpace load_is = ff.create_load_is(num_samples);
+  IndexLauncher launcher(CUSTOM_CPU_TASK_ID_1, load_is,
+      TaskArgument(alexnet.dataset_path.c_str(),
+                   alexnet.dataset_path.length() + 1), ArgumentMap());
   // regions[0]: full_input
   launcher.add_region_requirement(
-      RegionRequirement(full_input.region, WRITE_ONLY,
-                        EXCLUSIVE, full_input.region,
-                        MAP_TO_ZC_MEMORY));
+      RegionRequirement(ff.create_sample_partition(full_input, load_is),
+                        0/*projection id*/, WRITE_ONLY, EXCLUSIVE,
+                        full_input.region, MAP_TO_ZC_PARENT_MEMORY));
   launcher.add_field(0, FID_DATA);
   // regions[1]: full_label
   launcher.add_region_requirement(
-      RegionRequirement(full_label.region, WRITE_ONLY,
-                        EXCLUSIVE, full_label.region,
-                        MAP_TO_ZC_MEMORY));
+      RegionRequirement(ff.create_sample_partition(full_label, load_is),
+                        0/*projection id*/, WRITE_ONLY, EXCLUSIVE,
+                        full_label.region, MAP_TO_ZC_PARENT_MEMORY));
   launcher.add_field(1, FID_DATA);
-  runtime->execute_task(ctx, launcher);
+  runtime->execute_index_space(ctx, launcher);
+  init_prefetcher(ff);
   reset();
   next_batch(ff);
 }
@@ -153,17 +179,12 @@ void ImgDataLoader4D::load_entire_dataset_from_numpy(const Task *task,
   int* label_ptr = acc_label.ptr(rect_label.lo);
   const float* input_ptr_ = acc_input_.ptr(rect_input_.lo);
   const int* label_ptr_ = acc_label_.ptr(rect_label_.lo);
-  printf("Check ptr input %p %lu %lu, label %p %lu %lu\n", input_ptr_, (uintptr_t)input_ptr_, rect_input.volume(), label_ptr_, (uintptr_t)label_ptr_, rect_label.volume());
   int num_samples = rect_label.hi[1] - rect_label.lo[1] + 1;
   assert(rect_input.hi[3] - rect_input.lo[3] + 1 == num_samples);
   assert(rect_label.volume() == rect_label_.volume());
   assert(rect_input.volume() == rect_input_.volume());
   memcpy(input_ptr, input_ptr_, sizeof(float)*rect_input.volume());
   memcpy(label_ptr, label_ptr_, sizeof(int)*rect_label.volume());
-  for (int i = 0; i < 32; i++) {
-    printf("%f ", input_ptr[i]);
-  }
-  printf("\n");
 }
 
 __inline__
@@ -195,7 +216,7 @@ void ImgDataLoader4D::load_entire_dataset(const Task *task,
                                          const std::vector<PhysicalRegion> &regions,
                                          Context ctx, Runtime* runtime)
 {
-  const NetConfig* alexnet = *((NetConfig**)task->args);
+  std::string dataset_path((const char*)task->args);
   assert(regions.size() == 2);
   assert(task->regions.size() == regions.size());
   const AccessorWO<float, 4> acc_input(regions[0], FID_DATA);
@@ -208,36 +229,42 @@ void ImgDataLoader4D::load_entire_dataset(const Task *task,
   assert(acc_label.accessor.is_dense_arbitrary(rect_label));
   float* input_ptr = acc_input.ptr(rect_input.lo);
   int* label_ptr = acc_label.ptr(rect_label.lo);
+  // This point loads the block of samples [first, first + num_samples)
+  off_t first = rect_label.lo[1];
   int num_samples = rect_label.hi[1] - rect_label.lo[1] + 1;
   assert(rect_input.hi[3] - rect_input.lo[3] + 1 == num_samples);
-  if (alexnet->dataset_path.length() == 0) {
-    printf("Start generating random input samples\n");
+  assert(rect_input.lo[3] == first);
+  if (dataset_path.length() == 0) {
     for (size_t i = 0; i < rect_label.volume(); i++)
       label_ptr[i] = std::rand() % 10;
     return;
   }
-  printf("Start loading %d samples from %s\n",
-      num_samples, alexnet->dataset_path.c_str());
+  printf("Start loading samples [%lld, %lld) from %s\n",
+      (long long)first, (long long)(first + num_samples),
+      dataset_path.c_str());
   int height = rect_input.hi[1] - rect_input.lo[1] + 1;
   int width = rect_input.hi[0] - rect_input.lo[0] + 1;
   int origHeight = 32;
   int origWidth = 32;
   float heightScale = static_cast<float>(origHeight) / height;
   float widthScale = static_cast<float>(origWidth) / width;
-  FILE* file = fopen(alexnet->dataset_path.c_str(), "rb");
+  FILE* file = fopen(dataset_path.c_str(), "rb");
+  assert(file != NULL);
+  int ret = fseeko(file, first * 3073, SEEK_SET);
+  assert(ret == 0);
   unsigned char* buffer = (unsigned char*) malloc(3073);
   unsigned char* image = (unsigned char*) malloc(3 * height * width);
   for (off_t i = 0; i < num_samples; i++) {
-    size_t ret = fread(buffer, sizeof(unsigned char), 3073, file);
-    assert(ret = 3073);
-    if (i == 0) {
+    size_t bytes_read = fread(buffer, sizeof(unsigned char), 3073, file);
+    assert(bytes_read == 3073);
+    if (first + i == 0) {
       for (int i = 0; i < 32; i++) {
         printf("%f ", static_cast<float>(buffer[i])/255);
       }
       printf("\n");
     }
     if ((i+1) % 1000 == 0) {
-      printf("Loaded %zd samples\n", i+1);
+      printf("Loaded %lld samples\n", (long long)(i+1));
     }
     label_ptr[i] = buffer[0];
     nearest_neigh(image, buffer + 1, height, width,
@@ -247,17 +274,25 @@ void ImgDataLoader4D::load_entire_dataset(const Task *task,
     for (off_t h = 0; h < 3*height*width; h++)
         input_ptr[input_offset++] = static_cast<float>(image[image_offset++]) / 255;
   }
-  printf("Finish loading %d samples from %s\n",
-      num_samples, alexnet->dataset_path.c_str());
+  printf("Finish loading samples [%lld, %lld) from %s\n",
+      (long long)first, (long long)(first + num_samples),
+      dataset_path.c_str());
   fclose(file);
-  for (int i = 0; i < 32; i++) {
-    printf("%f ", input_ptr[i]);
-  }
-  printf("\n");
+  free(buffer);
+  free(image);
 }
 
 void ImgDataLoader4D::next_batch(FFModel& ff)
 {
+  prefetcher.next_batch(ff, *this);
+  next_index += ff.config.batchSize;
+}
+
+void ImgDataLoader4D::load_batch(FFModel& ff, long long key,
+                                 const std::vector<Tensor>& tensors)
+{
+  const Tensor& batch_input = tensors[0];
+  const Tensor& batch_label = tensors[1];
   Context ctx = ff.config.lg_ctx;
   Runtime* runtime = ff.config.lg_hlr;
   // Load input
@@ -265,7 +300,7 @@ void ImgDataLoader4D::next_batch(FFModel& ff)
     IndexSpaceT<4> task_is = IndexSpaceT<4>(ff.get_or_create_task_is(4, ""));
     Rect<4> rect = runtime->get_index_space_domain(ctx, task_is);
     ArgumentMap argmap;
-    int idx = next_index;
+    int idx = key;
     for (PointInRectIterator<4> it(rect); it(); it++) {
       SampleIdxs meta;
       assert(ff.config.batchSize % (rect.hi[3] - rect.lo[3] + 1) == 0);
@@ -277,7 +312,7 @@ void ImgDataLoader4D::next_batch(FFModel& ff)
     IndexLauncher launcher(CUSTOM_GPU_TASK_ID_1, task_is,
                            TaskArgument(NULL,0), argmap,
                            Predicate::TRUE_PRED, false/*must*/, 0/*mapper_id*/,
-                           FFConfig::get_hash_id(""));
+                           ff.config.get_strategy_id(""));
     launcher.add_region_requirement(
         RegionRequirement(full_input.region, 0/*projection id*/,
                           READ_ONLY, EXCLUSIVE, full_input.region,
@@ -294,7 +329,7 @@ void ImgDataLoader4D::next_batch(FFModel& ff)
     IndexSpaceT<2> task_is = IndexSpaceT<2>(ff.get_or_create_task_is(2, ""));
     Rect<2> rect = runtime->get_index_space_domain(ctx, task_is);
     ArgumentMap argmap;
-    int idx = next_index;
+    int idx = key;
     for (PointInRectIterator<2> it(rect); it(); it++) {
       SampleIdxs meta;
       assert(ff.config.batchSize % (rect.hi[1] - rect.lo[1] + 1) == 0);
@@ -306,7 +341,7 @@ void ImgDataLoader4D::next_batch(FFModel& ff)
     IndexLauncher launcher(CUSTOM_GPU_TASK_ID_2, task_is,
                            TaskArgument(NULL,0), argmap,
                            Predicate::TRUE_PRED, false/*must*/, 0/*mapper_id*/,
-                           FFConfig::get_hash_id(""));
+                           ff.config.get_strategy_id(""));
     launcher.add_region_requirement(
         RegionRequirement(full_label.region, 0/*projection id*/,
                           READ_ONLY, EXCLUSIVE, full_label.region,
@@ -318,7 +353,6 @@ void ImgDataLoader4D::next_batch(FFModel& ff)
     launcher.add_field(1, FID_DATA);
     runtime->execute_index_space(ctx, launcher);
   }
-  next_index += ff.config.batchSize;
 }
 
 size_t ImgDataLoader4D::get_file_size(const std::string& filename)
@@ -352,34 +386,41 @@ ImgDataLoader2D::ImgDataLoader2D(FFModel& ff, Tensor input, Tensor label,
     const int dims[] = {num_samples, label.adim[0]};
     full_label = ff.create_tensor<2>(dims, DT_INT32);
   }
-  // Load entire dataset
-  // TODO: Use index launcher instead of task launcher
-  TaskLauncher launcher(CUSTOM_CPU_TASK_ID_3,
-      TaskArgument(NULL, 0));
+  // Load entire dataset, a block of samples per loader CPU of this node:
+  // the NumPy source is attached to this node's system memory
+  IndexSpace load_is = ff.create_load_is(num_samples, true/*local_node*/);
+  IndexLauncher launcher(CUSTOM_CPU_TASK_ID_3, load_is,
+                         TaskArgument(NULL, 0), ArgumentMap(),
+                         Predicate::TRUE_PRED, false/*must*/, 0/*mapper_id*/,
+                         MAP_TO_LOCAL_NODE);
   // regions[0]: full_input
   launcher.add_region_requirement(
-      RegionRequirement(full_input.region, WRITE_ONLY,
-                        EXCLUSIVE, full_input.region,
-                        MAP_TO_ZC_MEMORY));
+      RegionRequirement(ff.create_sample_partition(full_input, load_is),
+                        0/*projection id*/, WRITE_ONLY, EXCLUSIVE,
+                        full_input.region, MAP_TO_ZC_PARENT_MEMORY));
   launcher.add_field(0, FID_DATA);
   // regions[1]: full_label
   launcher.add_region_requirement(
-      RegionRequirement(full_label.region, WRITE_ONLY,
-                        EXCLUSIVE, full_label.region,
-                        MAP_TO_ZC_MEMORY));
+      RegionRequirement(ff.create_sample_partition(full_label, load_is),
+                        0/*projection id*/, WRITE_ONLY, EXCLUSIVE,
+                        full_label.region, MAP_TO_ZC_PARENT_MEMORY));
   launcher.add_field(1, FID_DATA);
-  // regions[2]: full_input_
+  // regions[2]: full_input_, read in place
   launcher.add_region_requirement(
-      RegionRequirement(full_input_.region, READ_ONLY,
-                        EXCLUSIVE, full_input_.region));
+      RegionRequirement(ff.create_sample_partition(full_input_, load_is),
+                        0/*projection id*/, READ_ONLY, EXCLUSIVE,
+                        full_input_.region, MAP_TO_SYS_MEMORY));
   launcher.add_field(2, FID_DATA);
-  // regions[3]: full_label_
+  // regions[3]: full_label_, read in place
   launcher.add_region_requirement(
-      RegionRequirement(full_label_.region, READ_ONLY,
-                        EXCLUSIVE, full_label_.region));
+      RegionRequirement(ff.create_sample_partition(full_label_, load_is),
+                        0/*projection id*/, READ_ONLY, EXCLUSIVE,
+                        full_label_.region, MAP_TO_SYS_MEMORY));
   launcher.add_field(3, FID_DATA);
-  Future fu = runtime->execute_task(ctx, launcher);
-  fu.wait();
+  // The caller detaches full_input_ and full_label_ once we return
+  FutureMap fm = runtime->execute_index_space(ctx, launcher);
+  fm.wait_all_results();
+  init_prefetcher(ff);
   reset();
   next_batch(ff);
 }
@@ -409,21 +450,25 @@ void ImgDataLoader2D::load_entire_dataset_from_numpy(const Task *task,
   int* label_ptr = acc_label.ptr(rect_label.lo);
   const float* input_ptr_ = acc_input_.ptr(rect_input_.lo);
   const int* label_ptr_ = acc_label_.ptr(rect_label_.lo);
-  printf("Check ptr input %p %lu %lu, label %p %lu %lu\n", input_ptr_, (uintptr_t)input_ptr_, rect_input.volume(), label_ptr_, (uintptr_t)label_ptr_, rect_label.volume());
   int num_samples = rect_label.hi[1] - rect_label.lo[1] + 1;
   assert(rect_input.hi[1] - rect_input.lo[1] + 1 == num_samples);
   assert(rect_label.volume() == rect_label_.volume());
   assert(rect_input.volume() == rect_input_.volume());
   memcpy(input_ptr, input_ptr_, sizeof(float)*rect_input.volume());
   memcpy(label_ptr, label_ptr_, sizeof(int)*rect_label.volume());
-  for (int i = 0; i < 32; i++) {
-    printf("%f ", input_ptr[i]);
-  }
-  printf("\n");
 }
 
 void ImgDataLoader2D::next_batch(FFModel& ff)
 {
+  prefetcher.next_batch(ff, *this);
+  next_index += ff.config.batchSize;
+}
+
+void ImgDataLoader2D::load_batch(FFModel& ff, long long key,
+                                 const std::vector<Tensor>& tensors)
+{
+  const Tensor& batch_input = tensors[0];
+  const Tensor& batch_label = tensors[1];
   Context ctx = ff.config.lg_ctx;
   Runtime* runtime = ff.config.lg_hlr;
   // Load input
@@ -431,7 +476,7 @@ void ImgDataLoader2D::next_batch(FFModel& ff)
     IndexSpaceT<2> task_is = IndexSpaceT<2>(ff.get_or_create_task_is(2, ""));
     Rect<2> rect = runtime->get_index_space_domain(ctx, task_is);
     ArgumentMap argmap;
-    int idx = next_index;
+    int idx = key;
     for (PointInRectIterator<2> it(rect); it(); it++) {
       SampleIdxs meta;
       assert(ff.config.batchSize % (rect.hi[1] - rect.lo[1] + 1) == 0);
@@ -443,7 +488,7 @@ void ImgDataLoader2D::next_batch(FFModel& ff)
     IndexLauncher launcher(CUSTOM_GPU_TASK_ID_3, task_is,
                            TaskArgument(NULL,0), argmap,
                            Predicate::TRUE_PRED, false/*must*/, 0/*mapper_id*/,
-                           FFConfig::get_hash_id(""));
+                           ff.config.get_strategy_id(""));
     launcher.add_region_requirement(
         RegionRequirement(full_input.region, 0/*projection id*/,
                           READ_ONLY, EXCLUSIVE, full_input.region,
@@ -460,7 +505,7 @@ void ImgDataLoader2D::next_batch(FFModel& ff)
     IndexSpaceT<2> task_is = IndexSpaceT<2>(ff.get_or_create_task_is(2, ""));
     Rect<2> rect = runtime->get_index_space_domain(ctx, task_is);
     ArgumentMap argmap;
-    int idx = next_index;
+    int idx = key;
     for (PointInRectIterator<2> it(rect); it(); it++) {
       SampleIdxs meta;
       assert(ff.config.batchSize % (rect.hi[1] - rect.lo[1] + 1) == 0);
@@ -472,7 +517,7 @@ void ImgDataLoader2D::next_batch(FFModel& ff)
     IndexLauncher launcher(CUSTOM_GPU_TASK_ID_2, task_is,
                            TaskArgument(NULL,0), argmap,
                            Predicate::TRUE_PRED, false/*must*/, 0/*mapper_id*/,
-                           FFConfig::get_hash_id(""));
+                           ff.config.get_strategy_id(""));
     launcher.add_region_requirement(
         RegionRequirement(full_label.region, 0/*projection id*/,
                           READ_ONLY, EXCLUSIVE, full_label.region,
@@ -484,7 +529,6 @@ void ImgDataLoader2D::next_batch(FFModel& ff)
     launcher.add_field(1, FID_DATA);
     runtime->execute_index_space(ctx, launcher);
   }
-  next_index += ff.config.batchSize;
 }
 
 SingleDataLoader::SingleDataLoader(FFModel& ff, Tensor input, Tensor full_input_, int num_samples_, DataType datatype_)
@@ -493,6 +537,8 @@ SingleDataLoader::SingleDataLoader(FFModel& ff, Tensor input, Tensor full_input_
   Runtime* runtime = ff.config.lg_hlr;
   num_samples = num_samples_;
   datatype = datatype_;
+  num_buffers = 0;
+  attached = false;
   // Create full input
   assert(input.numDim == full_input_.numDim);
   for (int i = 0; i < input.numDim-1; i++)
@@ -522,27 +568,177 @@ SingleDataLoader::SingleDataLoader(FFModel& ff, Tensor input, Tensor full_input_
   } else {
     assert(0);
   }
-  // Load entire dataset
-  // TODO: Use index launcher instead of task launcher
-  TaskLauncher launcher(task_id,
-      TaskArgument(NULL, 0));
+  // Load entire dataset, a block of samples per loader CPU of this node:
+  // the NumPy source is attached to this node's system memory
+  IndexSpace load_is = ff.create_load_is(num_samples, true/*local_node*/);
+  IndexLauncher launcher(task_id, load_is,
+                         TaskArgument(NULL, 0), ArgumentMap(),
+                         Predicate::TRUE_PRED, false/*must*/, 0/*mapper_id*/,
+                         MAP_TO_LOCAL_NODE);
   // regions[0]: full_input
   launcher.add_region_requirement(
-      RegionRequirement(full_input.region, WRITE_ONLY,
-                        EXCLUSIVE, full_input.region,
-                        MAP_TO_ZC_MEMORY));
+      RegionRequirement(ff.create_sample_partition(full_input, load_is),
+                        0/*projection id*/, WRITE_ONLY, EXCLUSIVE,
+                        full_input.region, MAP_TO_ZC_PARENT_MEMORY));
   launcher.add_field(0, FID_DATA);
-  // regions[2]: full_input_
+  // regions[1]: full_input_, read in place
   launcher.add_region_requirement(
-      RegionRequirement(full_input_.region, READ_ONLY,
-                        EXCLUSIVE, full_input_.region));
+      RegionRequirement(ff.create_sample_partition(full_input_, load_is),
+                        0/*projection id*/, READ_ONLY, EXCLUSIVE,
+                        full_input_.region, MAP_TO_SYS_MEMORY));
   launcher.add_field(1, FID_DATA);
-  Future fu = runtime->execute_task(ctx, launcher);
-  fu.wait();
+  // The caller detaches full_input_ once we return
+  FutureMap fm = runtime->execute_index_space(ctx, launcher);
+  fm.wait_all_results();
+  prefetcher.init(ff, std::vector<Tensor>(1, batch_input),
+                  std::vector<std::string>(1, ""));
+  reset();
+  next_batch(ff);
+}
+
+SingleDataLoader::SingleDataLoader(FFModel& ff, Tensor input,
+                                   const std::string& filename_,
+                                   size_t header_bytes_, int num_samples_,
+                                   int shard_samples_, int num_buffers_,
+                                   bool shuffle_, DataType datatype_)
+: filename(filename_), header_bytes(header_bytes_),
+  shard_samples(shard_samples_), num_buffers(num_buffers_), shuffle(shuffle_)
+{
+  datatype = datatype_;
+  attached = false;
+  assert(filename.length() < MAX_FILENAME);
+  assert(num_buffers > 0);
+  // Each batch must come from a single shard
+  assert(shard_samples % ff.config.batchSize == 0);
+  num_shards = num_samples_ / shard_samples;
+  assert(num_shards > 0);
+  num_samples = num_shards * shard_samples;
+  batch_input = input;
+  int dims[MAX_TENSOR_DIM];
+  dims[0] = shard_samples;
+  for (int i = 1; i < input.numDim; i++)
+    dims[i] = input.adim[input.numDim-1-i];
+  for (int b = 0; b < num_buffers; b++) {
+    switch (input.numDim) {
+#define DIMFUNC(DIM) \
+      case DIM: \
+      { \
+        shard_buffers.push_back(ff.create_tensor<DIM>(dims, datatype, NULL, false/*create_grad*/)); \
+        break; \
+      }
+      LEGION_FOREACH_N(DIMFUNC)
+#undef DIMFUNC
+      default:
+        assert(false);
+    }
+  }
+  // full_input only describes the sample shape from now on
+  full_input = shard_buffers[0];
+  streamed_samples = 0;
+  shard_order_epoch = -1;
+  for (int p = 0; p < num_buffers; p++)
+    load_shard_at(ff, p);
+  prefetcher.init(ff, std::vector<Tensor>(1, batch_input),
+                  std::vector<std::string>(1, ""));
+  reset();
+  // No priming batch: reset() cannot rewind the stream, so a batch read
+  // here would be skipped by the first epoch and shift every later epoch
+  // off its shard order
+}
+
+SingleDataLoader::SingleDataLoader(FFModel& ff, Tensor input, void* data,
+                                   int num_samples_, DataType datatype_)
+{
+  num_samples = num_samples_;
+  datatype = datatype_;
+  num_buffers = 0;
+  attached = true;
+  batch_input = input;
+  int dims[MAX_TENSOR_DIM];
+  dims[0] = num_samples;
+  for (int i = 1; i < input.numDim; i++)
+    dims[i] = input.adim[input.numDim-1-i];
+  switch (input.numDim) {
+#define DIMFUNC(DIM) \
+    case DIM: \
+    { \
+      full_input = ff.create_tensor<DIM>(dims, datatype, NULL, false/*create_grad*/); \
+      break; \
+    }
+    LEGION_FOREACH_N(DIMFUNC)
+#undef DIMFUNC
+    default:
+      assert(false);
+  }
+  // A row-major array is column-major with full_input's reversed dims.
+  // Pages of a memory-mapped file are only read in by the batch gathers
+  full_input.attach_raw_ptr(ff.config, data, true/*column_major*/);
+  prefetcher.init(ff, std::vector<Tensor>(1, batch_input),
+                  std::vector<std::string>(1, ""));
   reset();
   next_batch(ff);
 }
 
+SingleDataLoader::~SingleDataLoader(void)
+{
+  if (attached) {
+    Runtime* runtime = Runtime::get_runtime();
+    Context ctx = Runtime::get_context();
+    // The detach follows the batch gathers still reading the caller's
+    // array; wait for it so the array can be freed on return
+    runtime->detach_external_resource(ctx, full_input.physical_region).wait();
+  }
+}
+
+int SingleDataLoader::get_shard(long long position)
+{
+  int epoch = position / num_shards;
+  if (!shuffle)
+    return position % num_shards;
+  // Reads only move forward, so one epoch's order is cached at a time
+  if (epoch != shard_order_epoch) {
+    shard_order.resize(num_shards);
+    for (int i = 0; i < num_shards; i++)
+      shard_order[i] = i;
+    std::mt19937 gen(epoch);
+    std::shuffle(shard_order.begin(), shard_order.end(), gen);
+    shard_order_epoch = epoch;
+  }
+  return shard_order[position % num_shards];
+}
+
+// Reads the shard at position of the stream into its ring buffer. Legion
+// orders the read after the batch copies still reading that buffer
+void SingleDataLoader::load_shard_at(FFModel& ff, long long position)
+{
+  Context ctx = ff.config.lg_ctx;
+  Runtime* runtime = ff.config.lg_hlr;
+  const Tensor& buffer = shard_buffers[position % num_buffers];
+  size_t sample_bytes = (datatype == DT_FLOAT) ? sizeof(float) : sizeof(int);
+  for (int i = 0; i < buffer.numDim - 1; i++)
+    sample_bytes *= buffer.adim[i];
+  DataShard shard;
+  strcpy(shard.filename, filename.c_str());
+  shard.offset = header_bytes
+      + (size_t)get_shard(position) * shard_samples * sample_bytes;
+  int task_id = -1;
+  if (datatype == DT_FLOAT) {
+    task_id = PY_DL_FLOAT_LOAD_SHARD_CPU_TASK_ID;
+  } else if (datatype == DT_INT32) {
+    task_id = PY_DL_INT_LOAD_SHARD_CPU_TASK_ID;
+  } else {
+    assert(0);
+  }
+  TaskLauncher launcher(task_id, TaskArgument(&shard, sizeof(DataShard)));
+  // regions[0]: buffer
+  launcher.add_region_requirement(
+      RegionRequirement(buffer.region, WRITE_ONLY,
+                        EXCLUSIVE, buffer.region,
+                        MAP_TO_ZC_MEMORY));
+  launcher.add_field(0, FID_DATA);
+  runtime->execute_task(ctx, launcher);
+}
+
 void SingleDataLoader::reset()
 {
   next_index = 0;
@@ -550,6 +746,58 @@ void SingleDataLoader::reset()
 
 void SingleDataLoader::next_batch(FFModel& ff)
 {
+  prefetcher.next_batch(ff, *this);
+  next_index += ff.config.batchSize;
+  if (num_buffers > 0)
+    streamed_samples += ff.config.batchSize;
+}
+
+long long SingleDataLoader::batch_key(const FFModel& ff, int ahead)
+{
+  // Streamed batches are never revisited, so their position in the
+  // stream identifies them
+  if (num_buffers > 0)
+    return streamed_samples + (long long)ahead * ff.config.batchSize;
+  return BatchPrefetcher::epoch_batch_key(next_index, ahead, num_samples,
+                                         ff.config.batchSize);
+}
+
+void SingleDataLoader::load_batch(FFModel& ff, long long key,
+                                  const std::vector<Tensor>& tensors)
+{
+  if (attached) {
+    Context ctx = ff.config.lg_ctx;
+    Runtime* runtime = ff.config.lg_hlr;
+    coord_t first = key;
+    int task_id = -1;
+    if (datatype == DT_FLOAT)
+      task_id = PY_DL_FLOAT_GATHER_BATCH_CPU_TASK_ID;
+    else if (datatype == DT_INT32)
+      task_id = PY_DL_INT_GATHER_BATCH_CPU_TASK_ID;
+    else
+      assert(0);
+    // One point per shard of the batch, on the CPUs of the node that
+    // attached full_input; the GPUs reading the batch copy their shards
+    // from zero-copy memory
+    IndexSpace task_is = ff.get_or_create_task_is(full_input.numDim, "");
+    IndexLauncher launcher(task_id, task_is,
+                           TaskArgument(&first, sizeof(coord_t)), ArgumentMap(),
+                           Predicate::TRUE_PRED, false/*must*/, 0/*mapper_id*/,
+                           MAP_TO_LOCAL_NODE);
+    // regions[0]: full_input
+    launcher.add_region_requirement(
+        RegionRequirement(full_input.region, 0/*projection id*/,
+                          READ_ONLY, EXCLUSIVE, full_input.region,
+                          MAP_TO_SYS_MEMORY));
+    launcher.add_field(0, FID_DATA);
+    // regions[1]: a shard of the batch
+    launcher.add_region_requirement(
+        RegionRequirement(tensors[0].part, 0/*projection id*/,
+                          WRITE_ONLY, EXCLUSIVE, tensors[0].region));
+    launcher.add_field(1, FID_DATA);
+    runtime->execute_index_space(ctx, launcher);
+    return;
+  }
   int task_id = -1;
   if (datatype == DT_FLOAT)
     task_id = PY_DL_FLOAT_LOAD_BATCH_GPU_TASK_ID;
@@ -557,20 +805,35 @@ void SingleDataLoader::next_batch(FFModel& ff)
     task_id = PY_DL_INT_LOAD_BATCH_GPU_TASK_ID;
   else
     assert(0);
+  Tensor source = full_input;
+  int source_index = key;
+  long long position = 0;
+  if (num_buffers > 0) {
+    position = key / shard_samples;
+    source = shard_buffers[position % num_buffers];
+    source_index = key % shard_samples;
+  }
   switch (full_input.numDim) {
 #define DIMFUNC(DIM) \
     case DIM: \
-      next_batch_xd_launcher<DIM>(ff, task_id); \
+      next_batch_xd_launcher<DIM>(ff, task_id, source, source_index, tensors[0]); \
       break;
     LEGION_FOREACH_N(DIMFUNC)
 #undef DIMFUNC
     default:
       assert(false);
   }
+  // Streamed batches are loaded in stream order, so the buffer of a shard
+  // whose last batch is loaded is refilled with the shard num_buffers ahead
+  if (num_buffers > 0 && (key + ff.config.batchSize) % shard_samples == 0)
+    load_shard_at(ff, position + num_buffers);
 }
 
 template<int NDIM>
-void SingleDataLoader::next_batch_xd_launcher(FFModel& ff, int task_id)
+void SingleDataLoader::next_batch_xd_launcher(FFModel& ff, int task_id,
+                                              const Tensor& source,
+                                              int source_index,
+                                              const Tensor& batch)
 {
   Context ctx = ff.config.lg_ctx;
   Runtime* runtime = ff.config.lg_hlr;
@@ -579,7 +842,7 @@ void SingleDataLoader::next_batch_xd_launcher(FFModel& ff, int task_id)
     IndexSpaceT<NDIM> task_is = IndexSpaceT<NDIM>(ff.get_or_create_task_is(NDIM, ""));
     Rect<NDIM> rect = runtime->get_index_space_domain(ctx, task_is);
     ArgumentMap argmap;
-    int idx = next_index;
+    int idx = source_index;
     for (PointInRectIterator<NDIM> it(rect); it(); it++) {
       SampleIdxs meta;
       assert(ff.config.batchSize % (rect.hi[1] - rect.lo[NDIM-1] + 1) == 0);
@@ -591,19 +854,18 @@ void SingleDataLoader::next_batch_xd_launcher(FFModel& ff, int task_id)
     IndexLauncher launcher(task_id, task_is,
                            TaskArgument(NULL,0), argmap,
                            Predicate::TRUE_PRED, false/*must*/, 0/*mapper_id*/,
-                           FFConfig::get_hash_id(""));
+                           ff.config.get_strategy_id(""));
     launcher.add_region_requirement(
-        RegionRequirement(full_input.region, 0/*projection id*/,
-                          READ_ONLY, EXCLUSIVE, full_input.region,
+        RegionRequirement(source.region, 0/*projection id*/,
+                          READ_ONLY, EXCLUSIVE, source.region,
                           MAP_TO_ZC_MEMORY));
     launcher.add_field(0, FID_DATA);
     launcher.add_region_requirement(
-        RegionRequirement(batch_input.part, 0/*projection id*/,
-                          WRITE_ONLY, EXCLUSIVE, batch_input.region));
+        RegionRequirement(batch.part, 0/*projection id*/,
+                          WRITE_ONLY, EXCLUSIVE, batch.region));
     launcher.add_field(1, FID_DATA);
     runtime->execute_index_space(ctx, launcher);
   }
-  next_index += ff.config.batchSize;
 }
 
 // Task body
@@ -646,13 +908,99 @@ void SingleDataLoader::load_entire_dataset_from_numpy_with_dim(const Task *task,
 
   DT* input_ptr = acc_input.ptr(rect_input.lo);
   const DT* input_ptr_ = acc_input_.ptr(rect_input_.lo);
-  printf("Check ptr input_ %p %lu %lu, input %p %lu %lu\n", input_ptr_, (uintptr_t)input_ptr_, rect_input_.volume(), input_ptr, (uintptr_t)input_ptr, rect_input.volume());
   assert(rect_input.volume() == rect_input_.volume());
   memcpy(input_ptr, input_ptr_, sizeof(DT)*rect_input.volume());
-  for (int i = 0; i < 32; i++) {
-    std::cout<<input_ptr[i]<<" ";
+}
+
+template<typename DT>
+void SingleDataLoader::load_shard(const Task *task,
+                                  const std::vector<PhysicalRegion> &regions,
+                                  Context ctx, Runtime* runtime)
+{
+  assert(regions.size() == 1);
+  assert(task->regions.size() == regions.size());
+  const DataShard* shard = (const DataShard*) task->args;
+  Domain domain = runtime->get_index_space_domain(
+    ctx, task->regions[0].region.get_index_space());
+  DT* buffer_ptr = NULL;
+  switch (domain.get_dim()) {
+#define DIMFUNC(DIM) \
+    case DIM: \
+    { \
+      const AccessorWO<DT, DIM> acc_buffer(regions[0], FID_DATA); \
+      Rect<DIM> rect_buffer = domain; \
+      assert(acc_buffer.accessor.is_dense_arbitrary(rect_buffer)); \
+      buffer_ptr = acc_buffer.ptr(rect_buffer.lo); \
+      break; \
+    }
+    LEGION_FOREACH_N(DIMFUNC)
+#undef DIMFUNC
+    default:
+      assert(false);
+  }
+  size_t bytes = sizeof(DT) * domain.get_volume();
+  FILE* file = fopen(shard->filename, "rb");
+  assert(file != NULL);
+  int ret = fseeko(file, shard->offset, SEEK_SET);
+  assert(ret == 0);
+  size_t bytes_read = fread(buffer_ptr, 1, bytes, file);
+  assert(bytes_read == bytes);
+  fclose(file);
+}
+
+/*
+  regions[0](I): full_input
+  regions[1](O): a shard of the batch
+  task->args: the index of the first sample of the batch
+*/
+template<typename DT>
+void SingleDataLoader::gather_batch(const Task *task,
+                                    const std::vector<PhysicalRegion> &regions,
+                                    Context ctx, Runtime* runtime)
+{
+  assert(regions.size() == 2);
+  assert(task->regions.size() == regions.size());
+  assert(task->arglen == sizeof(coord_t));
+  coord_t first = *((const coord_t*) task->args);
+  Domain full_domain = runtime->get_index_space_domain(
+    ctx, task->regions[0].region.get_index_space());
+  Domain batch_domain = runtime->get_index_space_domain(
+    ctx, task->regions[1].region.get_index_space());
+  Domain parent_domain = runtime->get_index_space_domain(
+    ctx, task->regions[1].parent.get_index_space());
+  assert(full_domain.get_dim() == batch_domain.get_dim());
+  const DT* full_ptr = NULL;
+  DT* batch_ptr = NULL;
+  switch (full_domain.get_dim()) {
+#define DIMFUNC(DIM) \
+    case DIM: \
+    { \
+      const AccessorRO<DT, DIM> acc_full(regions[0], FID_DATA); \
+      const AccessorWO<DT, DIM> acc_batch(regions[1], FID_DATA); \
+      Rect<DIM> rect_full = full_domain; \
+      Rect<DIM> rect_batch = batch_domain; \
+      assert(acc_full.accessor.is_dense_arbitrary(rect_full)); \
+      assert(acc_batch.accessor.is_dense_arbitrary(rect_batch)); \
+      full_ptr = acc_full.ptr(rect_full.lo); \
+      batch_ptr = acc_batch.ptr(rect_batch.lo); \
+      break; \
+    }
+    LEGION_FOREACH_N(DIMFUNC)
+#undef DIMFUNC
+    default:
+      assert(false);
   }
-  std::cout<<std::endl;
+  // Samples are contiguous since the sample dim is the outermost one, and
+  // the shard holds whole samples as the batch is only split on that dim
+  int dim = full_domain.get_dim() - 1;
+  coord_t full_samples = full_domain.hi()[dim] - full_domain.lo()[dim] + 1;
+  coord_t batch_samples = batch_domain.hi()[dim] - batch_domain.lo()[dim] + 1;
+  size_t sample_volume = full_domain.get_volume() / full_samples;
+  assert(batch_domain.get_volume() == sample_volume * batch_samples);
+  coord_t shard_first = first + batch_domain.lo()[dim] - parent_domain.lo()[dim];
+  assert(full_samples >= shard_first + batch_samples);
+  memcpy(batch_ptr, full_ptr + shard_first * sample_volume,
+         sizeof(DT) * batch_domain.get_volume());
 }
 
 void SingleDataLoader::register_cpu_tasks(void)
@@ -674,6 +1022,42 @@ void SingleDataLoader::register_cpu_tasks(void)
     Runtime::preregister_task_variant<SingleDataLoader::load_entire_dataset_from_numpy<int>>(
         registrar, "Int32 Load Entire Dataset Task Numpy");
   }
+
+  // float Load a shard of a streamed dataset
+  {
+    TaskVariantRegistrar registrar(PY_DL_FLOAT_LOAD_SHARD_CPU_TASK_ID, "Float Load Dataset Shard");
+    registrar.add_constraint(ProcessorConstraint(Processor::LOC_PROC));
+    registrar.set_leaf();
+    Runtime::preregister_task_variant<SingleDataLoader::load_shard<float>>(
+        registrar, "Float Load Dataset Shard Task");
+  }
+
+  // int Load a shard of a streamed dataset
+  {
+    TaskVariantRegistrar registrar(PY_DL_INT_LOAD_SHARD_CPU_TASK_ID, "Int32 Load Dataset Shard");
+    registrar.add_constraint(ProcessorConstraint(Processor::LOC_PROC));
+    registrar.set_leaf();
+    Runtime::preregister_task_variant<SingleDataLoader::load_shard<int>>(
+        registrar, "Int32 Load Dataset Shard Task");
+  }
+
+  // float Gather a batch from an attached dataset
+  {
+    TaskVariantRegistrar registrar(PY_DL_FLOAT_GATHER_BATCH_CPU_TASK_ID, "Float Gather Batch");
+    registrar.add_constraint(ProcessorConstraint(Processor::LOC_PROC));
+    registrar.set_leaf();
+    Runtime::preregister_task_variant<SingleDataLoader::gather_batch<float>>(
+        registrar, "Float Gather Batch Task");
+  }
+
+  // int Gather a batch from an attached dataset
+  {
+    TaskVariantRegistrar registrar(PY_DL_INT_GATHER_BATCH_CPU_TASK_ID, "Int32 Gather Batch");
+    registrar.add_constraint(ProcessorConstraint(Processor::LOC_PROC));
+    registrar.set_leaf();
+    Runtime::preregister_task_variant<SingleDataLoader::gather_batch<int>>(
+        registrar, "Int32 Gather Batch Task");
+  }
 }
 
 void SingleDataLoader::register_gpu_tasks(void)
@@ -696,7 +1080,7 @@ void SingleDataLoader::register_gpu_tasks(void)
   }
 }
 
-template void SingleDataLoader::next_batch_xd_launcher<2>(FFModel& ff, int task_id);
-template void SingleDataLoader::next_batch_xd_launcher<4>(FFModel& ff, int task_id);
+template void SingleDataLoader::next_batch_xd_launcher<2>(FFModel& ff, int task_id, const Tensor& source, int source_index, const Tensor& batch);
+template void SingleDataLoader::next_batch_xd_launcher<4>(FFModel& ff, int task_id, const Tensor& source, int source_index, const Tensor& batch);
 template void SingleDataLoader::load_entire_dataset_from_numpy<float>(const Task *task, const std::vector<PhysicalRegion> &regions, Context ctx, Runtime* runtime);
 template void SingleDataLoader::load_entire_dataset_from_numpy<int>(const Task *task, const std::vector<PhysicalRegion> &regions, Context ctx, Runtime* runtime);
@@ -32,7 +32,7 @@ struct DLRMConfig {
 };
 
 //TODO: remove data loaders except single data loader
-class ImgDataLoader {
+class ImgDataLoader : public BatchPrefetcher::Source {
 public:
   ImgDataLoader();
   static void load_label(const Task *task,
@@ -40,10 +40,14 @@ public:
                          Context ctx,
                          Runtime* runtime);
   void reset(void);             
+  long long batch_key(const FFModel& ff, int ahead);
+protected:
+  void init_prefetcher(FFModel& ff);
 public:
   int num_samples, next_index;
   Tensor full_input, batch_input;
   Tensor full_label, batch_label;
+  BatchPrefetcher prefetcher;
 };
 
 class ImgDataLoader4D : public ImgDataLoader {
@@ -65,6 +69,8 @@ public:
                                              Context ctx,
                                              Runtime* runtime);
   void next_batch(FFModel&);
+  void load_batch(FFModel& ff, long long key,
+                  const std::vector<Tensor>& tensors);
 private:
   size_t get_file_size(const std::string& filename);              
 };
@@ -82,16 +88,44 @@ public:
                                             Context ctx,
                                             Runtime* runtime);
   void next_batch(FFModel&);
+  void load_batch(FFModel& ff, long long key,
+                  const std::vector<Tensor>& tensors);
 };
 
-class SingleDataLoader {
+class SingleDataLoader : public BatchPrefetcher::Source {
 public:
   SingleDataLoader(FFModel& ff, Tensor input, Tensor full_input_, int num_samples_, DataType datatype_);
+  // Streams a raw file instead of holding the whole dataset in memory: the
+  // samples (each laid out like a sample of input) start at header_bytes
+  // and are read in shards of shard_samples samples into a ring of
+  // num_buffers zero-copy buffers, in file order or in a shuffled shard
+  // order that changes every epoch. Trailing samples that do not fill a
+  // shard are skipped
+  SingleDataLoader(FFModel& ff, Tensor input, const std::string& filename,
+                   size_t header_bytes, int num_samples_, int shard_samples_,
+                   int num_buffers_, bool shuffle_, DataType datatype_);
+  // Reads the samples in place from data, a row-major host array of
+  // num_samples_ samples laid out like input (e.g., a memory-mapped .npy
+  // file). data is attached as full_input instead of being copied, and
+  // each batch is gathered from it by CPU tasks, so data must stay valid
+  // while the loader is used
+  SingleDataLoader(FFModel& ff, Tensor input, void* data,
+                   int num_samples_, DataType datatype_);
+  // Detaches data if it was attached, so the caller may free it afterwards
+  ~SingleDataLoader(void);
+  // A copy would detach full_input a second time
+  SingleDataLoader(const SingleDataLoader&) = delete;
+  SingleDataLoader& operator=(const SingleDataLoader&) = delete;
   
   void next_batch(FFModel&);
   
   void reset(void); 
   
+  long long batch_key(const FFModel& ff, int ahead);
+  
+  void load_batch(FFModel& ff, long long key,
+                  const std::vector<Tensor>& tensors);
+  
   static void register_cpu_tasks(void);
   
   static void register_gpu_tasks(void);
@@ -116,13 +150,46 @@ public:
                                              const std::vector<PhysicalRegion> &regions,
                                              Context ctx,
                                              Runtime* runtime);
+  template<typename DT>
+  static void load_shard(const Task *task,
+                         const std::vector<PhysicalRegion> &regions,
+                         Context ctx,
+                         Runtime* runtime);
+  template<typename DT>
+  static void gather_batch(const Task *task,
+                           const std::vector<PhysicalRegion> &regions,
+                           Context ctx,
+                           Runtime* runtime);
 private:
   template<int NDIM>
-  void next_batch_xd_launcher(FFModel&, int task_id);
+  void next_batch_xd_launcher(FFModel&, int task_id,
+                              const Tensor& source, int source_index,
+                              const Tensor& batch);
+  void load_shard_at(FFModel&, long long position);
+  int get_shard(long long position);
 public:
   int num_samples, next_index;
   DataType datatype;
   Tensor full_input, batch_input;         
+  BatchPrefetcher prefetcher;
+  // Whether full_input is attached to the caller's array
+  bool attached;
+  // Streaming state; num_buffers is 0 when full_input holds the dataset
+  std::string filename;
+  size_t header_bytes;
+  int shard_samples, num_shards, num_buffers;
+  bool shuffle;
+  std::vector<Tensor> shard_buffers;
+  // Samples consumed since construction; shard position p of the stream
+  // is shard get_shard(p) and lives in shard_buffers[p % num_buffers]
+  long long streamed_samples;
+  int shard_order_epoch;
+  std::vector<int> shard_order;
+};
+
+struct DataShard {
+  char filename[MAX_FILENAME];
+  size_t offset;
 };
 
 #define MAX_NUM_SAMPLES 4196
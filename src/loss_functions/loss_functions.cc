@@ -0,0 +1,103 @@
+/* Copyright 2020 Stanford
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "model.h"
+#include "cpu_helper.h"
+
+void Loss::backward_task_cpu(const Task *task,
+                             const std::vector<PhysicalRegion> &regions,
+                             Context ctx, Runtime *runtime)
+{
+  Domain domain = runtime->get_index_space_domain(
+      ctx, task->regions[0].region.get_index_space());
+  switch (domain.get_dim()) {
+#define DIMFUNC(DIM) \
+    case DIM: \
+      return backward_task_cpu_with_dim<DIM>(task, regions, ctx, runtime);
+    LEGION_FOREACH_N(DIMFUNC)
+#undef DIMFUNC
+    default:
+      assert(false);
+  }
+}
+
+/*
+  regions[0](I/O): logit_grad
+  regions[1](I): logit
+  regions[2](I): label
+  Each sample's gradient is written and scaled in a single pass
+*/
+template<int NDIM>
+void Loss::backward_task_cpu_with_dim(const Task *task,
+                                      const std::vector<PhysicalRegion> &regions,
+                                      Context ctx, Runtime *runtime)
+{
+  assert(regions.size() == 3);
+  assert(task->regions.size() == 3);
+  const Loss* loss = (Loss*) task->args;
+  float scale = loss->scale_factor;
+  TensorAccessorW<float, NDIM> acc_logit_grad(
+      regions[0], task->regions[0], FID_DATA, ctx, runtime,
+      true/*readOutput*/);
+  TensorAccessorR<float, NDIM> acc_logit(
+      regions[1], task->regions[1], FID_DATA, ctx, runtime);
+  assert(acc_logit_grad.rect == acc_logit.rect);
+  int num_samples = acc_logit.rect.hi[NDIM-1] - acc_logit.rect.lo[NDIM-1] + 1;
+  int num_classes = acc_logit.rect.volume() / num_samples;
+  float* logit_grad = acc_logit_grad.ptr;
+  const float* logit = acc_logit.ptr;
+  if (loss->loss_type == LOSS_SPARSE_CATEGORICAL_CROSSENTROPY) {
+    //sparse_categorical_crossentropy has label of dim: (batch_size, 1)
+    TensorAccessorR<int, NDIM> acc_label(
+        regions[2], task->regions[2], FID_DATA, ctx, runtime);
+    for (int i = 1; i < NDIM; i++) {
+      assert(acc_label.rect.hi[i] == acc_logit.rect.hi[i]);
+      assert(acc_label.rect.lo[i] == acc_logit.rect.lo[i]);
+    }
+    assert(acc_label.rect.lo[0] == acc_label.rect.hi[0]);
+    const int* label = acc_label.ptr;
+    CPU_PARALLEL_FOR
+    for (int i = 0; i < num_samples; i++) {
+      const float* in = logit + (size_t)i * num_classes;
+      float* grad = logit_grad + (size_t)i * num_classes;
+      CPU_SIMD
+      for (int j = 0; j < num_classes; j++)
+        grad[j] = in[j] * scale;
+      assert(label[i] >= 0 && label[i] < num_classes);
+      grad[label[i]] -= scale;
+    }
+  } else {
+    TensorAccessorR<float, NDIM> acc_label(
+        regions[2], task->regions[2], FID_DATA, ctx, runtime);
+    // other loss require label and logit have identical shape
+    assert(acc_logit.rect == acc_label.rect);
+    const float* label = acc_label.ptr;
+    coord_t volume = acc_logit.rect.volume();
+    if (loss->loss_type == LOSS_CATEGORICAL_CROSSENTROPY
+    || loss->loss_type == LOSS_MEAN_SQUARED_ERROR_AVG_REDUCE) {
+      CPU_PARALLEL_FOR_SIMD
+      for (coord_t i = 0; i < volume; i++)
+        logit_grad[i] = (logit[i] - label[i]) * scale;
+    } else if (loss->loss_type == LOSS_MEAN_SQUARED_ERROR_SUM_REDUCE) {
+      // Summed over samples, so the gradient is not averaged
+      CPU_PARALLEL_FOR_SIMD
+      for (coord_t i = 0; i < volume; i++)
+        logit_grad[i] = logit[i] - label[i];
+    } else {
+      fprintf(stderr, "Unsupported loss --- report this error to the FlexFlow developers\n");
+      assert(false);
+    }
+  }
+}
@@ -152,6 +152,11 @@ void Loss::backward_task_with_dim(const Task *task,
       // Scale logit gradients by loss->scale_factor
       scale_kernel<<<GET_BLOCKS(acc_logit_grad.rect.volume()), CUDA_NUM_THREADS>>>(
           acc_logit_grad.ptr, acc_logit_grad.rect.volume(), 0, loss->scale_factor);
+    } else if (loss->loss_type == LOSS_MEAN_SQUARED_ERROR_SUM_REDUCE) {
+      // Summed over samples, so the gradient is not averaged
+      mean_squared_error_avg_loss_backward<<<GET_BLOCKS(acc_logit.rect.volume()), CUDA_NUM_THREADS>>>(
+          acc_logit_grad.ptr, acc_logit.ptr, acc_label.ptr,
+          acc_logit.rect.volume());
     } else {
       fprintf(stderr, "Unsupported loss --- report this error to the FlexFlow developers\n");
       assert(false);
@@ -208,7 +213,7 @@ void Loss::backward_with_dim(FFModel* model,
   IndexLauncher launcher(LOSS_BWD_TASK_ID, task_is,
                          TaskArgument(this, sizeof(Loss)), argmap,
                          Predicate::TRUE_PRED, false/*must*/, 0/*mapper_id*/,
-                         FFConfig::get_hash_id(pcname));
+                         model->config.get_strategy_id(pcname));
   launcher.add_region_requirement(
       RegionRequirement(logit->part_grad, 0/*projection id*/,
                         READ_WRITE, EXCLUSIVE, logit->region_grad));
@@ -14,21 +14,34 @@
  */
 
 #include "mapper.h"
+#include <algorithm>
 
 LegionRuntime::Logger::Category log_ff_mapper("Mapper");
 
+// Bounds cache_task_procs, since launches on fresh regions get new hashes
+#define MAX_CACHED_TASK_PROCS 4096
+
 FFMapper::FFMapper(MapperRuntime *rt, Machine machine, Processor local,
                    const char *mapper_name,
                    std::vector<Processor>* _gpus,
                    std::map<Processor, Memory>* _proc_fbmems,
                    std::map<Processor, Memory>* _proc_zcmems,
                    std::vector<Processor>* _cpus,
-                   std::map<size_t, ParallelConfig>* _strategies)
+                   std::map<Processor, Memory>* _proc_numamems,
+                   std::vector<ParallelConfig>* _strategies,
+                   int _cpu_steal_families)
   : DefaultMapper(rt, machine, local, mapper_name),
     gpus(*_gpus), proc_fbmems(*_proc_fbmems),
     proc_zcmems(*_proc_zcmems), cpus(*_cpus),
-    strategies(*_strategies)
-{}
+    proc_numamems(*_proc_numamems), strategies(*_strategies),
+    cpu_steal_families(_cpu_steal_families)
+{
+  for (size_t i = 0; i < cpus.size(); i++) {
+    Memory numa_mem = proc_numamems[cpus[i]];
+    if (numa_mem.exists())
+      numa_cpus[numa_mem].push_back(cpus[i]);
+  }
+}
 
 void FFMapper::slice_task(const MapperContext ctx,
                           const Task& task,
@@ -39,23 +52,52 @@ void FFMapper::slice_task(const MapperContext ctx,
   //    task.task_id, task.target_proc.id, input.domain.get_volume(), gpus.size());
   if ((task.task_id == TOP_LEVEL_TASK_ID)
   || ((task.task_id >= CUSTOM_CPU_TASK_ID_FIRST)
-     && (task.task_id <= CUSTOM_CPU_TASK_ID_LAST))) {
-    DefaultMapper::slice_task(ctx, task, input, output);
+     && (task.task_id <= CUSTOM_CPU_TASK_ID_LAST))
+  || (task.task_id == PY_DL_FLOAT_LOAD_ENTIRE_CPU_TASK_ID)
+  || (task.task_id == PY_DL_INT_LOAD_ENTIRE_CPU_TASK_ID)
+  || (task.task_id == PY_DL_FLOAT_GATHER_BATCH_CPU_TASK_ID)
+  || (task.task_id == PY_DL_INT_GATHER_BATCH_CPU_TASK_ID)) {
+    // Data loading launches are spread over the CPUs of all nodes,
+    // unless they must stay on the node that launched them
+    if (task.tag == MAP_TO_LOCAL_NODE)
+      default_slice_task(task, local_cpus, std::vector<Processor>(),
+                         input, output, cache_local_cpu_slices);
+    else
+      DefaultMapper::slice_task(ctx, task, input, output);
+    if (is_cpu_stealable(task.task_id)) {
+      for (size_t i = 0; i < output.slices.size(); i++)
+        if (output.slices[i].proc.kind() == Processor::LOC_PROC)
+          output.slices[i].stealable = true;
+    }
   } else {
+    // Slices only depend on the strategy and the launch domain, so we
+    // reuse the slices computed for previous launches
+    std::pair<MappingTagID, Domain> key(task.tag, input.domain);
+    std::map<std::pair<MappingTagID, Domain>, std::vector<TaskSlice> >::const_iterator
+        it = cache_slices.find(key);
+    if (it != cache_slices.end()) {
+      output.slices = it->second;
+      // Different task families may share a tag, so stealable is not cached
+      bool stealable = is_cpu_stealable(task.task_id);
+      for (size_t i = 0; i < output.slices.size(); i++)
+        output.slices[i].stealable = stealable
+            && (output.slices[i].proc.kind() == Processor::LOC_PROC);
+      return;
+    }
     output.slices.resize(input.domain.get_volume());
-    MappingTagID hash = task.tag;
+    MappingTagID id = task.tag;
     // Make sure the task has a non-zero tag
-    assert(hash != 0);
+    assert(id != FFConfig::InvalidID);
     ParallelConfig config;
     unsigned int config_num_parts = 1;
-    if (strategies.find(hash) == strategies.end()) {
+    if ((id < FFConfig::StrategyID_FIRST) || (id >= strategies.size())) {
       // No strategy found, use default data parallelism
       int ndim = input.domain.get_dim();
-      assert(strategies.find(FFConfig::DataParallelism_1D-1+ndim) != strategies.end());
       config = strategies[FFConfig::DataParallelism_1D-1+ndim];
+      assert(config.nDims == ndim);
     } else {
       // Found a strategy
-      config = strategies[hash];
+      config = strategies[id];
       // Check that the dimensions match
       assert(config.nDims == input.domain.get_dim());
     }
@@ -64,10 +106,12 @@ void FFMapper::slice_task(const MapperContext ctx,
       config_num_parts *= config.dim[i];
     }
     const std::vector<Processor>* devices;
+    bool stealable = false;
     if (config.device_type == ParallelConfig::GPU) {
       devices = &gpus;
     } else {
       devices = &cpus;
+      stealable = is_cpu_stealable(task.task_id);
     }
     switch (input.domain.get_dim())
     {
@@ -84,7 +128,7 @@ void FFMapper::slice_task(const MapperContext ctx,
           Rect<DIM> slice(*pir, *pir); \
           output.slices[cnt++] = TaskSlice(slice, \
               (*devices)[config.device_ids[idx] % devices->size()], \
-              false/*recurse*/, false/*stealable*/); \
+              false/*recurse*/, stealable); \
         } \
         break; \
       }
@@ -93,39 +137,54 @@ void FFMapper::slice_task(const MapperContext ctx,
       default:
         assert(false);
     }
+    cache_slices[key] = output.slices;
+    for (size_t i = 0; i < cache_slices[key].size(); i++)
+      cache_slices[key][i].stealable = false;
   }
 }
 
+unsigned long long FFMapper::compute_mapping_hash(const Task& task)
+{
+  // compute_task_hash covers the task id and all region requirements,
+  // we also mix in the tag since it selects the parallel config
+  const unsigned long long c1 = 0x5491C27F12DB3FA5;
+  return compute_task_hash(task) ^ ((task.tag + 1) * c1);
+}
+
 void FFMapper::select_task_options(const MapperContext ctx,
                                    const Task& task,
                                    TaskOptions& output)
 {
-  unsigned long long task_hash = compute_task_hash(task);
-  if (task.task_id == SGD_UPD_TASK_ID) {
-    // For SGD Update, pick a processor from config
-    // TODO: perform similar optimizations for other Optimizer
-    MappingTagID hash = task.tag;
+  unsigned long long task_hash = compute_mapping_hash(task);
+  if ((task.task_id == SGD_UPD_TASK_ID)
+  || (task.task_id == ADAM_UPD_TASK_ID)
+  || (task.task_id == SGD_SPARSE_UPD_TASK_ID)
+  || (task.task_id == ADAM_SPARSE_UPD_TASK_ID)
+  || (task.task_id == SGD_MULTI_UPD_TASK_ID)
+  || (task.task_id == ADAM_MULTI_UPD_TASK_ID)
+  || (task.task_id == SGD_BUCKET_UPD_TASK_ID)
+  || (task.task_id == ADAM_BUCKET_UPD_TASK_ID)
+  || (task.task_id == GRAD_NORM_TASK_ID)) {
+    // For optimizer updates and gradient norms, pick a processor from config
+    MappingTagID id = task.tag;
     ParallelConfig config;
-    if (strategies.find(hash) != strategies.end()) {
-      config = strategies[hash];
+    if ((id >= FFConfig::StrategyID_FIRST) && (id < strategies.size())) {
+      config = strategies[id];
       int num_parts = 1;
       for (int i = 0; i < config.nDims; i++)
         num_parts *= config.dim[i];
       if (num_parts == 1) {
-        output.initial_proc = gpus[config.device_ids[0]];
+        const std::vector<Processor>& devices =
+            config.device_type == ParallelConfig::GPU ? gpus : cpus;
+        assert(config.device_ids[0] < (int)devices.size());
+        output.initial_proc = devices[config.device_ids[0]];
         output.inline_task = false;
-        output.stealable = stealing_enabled;
+        output.stealable = is_task_stealable(task, output.initial_proc);
         output.map_locally = map_locally;
+        output.memoize = is_mapping_stable(task.task_id);
         return;
       }
     }
-    if (cache_update_tasks.find(task_hash) != cache_update_tasks.end()) {
-      output.initial_proc = cache_update_tasks[task_hash];
-      output.inline_task = false;
-      output.stealable = stealing_enabled;
-      output.map_locally = map_locally;
-      return;
-    }
   }
 
   if (task.task_id == STRATEGY_SEARCH_TASK_ID) {
@@ -136,11 +195,181 @@ void FFMapper::select_task_options(const MapperContext ctx,
     return;
   }
 
+  // Reuse the processor picked for an identical previous launch
+  // (e.g., optimizer updates, loss, metrics and data loader tasks)
+  std::map<unsigned long long, Processor>::const_iterator it =
+      cache_task_procs.find(task_hash);
+  if (it != cache_task_procs.end()) {
+    output.initial_proc = it->second;
+    output.inline_task = false;
+    output.stealable = is_task_stealable(task, output.initial_proc);
+    output.map_locally = map_locally;
+    output.memoize = is_mapping_stable(task.task_id);
+    return;
+  }
+
   DefaultMapper::select_task_options(ctx, task, output);
-  if ((task.task_id == SGD_UPD_TASK_ID)
-  && (cache_update_tasks.find(task_hash) == cache_update_tasks.end())) {
-    cache_update_tasks[task_hash] = output.initial_proc;
-    //printf("hash = %llu proc = %llu\n", task_hash, output.initial_proc.id);
+  if ((task.task_id != TOP_LEVEL_TASK_ID)
+  && (output.initial_proc.kind() == Processor::LOC_PROC)
+  && (!task.is_index_space)) {
+    // Run CPU tasks on the socket closest to the GPUs consuming their outputs
+    Memory numa_mem = select_numa_domain(task);
+    if (numa_mem.exists()) {
+      Processor proc = select_numa_cpu(numa_mem,
+                                       output.initial_proc.address_space());
+      if (proc.exists())
+        output.initial_proc = proc;
+    }
+  }
+  if (task.task_id != TOP_LEVEL_TASK_ID) {
+    output.stealable = is_task_stealable(task, output.initial_proc);
+    output.memoize = is_mapping_stable(task.task_id);
+    if (cache_task_procs.size() >= MAX_CACHED_TASK_PROCS)
+      cache_task_procs.clear();
+    cache_task_procs[task_hash] = output.initial_proc;
+  }
+}
+
+Memory FFMapper::select_numa_domain(const Task& task)
+{
+  // If the task carries a GPU strategy, its consumer is the first device
+  MappingTagID id = task.tag;
+  if ((id >= FFConfig::StrategyID_FIRST) && (id < strategies.size())
+  && (strategies[id].device_type == ParallelConfig::GPU)) {
+    Processor gpu = gpus[strategies[id].device_ids[0] % gpus.size()];
+    std::map<Processor, Memory>::const_iterator it = proc_numamems.find(gpu);
+    if (it != proc_numamems.end())
+      return it->second;
+  }
+  // Otherwise (e.g., data loaders filling zero-copy buffers read by all
+  // GPUs), pick the NUMA domain that hosts the most local GPUs
+  std::map<Memory, int> num_gpus;
+  Memory best = Memory::NO_MEMORY;
+  for (size_t i = 0; i < gpus.size(); i++) {
+    if (gpus[i].address_space() != node_id) continue;
+    Memory numa_mem = proc_numamems[gpus[i]];
+    if (!numa_mem.exists()) continue;
+    num_gpus[numa_mem] ++;
+    if (!best.exists() || num_gpus[numa_mem] > num_gpus[best])
+      best = numa_mem;
+  }
+  return best;
+}
+
+Processor FFMapper::select_numa_cpu(Memory numa_mem, AddressSpace space)
+{
+  std::map<Memory, std::vector<Processor> >::const_iterator it =
+      numa_cpus.find(numa_mem);
+  if ((it == numa_cpus.end()) || it->second.empty())
+    return Processor::NO_PROC;
+  // Round-robin over the CPUs in the NUMA domain
+  const std::vector<Processor>& procs = it->second;
+  for (size_t i = 0; i < procs.size(); i++) {
+    Processor proc = procs[numa_next_cpu[numa_mem]++ % procs.size()];
+    if (proc.address_space() == space)
+      return proc;
+  }
+  return Processor::NO_PROC;
+}
+
+bool FFMapper::is_cpu_stealable(TaskID task_id) const
+{
+  int family;
+  if (((task_id >= CUSTOM_CPU_TASK_ID_FIRST)
+     && (task_id <= CUSTOM_CPU_TASK_ID_LAST))
+  || (task_id == PY_DL_FLOAT_LOAD_ENTIRE_CPU_TASK_ID)
+  || (task_id == PY_DL_INT_LOAD_ENTIRE_CPU_TASK_ID)
+  || (task_id == PY_DL_FLOAT_LOAD_SHARD_CPU_TASK_ID)
+  || (task_id == PY_DL_INT_LOAD_SHARD_CPU_TASK_ID)
+  || (task_id == PY_DL_FLOAT_GATHER_BATCH_CPU_TASK_ID)
+  || (task_id == PY_DL_INT_GATHER_BATCH_CPU_TASK_ID)) {
+    family = FFConfig::CPU_STEAL_LOADER;
+  } else if ((task_id >= GLOROT_INIT_TASK_ID)
+          && (task_id <= NORMAL_INIT_TASK_ID)) {
+    family = FFConfig::CPU_STEAL_INIT;
+  } else if ((task_id == TOP_LEVEL_TASK_ID)
+          || (task_id == STRATEGY_SEARCH_TASK_ID)) {
+    return false;
+  } else {
+    family = FFConfig::CPU_STEAL_OPS;
+  }
+  return (cpu_steal_families & family) != 0;
+}
+
+// Stealability of a single task, whether select_task_options picked its
+// processor now or reused a cached one. Slices of index launches are
+// marked by slice_task instead
+bool FFMapper::is_task_stealable(const Task& task, Processor proc) const
+{
+  if (stealing_enabled)
+    return true;
+  return (proc.kind() == Processor::LOC_PROC) && !task.is_index_space
+      && is_cpu_stealable(task.task_id);
+}
+
+bool FFMapper::is_mapping_stable(TaskID task_id) const
+{
+  // Operator, loss, metrics and optimizer tasks launch on the same regions
+  // in every iteration. Data loaders rotate through staging buffers, and
+  // init and one-shot tasks gain nothing from memoization
+  if ((task_id == TOP_LEVEL_TASK_ID)
+  || (task_id == STRATEGY_SEARCH_TASK_ID)
+  || (task_id == COPY_BATCH_TASK_ID)
+  || ((task_id >= PY_DL_FLOAT_LOAD_ENTIRE_CPU_TASK_ID)
+     && (task_id <= PY_DL_INT_LOAD_BATCH_GPU_TASK_ID))
+  || ((task_id >= CUSTOM_GPU_TASK_ID_FIRST)
+     && (task_id <= CUSTOM_CPU_TASK_ID_LAST))
+  || ((task_id >= GLOROT_INIT_TASK_ID)
+     && (task_id <= NORMAL_INIT_TASK_ID)))
+    return false;
+  return true;
+}
+
+void FFMapper::select_steal_targets(const MapperContext ctx,
+                                    const SelectStealingInput& input,
+                                    SelectStealingOutput& output)
+{
+  if ((local_proc.kind() != Processor::LOC_PROC)
+  || (cpu_steal_families == FFConfig::CPU_STEAL_NONE)) {
+    DefaultMapper::select_steal_targets(ctx, input, output);
+    return;
+  }
+  // Idle CPUs steal from CPUs on the same node, trying the ones in the
+  // same NUMA domain first
+  Memory local_numa_mem = proc_numamems[local_proc];
+  for (int pass = 0; pass < 2; pass++) {
+    for (size_t i = 0; i < cpus.size(); i++) {
+      if (output.targets.size() >= max_steals_per_theft)
+        return;
+      Processor proc = cpus[i];
+      if ((proc == local_proc) || (proc.address_space() != node_id))
+        continue;
+      if (input.blacklist.find(proc) != input.blacklist.end())
+        continue;
+      bool same_numa = (proc_numamems[proc] == local_numa_mem);
+      if ((pass == 0) == same_numa)
+        output.targets.insert(proc);
+    }
+  }
+}
+
+void FFMapper::permit_steal_request(const MapperContext ctx,
+                                    const StealRequestInput& input,
+                                    StealRequestOutput& output)
+{
+  // Only give away tasks of the enabled families to CPUs on this node,
+  // without --cpu-steal we keep the default policy (-dm:steal)
+  if ((input.thief_proc.kind() != Processor::LOC_PROC)
+  || (input.thief_proc.address_space() != node_id)
+  || (cpu_steal_families == FFConfig::CPU_STEAL_NONE)) {
+    DefaultMapper::permit_steal_request(ctx, input, output);
+    return;
+  }
+  for (size_t i = 0; i < input.stealable_tasks.size(); i++) {
+    const Task* task = input.stealable_tasks[i];
+    if ((task->target_proc.kind() == Processor::LOC_PROC)
+    && is_cpu_stealable(task->task_id))
+      output.stolen_tasks.insert(task);
   }
 }
 
@@ -159,7 +388,7 @@ Memory FFMapper::default_policy_select_target_memory(MapperContext ctx,
                                                      MemoryConstraint mc)
 {
   if (target_proc.kind() == Processor::TOC_PROC) {
-    if (req.tag == MAP_TO_ZC_MEMORY) {
+    if ((req.tag == MAP_TO_ZC_MEMORY) || (req.tag == MAP_TO_ZC_PARENT_MEMORY)) {
       assert(proc_zcmems.find(target_proc) != proc_zcmems.end());
       return proc_zcmems[target_proc];
     } else {
@@ -170,6 +399,14 @@ Memory FFMapper::default_policy_select_target_memory(MapperContext ctx,
       return proc_fbmems[target_proc];
     }
   } else if (target_proc.kind() == Processor::LOC_PROC) {
+    if (req.tag == MAP_TO_SYS_MEMORY) {
+      // Read external instances attached in system memory (e.g.,
+      // memory-mapped datasets) in place
+      return Machine::MemoryQuery(machine)
+          .has_affinity_to(target_proc)
+          .only_kind(Memory::SYSTEM_MEM)
+          .first();
+    }
     assert(proc_zcmems.find(target_proc) != proc_zcmems.end());
     return proc_zcmems[target_proc];
   } else {
@@ -178,6 +415,25 @@ Memory FFMapper::default_policy_select_target_memory(MapperContext ctx,
   }
 }
 
+LogicalRegion FFMapper::default_policy_select_instance_region(
+                                     MapperContext ctx,
+                                     Memory target_memory,
+                                     const RegionRequirement &req,
+                                     const LayoutConstraintSet &constraints,
+                                     bool force_new_instances,
+                                     bool meets_constraints)
+{
+  // Points filling blocks of a dataset share one instance of the whole
+  // dataset, which is the one the batch loads read afterwards
+  if ((req.tag == MAP_TO_ZC_PARENT_MEMORY) && meets_constraints
+  && runtime->has_parent_logical_partition(ctx, req.region)) {
+    LogicalPartition part = runtime->get_parent_logical_partition(ctx, req.region);
+    return runtime->get_parent_logical_region(ctx, part);
+  }
+  return DefaultMapper::default_policy_select_instance_region(ctx,
+      target_memory, req, constraints, force_new_instances, meets_constraints);
+}
+
 void FFMapper::map_task(const MapperContext ctx,
                         const Task& task,
                         const MapTaskInput& input,
@@ -219,6 +475,33 @@ void FFMapper::map_task(const MapperContext ctx,
     DefaultMapper::map_task(ctx, task, input, output);
 }
 
+void FFMapper::memoize_operation(const MapperContext ctx,
+                                 const Mappable& mappable,
+                                 const MemoizeInput& input,
+                                 MemoizeOutput& output)
+{
+  if (mappable.get_mappable_type() != Mappable::TASK_MAPPABLE) {
+    DefaultMapper::memoize_operation(ctx, mappable, input, output);
+    return;
+  }
+  // Traced iterations replay the mappings of stable task families
+  // without calling into the mapper
+  const Task* task = mappable.as_task();
+  output.memoize = is_mapping_stable(task->task_id);
+}
+
+struct NUMAOrder {
+  NUMAOrder(const std::map<Processor, Memory>& _numamems)
+  : numamems(_numamems) {}
+  bool operator()(const Processor& a, const Processor& b) const
+  {
+    if (a.address_space() != b.address_space())
+      return a.address_space() < b.address_space();
+    return numamems.find(a)->second.id < numamems.find(b)->second.id;
+  }
+  const std::map<Processor, Memory>& numamems;
+};
+
 void update_mappers(Machine machine, Runtime *runtime,
                     const std::set<Processor> &local_procs)
 {
@@ -255,6 +538,30 @@ void update_mappers(Machine machine, Runtime *runtime,
       (*proc_zcmems)[*it] = *(zc_query.begin());
     }
   }
+  // Discover the NUMA topology: each processor is assigned to the socket
+  // memory it has the best affinity to, which is only available when Realm
+  // is built with NUMA support (-ll:nsize), otherwise we fall back to the
+  // system memory and every processor on a node shares the same domain
+  std::map<Processor, Memory>* proc_numamems = new std::map<Processor, Memory>();
+  std::vector<Processor> all_procs(*cpus);
+  all_procs.insert(all_procs.end(), gpus->begin(), gpus->end());
+  for (size_t i = 0; i < all_procs.size(); i++) {
+    Machine::MemoryQuery numa_query(machine);
+    numa_query.only_kind(Memory::SOCKET_MEM);
+    numa_query.best_affinity_to(all_procs[i]);
+    if (numa_query.count() == 0) {
+      numa_query = Machine::MemoryQuery(machine);
+      numa_query.only_kind(Memory::SYSTEM_MEM);
+      numa_query.best_affinity_to(all_procs[i]);
+    }
+    (*proc_numamems)[all_procs[i]] =
+        numa_query.count() > 0 ? *(numa_query.begin()) : Memory::NO_MEMORY;
+    log_ff_mapper.debug("Processor " IDFMT " in NUMA domain " IDFMT,
+                        all_procs[i].id, (*proc_numamems)[all_procs[i]].id);
+  }
+  // Keep CPUs on the same socket adjacent, so that strategies assigning
+  // consecutive device ids to CPU slices stay within one NUMA domain
+  std::stable_sort(cpus->begin(), cpus->end(), NUMAOrder(*proc_numamems));
 
 /*
   for (unsigned idx = 0; idx < proc_mem_affinities.size(); ++idx) {
@@ -274,27 +581,24 @@ void update_mappers(Machine machine, Runtime *runtime,
     gpus->push_back(it->first);
   }
 */
-  // Find strategy file path
-  std::string strategyFile = "";
+  // Find strategy file path and mapper options
   const InputArgs &command_args = HighLevelRuntime::get_input_args();
-  char **argv = command_args.argv;
-  int argc = command_args.argc;
-  for (int i = 1; i < argc; i++) {
-    if ((!strcmp(argv[i], "--import")) || (!strcmp(argv[i], "--import-strategy"))) {
-      strategyFile = std::string(argv[++i]);
-      continue;
-    }
-  }
-  std::map<MappingTagID, ParallelConfig>* strategies = new std::map<MappingTagID, ParallelConfig>();
-
+  FFConfig ffconfig;
+  ffconfig.parse_args(command_args.argv, command_args.argc);
+  std::string strategyFile = ffconfig.import_strategy_file;
+  std::vector<ParallelConfig>* strategies = new std::vector<ParallelConfig>();
+  std::map<std::string, ParallelConfig> named_strategies;
   if (strategyFile == "") {
     // No strategy file provided, use data parallelism
     log_ff_mapper.print("No strategy file provided. Use default data parallelism.");
   } else {
     log_ff_mapper.print("Load parallelization strategy from file %s",
                      strategyFile.c_str());
-    load_strategies_from_file(strategyFile, *strategies);
+    load_strategies_from_file(strategyFile, named_strategies);
   }
+  // Must assign the same ids as FFModel, which loads the same file
+  std::map<std::string, MappingTagID> strategy_ids;
+  assign_strategy_ids(named_strategies, strategy_ids, *strategies);
   int start_dim = FFConfig::DataParallelism_1D, end_dim = FFConfig::DataParallelism_4D;
 #if MAX_TENSOR_DIM >= 5
   end_dim = FFConfig::DataParallelism_5D;
@@ -317,7 +621,8 @@ void update_mappers(Machine machine, Runtime *runtime,
     FFMapper* mapper = new FFMapper(runtime->get_mapper_runtime(),
                                     machine, *it, "FlexFlow Mapper",
                                     gpus, proc_fbmems, proc_zcmems,
-                                    cpus, strategies);
+                                    cpus, proc_numamems, strategies,
+                                    ffconfig.cpu_steal_families);
     runtime->replace_default_mapper(mapper, *it);
   }
 }
@@ -14,6 +14,9 @@
  */
 
 #include "metrics_functions.h"
+#include "model.h"
+#include "cpu_helper.h"
+#include <cmath>
 
 
 PerfMetrics::PerfMetrics(void)
@@ -70,3 +73,161 @@ void PerfMetrics::print(const Metrics* m)
   fprintf(stderr, "%s\n", output.c_str());
 }
 
+PerfMetrics Metrics::compute_task_cpu(const Task *task,
+                                      const std::vector<PhysicalRegion> &regions,
+                                      Context ctx, Runtime *runtime)
+{
+  Domain domain = runtime->get_index_space_domain(
+      ctx, task->regions[0].region.get_index_space());
+  switch (domain.get_dim()) {
+#define DIMFUNC(DIM) \
+    case DIM: \
+      return compute_task_cpu_with_dim<DIM>(task, regions, ctx, runtime);
+    LEGION_FOREACH_N(DIMFUNC)
+#undef DIMFUNC
+    default:
+      assert(false);
+  }
+  PerfMetrics invalid;
+  return invalid;
+}
+
+/*
+  regions[0](I): logit
+  regions[1](I): label
+  Samples are processed in parallel and combined through OpenMP
+  reductions, matching the per-sample semantics of the GPU kernels
+*/
+template<int NDIM>
+PerfMetrics Metrics::compute_task_cpu_with_dim(const Task *task,
+                                               const std::vector<PhysicalRegion> &regions,
+                                               Context ctx, Runtime *runtime)
+{
+  assert(regions.size() == 2);
+  assert(task->regions.size() == 2);
+  const Metrics* me = (Metrics*) task->args;
+  TensorAccessorR<float, NDIM> acc_logit(
+      regions[0], task->regions[0], FID_DATA, ctx, runtime);
+  int num_samples = acc_logit.rect.hi[NDIM-1] - acc_logit.rect.lo[NDIM-1] + 1;
+  int num_classes = acc_logit.rect.volume() / num_samples;
+  const float* logits = acc_logit.ptr;
+  bool measure_error = me->measure_mean_squared_error
+                    || me->measure_root_mean_squared_error
+                    || me->measure_mean_absolute_error;
+  int train_all = 0, train_correct = 0;
+  double cce_loss = 0.0, sparse_cce_loss = 0.0;
+  double mse_loss = 0.0, rmse_loss = 0.0, mae_loss = 0.0;
+  if (me->loss_type == LOSS_SPARSE_CATEGORICAL_CROSSENTROPY) {
+    TensorAccessorR<int, NDIM> acc_label(
+        regions[1], task->regions[1], FID_DATA, ctx, runtime);
+    for (int i = 1; i < NDIM; i++) {
+      assert(acc_label.rect.hi[i] == acc_logit.rect.hi[i]);
+      assert(acc_label.rect.lo[i] == acc_logit.rect.lo[i]);
+    }
+    assert(acc_label.rect.lo[0] == acc_label.rect.hi[0]);
+    // Cannot measure categorical_crossentropy w/ sparse labels
+    // Use measure_sparse_categorical_crossentropy instead
+    assert(!me->measure_categorical_crossentropy);
+    const int* labels = acc_label.ptr;
+    CPU_PARALLEL_FOR_REDUCTION(+:train_all,train_correct,sparse_cce_loss,mse_loss,rmse_loss,mae_loss)
+    for (int b = 0; b < num_samples; b++) {
+      const float* logit = logits + (size_t)b * num_classes;
+      int label = labels[b];
+      if (me->measure_accuracy) {
+        float max_val = -1.0f;
+        int my_label = -1;
+        for (int i = 0; i < num_classes; i++)
+          if (logit[i] > max_val) {
+            max_val = logit[i];
+            my_label = i;
+          }
+        assert(my_label >= 0);
+        train_all += 1;
+        if (label == my_label)
+          train_correct += 1;
+      }
+      if (me->measure_sparse_categorical_crossentropy)
+        sparse_cce_loss -= std::log(std::max(logit[label], LOG_MIN_VALUE));
+      if (measure_error) {
+        float mse = 0.0f, mae = 0.0f;
+        CPU_SIMD_REDUCTION(+:mse,mae)
+        for (int i = 0; i < num_classes; i++) {
+          float diff = logit[i] - (label == i ? 1.0f : 0.0f);
+          mse += diff * diff;
+          mae += std::abs(diff);
+        }
+        mse_loss += mse;
+        rmse_loss += std::sqrt(mse);
+        mae_loss += mae;
+      }
+    }
+  } else {
+    TensorAccessorR<float, NDIM> acc_label(
+        regions[1], task->regions[1], FID_DATA, ctx, runtime);
+    // other loss require label and logit have identical shape
+    assert(acc_logit.rect == acc_label.rect);
+    const float* labels = acc_label.ptr;
+    CPU_PARALLEL_FOR_REDUCTION(+:train_all,train_correct,cce_loss,mse_loss,rmse_loss,mae_loss)
+    for (int b = 0; b < num_samples; b++) {
+      const float* logit = logits + (size_t)b * num_classes;
+      const float* label = labels + (size_t)b * num_classes;
+      train_all += 1;
+      if (me->measure_accuracy) {
+        if (num_classes == 1) {
+          // accuracy does not make sense when num_classes = 1
+          // we just return 100% (counted the same way as the GPU kernel)
+          train_all += 1;
+          train_correct += 1;
+        } else {
+          float max_val = 0.0f;
+          int my_label = -1, true_label = -1;
+          for (int i = 0; i < num_classes; i++) {
+            if (my_label == -1 || logit[i] > max_val) {
+              max_val = logit[i];
+              my_label = i;
+            }
+            if (label[i] > 0.9f) {
+              assert(true_label == -1);
+              true_label = i;
+            }
+          }
+          assert(my_label >= 0);
+          assert(true_label >= 0);
+          if (true_label == my_label)
+            train_correct += 1;
+        }
+      }
+      if (me->measure_categorical_crossentropy) {
+        float cce = 0.0f;
+        for (int i = 0; i < num_classes; i++)
+          if (label[i] > 0.0f)
+            cce -= label[i] * std::log(std::max(logit[i], LOG_MIN_VALUE));
+        cce_loss += cce;
+      }
+      if (measure_error) {
+        float mse = 0.0f, mae = 0.0f;
+        CPU_SIMD_REDUCTION(+:mse,mae)
+        for (int i = 0; i < num_classes; i++) {
+          float diff = logit[i] - label[i];
+          mse += diff * diff;
+          mae += std::abs(diff);
+        }
+        mse_loss += mse;
+        rmse_loss += std::sqrt(mse);
+        mae_loss += mae;
+      }
+    }
+  }
+  PerfMetrics perf;
+  perf.train_all = train_all;
+  perf.train_correct = train_correct;
+  perf.cce_loss = cce_loss;
+  perf.sparse_cce_loss = sparse_cce_loss;
+  if (me->measure_mean_squared_error)
+    perf.mse_loss = mse_loss;
+  if (me->measure_root_mean_squared_error)
+    perf.rmse_loss = rmse_loss;
+  if (me->measure_mean_absolute_error)
+    perf.mae_loss = mae_loss;
+  return perf;
+}
@@ -16,8 +16,6 @@
 #include "model.h"
 #include "cuda_helper.h"
 
-const float LOG_MIN_VALUE = 0.00000001f;
-
 Metrics::Metrics(LossType _loss_type, const std::vector<MetricsType>& metrics)
 : measure_accuracy(false),
   measure_categorical_crossentropy(false),
@@ -288,7 +286,7 @@ void Metrics::compute_with_dim(FFModel* model,
   IndexLauncher launcher(METRICS_COMP_TASK_ID, task_is,
                          TaskArgument(this, sizeof(Metrics)), argmap,
                          Predicate::TRUE_PRED, false/*must*/, 0/*mapper_id*/,
-                         FFConfig::get_hash_id(pcname));
+                         model->config.get_strategy_id(pcname));
   launcher.add_region_requirement(
       RegionRequirement(logit->part, 0/*projection id*/,
                         READ_ONLY, EXCLUSIVE, logit->region));
@@ -0,0 +1,460 @@
+/* Copyright 2020 Stanford
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "model.h"
+#include "cpu_helper.h"
+#include <vector>
+
+// Scores are computed for ATTN_BLOCK queries against ATTN_BLOCK keys at a
+// time with an online softmax, so memory grows linearly with the sequence
+// lengths instead of materializing the qoSeqLength x kvSeqLength matrix
+const int ATTN_BLOCK = 64;
+// Same smScaler as the cuDNN attention descriptor
+const float ATTN_SM_SCALER = 1.0f;
+
+// The weight region is used as the flat cuDNN weight buffer: the Wq of
+// all heads, then Wk, Wv and Wo, as cudnnGetMultiHeadAttnWeights exposes
+// them. Each head's matrix is row-major Wq (qProjSize x qSize),
+// Wk (kProjSize x kSize), Wv (vProjSize x vSize) or Wo (oProjSize x
+// vProjSize); the cuDNN init task asserts that this layout holds, so
+// weights can move between CPU and GPU placements
+struct AttentionShape {
+  int num_samples, num_heads;
+  int q_size, k_size, v_size, proj_size, v_proj_size, o_proj_size;
+  int qo_len, kv_len;
+  size_t wq_off, wk_off, wv_off, wo_off, weight_size;
+  size_t wq_size, wk_size, wv_size, wo_size;
+  size_t wq(int h) const { return wq_off + h * wq_size; }
+  size_t wk(int h) const { return wk_off + h * wk_size; }
+  size_t wv(int h) const { return wv_off + h * wv_size; }
+  size_t wo(int h) const { return wo_off + h * wo_size; }
+};
+
+static AttentionShape get_attention_shape(const MultiHeadAttention* attn,
+                                          int num_samples, int num_heads)
+{
+  AttentionShape s;
+  s.num_samples = num_samples;
+  s.num_heads = num_heads;
+  s.q_size = attn->qSize;
+  s.k_size = attn->kSize;
+  s.v_size = attn->vSize;
+  assert(attn->qProjSize == attn->kProjSize);
+  assert(attn->vProjSize > 0);
+  s.proj_size = attn->qProjSize;
+  s.v_proj_size = attn->vProjSize;
+  s.o_proj_size = attn->oProjSize;
+  s.qo_len = attn->qoSeqLength;
+  s.kv_len = attn->kvSeqLength;
+  s.wq_size = (size_t)s.proj_size * s.q_size;
+  s.wk_size = (size_t)s.proj_size * s.k_size;
+  s.wv_size = (size_t)s.v_proj_size * s.v_size;
+  s.wo_size = (size_t)s.o_proj_size * s.v_proj_size;
+  s.wq_off = 0;
+  s.wk_off = s.wq_off + num_heads * s.wq_size;
+  s.wv_off = s.wk_off + num_heads * s.wk_size;
+  s.wo_off = s.wv_off + num_heads * s.wv_size;
+  s.weight_size = s.wo_off + num_heads * s.wo_size;
+  return s;
+}
+
+// Per-(sample, head) buffers, each stored row-major per sequence position
+struct AttentionBuffers {
+  std::vector<float> q, k, v, o, lse;
+  AttentionBuffers(const AttentionShape& s)
+  : q((size_t)s.num_samples * s.num_heads * s.qo_len * s.proj_size),
+    k((size_t)s.num_samples * s.num_heads * s.kv_len * s.proj_size),
+    v((size_t)s.num_samples * s.num_heads * s.kv_len * s.v_proj_size),
+    o((size_t)s.num_samples * s.num_heads * s.qo_len * s.v_proj_size),
+    lse((size_t)s.num_samples * s.num_heads * s.qo_len) {}
+};
+
+// Q/K/V projections of every (sample, head) pair
+static void attention_project_cpu(const AttentionShape& s,
+                                  const float* query, const float* key,
+                                  const float* value, const float* weight,
+                                  AttentionBuffers& buf)
+{
+  int P = s.proj_size, PV = s.v_proj_size;
+  CPU_PARALLEL_FOR
+  for (int nh = 0; nh < s.num_samples * s.num_heads; nh++) {
+    int n = nh / s.num_heads, h = nh % s.num_heads;
+    cpu_sgemm(true, false, P, s.qo_len, s.q_size, 1.0f,
+              weight + s.wq(h), s.q_size,
+              query + (size_t)n * s.qo_len * s.q_size, s.q_size,
+              0.0f, &buf.q[(size_t)nh * s.qo_len * P], P);
+    cpu_sgemm(true, false, P, s.kv_len, s.k_size, 1.0f,
+              weight + s.wk(h), s.k_size,
+              key + (size_t)n * s.kv_len * s.k_size, s.k_size,
+              0.0f, &buf.k[(size_t)nh * s.kv_len * P], P);
+    cpu_sgemm(true, false, PV, s.kv_len, s.v_size, 1.0f,
+              weight + s.wv(h), s.v_size,
+              value + (size_t)n * s.kv_len * s.v_size, s.v_size,
+              0.0f, &buf.v[(size_t)nh * s.kv_len * PV], PV);
+  }
+}
+
+// o = softmax(scaler * q * k^T) * v for one block of queries, keeping
+// a running maximum and sum per row; lse receives the log-sum-exp of
+// every row for the backward pass
+static void attention_block_forward(const AttentionShape& s, int bq,
+                                    const float* q, const float* k,
+                                    const float* v, float* o, float* lse,
+                                    float* scores)
+{
+  int P = s.proj_size, PV = s.v_proj_size;
+  float row_max[ATTN_BLOCK], row_sum[ATTN_BLOCK];
+  for (int i = 0; i < bq; i++) {
+    row_max[i] = -INFINITY;
+    row_sum[i] = 0.0f;
+  }
+  cpu_assign(o, (coord_t)bq * PV, 0.0f);
+  for (int j0 = 0; j0 < s.kv_len; j0 += ATTN_BLOCK) {
+    int bk = std::min(ATTN_BLOCK, s.kv_len - j0);
+    // scores is row-major bq x bk
+    cpu_sgemm(true, false, bk, bq, P, ATTN_SM_SCALER,
+              k + (size_t)j0 * P, P, q, P, 0.0f, scores, bk);
+    for (int i = 0; i < bq; i++) {
+      float* row = scores + i * bk;
+      float new_max = row_max[i];
+      for (int j = 0; j < bk; j++)
+        new_max = std::max(new_max, row[j]);
+      float sum = 0.0f;
+      CPU_SIMD_REDUCTION(+:sum)
+      for (int j = 0; j < bk; j++) {
+        row[j] = cpu_exp(row[j] - new_max);
+        sum += row[j];
+      }
+      float correction = cpu_exp(row_max[i] - new_max);
+      row_sum[i] = row_sum[i] * correction + sum;
+      row_max[i] = new_max;
+      cpu_scale(o + i * PV, PV, correction);
+    }
+    cpu_sgemm(false, false, PV, bq, bk, 1.0f, v + (size_t)j0 * PV, PV,
+              scores, bk, 1.0f, o, PV);
+  }
+  for (int i = 0; i < bq; i++) {
+    cpu_scale(o + i * PV, PV, 1.0f / row_sum[i]);
+    lse[i] = row_max[i] + std::log(row_sum[i]);
+  }
+}
+
+// Projections and per-head attention outputs o, plus their lse
+static void attention_heads_forward_cpu(const AttentionShape& s,
+                                        const float* query, const float* key,
+                                        const float* value,
+                                        const float* weight,
+                                        AttentionBuffers& buf)
+{
+  int P = s.proj_size, PV = s.v_proj_size;
+  attention_project_cpu(s, query, key, value, weight, buf);
+  int num_q_blocks = (s.qo_len + ATTN_BLOCK - 1) / ATTN_BLOCK;
+  int num_blocks = s.num_samples * s.num_heads * num_q_blocks;
+  CPU_PARALLEL
+  {
+    std::vector<float> scores(ATTN_BLOCK * ATTN_BLOCK);
+    CPU_FOR
+    for (int t = 0; t < num_blocks; t++) {
+      int nh = t / num_q_blocks;
+      int i0 = (t % num_q_blocks) * ATTN_BLOCK;
+      int bq = std::min(ATTN_BLOCK, s.qo_len - i0);
+      size_t row = (size_t)nh * s.qo_len + i0;
+      attention_block_forward(s, bq, &buf.q[row * P],
+                              &buf.k[(size_t)nh * s.kv_len * P],
+                              &buf.v[(size_t)nh * s.kv_len * PV],
+                              &buf.o[row * PV], &buf.lse[row],
+                              scores.data());
+    }
+  }
+}
+
+static void attention_forward_cpu(const AttentionShape& s,
+                                  const float* query, const float* key,
+                                  const float* value, const float* weight,
+                                  AttentionBuffers& buf, float* output)
+{
+  int PV = s.v_proj_size;
+  attention_heads_forward_cpu(s, query, key, value, weight, buf);
+  // Output projection, summed over heads
+  CPU_PARALLEL_FOR
+  for (int n = 0; n < s.num_samples; n++)
+    for (int h = 0; h < s.num_heads; h++)
+      cpu_sgemm(true, false, s.o_proj_size, s.qo_len, PV, 1.0f,
+                weight + s.wo(h), PV,
+                &buf.o[((size_t)n * s.num_heads + h) * s.qo_len * PV], PV,
+                h == 0 ? 0.0f : 1.0f,
+                output + (size_t)n * s.qo_len * s.o_proj_size, s.o_proj_size);
+}
+
+// Gradients of one (sample, head) pair with respect to its projected
+// q, k and v, recomputing each block of probabilities from lse
+static void attention_head_backward(const AttentionShape& s,
+                                    const float* q, const float* k,
+                                    const float* v, const float* o,
+                                    const float* lse, const float* o_grad,
+                                    float* q_grad, float* k_grad,
+                                    float* v_grad, float* probs,
+                                    float* probs_grad)
+{
+  int P = s.proj_size, PV = s.v_proj_size;
+  for (int i0 = 0; i0 < s.qo_len; i0 += ATTN_BLOCK) {
+    int bq = std::min(ATTN_BLOCK, s.qo_len - i0);
+    const float* qb = q + (size_t)i0 * P;
+    const float* dob = o_grad + (size_t)i0 * PV;
+    float* dqb = q_grad + (size_t)i0 * P;
+    // delta_i = sum_p o_grad[i][p] * o[i][p]
+    float delta[ATTN_BLOCK];
+    for (int i = 0; i < bq; i++) {
+      float d = 0.0f;
+      const float* oi = o + (size_t)(i0 + i) * PV;
+      const float* doi = dob + (size_t)i * PV;
+      CPU_SIMD_REDUCTION(+:d)
+      for (int p = 0; p < PV; p++)
+        d += oi[p] * doi[p];
+      delta[i] = d;
+    }
+    for (int j0 = 0; j0 < s.kv_len; j0 += ATTN_BLOCK) {
+      int bk = std::min(ATTN_BLOCK, s.kv_len - j0);
+      const float* kb = k + (size_t)j0 * P;
+      const float* vb = v + (size_t)j0 * PV;
+      cpu_sgemm(true, false, bk, bq, P, ATTN_SM_SCALER, kb, P, qb, P,
+                0.0f, probs, bk);
+      for (int i = 0; i < bq; i++) {
+        float* row = probs + i * bk;
+        float l = lse[i0 + i];
+        CPU_SIMD
+        for (int j = 0; j < bk; j++)
+          row[j] = cpu_exp(row[j] - l);
+      }
+      // v_grad += probs^T * o_grad
+      cpu_sgemm(false, true, PV, bk, bq, 1.0f, dob, PV, probs, bk,
+                1.0f, v_grad + (size_t)j0 * PV, PV);
+      // probs_grad = o_grad * v^T
+      cpu_sgemm(true, false, bk, bq, PV, 1.0f, vb, PV, dob, PV,
+                0.0f, probs_grad, bk);
+      // Softmax backward, folding in the scaler of the scores
+      for (int i = 0; i < bq; i++) {
+        float* row = probs_grad + i * bk;
+        const float* p_row = probs + i * bk;
+        CPU_SIMD
+        for (int j = 0; j < bk; j++)
+          row[j] = p_row[j] * (row[j] - delta[i]) * ATTN_SM_SCALER;
+      }
+      // q_grad += scores_grad * k, k_grad += scores_grad^T * q
+      cpu_sgemm(false, false, P, bq, bk, 1.0f, kb, P, probs_grad, bk,
+                1.0f, dqb, P);
+      cpu_sgemm(false, true, P, bk, bq, 1.0f, qb, P, probs_grad, bk,
+                1.0f, k_grad + (size_t)j0 * P, P);
+    }
+  }
+}
+
+// Accumulates into the input and weight gradients. The input gradients
+// may alias each other when query, key and value are the same tensor
+static void attention_backward_cpu(const AttentionShape& s,
+                                   const float* query, const float* key,
+                                   const float* value, const float* weight,
+                                   const float* output_grad,
+                                   float* query_grad, float* key_grad,
+                                   float* value_grad, float* weight_grad)
+{
+  int P = s.proj_size, PV = s.v_proj_size;
+  int num_pairs = s.num_samples * s.num_heads;
+  AttentionBuffers buf(s);
+  std::vector<float> o_grad(buf.o.size()), q_grad(buf.q.size());
+  std::vector<float> k_grad(buf.k.size()), v_grad(buf.v.size());
+  // The forward pass is recomputed rather than kept in the meta
+  attention_heads_forward_cpu(s, query, key, value, weight, buf);
+  // Gradients of the per-head attention outputs
+  CPU_PARALLEL_FOR
+  for (int nh = 0; nh < num_pairs; nh++) {
+    int n = nh / s.num_heads, h = nh % s.num_heads;
+    cpu_sgemm(false, false, PV, s.qo_len, s.o_proj_size, 1.0f,
+              weight + s.wo(h), PV,
+              output_grad + (size_t)n * s.qo_len * s.o_proj_size,
+              s.o_proj_size, 0.0f, &o_grad[(size_t)nh * s.qo_len * PV], PV);
+  }
+  CPU_PARALLEL
+  {
+    std::vector<float> probs(ATTN_BLOCK * ATTN_BLOCK);
+    std::vector<float> probs_grad(ATTN_BLOCK * ATTN_BLOCK);
+    CPU_FOR
+    for (int nh = 0; nh < num_pairs; nh++) {
+      size_t qo = (size_t)nh * s.qo_len, kv = (size_t)nh * s.kv_len;
+      attention_head_backward(s, &buf.q[qo * P], &buf.k[kv * P],
+                              &buf.v[kv * PV], &buf.o[qo * PV],
+                              &buf.lse[qo], &o_grad[qo * PV],
+                              &q_grad[qo * P], &k_grad[kv * P],
+                              &v_grad[kv * PV], probs.data(),
+                              probs_grad.data());
+    }
+  }
+  // Weight gradients: each head owns its matrices, summed over samples
+  CPU_PARALLEL_FOR
+  for (int h = 0; h < s.num_heads; h++) {
+    for (int n = 0; n < s.num_samples; n++) {
+      size_t nh = (size_t)n * s.num_heads + h;
+      size_t qo = nh * s.qo_len, kv = nh * s.kv_len;
+      cpu_sgemm(false, true, s.q_size, P, s.qo_len, 1.0f,
+                query + (size_t)n * s.qo_len * s.q_size, s.q_size,
+                &q_grad[qo * P], P, 1.0f, weight_grad + s.wq(h), s.q_size);
+      cpu_sgemm(false, true, s.k_size, P, s.kv_len, 1.0f,
+                key + (size_t)n * s.kv_len * s.k_size, s.k_size,
+                &k_grad[kv * P], P, 1.0f, weight_grad + s.wk(h), s.k_size);
+      cpu_sgemm(false, true, s.v_size, PV, s.kv_len, 1.0f,
+                value + (size_t)n * s.kv_len * s.v_size, s.v_size,
+                &v_grad[kv * PV], PV, 1.0f, weight_grad + s.wv(h), s.v_size);
+      cpu_sgemm(false, true, PV, s.o_proj_size, s.qo_len, 1.0f,
+                &buf.o[qo * PV], PV,
+                output_grad + (size_t)n * s.qo_len * s.o_proj_size,
+                s.o_proj_size, 1.0f, weight_grad + s.wo(h), PV);
+    }
+  }
+  // Input gradients: each sample owns its rows, summed over heads
+  CPU_PARALLEL_FOR
+  for (int n = 0; n < s.num_samples; n++) {
+    for (int h = 0; h < s.num_heads; h++) {
+      size_t nh = (size_t)n * s.num_heads + h;
+      size_t qo = nh * s.qo_len, kv = nh * s.kv_len;
+      cpu_sgemm(false, false, s.q_size, s.qo_len, P, 1.0f,
+                weight + s.wq(h), s.q_size, &q_grad[qo * P], P, 1.0f,
+                query_grad + (size_t)n * s.qo_len * s.q_size, s.q_size);
+      cpu_sgemm(false, false, s.k_size, s.kv_len, P, 1.0f,
+                weight + s.wk(h), s.k_size, &k_grad[kv * P], P, 1.0f,
+                key_grad + (size_t)n * s.kv_len * s.k_size, s.k_size);
+      cpu_sgemm(false, false, s.v_size, s.kv_len, PV, 1.0f,
+                weight + s.wv(h), s.v_size, &v_grad[kv * PV], PV, 1.0f,
+                value_grad + (size_t)n * s.kv_len * s.v_size, s.v_size);
+    }
+  }
+}
+
+OpMeta* MultiHeadAttention::init_task_cpu(
+    const Task *task,
+    const std::vector<PhysicalRegion> &regions,
+    Context ctx, Runtime* runtime)
+{
+  // CPU kernels keep no per-processor state
+  return NULL;
+}
+
+/*
+  regions[0](I): query
+  regions[1](I): key
+  regions[2](I): value
+  regions[3](I): weight
+  regions[4](O): output
+*/
+void MultiHeadAttention::forward_task_cpu(
+    const Task *task,
+    const std::vector<PhysicalRegion> &regions,
+    Context ctx, Runtime* runtime)
+{
+  assert(regions.size() == 5);
+  assert(task->regions.size() == regions.size());
+  const MultiHeadAttention* attn = (MultiHeadAttention*) task->args;
+  TensorAccessorR<float, 3> acc_query(
+      regions[0], task->regions[0], FID_DATA, ctx, runtime);
+  TensorAccessorR<float, 3> acc_key(
+      regions[1], task->regions[1], FID_DATA, ctx, runtime);
+  TensorAccessorR<float, 3> acc_value(
+      regions[2], task->regions[2], FID_DATA, ctx, runtime);
+  TensorAccessorR<float, 2> acc_weight(
+      regions[3], task->regions[3], FID_DATA, ctx, runtime);
+  TensorAccessorW<float, 3> acc_output(
+      regions[4], task->regions[4], FID_DATA, ctx, runtime,
+      false/*readOutput*/);
+  int num_samples = acc_query.rect.hi[2] - acc_query.rect.lo[2] + 1;
+  int num_heads = acc_weight.rect.hi[1] - acc_weight.rect.lo[1] + 1;
+  AttentionShape s = get_attention_shape(attn, num_samples, num_heads);
+  assert(acc_weight.rect.volume() == s.weight_size);
+  assert(acc_output.rect.volume()
+         == (size_t)num_samples * s.qo_len * s.o_proj_size);
+  AttentionBuffers buf(s);
+  attention_forward_cpu(s, acc_query.ptr, acc_key.ptr, acc_value.ptr,
+                        acc_weight.ptr, buf, acc_output.ptr);
+}
+
+/*
+  regions[0](I): query
+  regions[1](I): key
+  regions[2](I): value
+  regions[3](I): weight
+  regions[4](I): output_grad
+  regions[5](I/O): weight_grad
+  regions[6](I/O): query_grad
+  regions[7](I/O) (optional): key_grad
+  regions[8](I/O) (optional): value_grad
+*/
+void MultiHeadAttention::backward_task_cpu(
+    const Task *task,
+    const std::vector<PhysicalRegion> &regions,
+    Context ctx, Runtime* runtime)
+{
+  assert(regions.size() >= 7);
+  assert(task->regions.size() == regions.size());
+  const MultiHeadAttention* attn = (MultiHeadAttention*) task->args;
+  TensorAccessorR<float, 3> acc_query(
+      regions[0], task->regions[0], FID_DATA, ctx, runtime);
+  TensorAccessorR<float, 3> acc_key(
+      regions[1], task->regions[1], FID_DATA, ctx, runtime);
+  TensorAccessorR<float, 3> acc_value(
+      regions[2], task->regions[2], FID_DATA, ctx, runtime);
+  TensorAccessorR<float, 2> acc_weight(
+      regions[3], task->regions[3], FID_DATA, ctx, runtime);
+  TensorAccessorR<float, 3> acc_output_grad(
+      regions[4], task->regions[4], FID_DATA, ctx, runtime);
+  TensorAccessorW<float, 2> acc_weight_grad(
+      regions[5], task->regions[5], FID_DATA, ctx, runtime,
+      true/*readOutput*/);
+  TensorAccessorW<float, 3> acc_query_grad(
+      regions[6], task->regions[6], FID_DATA, ctx, runtime,
+      true/*readOutput*/);
+  assert(acc_query_grad.rect == acc_query.rect);
+  assert(acc_weight_grad.rect == acc_weight.rect);
+  // key_grad and value_grad only have their own regions when key and
+  // value are different tensors from the ones before them
+  int next_region = 7;
+  float* key_grad_ptr = acc_query_grad.ptr;
+  if (regions[1].get_logical_region() != regions[0].get_logical_region()) {
+    TensorAccessorW<float, 3> acc_key_grad(
+        regions[next_region], task->regions[next_region], FID_DATA, ctx,
+        runtime, true/*readOutput*/);
+    assert(acc_key_grad.rect == acc_key.rect);
+    key_grad_ptr = acc_key_grad.ptr;
+    next_region++;
+  }
+  float* value_grad_ptr = acc_query_grad.ptr;
+  if (regions[2].get_logical_region() == regions[1].get_logical_region()) {
+    value_grad_ptr = key_grad_ptr;
+  } else if (regions[2].get_logical_region()
+             != regions[0].get_logical_region()) {
+    TensorAccessorW<float, 3> acc_value_grad(
+        regions[next_region], task->regions[next_region], FID_DATA, ctx,
+        runtime, true/*readOutput*/);
+    assert(acc_value_grad.rect == acc_value.rect);
+    value_grad_ptr = acc_value_grad.ptr;
+    next_region++;
+  }
+  assert(next_region == (int)regions.size());
+  int num_samples = acc_query.rect.hi[2] - acc_query.rect.lo[2] + 1;
+  int num_heads = acc_weight.rect.hi[1] - acc_weight.rect.lo[1] + 1;
+  AttentionShape s = get_attention_shape(attn, num_samples, num_heads);
+  assert(acc_weight.rect.volume() == s.weight_size);
+  attention_backward_cpu(s, acc_query.ptr, acc_key.ptr, acc_value.ptr,
+                         acc_weight.ptr, acc_output_grad.ptr,
+                         acc_query_grad.ptr, key_grad_ptr, value_grad_ptr,
+                         acc_weight_grad.ptr);
+}
@@ -128,6 +128,31 @@ void MultiHeadAttention::create_output_and_partition(FFModel& model)
   }
 }
 
+// Asserts that cuDNN stores the weights of `kind` at `offset` floats into
+// the buffer as num_heads row-major rows x cols matrices, which is the
+// layout the CPU variants assume
+static void check_weight_layout(const MultiHeadAttentionMeta* m,
+                                const float* weight_ptr,
+                                cudnnMultiHeadAttnWeightKind_t kind,
+                                size_t offset, int num_heads,
+                                int rows, int cols)
+{
+  cudnnTensorDescriptor_t wDesc;
+  checkCUDNN(cudnnCreateTensorDescriptor(&wDesc));
+  void* wAddr = NULL;
+  checkCUDNN(cudnnGetMultiHeadAttnWeights(m->handle.dnn, m->attnDesc, kind,
+      m->weightSize, weight_ptr, wDesc, &wAddr));
+  cudnnDataType_t dataType;
+  int nbDims, dimA[3], strideA[3];
+  checkCUDNN(cudnnGetTensorNdDescriptor(wDesc, 3, &dataType, &nbDims,
+      dimA, strideA));
+  assert((const float*)wAddr == weight_ptr + offset);
+  assert(nbDims == 3);
+  assert(dimA[0] == num_heads && dimA[1] == rows && dimA[2] == cols);
+  assert(strideA[0] == rows * cols && strideA[1] == cols && strideA[2] == 1);
+  checkCUDNN(cudnnDestroyTensorDescriptor(wDesc));
+}
+
 /*
   regions[0](I): query
   regions[1](I): key
@@ -172,6 +197,20 @@ OpMeta* MultiHeadAttention::init_task(
   MultiHeadAttentionMeta* m = new MultiHeadAttentionMeta(handle,
       attn, gpu_mem, num_samples, num_heads);
   assert(acc_weight.rect.volume() * sizeof(float) == m->weightSize);
+  // The CPU variants index the same buffer directly (see attention.cc)
+  int vProjSize = attn->vProjSize > 0 ? attn->vProjSize : attn->vSize;
+  size_t qParas = (size_t)num_heads * attn->qProjSize * attn->qSize;
+  size_t kParas = (size_t)num_heads * attn->kProjSize * attn->kSize;
+  size_t vParas = (size_t)num_heads * vProjSize * attn->vSize;
+  check_weight_layout(m, acc_weight.ptr, CUDNN_MH_ATTN_Q_WEIGHTS, 0,
+                      num_heads, attn->qProjSize, attn->qSize);
+  check_weight_layout(m, acc_weight.ptr, CUDNN_MH_ATTN_K_WEIGHTS, qParas,
+                      num_heads, attn->kProjSize, attn->kSize);
+  check_weight_layout(m, acc_weight.ptr, CUDNN_MH_ATTN_V_WEIGHTS,
+                      qParas + kParas, num_heads, vProjSize, attn->vSize);
+  check_weight_layout(m, acc_weight.ptr, CUDNN_MH_ATTN_O_WEIGHTS,
+                      qParas + kParas + vParas, num_heads,
+                      attn->oProjSize, vProjSize);
   return m;
 }
 
@@ -192,7 +231,7 @@ void MultiHeadAttention::init(const FFModel& ff)
   IndexLauncher launcher(ATTENTION_INIT_TASK_ID, task_is,
       TaskArgument(this, sizeof(MultiHeadAttention)), argmap,
       Predicate::TRUE_PRED, false/*must*/, 0/*mapper_id*/,
-      FFConfig::get_hash_id(std::string(name)));
+      ff.config.get_strategy_id(std::string(name)));
   launcher.add_region_requirement(
       RegionRequirement(input_lps[0], 0/*projection id*/,
           READ_ONLY, EXCLUSIVE, inputs[0].region));
@@ -306,7 +345,7 @@ void MultiHeadAttention::forward(const FFModel& ff)
   IndexLauncher launcher(ATTENTION_FWD_TASK_ID, task_is,
       TaskArgument(this, sizeof(MultiHeadAttention)), argmap,
       Predicate::TRUE_PRED, false/*must*/, 0/*mapper_id*/,
-      FFConfig::get_hash_id(std::string(name)));
+      ff.config.get_strategy_id(std::string(name)));
   launcher.add_region_requirement(
       RegionRequirement(input_lps[0], 0/*projection id*/,
           READ_ONLY, EXCLUSIVE, inputs[0].region));
@@ -467,7 +506,7 @@ void MultiHeadAttention::backward(const FFModel& ff)
   IndexLauncher launcher(ATTENTION_BWD_TASK_ID, task_is,
       TaskArgument(this, sizeof(MultiHeadAttention)), argmap,
       Predicate::TRUE_PRED, false/*must*/, 0/*mapper_id*/,
-      FFConfig::get_hash_id(std::string(name)));
+      ff.config.get_strategy_id(std::string(name)));
   launcher.add_region_requirement(
       RegionRequirement(input_lps[0], 0/*projection id*/,
           READ_ONLY, EXCLUSIVE, inputs[0].region));
@@ -496,7 +535,7 @@ void MultiHeadAttention::backward(const FFModel& ff)
       RegionRequirement(input_grad_lps[0], 0/*projection id*/,
           READ_WRITE, EXCLUSIVE, inputs[0].region_grad));
   launcher.add_field(6, FID_DATA);
-  int num_regions = 6;
+  int num_regions = 7;
   if (inputs[1].region != inputs[0].region) {
     // when key != query
     launcher.add_region_requirement(
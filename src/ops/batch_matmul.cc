@@ -0,0 +1,130 @@
+/* Copyright 2020 Stanford
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "model.h"
+#include "cpu_helper.h"
+
+// Returns m, n, k and batch as in BatchMatmul::forward_task
+static void get_batch_matmul_shape(const Domain& out_domain,
+                                   const Domain& a_domain,
+                                   const Domain& b_domain,
+                                   int& m, int& n, int& k, int& batch)
+{
+  m = b_domain.hi()[0] - b_domain.lo()[0] + 1;
+  assert(m == out_domain.hi()[0] - out_domain.lo()[0] + 1);
+  n = a_domain.hi()[1] - a_domain.lo()[1] + 1;
+  assert(n == out_domain.hi()[1] - out_domain.lo()[1] + 1);
+  k = a_domain.hi()[0] - a_domain.lo()[0] + 1;
+  assert(k == b_domain.hi()[1] - b_domain.lo()[1] + 1);
+  assert(a_domain.get_dim() == b_domain.get_dim());
+  assert(a_domain.get_dim() == out_domain.get_dim());
+  batch = 1;
+  for (int i = 2; i < a_domain.get_dim(); i++) {
+    int dim_size = a_domain.hi()[i] - a_domain.lo()[i] + 1;
+    assert(dim_size == b_domain.hi()[i] - b_domain.lo()[i] + 1);
+    assert(dim_size == out_domain.hi()[i] - out_domain.lo()[i] + 1);
+    batch *= dim_size;
+  }
+}
+
+OpMeta* BatchMatmul::init_task_cpu(const Task* task,
+                                   const std::vector<PhysicalRegion>& regions,
+                                   Context ctx, Runtime* runtime)
+{
+  // CPU kernels keep no per-processor state
+  return NULL;
+}
+
+/*
+  regions[0](O): output
+  regions[1](I): A
+  regions[2](I): B
+  output = A * B
+*/
+void BatchMatmul::forward_task_cpu(const Task* task,
+                                   const std::vector<PhysicalRegion>& regions,
+                                   Context ctx, Runtime* runtime)
+{
+  assert(regions.size() == 3);
+  assert(task->regions.size() == 3);
+  Domain out_domain = runtime->get_index_space_domain(
+    ctx, task->regions[0].region.get_index_space());
+  Domain a_domain = runtime->get_index_space_domain(
+    ctx, task->regions[1].region.get_index_space());
+  Domain b_domain = runtime->get_index_space_domain(
+    ctx, task->regions[2].region.get_index_space());
+  int m, n, k, batch;
+  get_batch_matmul_shape(out_domain, a_domain, b_domain, m, n, k, batch);
+  float* out_ptr = helperGetTensorPointerWO<float>(
+    regions[0], task->regions[0], FID_DATA, ctx, runtime);
+  const float* a_ptr = helperGetTensorPointerRO<float>(
+    regions[1], task->regions[1], FID_DATA, ctx, runtime);
+  const float* b_ptr = helperGetTensorPointerRO<float>(
+    regions[2], task->regions[2], FID_DATA, ctx, runtime);
+  // Same column-major formulation as BatchMatmul::forward_kernel
+  cpu_sgemm_strided_batched(false, false, m, n, k, 1.0f,
+      b_ptr, m, (coord_t)m * k, a_ptr, k, (coord_t)n * k,
+      0.0f, out_ptr, m, (coord_t)n * m, batch);
+}
+
+/*
+  regions[0](I): output
+  regions[1](I): output_grad
+  regions[2](I): A
+  regions[3](I/O): A_grad
+  regions[4](I): B
+  regions[5](I/O): B_grad
+*/
+void BatchMatmul::backward_task_cpu(const Task* task,
+                                    const std::vector<PhysicalRegion>& regions,
+                                    Context ctx, Runtime* runtime)
+{
+  assert(regions.size() == 6);
+  assert(task->regions.size() == 6);
+  Domain out_domain = runtime->get_index_space_domain(
+    ctx, task->regions[0].region.get_index_space());
+  Domain out_grad_domain = runtime->get_index_space_domain(
+    ctx, task->regions[1].region.get_index_space());
+  assert(out_domain == out_grad_domain);
+  Domain a_domain = runtime->get_index_space_domain(
+    ctx, task->regions[2].region.get_index_space());
+  Domain a_grad_domain = runtime->get_index_space_domain(
+    ctx, task->regions[3].region.get_index_space());
+  assert(a_domain == a_grad_domain);
+  Domain b_domain = runtime->get_index_space_domain(
+    ctx, task->regions[4].region.get_index_space());
+  Domain b_grad_domain = runtime->get_index_space_domain(
+    ctx, task->regions[5].region.get_index_space());
+  assert(b_domain == b_grad_domain);
+  int m, n, k, batch;
+  get_batch_matmul_shape(out_domain, a_domain, b_domain, m, n, k, batch);
+  const float* out_grad_ptr = helperGetTensorPointerRO<float>(
+    regions[1], task->regions[1], FID_DATA, ctx, runtime);
+  const float* a_ptr = helperGetTensorPointerRO<float>(
+    regions[2], task->regions[2], FID_DATA, ctx, runtime);
+  float* a_grad_ptr = helperGetTensorPointerRW<float>(
+    regions[3], task->regions[3], FID_DATA, ctx, runtime);
+  const float* b_ptr = helperGetTensorPointerRO<float>(
+    regions[4], task->regions[4], FID_DATA, ctx, runtime);
+  float* b_grad_ptr = helperGetTensorPointerRW<float>(
+    regions[5], task->regions[5], FID_DATA, ctx, runtime);
+  // AGrad += OGrad * B^T and BGrad += A^T * OGrad
+  cpu_sgemm_strided_batched(true, false, k, n, m, 1.0f,
+      b_ptr, m, (coord_t)m * k, out_grad_ptr, m, (coord_t)n * m,
+      1.0f, a_grad_ptr, k, (coord_t)n * k, batch);
+  cpu_sgemm_strided_batched(false, true, m, k, n, 1.0f,
+      out_grad_ptr, m, (coord_t)n * m, a_ptr, k, (coord_t)n * k,
+      1.0f, b_grad_ptr, m, (coord_t)m * k, batch);
+}
@@ -152,7 +152,7 @@ void BatchMatmul::init_with_dim(const FFModel& ff)
   IndexLauncher launcher(BATCHMATMUL_INIT_TASK_ID, task_is,
                          TaskArgument(this, sizeof(BatchMatmul)), argmap,
                          Predicate::TRUE_PRED, false/*must*/, 0/*mapper_id*/,
-                         FFConfig::get_hash_id(std::string(name)));
+                         ff.config.get_strategy_id(std::string(name)));
   launcher.add_region_requirement(
     RegionRequirement(outputs[0].part, 0/*projection id*/,
       WRITE_ONLY, EXCLUSIVE, outputs[0].region));
@@ -304,7 +304,7 @@ void BatchMatmul::forward_with_dim(const FFModel& ff)
   IndexLauncher launcher(BATCHMATMUL_FWD_TASK_ID, task_is,
                          TaskArgument(this, sizeof(BatchMatmul)), argmap,
                          Predicate::TRUE_PRED, false/*must*/, 0/*mapper_id*/,
-                         FFConfig::get_hash_id(std::string(name)));
+                         ff.config.get_strategy_id(std::string(name)));
   launcher.add_region_requirement(
     RegionRequirement(outputs[0].part, 0/*projection id*/,
       WRITE_ONLY, EXCLUSIVE, outputs[0].region));
@@ -482,7 +482,7 @@ void BatchMatmul::backward_with_dim(const FFModel& ff)
   IndexLauncher launcher(BATCHMATMUL_BWD_TASK_ID, task_is,
                          TaskArgument(this, sizeof(BatchMatmul)), argmap,
                          Predicate::TRUE_PRED, false/*must*/, 0/*mapper_id*/,
-                         FFConfig::get_hash_id(std::string(name)));
+                         ff.config.get_strategy_id(std::string(name)));
   // regions[0](I): output
   launcher.add_region_requirement(
     RegionRequirement(outputs[0].part, 0/*projection id*/,
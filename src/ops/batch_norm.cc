@@ -0,0 +1,322 @@
+/* Copyright 2020 Stanford
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "model.h"
+#include "cpu_helper.h"
+
+// Same epsilon as CUDNN_BN_MIN_EPSILON in the cuDNN variants
+#define BN_CPU_EPSILON 1e-5
+// Weight of the current batch in the running statistics
+#define BN_CPU_MOMENTUM 0.1f
+
+struct BatchNormShape {
+  int num_samples, num_channels, plane_size;
+};
+
+static BatchNormShape get_batch_norm_shape(const Rect<4>& rect)
+{
+  BatchNormShape s;
+  s.plane_size = (rect.hi[0] - rect.lo[0] + 1) * (rect.hi[1] - rect.lo[1] + 1);
+  s.num_channels = rect.hi[2] - rect.lo[2] + 1;
+  s.num_samples = rect.hi[3] - rect.lo[3] + 1;
+  return s;
+}
+
+BatchNormCPUMeta::BatchNormCPUMeta(FFHandler handle, int num_channels)
+: OpMeta(handle), numChannels(num_channels)
+{
+  runningMean = new float[numChannels];
+  runningVar = new float[numChannels];
+  saveMean = new float[numChannels];
+  saveInvStd = new float[numChannels];
+  cpu_assign(runningMean, numChannels, 0.0f);
+  cpu_assign(runningVar, numChannels, 1.0f);
+  cpu_assign(saveMean, numChannels, 0.0f);
+  cpu_assign(saveInvStd, numChannels, 1.0f);
+}
+
+BatchNormCPUMeta::~BatchNormCPUMeta(void)
+{
+  delete[] runningMean;
+  delete[] runningVar;
+  delete[] saveMean;
+  delete[] saveInvStd;
+}
+
+// Mean and biased variance of channel c in one pass over the input.
+// Each HxW plane is reduced with shifted sums, which vectorize, and the
+// per-plane moments are merged with Welford's parallel update
+static void batch_norm_channel_stats(const BatchNormShape& s, int c,
+                                     const float* input,
+                                     double& mean, double& var)
+{
+  double count = 0.0, m2 = 0.0;
+  mean = 0.0;
+  for (int n = 0; n < s.num_samples; n++) {
+    const float* in = input + ((size_t)n * s.num_channels + c) * s.plane_size;
+    float shift = in[0];
+    double sum = 0.0, sum_sq = 0.0;
+    CPU_SIMD_REDUCTION(+:sum,sum_sq)
+    for (int i = 0; i < s.plane_size; i++) {
+      double d = in[i] - shift;
+      sum += d;
+      sum_sq += d * d;
+    }
+    double plane_count = s.plane_size;
+    double plane_mean = shift + sum / plane_count;
+    double plane_m2 = std::max(sum_sq - sum * sum / plane_count, 0.0);
+    double delta = plane_mean - mean;
+    double total = count + plane_count;
+    mean += delta * plane_count / total;
+    m2 += plane_m2 + delta * delta * count * plane_count / total;
+    count = total;
+  }
+  var = m2 / count;
+}
+
+// output = input * scale[c] + shift[c], followed by the optional relu
+static void batch_norm_apply(const BatchNormShape& s, int c,
+                             float scale, float shift, bool relu,
+                             const float* input, float* output)
+{
+  for (int n = 0; n < s.num_samples; n++) {
+    size_t offset = ((size_t)n * s.num_channels + c) * s.plane_size;
+    const float* in = input + offset;
+    float* out = output + offset;
+    if (relu) {
+      CPU_SIMD
+      for (int i = 0; i < s.plane_size; i++)
+        out[i] = std::max(in[i] * scale + shift, 0.0f);
+    } else {
+      CPU_SIMD
+      for (int i = 0; i < s.plane_size; i++)
+        out[i] = in[i] * scale + shift;
+    }
+  }
+}
+
+static void batch_norm_forward_cpu(const BatchNormShape& s,
+                                   BatchNormCPUMeta* m, bool inference,
+                                   const float* input, float* output,
+                                   const float* gamma, const float* beta)
+{
+  double m_count = (double)s.num_samples * s.plane_size;
+  CPU_PARALLEL_FOR
+  for (int c = 0; c < s.num_channels; c++) {
+    float scale, shift;
+    if (inference) {
+      // Fold the running statistics into a single multiply-add
+      scale = gamma[c] / std::sqrt(m->runningVar[c] + BN_CPU_EPSILON);
+      shift = beta[c] - m->runningMean[c] * scale;
+    } else {
+      double mean, var;
+      batch_norm_channel_stats(s, c, input, mean, var);
+      float inv_std = 1.0 / std::sqrt(var + BN_CPU_EPSILON);
+      m->saveMean[c] = mean;
+      m->saveInvStd[c] = inv_std;
+      // Running variance is unbiased, as in cuDNN
+      double unbiased = m_count > 1.0 ? var * m_count / (m_count - 1.0) : var;
+      m->runningMean[c] = (1.0f - BN_CPU_MOMENTUM) * m->runningMean[c]
+                        + BN_CPU_MOMENTUM * mean;
+      m->runningVar[c] = (1.0f - BN_CPU_MOMENTUM) * m->runningVar[c]
+                       + BN_CPU_MOMENTUM * unbiased;
+      scale = gamma[c] * inv_std;
+      shift = beta[c] - mean * scale;
+    }
+    batch_norm_apply(s, c, scale, shift, m->relu, input, output);
+  }
+}
+
+// Accumulates into input_grad, scale_grad and bias_grad using the
+// statistics saved by the last training forward. With relu, the gradient
+// is masked by the (post-relu) output, like reluBackward on the GPU
+static void batch_norm_backward_cpu(const BatchNormShape& s,
+                                    const BatchNormCPUMeta* m,
+                                    const float* input, float* input_grad,
+                                    const float* output,
+                                    const float* output_grad,
+                                    const float* gamma,
+                                    float* gamma_grad, float* beta_grad)
+{
+  float m_count = (float)s.num_samples * s.plane_size;
+  CPU_PARALLEL_FOR
+  for (int c = 0; c < s.num_channels; c++) {
+    float mean = m->saveMean[c];
+    float inv_std = m->saveInvStd[c];
+    double sum_dy = 0.0, sum_dy_xhat = 0.0;
+    for (int n = 0; n < s.num_samples; n++) {
+      size_t offset = ((size_t)n * s.num_channels + c) * s.plane_size;
+      const float* in = input + offset;
+      const float* out = output + offset;
+      const float* dy = output_grad + offset;
+      double plane_dy = 0.0, plane_dy_x = 0.0;
+      if (m->relu) {
+        CPU_SIMD_REDUCTION(+:plane_dy,plane_dy_x)
+        for (int i = 0; i < s.plane_size; i++) {
+          float g = out[i] > 0.0f ? dy[i] : 0.0f;
+          plane_dy += g;
+          plane_dy_x += g * (in[i] - mean);
+        }
+      } else {
+        CPU_SIMD_REDUCTION(+:plane_dy,plane_dy_x)
+        for (int i = 0; i < s.plane_size; i++) {
+          plane_dy += dy[i];
+          plane_dy_x += dy[i] * (in[i] - mean);
+        }
+      }
+      sum_dy += plane_dy;
+      sum_dy_xhat += plane_dy_x * inv_std;
+    }
+    gamma_grad[c] += sum_dy_xhat;
+    beta_grad[c] += sum_dy;
+    // dx = gamma * inv_std * (dy - mean(dy) - xhat * mean(dy * xhat))
+    float k = gamma[c] * inv_std;
+    float mean_dy = sum_dy / m_count;
+    float xhat_coef = sum_dy_xhat / m_count * inv_std;
+    for (int n = 0; n < s.num_samples; n++) {
+      size_t offset = ((size_t)n * s.num_channels + c) * s.plane_size;
+      const float* in = input + offset;
+      const float* out = output + offset;
+      const float* dy = output_grad + offset;
+      float* dx = input_grad + offset;
+      if (m->relu) {
+        CPU_SIMD
+        for (int i = 0; i < s.plane_size; i++) {
+          float g = out[i] > 0.0f ? dy[i] : 0.0f;
+          dx[i] += k * (g - mean_dy - (in[i] - mean) * xhat_coef);
+        }
+      } else {
+        CPU_SIMD
+        for (int i = 0; i < s.plane_size; i++)
+          dx[i] += k * (dy[i] - mean_dy - (in[i] - mean) * xhat_coef);
+      }
+    }
+  }
+}
+
+/*
+  regions[0]: input
+  regions[1]: output
+  regions[2](I): scale
+  regions[3](I): bias
+*/
+OpMeta* BatchNorm::init_task_cpu(const Task *task,
+                                 const std::vector<PhysicalRegion> &regions,
+                                 Context ctx, Runtime *runtime)
+{
+  assert(regions.size() == 4);
+  assert(task->regions.size() == 4);
+  const BatchNorm* bm = (BatchNorm*) task->args;
+  FFHandler handle = *((const FFHandler*) task->local_args);
+  Rect<4> rect = runtime->get_index_space_domain(
+      ctx, task->regions[1].region.get_index_space());
+  BatchNormShape s = get_batch_norm_shape(rect);
+  // Running statistics live with the point task, like the cuDNN buffers
+  BatchNormCPUMeta* m = new BatchNormCPUMeta(handle, s.num_channels);
+  m->relu = bm->relu;
+  return m;
+}
+
+/*
+  task->args: running mean followed by running variance
+*/
+void BatchNorm::set_stats_task_cpu(const Task *task,
+                                   const std::vector<PhysicalRegion> &regions,
+                                   Context ctx, Runtime *runtime)
+{
+  assert(regions.size() == 0);
+  BatchNormCPUMeta* m = *((BatchNormCPUMeta**) task->local_args);
+  const float* stats = (const float*) task->args;
+  assert(task->arglen == 2 * sizeof(float) * m->numChannels);
+  std::copy(stats, stats + m->numChannels, m->runningMean);
+  std::copy(stats + m->numChannels, stats + 2 * m->numChannels, m->runningVar);
+}
+
+/*
+  regions[0](I): input
+  regions[1](O): ouptut
+  regions[2](I): scale
+  regions[3](I): bias
+*/
+void BatchNorm::forward_task_cpu(const Task *task,
+                                 const std::vector<PhysicalRegion> &regions,
+                                 Context ctx, Runtime *runtime)
+{
+  assert(regions.size() == 4);
+  assert(task->regions.size() == 4);
+  const BatchNorm* bm = (BatchNorm*) task->args;
+  BatchNormCPUMeta* m = *((BatchNormCPUMeta**) task->local_args);
+  TensorAccessorR<float, 4> acc_input(
+      regions[0], task->regions[0], FID_DATA, ctx, runtime);
+  TensorAccessorW<float, 4> acc_output(
+      regions[1], task->regions[1], FID_DATA, ctx, runtime,
+      false/*readOutput*/);
+  TensorAccessorR<float, 1> acc_scale(
+      regions[2], task->regions[2], FID_DATA, ctx, runtime);
+  TensorAccessorR<float, 1> acc_bias(
+      regions[3], task->regions[3], FID_DATA, ctx, runtime);
+  assert(acc_input.rect == acc_output.rect);
+  BatchNormShape s = get_batch_norm_shape(acc_output.rect);
+  assert(s.num_channels == m->numChannels);
+  assert(acc_scale.rect.volume() == s.num_channels);
+  assert(acc_bias.rect.volume() == s.num_channels);
+  batch_norm_forward_cpu(s, m, bm->inference, acc_input.ptr, acc_output.ptr,
+                         acc_scale.ptr, acc_bias.ptr);
+}
+
+/*
+  regions[0](I): input
+  regions[1](I/O): input_grad
+  regions[2](I): output
+  regions[3](I): output_grad
+  regions[4](I): scale
+  regions[5](I/O): scale_grad
+  regions[6](I/O): bias_grad
+*/
+void BatchNorm::backward_task_cpu(const Task *task,
+                                  const std::vector<PhysicalRegion> &regions,
+                                  Context ctx, Runtime *runtime)
+{
+  assert(regions.size() == 7);
+  assert(task->regions.size() == 7);
+  const BatchNormCPUMeta* m = *((BatchNormCPUMeta**) task->local_args);
+  TensorAccessorR<float, 4> acc_input(
+      regions[0], task->regions[0], FID_DATA, ctx, runtime);
+  TensorAccessorW<float, 4> acc_input_grad(
+      regions[1], task->regions[1], FID_DATA, ctx, runtime,
+      true/*readOutput*/);
+  TensorAccessorR<float, 4> acc_output(
+      regions[2], task->regions[2], FID_DATA, ctx, runtime);
+  TensorAccessorR<float, 4> acc_output_grad(
+      regions[3], task->regions[3], FID_DATA, ctx, runtime);
+  TensorAccessorR<float, 1> acc_scale(
+      regions[4], task->regions[4], FID_DATA, ctx, runtime);
+  TensorAccessorW<float, 1> acc_scale_grad(
+      regions[5], task->regions[5], FID_DATA, ctx, runtime,
+      true/*readOutput*/);
+  TensorAccessorW<float, 1> acc_bias_grad(
+      regions[6], task->regions[6], FID_DATA, ctx, runtime,
+      true/*readOutput*/);
+  assert(acc_input_grad.rect == acc_input.rect);
+  assert(acc_output.rect == acc_input.rect);
+  assert(acc_output_grad.rect == acc_input.rect);
+  BatchNormShape s = get_batch_norm_shape(acc_input.rect);
+  assert(s.num_channels == m->numChannels);
+  assert(acc_scale_grad.rect.volume() == s.num_channels);
+  assert(acc_bias_grad.rect.volume() == s.num_channels);
+  batch_norm_backward_cpu(s, m, acc_input.ptr, acc_input_grad.ptr,
+                          acc_output.ptr, acc_output_grad.ptr, acc_scale.ptr,
+                          acc_scale_grad.ptr, acc_bias_grad.ptr);
+}
@@ -32,7 +32,8 @@ Tensor FFModel::batch_norm(const Tensor& input,
 BatchNorm::BatchNorm(FFModel& model,
                      const Tensor& _input,
                      bool _relu)
-: Op(model, OP_BATCHNORM, "BatchNorm", _input), relu(_relu), profiling(model.config.profiling)
+: Op(model, OP_BATCHNORM, "BatchNorm", _input), relu(_relu), profiling(model.config.profiling),
+  inference(model.config.inference)
 {
   assert(_input.numDim == 4);
   numOutputs = 1;
@@ -243,6 +244,10 @@ OpMeta* BatchNorm::init_task(const Task *task,
   checkCUDA(cudaMalloc(&m->runningVar, sizeof(float) * output_c));
   checkCUDA(cudaMalloc(&m->saveMean, sizeof(float) * output_c));
   checkCUDA(cudaMalloc(&m->saveVar, sizeof(float) * output_c));
+  // Running statistics persist across iterations; start from N(0, 1)
+  // like the CPU variants until set_running_stats overwrites them
+  assign_kernel<<<GET_BLOCKS(output_c), CUDA_NUM_THREADS>>>(m->runningMean, output_c, 0.0f);
+  assign_kernel<<<GET_BLOCKS(output_c), CUDA_NUM_THREADS>>>(m->runningVar, output_c, 1.0f);
   if (m->relu) {
     checkCUDNN(cudnnCreateActivationDescriptor(&m->actiDesc));
     checkCUDNN(cudnnSetActivationDescriptor(m->actiDesc, CUDNN_ACTIVATION_RELU,
@@ -252,6 +257,24 @@ OpMeta* BatchNorm::init_task(const Task *task,
   return m;
 }
 
+/*
+  task->args: running mean followed by running variance
+*/
+__host__
+void BatchNorm::set_stats_task(const Task *task,
+                               const std::vector<PhysicalRegion> &regions,
+                               Context ctx, Runtime *runtime)
+{
+  assert(regions.size() == 0);
+  const BatchNormMeta* m = *((BatchNormMeta**) task->local_args);
+  const float* stats = (const float*) task->args;
+  size_t num_channels = task->arglen / (2 * sizeof(float));
+  checkCUDA(cudaMemcpy(m->runningMean, stats, sizeof(float) * num_channels,
+                       cudaMemcpyHostToDevice));
+  checkCUDA(cudaMemcpy(m->runningVar, stats + num_channels,
+                       sizeof(float) * num_channels, cudaMemcpyHostToDevice));
+}
+
 /*
   regions[0](O): scale, initilized to ones
   regions[1](O): bias, initilized to zeros
@@ -313,7 +336,7 @@ void BatchNorm::init(const FFModel& ff)
   IndexLauncher launcher(BATCHNORM_INIT_TASK_ID, task_is,
                          TaskArgument(this, sizeof(BatchNorm)), argmap,
                          Predicate::TRUE_PRED, false/*must*/, 0/*mapper_id*/,
-                         FFConfig::get_hash_id(std::string(name)));
+                         ff.config.get_strategy_id(std::string(name)));
   launcher.add_region_requirement(
       RegionRequirement(input_lps[0], 0/*projection id*/,
                         READ_ONLY, EXCLUSIVE, inputs[0].region));
@@ -338,6 +361,31 @@ void BatchNorm::init(const FFModel& ff)
   }
 }
 
+__host__
+void BatchNorm::set_running_stats(const FFModel& ff,
+                                  const std::vector<float>& mean,
+                                  const std::vector<float>& var)
+{
+  assert((int)mean.size() == outputs[0].adim[2]);
+  assert((int)var.size() == outputs[0].adim[2]);
+  std::vector<float> stats(mean);
+  stats.insert(stats.end(), var.begin(), var.end());
+  ArgumentMap argmap;
+  Context ctx = ff.config.lg_ctx;
+  Runtime* runtime = ff.config.lg_hlr;
+  Rect<4> rect = runtime->get_index_space_domain(ctx, task_is);
+  int idx = 0;
+  for (PointInRectIterator<4> it(rect); it(); it++) {
+    OpMeta* mp = meta[idx++];
+    argmap.set_point(*it, TaskArgument(&mp, sizeof(OpMeta*)));
+  }
+  IndexLauncher launcher(BATCHNORM_SET_STATS_TASK_ID, task_is,
+                         TaskArgument(stats.data(), sizeof(float) * stats.size()), argmap,
+                         Predicate::TRUE_PRED, false/*must*/, 0/*mapper_id*/,
+                         ff.config.get_strategy_id(std::string(name)));
+  runtime->execute_index_space(ctx, launcher);
+}
+
 /*
   regions[0](I): input
   regions[1](O): ouptut
@@ -374,14 +422,24 @@ void BatchNorm::forward_task(const Task *task,
   checkCUDA(cudaStreamCreate(&stream));
   checkCUDNN(cudnnSetStream(m->handle.dnn, stream));
 #endif
-  coord_t numChannels = acc_output.rect.hi[2] - acc_output.rect.lo[2] + 1;
-  assign_kernel<<<GET_BLOCKS(numChannels), CUDA_NUM_THREADS>>>(m->runningMean, numChannels, 0.0f);
-  assign_kernel<<<GET_BLOCKS(numChannels), CUDA_NUM_THREADS>>>(m->runningVar, numChannels, 0.0f);
-  checkCUDNN(cudnnBatchNormalizationForwardTraining(
-             m->handle.dnn, m->mode, &alpha, &beta, m->inputTensor, acc_input.ptr,
-             m->outputTensor, acc_output.ptr, m->biasTensor, acc_scale.ptr, acc_bias.ptr,
-             1.0, m->runningMean, m->runningVar, CUDNN_BN_MIN_EPSILON,
-             m->saveMean, m->saveVar));
+  if (bm->inference) {
+    checkCUDNN(cudnnBatchNormalizationForwardInference(
+               m->handle.dnn, m->mode, &alpha, &beta, m->inputTensor, acc_input.ptr,
+               m->outputTensor, acc_output.ptr, m->biasTensor, acc_scale.ptr, acc_bias.ptr,
+               m->runningMean, m->runningVar, CUDNN_BN_MIN_EPSILON));
+  } else {
+    // Same momentum as BN_CPU_MOMENTUM in the CPU variants
+    checkCUDNN(cudnnBatchNormalizationForwardTraining(
+               m->handle.dnn, m->mode, &alpha, &beta, m->inputTensor, acc_input.ptr,
+               m->outputTensor, acc_output.ptr, m->biasTensor, acc_scale.ptr, acc_bias.ptr,
+               0.1, m->runningMean, m->runningVar, CUDNN_BN_MIN_EPSILON,
+               m->saveMean, m->saveVar));
+  }
+  if (m->relu) {
+    checkCUDNN(cudnnActivationForward(m->handle.dnn, m->actiDesc,
+                                      &alpha, m->outputTensor, acc_output.ptr,
+                                      &beta, m->outputTensor, acc_output.ptr));
+  }
   if (bm->profiling) {
     cudaEventRecord(t_end);
     checkCUDA(cudaEventSynchronize(t_end));
@@ -408,7 +466,7 @@ void BatchNorm::forward(const FFModel& ff)
   IndexLauncher launcher(BATCHNORM_FWD_TASK_ID, task_is,
                          TaskArgument(this, sizeof(BatchNorm)), argmap,
                          Predicate::TRUE_PRED, false/*must*/, 0/*mapper_id*/,
-                         FFConfig::get_hash_id(std::string(name)));
+                         ff.config.get_strategy_id(std::string(name)));
   launcher.add_region_requirement(
       RegionRequirement(input_lps[0], 0/*projection id*/,
                         READ_ONLY, EXCLUSIVE, inputs[0].region));
@@ -516,7 +574,7 @@ void BatchNorm::backward(const FFModel& ff)
   IndexLauncher launcher(BATCHNORM_BWD_TASK_ID, task_is,
                          TaskArgument(this, sizeof(BatchNorm)), argmap,
                          Predicate::TRUE_PRED, false/*must*/, 0/*mapper_id*/,
-                         FFConfig::get_hash_id(std::string(name)));
+                         ff.config.get_strategy_id(std::string(name)));
   // regions[0](I): input
   launcher.add_region_requirement(
       RegionRequirement(input_lps[0], 0/*projection id*/,
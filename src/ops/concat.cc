@@ -0,0 +1,109 @@
+/* Copyright 2020 Stanford
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "model.h"
+#include "cpu_helper.h"
+
+// Same blocking as calc_blk_size in concat.cu, computed from a Domain
+static void get_concat_blocks(const Domain& domain, int axis,
+                              coord_t& num_blocks, coord_t& blk_size)
+{
+  num_blocks = 1;
+  blk_size = 1;
+  for (int d = 0; d < domain.get_dim(); d++) {
+    if (d <= axis)
+      blk_size *= (domain.hi()[d] - domain.lo()[d] + 1);
+    else
+      num_blocks *= (domain.hi()[d] - domain.lo()[d] + 1);
+  }
+}
+
+OpMeta* Concat::init_task_cpu(const Task* task,
+                              const std::vector<PhysicalRegion>& regions,
+                              Context ctx, Runtime* runtime)
+{
+  // CPU kernels keep no per-processor state
+  return NULL;
+}
+
+/*
+  regions[0](O): output
+  regions[1..numInputs](I): inputs
+*/
+void Concat::forward_task_cpu(const Task* task,
+                              const std::vector<PhysicalRegion>& regions,
+                              Context ctx, Runtime* runtime)
+{
+  const Concat* cc = (Concat*) task->args;
+  // Note that our internal axis index ordering is opposite to other frameworks
+  int axis = cc->outputs[0].numDim - 1 - cc->axis;
+  assert(regions.size() == cc->numInputs + 1);
+  assert(task->regions.size() == cc->numInputs + 1);
+  Domain out_domain = runtime->get_index_space_domain(
+    ctx, task->regions[0].region.get_index_space());
+  assert(out_domain.get_dim() == cc->outputs[0].numDim);
+  coord_t num_blocks, output_blk_size;
+  get_concat_blocks(out_domain, axis, num_blocks, output_blk_size);
+  float* output = helperGetTensorPointerWO<float>(
+    regions[0], task->regions[0], FID_DATA, ctx, runtime);
+  // Each input fills a contiguous slice of every output block
+  for (int i = 0; i < cc->numInputs; i++) {
+    Domain in_domain = runtime->get_index_space_domain(
+      ctx, task->regions[i+1].region.get_index_space());
+    coord_t input_num_blocks, input_blk_size;
+    get_concat_blocks(in_domain, axis, input_num_blocks, input_blk_size);
+    assert(input_num_blocks == num_blocks);
+    const float* input = helperGetTensorPointerRO<float>(
+      regions[i+1], task->regions[i+1], FID_DATA, ctx, runtime);
+    cpu_copy_with_stride(output, output_blk_size, input, input_blk_size,
+                         num_blocks, input_blk_size);
+    output += input_blk_size;
+  }
+}
+
+/*
+  regions[0](I): output_grad
+  regions[1..numInputs](I/O): input_grads
+*/
+void Concat::backward_task_cpu(const Task* task,
+                               const std::vector<PhysicalRegion>& regions,
+                               Context ctx, Runtime* runtime)
+{
+  const Concat* cc = (Concat*) task->args;
+  // Note that our internal axis index ordering is opposite to other frameworks
+  int axis = cc->outputs[0].numDim - 1 - cc->axis;
+  assert(regions.size() == cc->numInputs + 1);
+  assert(task->regions.size() == cc->numInputs + 1);
+  Domain out_domain = runtime->get_index_space_domain(
+    ctx, task->regions[0].region.get_index_space());
+  assert(out_domain.get_dim() == cc->outputs[0].numDim);
+  coord_t num_blocks, output_blk_size;
+  get_concat_blocks(out_domain, axis, num_blocks, output_blk_size);
+  const float* output_grad = helperGetTensorPointerRO<float>(
+    regions[0], task->regions[0], FID_DATA, ctx, runtime);
+  for (int i = 0; i < cc->numInputs; i++) {
+    Domain in_domain = runtime->get_index_space_domain(
+      ctx, task->regions[i+1].region.get_index_space());
+    coord_t input_num_blocks, input_blk_size;
+    get_concat_blocks(in_domain, axis, input_num_blocks, input_blk_size);
+    assert(input_num_blocks == num_blocks);
+    float* input_grad = helperGetTensorPointerRW<float>(
+      regions[i+1], task->regions[i+1], FID_DATA, ctx, runtime);
+    cpu_add_with_stride(input_grad, input_blk_size, output_grad,
+                        output_blk_size, num_blocks, input_blk_size);
+    output_grad += input_blk_size;
+  }
+}
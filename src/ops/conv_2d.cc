@@ -0,0 +1,127 @@
+/* Copyright 2020 Stanford
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "model.h"
+#include "cpu_kernels.h"
+
+static Conv2DShape get_conv2d_shape(const Conv2D* conv,
+                                    const Rect<4>& input_rect,
+                                    const Rect<4>& output_rect)
+{
+  Conv2DShape s;
+  s.input_w = input_rect.hi[0] - input_rect.lo[0] + 1;
+  s.input_h = input_rect.hi[1] - input_rect.lo[1] + 1;
+  s.input_c = input_rect.hi[2] - input_rect.lo[2] + 1;
+  s.input_n = input_rect.hi[3] - input_rect.lo[3] + 1;
+  s.output_w = output_rect.hi[0] - output_rect.lo[0] + 1;
+  s.output_h = output_rect.hi[1] - output_rect.lo[1] + 1;
+  s.output_c = output_rect.hi[2] - output_rect.lo[2] + 1;
+  assert(s.input_n == output_rect.hi[3] - output_rect.lo[3] + 1);
+  s.kernel_h = conv->kernel_h;
+  s.kernel_w = conv->kernel_w;
+  s.stride_h = conv->stride_h;
+  s.stride_w = conv->stride_w;
+  s.groups = conv->groups;
+  // Same padding as the cuDNN descriptor in Conv2D::init_task
+  s.pad_h = ((s.output_h - 1) * s.stride_h + s.kernel_h - s.input_h + 1) / 2;
+  s.pad_w = ((s.output_w - 1) * s.stride_w + s.kernel_w - s.input_w + 1) / 2;
+  assert(s.input_c % s.groups == 0);
+  assert(s.output_c % s.groups == 0);
+  return s;
+}
+
+OpMeta* Conv2D::init_task_cpu(const Task *task,
+                              const std::vector<PhysicalRegion> &regions,
+                              Context ctx, Runtime *runtime)
+{
+  // CPU kernels keep no per-processor state
+  return NULL;
+}
+
+/*
+  regions[0](I): input
+  regions[1](O): output
+  regions[2](I): filter
+  regions[3](I): bias
+*/
+void Conv2D::forward_task_cpu(const Task *task,
+                              const std::vector<PhysicalRegion> &regions,
+                              Context ctx, Runtime *runtime)
+{
+  assert(regions.size() == 4);
+  assert(task->regions.size() == 4);
+  const Conv2D* conv = (Conv2D*) task->args;
+  TensorAccessorR<float, 4> acc_input(
+      regions[0], task->regions[0], FID_DATA, ctx, runtime);
+  TensorAccessorW<float, 4> acc_output(
+      regions[1], task->regions[1], FID_DATA, ctx, runtime,
+      false/*readOutput*/);
+  TensorAccessorR<float, 4> acc_kernel(
+      regions[2], task->regions[2], FID_DATA, ctx, runtime);
+  TensorAccessorR<float, 1> acc_bias(
+      regions[3], task->regions[3], FID_DATA, ctx, runtime);
+  Conv2DShape s = get_conv2d_shape(conv, acc_input.rect, acc_output.rect);
+  assert(acc_kernel.rect.volume() == s.output_c * (s.input_c / s.groups)
+                                     * s.kernel_h * s.kernel_w);
+  assert(acc_bias.rect.volume() == s.output_c);
+  conv2d_forward_cpu(s, acc_input.ptr, acc_output.ptr,
+                     acc_kernel.ptr, acc_bias.ptr,
+                     conv->activation == AC_MODE_RELU);
+}
+
+/*
+  regions[0](I): input
+  regions[1](I/O): input_grad
+  regions[2](I): output
+  regions[3](I/O): output_grad
+  regions[4](I): filter
+  regions[5](I/O): filter_grad
+  regions[6](I/O): bias_grad
+*/
+void Conv2D::backward_task_cpu(const Task *task,
+                               const std::vector<PhysicalRegion> &regions,
+                               Context ctx, Runtime *runtime)
+{
+  assert(regions.size() == 7);
+  assert(task->regions.size() == 7);
+  const Conv2D* conv = (Conv2D*) task->args;
+  TensorAccessorR<float, 4> acc_input(
+      regions[0], task->regions[0], FID_DATA, ctx, runtime);
+  TensorAccessorW<float, 4> acc_input_grad(
+      regions[1], task->regions[1], FID_DATA, ctx, runtime,
+      true/*readOutput*/);
+  TensorAccessorR<float, 4> acc_output(
+      regions[2], task->regions[2], FID_DATA, ctx, runtime);
+  TensorAccessorW<float, 4> acc_output_grad(
+      regions[3], task->regions[3], FID_DATA, ctx, runtime,
+      true/*readOutput*/);
+  TensorAccessorR<float, 4> acc_kernel(
+      regions[4], task->regions[4], FID_DATA, ctx, runtime);
+  TensorAccessorW<float, 4> acc_kernel_grad(
+      regions[5], task->regions[5], FID_DATA, ctx, runtime,
+      true/*readOutput*/);
+  TensorAccessorW<float, 1> acc_bias_grad(
+      regions[6], task->regions[6], FID_DATA, ctx, runtime,
+      true/*readOutput*/);
+  Conv2DShape s = get_conv2d_shape(conv, acc_input.rect, acc_output.rect);
+  assert(acc_input_grad.rect == acc_input.rect);
+  assert(acc_output_grad.rect == acc_output.rect);
+  assert(acc_kernel_grad.rect.volume() == acc_kernel.rect.volume());
+  assert(acc_bias_grad.rect.volume() == s.output_c);
+  conv2d_backward_cpu(s, acc_input.ptr, acc_input_grad.ptr,
+                      acc_output.ptr, acc_output_grad.ptr,
+                      acc_kernel.ptr, acc_kernel_grad.ptr,
+                      acc_bias_grad.ptr, conv->activation == AC_MODE_RELU);
+}
@@ -322,7 +322,7 @@ void Conv2D::init(const FFModel& ff)
   IndexLauncher launcher(CONV2D_INIT_TASK_ID, task_is,
                          TaskArgument(this, sizeof(Conv2D)), argmap,
                          Predicate::TRUE_PRED, false/*must*/, 0/*mapper_id*/,
-                         FFConfig::get_hash_id(std::string(name)));
+                         ff.config.get_strategy_id(std::string(name)));
   launcher.add_region_requirement(
       RegionRequirement(input_lps[0], 0/*projection id*/,
                         READ_ONLY, EXCLUSIVE, inputs[0].region));
@@ -447,7 +447,7 @@ void Conv2D::forward(const FFModel& ff)
   IndexLauncher launcher(CONV2D_FWD_TASK_ID, task_is,
                          TaskArgument(this, sizeof(Conv2D)), argmap,
                          Predicate::TRUE_PRED, false/*must*/, 0/*mapper_id*/,
-                         FFConfig::get_hash_id(std::string(name)));
+                         ff.config.get_strategy_id(std::string(name)));
   launcher.add_region_requirement(
       RegionRequirement(input_lps[0], 0/*projection id*/,
                         READ_ONLY, EXCLUSIVE, inputs[0].region));
@@ -592,7 +592,7 @@ void Conv2D::backward(const FFModel& ff)
   IndexLauncher launcher(CONV2D_BWD_TASK_ID, task_is,
                          TaskArgument(this, sizeof(Conv2D)), argmap,
                          Predicate::TRUE_PRED, false/*must*/, 0/*mapper_id*/,
-                         FFConfig::get_hash_id(std::string(name)));
+                         ff.config.get_strategy_id(std::string(name)));
   // regions[0](I): input
   launcher.add_region_requirement(
       RegionRequirement(input_lps[0], 0/*projection id*/,
@@ -0,0 +1,224 @@
+/* Copyright 2020 Stanford
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cpu_kernels.h"
+#include <cfloat>
+#include <vector>
+
+// A 1x1 convolution with unit stride and no padding reads the input
+// image as its own im2col matrix
+static inline bool is_direct_conv(const Conv2DShape& s)
+{
+  return s.kernel_h == 1 && s.kernel_w == 1 && s.stride_h == 1
+      && s.stride_w == 1 && s.pad_h == 0 && s.pad_w == 0;
+}
+
+/*
+  Each (sample, group) is one GEMM with row-major operands
+    output[oc, hw] = filter[oc, k] * col[k, hw]
+  which cpu_sgemm (column-major) computes as output^T = col^T * filter^T
+*/
+void conv2d_forward_cpu(const Conv2DShape& s,
+                        const float* input, float* output,
+                        const float* kernel, const float* bias,
+                        bool relu)
+{
+  int in_c_g = s.input_c / s.groups;
+  int out_c_g = s.output_c / s.groups;
+  int k_size = in_c_g * s.kernel_h * s.kernel_w;
+  int in_hw = s.input_h * s.input_w;
+  int out_hw = s.output_h * s.output_w;
+  bool direct = is_direct_conv(s);
+  std::vector<float> col(direct ? 0 : (size_t)k_size * out_hw);
+  for (int n = 0; n < s.input_n; n++) {
+    float* out_n = output + (size_t)n * s.output_c * out_hw;
+    // The GEMMs accumulate on top of the bias
+    CPU_PARALLEL_FOR
+    for (int c = 0; c < s.output_c; c++)
+      cpu_assign(out_n + (size_t)c * out_hw, out_hw, bias[c]);
+    for (int g = 0; g < s.groups; g++) {
+      const float* in_g = input + ((size_t)n * s.input_c + g * in_c_g) * in_hw;
+      const float* col_g = in_g;
+      if (!direct) {
+        cpu_im2col(in_g, in_c_g, s.input_h, s.input_w,
+                   s.kernel_h, s.kernel_w, s.pad_h, s.pad_w,
+                   s.stride_h, s.stride_w, s.output_h, s.output_w,
+                   col.data());
+        col_g = col.data();
+      }
+      cpu_sgemm(false, false, out_hw, out_c_g, k_size,
+                1.0f, col_g, out_hw,
+                kernel + (size_t)g * out_c_g * k_size, k_size,
+                1.0f, out_n + (size_t)g * out_c_g * out_hw, out_hw);
+    }
+    if (relu) {
+      CPU_PARALLEL_FOR
+      for (int c = 0; c < s.output_c; c++) {
+        float* out = out_n + (size_t)c * out_hw;
+        CPU_SIMD
+        for (int i = 0; i < out_hw; i++)
+          out[i] = out[i] > 0.0f ? out[i] : 0.0f;
+      }
+    }
+  }
+}
+
+void conv2d_backward_cpu(const Conv2DShape& s,
+                         const float* input, float* input_grad,
+                         const float* output, float* output_grad,
+                         const float* kernel, float* kernel_grad,
+                         float* bias_grad, bool relu)
+{
+  int in_c_g = s.input_c / s.groups;
+  int out_c_g = s.output_c / s.groups;
+  int k_size = in_c_g * s.kernel_h * s.kernel_w;
+  int in_hw = s.input_h * s.input_w;
+  int out_hw = s.output_h * s.output_w;
+  bool direct = is_direct_conv(s);
+  std::vector<float> col(direct ? 0 : (size_t)k_size * out_hw);
+  if (relu) {
+    size_t volume = (size_t)s.input_n * s.output_c * out_hw;
+    CPU_PARALLEL_FOR
+    for (size_t i = 0; i < volume; i++)
+      if (output[i] <= 0.0f)
+        output_grad[i] = 0.0f;
+  }
+  // Compute bias gradient
+  CPU_PARALLEL_FOR
+  for (int c = 0; c < s.output_c; c++) {
+    float sum = 0.0f;
+    for (int n = 0; n < s.input_n; n++) {
+      const float* og = output_grad + ((size_t)n * s.output_c + c) * out_hw;
+      CPU_SIMD_REDUCTION(+:sum)
+      for (int i = 0; i < out_hw; i++)
+        sum += og[i];
+    }
+    bias_grad[c] += sum;
+  }
+  for (int n = 0; n < s.input_n; n++) {
+    for (int g = 0; g < s.groups; g++) {
+      const float* in_g = input + ((size_t)n * s.input_c + g * in_c_g) * in_hw;
+      float* in_grad_g = input_grad
+                       + ((size_t)n * s.input_c + g * in_c_g) * in_hw;
+      const float* out_grad_g = output_grad
+                              + ((size_t)n * s.output_c + g * out_c_g) * out_hw;
+      const float* kernel_g = kernel + (size_t)g * out_c_g * k_size;
+      float* kernel_grad_g = kernel_grad + (size_t)g * out_c_g * k_size;
+      // Compute filter gradient: filter_grad[oc, k] += output_grad[oc, hw] * col[k, hw]
+      const float* col_g = in_g;
+      if (!direct) {
+        cpu_im2col(in_g, in_c_g, s.input_h, s.input_w,
+                   s.kernel_h, s.kernel_w, s.pad_h, s.pad_w,
+                   s.stride_h, s.stride_w, s.output_h, s.output_w,
+                   col.data());
+        col_g = col.data();
+      }
+      cpu_sgemm(true, false, k_size, out_c_g, out_hw,
+                1.0f, col_g, out_hw, out_grad_g, out_hw,
+                1.0f, kernel_grad_g, k_size);
+      // Compute data gradient: col_grad[k, hw] = filter[oc, k] * output_grad[oc, hw]
+      if (direct) {
+        cpu_sgemm(false, true, out_hw, k_size, out_c_g,
+                  1.0f, out_grad_g, out_hw, kernel_g, k_size,
+                  1.0f, in_grad_g, out_hw);
+      } else {
+        cpu_sgemm(false, true, out_hw, k_size, out_c_g,
+                  1.0f, out_grad_g, out_hw, kernel_g, k_size,
+                  0.0f, col.data(), out_hw);
+        cpu_col2im(col.data(), in_c_g, s.input_h, s.input_w,
+                   s.kernel_h, s.kernel_w, s.pad_h, s.pad_w,
+                   s.stride_h, s.stride_w, s.output_h, s.output_w,
+                   in_grad_g);
+      }
+    }
+  }
+}
+
+void pool2d_forward_cpu(const Pool2DShape& s, PoolType type,
+                        const float* input, float* output)
+{
+  int in_hw = s.input_h * s.input_w;
+  int out_hw = s.output_h * s.output_w;
+  CPU_PARALLEL_FOR
+  for (int p = 0; p < s.num_planes; p++) {
+    const float* in = input + (size_t)p * in_hw;
+    float* out = output + (size_t)p * out_hw;
+    for (int oy = 0; oy < s.output_h; oy++) {
+      int h_start = std::max(oy * s.stride_h - s.pad_h, 0);
+      int h_end = std::min(oy * s.stride_h - s.pad_h + s.kernel_h, s.input_h);
+      for (int ox = 0; ox < s.output_w; ox++) {
+        int w_start = std::max(ox * s.stride_w - s.pad_w, 0);
+        int w_end = std::min(ox * s.stride_w - s.pad_w + s.kernel_w, s.input_w);
+        if (type == POOL_MAX) {
+          float max_val = -FLT_MAX;
+          for (int y = h_start; y < h_end; y++)
+            for (int x = w_start; x < w_end; x++)
+              max_val = std::max(max_val, in[y * s.input_w + x]);
+          out[oy * s.output_w + ox] = max_val;
+        } else {
+          float sum = 0.0f;
+          for (int y = h_start; y < h_end; y++)
+            for (int x = w_start; x < w_end; x++)
+              sum += in[y * s.input_w + x];
+          int count = (h_end - h_start) * (w_end - w_start);
+          out[oy * s.output_w + ox] = count > 0 ? sum / count : 0.0f;
+        }
+      }
+    }
+  }
+}
+
+void pool2d_backward_cpu(const Pool2DShape& s, PoolType type,
+                         const float* input, float* input_grad,
+                         const float* output_grad)
+{
+  int in_hw = s.input_h * s.input_w;
+  int out_hw = s.output_h * s.output_w;
+  CPU_PARALLEL_FOR
+  for (int p = 0; p < s.num_planes; p++) {
+    const float* in = input + (size_t)p * in_hw;
+    float* in_grad = input_grad + (size_t)p * in_hw;
+    const float* out_grad = output_grad + (size_t)p * out_hw;
+    for (int oy = 0; oy < s.output_h; oy++) {
+      int h_start = std::max(oy * s.stride_h - s.pad_h, 0);
+      int h_end = std::min(oy * s.stride_h - s.pad_h + s.kernel_h, s.input_h);
+      for (int ox = 0; ox < s.output_w; ox++) {
+        int w_start = std::max(ox * s.stride_w - s.pad_w, 0);
+        int w_end = std::min(ox * s.stride_w - s.pad_w + s.kernel_w, s.input_w);
+        float grad = out_grad[oy * s.output_w + ox];
+        if (type == POOL_MAX) {
+          int max_idx = -1;
+          float max_val = -FLT_MAX;
+          for (int y = h_start; y < h_end; y++)
+            for (int x = w_start; x < w_end; x++)
+              if (max_idx < 0 || in[y * s.input_w + x] > max_val) {
+                max_idx = y * s.input_w + x;
+                max_val = in[max_idx];
+              }
+          if (max_idx >= 0)
+            in_grad[max_idx] += grad;
+        } else {
+          int count = (h_end - h_start) * (w_end - w_start);
+          if (count == 0)
+            continue;
+          grad /= count;
+          for (int y = h_start; y < h_end; y++)
+            for (int x = w_start; x < w_end; x++)
+              in_grad[y * s.input_w + x] += grad;
+        }
+      }
+    }
+  }
+}
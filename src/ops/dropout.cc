@@ -0,0 +1,145 @@
+/* Copyright 2020 Stanford
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "model.h"
+#include "cpu_helper.h"
+
+// Elements covered by one word of the packed dropout mask
+#define DROPOUT_MASK_BITS 64
+
+DropoutCPUMeta::DropoutCPUMeta(FFHandler handler, coord_t _volume)
+: OpMeta(handler), volume(_volume), step(0)
+{
+  numWords = (volume + DROPOUT_MASK_BITS - 1) / DROPOUT_MASK_BITS;
+  mask = new uint64_t[numWords];
+  memset(mask, 0, numWords * sizeof(uint64_t));
+}
+
+DropoutCPUMeta::~DropoutCPUMeta(void)
+{
+  delete[] mask;
+}
+
+// Keep bits for elements [w * 64, w * 64 + 64). Element i draws lane
+// (counterBase + i) % 4 of Philox block (counterBase + i) / 4 in the
+// stream of the current step, so a bit never depends on the thread count
+static uint64_t dropout_mask_word(const DropoutCPUMeta* m, coord_t w)
+{
+  coord_t first = w * DROPOUT_MASK_BITS;
+  coord_t last = std::min(first + DROPOUT_MASK_BITS, m->volume);
+  uint64_t word = 0, block = ~(uint64_t)0;
+  uint32_t r[4];
+  for (coord_t i = first; i < last; i++) {
+    uint64_t g = m->counterBase + i;
+    if (g / 4 != block) {
+      block = g / 4;
+      cpu_philox4x32(m->seed, block, m->step, r);
+    }
+    word |= (uint64_t)(r[g % 4] >= m->threshold) << (i - first);
+  }
+  return word;
+}
+
+OpMeta* Dropout::init_task_cpu(const Task *task,
+                               const std::vector<PhysicalRegion> &regions,
+                               Context ctx, Runtime *runtime)
+{
+  assert(regions.size() == 2);
+  assert(task->regions.size() == 2);
+  const Dropout* dropout = (Dropout*) task->args;
+  FFHandler handle = *((const FFHandler*) task->local_args);
+  Domain input_domain = runtime->get_index_space_domain(
+    ctx, task->regions[0].region.get_index_space());
+  Domain output_domain = runtime->get_index_space_domain(
+    ctx, task->regions[1].region.get_index_space());
+  assert(input_domain == output_domain);
+  assert(dropout->rate >= 0.0f && dropout->rate < 1.0f);
+  DropoutCPUMeta* m = new DropoutCPUMeta(handle, output_domain.get_volume());
+  m->seed = dropout->seed;
+  m->scale = 1.0f / (1.0f - dropout->rate);
+  m->threshold = (uint32_t) std::min(
+      (double) dropout->rate * 4294967296.0, 4294967295.0);
+  // Offset of this partition in the whole tensor, so that the mask of a
+  // partition split along its outermost dimension matches the unsplit one
+  const Tensor& output = dropout->outputs[0];
+  coord_t stride = 1;
+  m->counterBase = 0;
+  for (int i = 0; i < output.numDim; i++) {
+    m->counterBase += output_domain.lo()[i] * stride;
+    stride *= output.adim[i];
+  }
+  return m;
+}
+
+/*
+  regions[0](I): input
+  regions[1](O): output
+*/
+void Dropout::forward_task_cpu(const Task* task,
+                               const std::vector<PhysicalRegion> &regions,
+                               Context ctx, Runtime* runtime)
+{
+  assert(regions.size() == 2);
+  assert(task->regions.size() == 2);
+  DropoutCPUMeta* m = *((DropoutCPUMeta**) task->local_args);
+  const float* input_ptr = helperGetTensorPointerRO<float>(
+    regions[0], task->regions[0], FID_DATA, ctx, runtime);
+  float* output_ptr = helperGetTensorPointerWO<float>(
+    regions[1], task->regions[1], FID_DATA, ctx, runtime);
+  CPU_PARALLEL_FOR_IF(m->volume >= CPU_PARALLEL_MIN_VOLUME)
+  for (coord_t w = 0; w < m->numWords; w++) {
+    uint64_t word = dropout_mask_word(m, w);
+    m->mask[w] = word;
+    coord_t first = w * DROPOUT_MASK_BITS;
+    int n = (int) std::min((coord_t) DROPOUT_MASK_BITS, m->volume - first);
+    const float* in = input_ptr + first;
+    float* out = output_ptr + first;
+    CPU_SIMD
+    for (int j = 0; j < n; j++)
+      out[j] = in[j] * (m->scale * (float)((word >> j) & 1));
+  }
+  // Every forward pass draws a fresh mask
+  m->step++;
+}
+
+/*
+  regions[0](I/O): input_grad
+  regions[1](I): output_grad
+*/
+void Dropout::backward_task_cpu(const Task* task,
+                                const std::vector<PhysicalRegion> &regions,
+                                Context ctx, Runtime* runtime)
+{
+  assert(regions.size() == 2);
+  assert(task->regions.size() == 2);
+  const DropoutCPUMeta* m = *((DropoutCPUMeta**) task->local_args);
+  float* input_grad_ptr = helperGetTensorPointerRW<float>(
+    regions[0], task->regions[0], FID_DATA, ctx, runtime);
+  const float* output_grad_ptr = helperGetTensorPointerRO<float>(
+    regions[1], task->regions[1], FID_DATA, ctx, runtime);
+  // Re-apply the mask saved by the last forward pass
+  CPU_PARALLEL_FOR_IF(m->volume >= CPU_PARALLEL_MIN_VOLUME)
+  for (coord_t w = 0; w < m->numWords; w++) {
+    uint64_t word = m->mask[w];
+    coord_t first = w * DROPOUT_MASK_BITS;
+    int n = (int) std::min((coord_t) DROPOUT_MASK_BITS, m->volume - first);
+    const float* out_grad = output_grad_ptr + first;
+    float* in_grad = input_grad_ptr + first;
+    CPU_SIMD
+    for (int j = 0; j < n; j++)
+      in_grad[j] += out_grad[j] * (m->scale * (float)((word >> j) & 1));
+  }
+}
@@ -148,9 +148,9 @@ void Dropout::init(const FFModel& ff)
       assert(false);
   }
   IndexLauncher init_launcher(DROPOUT_INIT_TASK_ID, task_is,
-                              TaskArgument(this, sizeof(ElementUnary)), argmap,
+                              TaskArgument(this, sizeof(Dropout)), argmap,
                               Predicate::TRUE_PRED, false/*must*/, 0/*mapper_id*/,
-                              FFConfig::get_hash_id(std::string(name)));
+                              ff.config.get_strategy_id(std::string(name)));
   init_launcher.add_region_requirement(
       RegionRequirement(input_lps[0], 0/*projection id*/,
                         READ_ONLY, EXCLUSIVE, inputs[0].region));
@@ -227,9 +227,9 @@ void Dropout::forward(const FFModel& ff)
       assert(false);
   }
   IndexLauncher launcher(DROPOUT_FWD_TASK_ID, task_is,
-                         TaskArgument(this, sizeof(ElementUnary)), argmap,
+                         TaskArgument(this, sizeof(Dropout)), argmap,
                          Predicate::TRUE_PRED, false/*must*/, 0/*mapper_id*/,
-                         FFConfig::get_hash_id(std::string(name)));
+                         ff.config.get_strategy_id(std::string(name)));
   launcher.add_region_requirement(
     RegionRequirement(input_lps[0], 0/*projection id*/,
       READ_ONLY, EXCLUSIVE, inputs[0].region));
@@ -294,9 +294,9 @@ void Dropout::backward(const FFModel& ff)
       assert(false);
   }
   IndexLauncher launcher(DROPOUT_BWD_TASK_ID, task_is,
-                         TaskArgument(this, sizeof(ElementUnary)), argmap,
+                         TaskArgument(this, sizeof(Dropout)), argmap,
                          Predicate::TRUE_PRED, false/*must*/, 0/*mapper_id*/,
-                         FFConfig::get_hash_id(std::string(name)));
+                         ff.config.get_strategy_id(std::string(name)));
   launcher.add_region_requirement(
     RegionRequirement(input_grad_lps[0], 0/*projection id*/,
       READ_WRITE, EXCLUSIVE, inputs[0].region_grad));
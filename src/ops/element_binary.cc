@@ -0,0 +1,194 @@
+/* Copyright 2020 Stanford
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "model.h"
+#include "cpu_helper.h"
+
+static void elewise_binary_forward_cpu(OperatorType type, coord_t volume,
+                                       const float* in1, const float* in2,
+                                       float* out)
+{
+  switch (type) {
+    case OP_EW_ADD:
+    {
+      CPU_PARALLEL_FOR_SIMD
+      for (coord_t i = 0; i < volume; i++)
+        out[i] = in1[i] + in2[i];
+      break;
+    }
+    case OP_EW_SUB:
+    {
+      CPU_PARALLEL_FOR_SIMD
+      for (coord_t i = 0; i < volume; i++)
+        out[i] = in1[i] - in2[i];
+      break;
+    }
+    case OP_EW_MUL:
+    {
+      CPU_PARALLEL_FOR_SIMD
+      for (coord_t i = 0; i < volume; i++)
+        out[i] = in1[i] * in2[i];
+      break;
+    }
+    case OP_EW_DIV:
+    {
+      CPU_PARALLEL_FOR_SIMD
+      for (coord_t i = 0; i < volume; i++)
+        out[i] = in1[i] / in2[i];
+      break;
+    }
+    default:
+      assert(false);
+  }
+}
+
+// Both input gradients are updated in the same pass over out_grad.
+// in1_grad and in2_grad alias when both inputs are the same tensor, which
+// is safe since every iteration only touches its own element
+static void elewise_binary_backward_cpu(OperatorType type, coord_t volume,
+                                        const float* out_grad,
+                                        const float* in1, const float* in2,
+                                        float* in1_grad, float* in2_grad)
+{
+  switch (type) {
+    case OP_EW_ADD:
+    {
+      CPU_PARALLEL_FOR_SIMD
+      for (coord_t i = 0; i < volume; i++) {
+        in1_grad[i] += out_grad[i];
+        in2_grad[i] += out_grad[i];
+      }
+      break;
+    }
+    case OP_EW_SUB:
+    {
+      CPU_PARALLEL_FOR_SIMD
+      for (coord_t i = 0; i < volume; i++) {
+        in1_grad[i] += out_grad[i];
+        in2_grad[i] -= out_grad[i];
+      }
+      break;
+    }
+    case OP_EW_MUL:
+    {
+      CPU_PARALLEL_FOR_SIMD
+      for (coord_t i = 0; i < volume; i++) {
+        in1_grad[i] += out_grad[i] * in2[i];
+        in2_grad[i] += out_grad[i] * in1[i];
+      }
+      break;
+    }
+    case OP_EW_DIV:
+    {
+      CPU_PARALLEL_FOR_SIMD
+      for (coord_t i = 0; i < volume; i++) {
+        float g = out_grad[i] / in2[i];
+        in1_grad[i] += g;
+        in2_grad[i] -= g * in1[i] / in2[i];
+      }
+      break;
+    }
+    default:
+      assert(false);
+  }
+}
+
+OpMeta* ElementBinary::init_task_cpu(const Task *task,
+                                     const std::vector<PhysicalRegion> &regions,
+                                     Context ctx, Runtime *runtime)
+{
+  // CPU kernels keep no per-processor state
+  return NULL;
+}
+
+/*
+  regions[0](I): in1
+  regions[1](I): in2
+  regions[2](O): output
+*/
+void ElementBinary::forward_task_cpu(const Task* task,
+                                     const std::vector<PhysicalRegion> &regions,
+                                     Context ctx, Runtime* runtime)
+{
+  assert(regions.size() == 3);
+  assert(task->regions.size() == 3);
+  const ElementBinary* ele = (const ElementBinary*) task->args;
+  Domain in1_domain = runtime->get_index_space_domain(
+    ctx, task->regions[0].region.get_index_space());
+  Domain in2_domain = runtime->get_index_space_domain(
+    ctx, task->regions[1].region.get_index_space());
+  Domain out_domain = runtime->get_index_space_domain(
+    ctx, task->regions[2].region.get_index_space());
+  assert(in1_domain == in2_domain);
+  assert(out_domain == in1_domain);
+
+  const float* in1_ptr = helperGetTensorPointerRO<float>(
+    regions[0], task->regions[0], FID_DATA, ctx, runtime);
+  const float* in2_ptr = helperGetTensorPointerRO<float>(
+    regions[1], task->regions[1], FID_DATA, ctx, runtime);
+  float* out_ptr = helperGetTensorPointerWO<float>(
+    regions[2], task->regions[2], FID_DATA, ctx, runtime);
+  elewise_binary_forward_cpu(ele->op_type, out_domain.get_volume(),
+                             in1_ptr, in2_ptr, out_ptr);
+}
+
+/*
+  regions[0](I): out_grad
+  regions[1](I): in0
+  regions[2](I): in1
+  regions[3](I/O): in0_grad
+  regions[4](I/O): in1_grad (Missing if in0=in1)
+*/
+void ElementBinary::backward_task_cpu(const Task *task,
+                                      const std::vector<PhysicalRegion> &regions,
+                                      Context ctx, Runtime* runtime)
+{
+  const ElementBinary* ele = (const ElementBinary*) task->args;
+  assert(regions.size() == 5 || regions.size() == 4);
+  assert(task->regions.size() == regions.size());
+  Domain out_grad_domain = runtime->get_index_space_domain(
+    ctx, task->regions[0].region.get_index_space());
+  Domain in0_domain = runtime->get_index_space_domain(
+    ctx, task->regions[1].region.get_index_space());
+  Domain in1_domain = runtime->get_index_space_domain(
+    ctx, task->regions[2].region.get_index_space());
+  Domain in0_grad_domain = runtime->get_index_space_domain(
+    ctx, task->regions[3].region.get_index_space());
+  assert(out_grad_domain == in0_domain);
+  assert(out_grad_domain == in1_domain);
+  assert(out_grad_domain == in0_grad_domain);
+
+  const float* out_grad_ptr = helperGetTensorPointerRO<float>(
+    regions[0], task->regions[0], FID_DATA, ctx, runtime);
+  const float* in1_ptr = helperGetTensorPointerRO<float>(
+    regions[1], task->regions[1], FID_DATA, ctx, runtime);
+  const float* in2_ptr = helperGetTensorPointerRO<float>(
+    regions[2], task->regions[2], FID_DATA, ctx, runtime);
+  float* in1_grad_ptr = helperGetTensorPointerRW<float>(
+    regions[3], task->regions[3], FID_DATA, ctx, runtime);
+  float* in2_grad_ptr = NULL;
+  if (regions.size() == 5) {
+    Domain in1_grad_domain = runtime->get_index_space_domain(
+      ctx, task->regions[4].region.get_index_space());
+    assert(out_grad_domain == in1_grad_domain);
+    in2_grad_ptr = helperGetTensorPointerRW<float>(
+      regions[4], task->regions[4], FID_DATA, ctx, runtime);
+  } else {
+    in2_grad_ptr = in1_grad_ptr;
+  }
+  elewise_binary_backward_cpu(ele->op_type, out_grad_domain.get_volume(),
+                              out_grad_ptr, in1_ptr, in2_ptr,
+                              in1_grad_ptr, in2_grad_ptr);
+}
@@ -186,7 +186,7 @@ void ElementBinary::init(const FFModel& ff)
   IndexLauncher launcher(ELEMENTBINARY_INIT_TASK_ID, task_is,
                          TaskArgument(this, sizeof(ElementBinary)), argmap,
                          Predicate::TRUE_PRED, false/*must*/, 0/*mapper_id*/,
-                         FFConfig::get_hash_id(std::string(name)));
+                         ff.config.get_strategy_id(std::string(name)));
   launcher.add_region_requirement(
     RegionRequirement(input_lps[0], 0/*projection id*/,
       READ_ONLY, EXCLUSIVE, inputs[0].region));
@@ -365,7 +365,7 @@ void ElementBinary::forward(const FFModel& ff)
   IndexLauncher launcher(ELEMENTBINARY_FWD_TASK_ID, task_is,
                          TaskArgument(this, sizeof(ElementBinary)), argmap,
                          Predicate::TRUE_PRED, false/*must*/, 0/*mapper_id*/,
-                         FFConfig::get_hash_id(std::string(name)));
+                         ff.config.get_strategy_id(std::string(name)));
   launcher.add_region_requirement(
     RegionRequirement(input_lps[0], 0/*projection id*/,
       READ_ONLY, EXCLUSIVE, inputs[0].region));
@@ -556,7 +556,7 @@ void ElementBinary::backward(const FFModel& ff)
   IndexLauncher launcher(ELEMENTBINARY_BWD_TASK_ID, task_is,
                          TaskArgument(this, sizeof(ElementBinary)), argmap,
                          Predicate::TRUE_PRED, false/*must*/, 0/*mapper_id*/,
-                         FFConfig::get_hash_id(std::string(name)));
+                         ff.config.get_strategy_id(std::string(name)));
   // regions[0](I): output_grad
   launcher.add_region_requirement(
     RegionRequirement(outputs[0].part_grad, 0/*projection id*/,
@@ -0,0 +1,180 @@
+/* Copyright 2020 Stanford
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "model.h"
+#include "cpu_helper.h"
+
+// ELU uses alpha = 1
+static void elewise_unary_forward_cpu(OperatorType type, coord_t volume,
+                                      const float* in, float* out)
+{
+  switch (type) {
+    case OP_EXP:
+    {
+      CPU_PARALLEL_FOR_SIMD
+      for (coord_t i = 0; i < volume; i++)
+        out[i] = cpu_exp(in[i]);
+      break;
+    }
+    case OP_RELU:
+    {
+      CPU_PARALLEL_FOR_SIMD
+      for (coord_t i = 0; i < volume; i++)
+        out[i] = in[i] > 0.0f ? in[i] : 0.0f;
+      break;
+    }
+    case OP_SIGMOID:
+    {
+      CPU_PARALLEL_FOR_SIMD
+      for (coord_t i = 0; i < volume; i++)
+        out[i] = cpu_sigmoid(in[i]);
+      break;
+    }
+    case OP_TANH:
+    {
+      CPU_PARALLEL_FOR_SIMD
+      for (coord_t i = 0; i < volume; i++)
+        out[i] = cpu_tanh(in[i]);
+      break;
+    }
+    case OP_ELU:
+    {
+      CPU_PARALLEL_FOR_SIMD
+      for (coord_t i = 0; i < volume; i++)
+        out[i] = in[i] > 0.0f ? in[i] : cpu_exp(in[i]) - 1.0f;
+      break;
+    }
+    default:
+      assert(false);
+  }
+}
+
+// Derivatives are taken from the saved output where possible, so each
+// element costs one fused read-modify-write of input_grad
+static void elewise_unary_backward_cpu(OperatorType type, coord_t volume,
+                                       const float* in, const float* out,
+                                       const float* out_grad, float* in_grad)
+{
+  switch (type) {
+    case OP_EXP:
+    {
+      CPU_PARALLEL_FOR_SIMD
+      for (coord_t i = 0; i < volume; i++)
+        in_grad[i] += out_grad[i] * out[i];
+      break;
+    }
+    case OP_RELU:
+    {
+      CPU_PARALLEL_FOR_SIMD
+      for (coord_t i = 0; i < volume; i++)
+        in_grad[i] += in[i] > 0.0f ? out_grad[i] : 0.0f;
+      break;
+    }
+    case OP_SIGMOID:
+    {
+      CPU_PARALLEL_FOR_SIMD
+      for (coord_t i = 0; i < volume; i++)
+        in_grad[i] += out_grad[i] * out[i] * (1.0f - out[i]);
+      break;
+    }
+    case OP_TANH:
+    {
+      CPU_PARALLEL_FOR_SIMD
+      for (coord_t i = 0; i < volume; i++)
+        in_grad[i] += out_grad[i] * (1.0f - out[i] * out[i]);
+      break;
+    }
+    case OP_ELU:
+    {
+      CPU_PARALLEL_FOR_SIMD
+      for (coord_t i = 0; i < volume; i++)
+        in_grad[i] += in[i] > 0.0f ? out_grad[i] : out_grad[i] * (out[i] + 1.0f);
+      break;
+    }
+    default:
+      assert(false);
+  }
+}
+
+OpMeta* ElementUnary::init_task_cpu(const Task *task,
+                                    const std::vector<PhysicalRegion> &regions,
+                                    Context ctx, Runtime *runtime)
+{
+  // CPU kernels keep no per-processor state
+  return NULL;
+}
+
+/*
+  regions[0](I): input
+  regions[1](O): output
+*/
+void ElementUnary::forward_task_cpu(const Task* task,
+                                    const std::vector<PhysicalRegion> &regions,
+                                    Context ctx, Runtime* runtime)
+{
+  assert(regions.size() == 2);
+  assert(task->regions.size() == 2);
+  const ElementUnary* ele = (const ElementUnary*) task->args;
+  Domain input_domain = runtime->get_index_space_domain(
+    ctx, task->regions[0].region.get_index_space());
+  Domain output_domain = runtime->get_index_space_domain(
+    ctx, task->regions[1].region.get_index_space());
+  assert(output_domain == input_domain);
+
+  const float* input_ptr = helperGetTensorPointerRO<float>(
+    regions[0], task->regions[0], FID_DATA, ctx, runtime);
+  float* output_ptr = helperGetTensorPointerWO<float>(
+    regions[1], task->regions[1], FID_DATA, ctx, runtime);
+  elewise_unary_forward_cpu(ele->op_type, output_domain.get_volume(),
+                            input_ptr, output_ptr);
+}
+
+/*
+  regions[0](I): input
+  regions[1](I/O): input_grad
+  regions[2](I): output
+  regions[3](I): output_grad
+*/
+void ElementUnary::backward_task_cpu(const Task* task,
+                                     const std::vector<PhysicalRegion> &regions,
+                                     Context ctx, Runtime* runtime)
+{
+  assert(regions.size() == 4);
+  assert(task->regions.size() == 4);
+  const ElementUnary* ele = (const ElementUnary*) task->args;
+  Domain input_domain = runtime->get_index_space_domain(
+    ctx, task->regions[0].region.get_index_space());
+  Domain input_grad_domain = runtime->get_index_space_domain(
+    ctx, task->regions[1].region.get_index_space());
+  Domain output_domain = runtime->get_index_space_domain(
+    ctx, task->regions[2].region.get_index_space());
+  Domain output_grad_domain = runtime->get_index_space_domain(
+    ctx, task->regions[3].region.get_index_space());
+  assert(output_grad_domain == input_domain);
+  assert(output_grad_domain == output_domain);
+  assert(output_grad_domain == input_grad_domain);
+
+  const float* input_ptr = helperGetTensorPointerRO<float>(
+    regions[0], task->regions[0], FID_DATA, ctx, runtime);
+  float* input_grad_ptr = helperGetTensorPointerRW<float>(
+    regions[1], task->regions[1], FID_DATA, ctx, runtime);
+  const float* output_ptr = helperGetTensorPointerRO<float>(
+    regions[2], task->regions[2], FID_DATA, ctx, runtime);
+  const float* output_grad_ptr = helperGetTensorPointerRO<float>(
+    regions[3], task->regions[3], FID_DATA, ctx, runtime);
+  elewise_unary_backward_cpu(ele->op_type, input_domain.get_volume(),
+                             input_ptr, output_ptr, output_grad_ptr,
+                             input_grad_ptr);
+}
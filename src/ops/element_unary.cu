@@ -196,7 +196,7 @@ void ElementUnary::init(const FFModel& ff)
   IndexLauncher init_launcher(ELEMENTUNARY_INIT_TASK_ID, task_is,
                               TaskArgument(this, sizeof(ElementUnary)), argmap,
                               Predicate::TRUE_PRED, false/*must*/, 0/*mapper_id*/,
-                              FFConfig::get_hash_id(std::string(name)));
+                              ff.config.get_strategy_id(std::string(name)));
   init_launcher.add_region_requirement(
       RegionRequirement(input_lps[0], 0/*projection id*/,
                         READ_ONLY, EXCLUSIVE, inputs[0].region));
@@ -314,7 +314,7 @@ void ElementUnary::forward(const FFModel& ff)
   IndexLauncher launcher(ELEMENTUNARY_FWD_TASK_ID, task_is,
                          TaskArgument(this, sizeof(ElementUnary)), argmap,
                          Predicate::TRUE_PRED, false/*must*/, 0/*mapper_id*/,
-                         FFConfig::get_hash_id(std::string(name)));
+                         ff.config.get_strategy_id(std::string(name)));
   launcher.add_region_requirement(
     RegionRequirement(input_lps[0], 0/*projection id*/,
       READ_ONLY, EXCLUSIVE, inputs[0].region));
@@ -428,7 +428,7 @@ void ElementUnary::backward(const FFModel& ff)
   IndexLauncher launcher(ELEMENTUNARY_BWD_TASK_ID, task_is,
                          TaskArgument(this, sizeof(ElementUnary)), argmap,
                          Predicate::TRUE_PRED, false/*must*/, 0/*mapper_id*/,
-                         FFConfig::get_hash_id(std::string(name)));
+                         ff.config.get_strategy_id(std::string(name)));
   // regions[0](I): input
   launcher.add_region_requirement(
     RegionRequirement(input_lps[0], 0/*projection id*/,
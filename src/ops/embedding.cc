@@ -14,6 +14,38 @@
  */
 
 #include "model.h"
+#include "cpu_helper.h"
+#include <algorithm>
+
+/*
+  Groups the slots by their position in the unique rows computed by
+  compute_unique_rows: slots[offsets[u] .. offsets[u+1]) are the slots
+  holding unique row u, in increasing order.
+*/
+static void group_slots_by_row(const int* slot_to_unique,
+                               coord_t num_slots,
+                               int num_unique,
+                               std::vector<coord_t>& offsets,
+                               std::vector<coord_t>& slots)
+{
+  offsets.assign(num_unique + 1, 0);
+  for (coord_t i = 0; i < num_slots; i++)
+    offsets[slot_to_unique[i] + 1] ++;
+  for (int u = 0; u < num_unique; u++)
+    offsets[u + 1] += offsets[u];
+  std::vector<coord_t> next(offsets.begin(), offsets.end() - 1);
+  slots.resize(num_slots);
+  for (coord_t i = 0; i < num_slots; i++)
+    slots[next[slot_to_unique[i]]++] = i;
+}
+
+OpMeta* Embedding::init_task_cpu(const Task *task,
+                                 const std::vector<PhysicalRegion> &regions,
+                                 Context ctx, Runtime* runtime)
+{
+  // CPU kernels keep no per-processor state
+  return NULL;
+}
 
 void Embedding::forward_task_cpu(const Task *task,
                                  const std::vector<PhysicalRegion>& regions,
@@ -21,7 +53,7 @@ void Embedding::forward_task_cpu(const Task *task,
 {
   assert(regions.size() == 3);
   assert(task->regions.size() == 3);
-  //const Embedding* embed = (Embedding*) task->args;
+  const Embedding* embed = (Embedding*) task->args;
   const AccessorRO<int64_t, 2> acc_input(regions[0], FID_DATA);
   const AccessorWO<float, 2> acc_output(regions[1], FID_DATA);
   const AccessorRO<float, 2> acc_weight(regions[2], FID_DATA);
@@ -36,21 +68,56 @@ void Embedding::forward_task_cpu(const Task *task,
   assert(batch_size == rect_output.hi[1] - rect_output.lo[1] + 1);
   coord_t in_dim = rect_input.hi[0] - rect_input.lo[0] + 1;
   coord_t out_dim = rect_output.hi[0] - rect_output.lo[0] + 1;
-  // Weight and output have same out dim
-  assert(out_dim == rect_weight.hi[1] - rect_weight.lo[1] + 1);
+  coord_t embed_dim = rect_weight.hi[1] - rect_weight.lo[1] + 1;
+  // Weight and output have same out dim, unless each index of a sample
+  // produces its own slice of the output
+  if (embed->aggr == AGGR_MODE_NONE)
+    assert(out_dim == in_dim * embed_dim);
+  else
+    assert(out_dim == embed_dim);
   const int64_t* input = acc_input.ptr(rect_input);
   float* output = acc_output.ptr(rect_output);
   const float* weight = acc_weight.ptr(rect_weight);
-  //TODO: implement Embedding forward
+  coord_t num_entries = rect_weight.hi[0] - rect_weight.lo[0] + 1;
+  AggrMode aggr = embed->aggr;
+  // Samples are independent, each gathers in_dim rows of the table
+  CPU_PARALLEL_FOR
+  for (coord_t i = 0; i < batch_size; i++) {
+    const int64_t* idx = input + i * in_dim;
+    float* out = output + i * out_dim;
+    if (aggr == AGGR_MODE_NONE) {
+      for (coord_t j = 0; j < in_dim; j++) {
+        coord_t row = idx[j] - rect_weight.lo[0];
+        assert(row >= 0 && row < num_entries);
+        cpu_copy(out + j * embed_dim, weight + row * embed_dim, embed_dim);
+      }
+    } else {
+      cpu_assign(out, out_dim, 0.0f);
+      for (coord_t j = 0; j < in_dim; j++) {
+        coord_t row = idx[j] - rect_weight.lo[0];
+        assert(row >= 0 && row < num_entries);
+        cpu_add(out, weight + row * embed_dim, embed_dim);
+      }
+      if (aggr == AGGR_MODE_AVG) {
+        cpu_scale(out, out_dim, 1.0f / in_dim);
+      } else {
+        assert(aggr == AGGR_MODE_SUM);
+      }
+    }
+  }
 }
 
 void Embedding::backward_task_cpu(const Task *task,
                                   const std::vector<PhysicalRegion>& regions,
                                   Context ctx, Runtime* runtime)
 {
+  const Embedding* embed = (Embedding*) task->args;
+  if (embed->weights[0].sparse_grad) {
+    backward_task_sparse_cpu(task, regions, ctx, runtime);
+    return;
+  }
   assert(regions.size() == 3);
   assert(task->regions.size() == 3);
-  //const Embedding* embed = (Embedding*) task->args;
   const AccessorRO<int64_t, 2> acc_input(regions[0], FID_DATA);
   const AccessorRO<float, 2> acc_output(regions[1], FID_DATA);
   const AccessorRW<float, 2> acc_weight(regions[2], FID_DATA);
@@ -65,11 +132,125 @@ void Embedding::backward_task_cpu(const Task *task,
   assert(batch_size == rect_output.hi[1] - rect_output.lo[1] + 1);
   coord_t in_dim = rect_input.hi[0] - rect_input.lo[0] + 1;
   coord_t out_dim = rect_output.hi[0] - rect_output.lo[0] + 1;
-  // Weight and output have same out dim
-  assert(out_dim == rect_weight.hi[1] - rect_weight.lo[1] + 1);
+  coord_t embed_dim = rect_weight.hi[1] - rect_weight.lo[1] + 1;
+  // Weight and output have same out dim, unless each index of a sample
+  // produces its own slice of the output
+  if (embed->aggr == AGGR_MODE_NONE)
+    assert(out_dim == in_dim * embed_dim);
+  else
+    assert(out_dim == embed_dim);
   const int64_t* input = acc_input.ptr(rect_input);
   const float* output = acc_output.ptr(rect_output);
   float* weight = acc_weight.ptr(rect_weight);
-  //TODO: implement Embedding backward
+  coord_t num_entries = rect_weight.hi[0] - rect_weight.lo[0] + 1;
+  AggrMode aggr = embed->aggr;
+  float scale = (aggr == AGGR_MODE_AVG) ? 1.0f / in_dim : 1.0f;
+  coord_t num_slots = rect_input.volume();
+  std::vector<int64_t> rows(num_slots);
+  std::vector<int> slot_to_unique(num_slots);
+  int num_unique = compute_unique_rows(input, num_slots, rows.data(),
+                                       slot_to_unique.data());
+  std::vector<coord_t> offsets, slots;
+  group_slots_by_row(slot_to_unique.data(), num_slots, num_unique,
+                     offsets, slots);
+  // Accumulate into weight_grad (zeroed by zero_gradients). Each row is
+  // updated by a single thread, so the scatter-add needs no atomics
+  CPU_PARALLEL_FOR
+  for (int u = 0; u < num_unique; u++) {
+    coord_t row = rows[u] - rect_weight.lo[0];
+    assert(row >= 0 && row < num_entries);
+    for (coord_t k = offsets[u]; k < offsets[u+1]; k++) {
+      coord_t slot = slots[k];
+      const float* grad = output + (slot / in_dim) * out_dim;
+      if (aggr == AGGR_MODE_NONE)
+        grad += (slot % in_dim) * embed_dim;
+      cpu_axpy(weight + row * embed_dim, grad, scale, embed_dim);
+    }
+  }
 }
 
+
+/*
+  Sorts the num_slots indices in input and writes the distinct ones to
+  rows (padded with -1 up to num_slots). slot_to_unique[i] is set to the
+  position of input[i] in rows. Returns the number of distinct rows.
+*/
+int Embedding::compute_unique_rows(const int64_t* input,
+                                   coord_t num_slots,
+                                   int64_t* rows,
+                                   int* slot_to_unique)
+{
+  std::vector<std::pair<int64_t, coord_t> > sorted(num_slots);
+  for (coord_t i = 0; i < num_slots; i++)
+    sorted[i] = std::make_pair(input[i], i);
+  std::sort(sorted.begin(), sorted.end());
+  int num_unique = 0;
+  for (coord_t i = 0; i < num_slots; i++) {
+    if (i == 0 || sorted[i].first != sorted[i-1].first)
+      rows[num_unique++] = sorted[i].first;
+    slot_to_unique[sorted[i].second] = num_unique - 1;
+  }
+  for (coord_t i = num_unique; i < num_slots; i++)
+    rows[i] = -1;
+  return num_unique;
+}
+
+/*
+  regions[0](I): input
+  regions[1](I): output_grad
+  regions[2](O): sparse_grad_rows
+  regions[3](O): sparse_grad_values
+*/
+void Embedding::backward_task_sparse_cpu(const Task *task,
+                                         const std::vector<PhysicalRegion>& regions,
+                                         Context ctx, Runtime* runtime)
+{
+  assert(regions.size() == 4);
+  assert(task->regions.size() == 4);
+  const Embedding* embed = (Embedding*) task->args;
+  const AccessorRO<int64_t, 2> acc_input(regions[0], FID_DATA);
+  const AccessorRO<float, 2> acc_output(regions[1], FID_DATA);
+  const AccessorWO<int64_t, 2> acc_rows(regions[2], FID_DATA);
+  const AccessorWO<float, 2> acc_values(regions[3], FID_DATA);
+  Rect<2> rect_input = runtime->get_index_space_domain(
+      ctx, task->regions[0].region.get_index_space());
+  Rect<2> rect_output = runtime->get_index_space_domain(
+      ctx, task->regions[1].region.get_index_space());
+  Rect<2> rect_rows = runtime->get_index_space_domain(
+      ctx, task->regions[2].region.get_index_space());
+  Rect<2> rect_values = runtime->get_index_space_domain(
+      ctx, task->regions[3].region.get_index_space());
+  coord_t batch_size = rect_input.hi[1] - rect_input.lo[1] + 1;
+  // Input and output have same batch size
+  assert(batch_size == rect_output.hi[1] - rect_output.lo[1] + 1);
+  assert(rect_input == rect_rows);
+  coord_t in_dim = rect_input.hi[0] - rect_input.lo[0] + 1;
+  coord_t out_dim = rect_output.hi[0] - rect_output.lo[0] + 1;
+  coord_t num_slots = rect_input.volume();
+  assert(rect_values.volume() % num_slots == 0);
+  coord_t embed_dim = rect_values.volume() / num_slots;
+  const int64_t* input = acc_input.ptr(rect_input);
+  const float* output = acc_output.ptr(rect_output);
+  int64_t* rows = acc_rows.ptr(rect_rows);
+  float* values = acc_values.ptr(rect_values);
+  std::vector<int> slot_to_unique(num_slots);
+  int num_unique = compute_unique_rows(input, num_slots, rows,
+                                       slot_to_unique.data());
+  AggrMode aggr = embed->aggr;
+  float scale = (aggr == AGGR_MODE_AVG) ? 1.0f / in_dim : 1.0f;
+  cpu_assign(values, rect_values.volume(), 0.0f);
+  std::vector<coord_t> offsets, slots;
+  group_slots_by_row(slot_to_unique.data(), num_slots, num_unique,
+                     offsets, slots);
+  // Each unique row is accumulated by a single thread
+  CPU_PARALLEL_FOR
+  for (int u = 0; u < num_unique; u++) {
+    for (coord_t k = offsets[u]; k < offsets[u+1]; k++) {
+      coord_t slot = slots[k];
+      const float* grad = output + (slot / in_dim) * out_dim;
+      if (aggr == AGGR_MODE_NONE)
+        grad += (slot % in_dim) * embed_dim;
+      cpu_axpy(values + u * embed_dim, grad, scale, embed_dim);
+    }
+  }
+}
@@ -15,6 +15,10 @@
 
 #include "model.h"
 #include "cuda_helper.h"
+#include <thrust/execution_policy.h>
+#include <thrust/scan.h>
+#include <thrust/sequence.h>
+#include <thrust/sort.h>
 
 Tensor FFModel::embedding(const Tensor& input,
                           int num_entries,
@@ -45,7 +49,9 @@ Embedding::Embedding(FFModel& model,
 {
   assert(_input.numDim == 2);
   outputs[0].numDim = 2;
-  outputs[0].adim[0] = out_channels;
+  // Without aggregation, each index of a sample produces its own slice
+  outputs[0].adim[0] = (aggr == AGGR_MODE_NONE)
+                       ? inputs[0].adim[0] * out_channels : out_channels;
   outputs[0].adim[1] = inputs[0].adim[1];
   weights[0].numDim = 2;
   weights[0].adim[0] = num_entries;
@@ -58,12 +64,26 @@ void Embedding::create_weights(FFModel& model)
   // Retrive the task indexspace for the op
   std::string pcname = name;
   task_is = IndexSpaceT<2>(model.get_or_create_task_is(2, pcname));
+  bool sparse_grad = model.config.sparse_embedding_grad;
   {
     const int dims[2] = {out_channels, num_entries};
     // Embeddding weights and linear weights can be partitioned in the same way
-    weights[0] = model.create_linear_weight<2>(this, dims, (IndexSpaceT<2>)task_is, DT_FLOAT, kernel_initializer);
+    weights[0] = model.create_linear_weight<2>(this, dims, (IndexSpaceT<2>)task_is, DT_FLOAT,
+                                               kernel_initializer, !sparse_grad/*create_grad*/);
     assert(numWeights == 1);
   }
+  if (sparse_grad) {
+    // One slot per input index, partitioned in the same way as the input
+    const int in_dim = inputs[0].adim[0];
+    const int batch_size = inputs[0].adim[1];
+    const int rows_dims[2] = {batch_size, in_dim};
+    const int values_dims[2] = {batch_size, in_dim * out_channels};
+    weights[0].sparse_grad = true;
+    weights[0].sparse_grad_rows = model.create_tensor<2>(
+        rows_dims, DT_INT64, this, false/*create_grad*/);
+    weights[0].sparse_grad_values = model.create_tensor<2>(
+        values_dims, DT_FLOAT, this, false/*create_grad*/);
+  }
 }
 
 void Embedding::create_output_and_partition(FFModel& model)
@@ -78,7 +98,7 @@ void Embedding::create_output_and_partition(FFModel& model)
   // Currently assume we can only partition over the sample dim
   assert(part_rect.hi[0] == part_rect.lo[0]);
   {
-    const int dims[2] = {inputs[0].adim[1], out_channels};
+    const int dims[2] = {inputs[0].adim[1], outputs[0].adim[0]};
     outputs[0] = model.create_tensor<2>(dims, DT_FLOAT, this);
     outputs[0].owner_op = this;
     outputs[0].owner_idx = 0;
@@ -95,12 +115,26 @@ void Embedding::create_output_and_partition(FFModel& model)
   }
 }
 
+/*
+  regions[0](O): output
+  regions[1](I): kernel
+  regions[2](O): input_grad
+*/
 __host__
 OpMeta* Embedding::init_task(const Task *task,
                              const std::vector<PhysicalRegion> &regions,
                              Context ctx, Runtime* runtime)
 {
-  return NULL;
+  assert(regions.size() == 3);
+  assert(task->regions.size() == 3);
+  const Embedding* embed = (Embedding*) task->args;
+  FFHandler handle = *((const FFHandler*) task->local_args);
+  // input_grad is partitioned in the same way as the input
+  Domain input_domain = runtime->get_index_space_domain(
+      ctx, task->regions[2].region.get_index_space());
+  int num_slots = embed->weights[0].sparse_grad ? input_domain.get_volume() : 0;
+  EmbeddingMeta* m = new EmbeddingMeta(handle, num_slots);
+  return m;
 }
 
 void Embedding::init(const FFModel& ff)
@@ -108,10 +142,19 @@ void Embedding::init(const FFModel& ff)
   ArgumentMap argmap;
   Context ctx = ff.config.lg_ctx;
   Runtime* runtime = ff.config.lg_hlr;
+  Rect<2> rect = runtime->get_index_space_domain(ctx, task_is);
+  ParallelConfig pc;
+  std::string pcname = name;
+  ff.config.find_parallel_config(2, pcname, pc);
+  int idx = 0;
+  for (PointInRectIterator<2> it(rect); it(); it++) {
+    FFHandler handle = ff.handlers[pc.device_ids[idx++]];
+    argmap.set_point(*it, TaskArgument(&handle, sizeof(FFHandler)));
+  }
   IndexLauncher launcher(EMBED_INIT_TASK_ID, task_is,
                          TaskArgument(this, sizeof(Embedding)), argmap,
                          Predicate::TRUE_PRED, false/*must*/, 0/*mapper_id*/,
-                         FFConfig::get_hash_id(std::string(name)));
+                         ff.config.get_strategy_id(std::string(name)));
   // regions[0]: input
   //launcher.add_region_requirement(
   //  RegionRequirement(input_lps[0], 0/*projection*/,
@@ -132,7 +175,12 @@ void Embedding::init(const FFModel& ff)
     RegionRequirement(input_grad_lps[0], 0/*projection*/,
       WRITE_ONLY, EXCLUSIVE, inputs[0].region_grad));
   launcher.add_field(2, FID_DATA);
-  runtime->execute_index_space(ctx, launcher);
+  FutureMap fm = runtime->execute_index_space(ctx, launcher);
+  fm.wait_all_results();
+  idx = 0;
+  for (PointInRectIterator<2> it(rect); it(); it++) {
+    meta[idx++] = fm.get_result<OpMeta*>(*it);
+  }
 }
 
 __global__
@@ -140,22 +188,30 @@ void embed_forward(const int64_t* input,
                    float* output,
                    const float* embed,
                    int out_dim,
+                   int embed_dim,
                    int in_dim,
                    int batch_size,
                    AggrMode aggr)
 {
   CUDA_KERNEL_LOOP(i, batch_size * out_dim)
   {
-    output[i] = 0;
     int idx = i / out_dim;
     int off = i % out_dim;
-    for (int j = 0; j < in_dim; j++) {
-      int64_t wordIdx = input[idx * in_dim + j];
-      output[i] += embed[wordIdx * out_dim + off];
+    if (aggr == AGGR_MODE_NONE) {
+      // Output slice off / embed_dim comes from the index at that position
+      int64_t wordIdx = input[idx * in_dim + off / embed_dim];
+      output[i] = embed[wordIdx * embed_dim + off % embed_dim];
+    } else {
+      float sum = 0.0f;
+      for (int j = 0; j < in_dim; j++) {
+        int64_t wordIdx = input[idx * in_dim + j];
+        sum += embed[wordIdx * embed_dim + off];
+      }
       if (aggr == AGGR_MODE_SUM) {
+        output[i] = sum;
       } else {
         assert(aggr == AGGR_MODE_AVG);
-        output[i] /= in_dim;
+        output[i] = sum / in_dim;
       }
     }
   }
@@ -166,6 +222,7 @@ void embed_backward(const int64_t* input,
                     const float* output,
                     float* embed,
                     int out_dim,
+                    int embed_dim,
                     int in_dim,
                     int batch_size,
                     AggrMode aggr)
@@ -174,25 +231,89 @@ void embed_backward(const int64_t* input,
   {
     int idx = i / out_dim;
     int off = i % out_dim;
-    float gradient;
-    if (aggr == AGGR_MODE_SUM) {
-       gradient = output[i];
+    if (aggr == AGGR_MODE_NONE) {
+      int64_t wordIdx = input[idx * in_dim + off / embed_dim];
+      atomicAdd(embed + wordIdx * embed_dim + off % embed_dim, output[i]);
     } else {
-      assert(aggr == AGGR_MODE_AVG);
-      gradient = output[i] / in_dim;
-    }
-    for (int j = 0; j < in_dim; j++) {
-      int64_t wordIdx = input[idx * in_dim + j];
-      atomicAdd(embed + wordIdx * out_dim + off, gradient);
+      float gradient;
+      if (aggr == AGGR_MODE_SUM) {
+        gradient = output[i];
+      } else {
+        assert(aggr == AGGR_MODE_AVG);
+        gradient = output[i] / in_dim;
+      }
+      for (int j = 0; j < in_dim; j++) {
+        int64_t wordIdx = input[idx * in_dim + j];
+        atomicAdd(embed + wordIdx * embed_dim + off, gradient);
+      }
     }
   }
 }
 
+// Flags the first occurrence of each index in the sorted indices
+__global__
+void embed_mark_unique(const int64_t* sorted_rows,
+                       int* unique_ids,
+                       int num_slots)
+{
+  CUDA_KERNEL_LOOP(i, num_slots)
+  {
+    unique_ids[i] = (i == 0 || sorted_rows[i] != sorted_rows[i-1]) ? 1 : 0;
+  }
+}
+
+// unique_ids holds the inclusive scan of the flags, so unique_ids[i] - 1
+// is the position of sorted_rows[i] among the distinct indices
+__global__
+void embed_scatter_unique(const int64_t* sorted_rows,
+                          const int* sorted_slots,
+                          const int* unique_ids,
+                          int64_t* rows,
+                          int* slot_to_unique,
+                          int num_slots)
+{
+  CUDA_KERNEL_LOOP(i, num_slots)
+  {
+    int u = unique_ids[i] - 1;
+    slot_to_unique[sorted_slots[i]] = u;
+    if (i == 0 || sorted_rows[i] != sorted_rows[i-1])
+      rows[u] = sorted_rows[i];
+  }
+}
+
 /*
   regions[0](I): input
   regions[1](O): output
   regions[2](I): kernel
 */
+__global__
+void embed_backward_sparse(const int* slot_to_unique,
+                           const float* output,
+                           float* values,
+                           int out_dim,
+                           int embed_dim,
+                           int in_dim,
+                           int num_slots,
+                           AggrMode aggr)
+{
+  CUDA_KERNEL_LOOP(i, num_slots * embed_dim)
+  {
+    int slot = i / embed_dim;
+    int off = i % embed_dim;
+    int idx = slot / in_dim;
+    float gradient;
+    if (aggr == AGGR_MODE_NONE) {
+      gradient = output[idx * out_dim + (slot % in_dim) * embed_dim + off];
+    } else if (aggr == AGGR_MODE_SUM) {
+      gradient = output[idx * out_dim + off];
+    } else {
+      assert(aggr == AGGR_MODE_AVG);
+      gradient = output[idx * out_dim + off] / in_dim;
+    }
+    atomicAdd(values + slot_to_unique[slot] * embed_dim + off, gradient);
+  }
+}
+
 __host__
 void Embedding::forward_task(const Task *task,
                              const std::vector<PhysicalRegion> &regions,
@@ -210,14 +331,18 @@ void Embedding::forward_task(const Task *task,
   // Input matches Output
   assert(accInput.rect.hi[1] == accOutput.rect.hi[1]);
   assert(accInput.rect.lo[1] == accOutput.rect.lo[1]);
-  // Weight matches Output
-  assert(accWeight.rect.hi[1] == accOutput.rect.hi[0]);
-  assert(accWeight.rect.lo[1] == accOutput.rect.lo[0]);
   int in_dim = accInput.rect.hi[0] - accInput.rect.lo[0] + 1;
   int out_dim = accOutput.rect.hi[0] - accOutput.rect.lo[0] + 1;
+  int embed_dim = accWeight.rect.hi[1] - accWeight.rect.lo[1] + 1;
   int batch_size = accOutput.rect.hi[1] - accOutput.rect.lo[1] + 1;
+  // Weight matches Output
+  if (embed->aggr == AGGR_MODE_NONE)
+    assert(out_dim == in_dim * embed_dim);
+  else
+    assert(out_dim == embed_dim);
   embed_forward<<<GET_BLOCKS(accOutput.rect.volume()), CUDA_NUM_THREADS>>>(
-      accInput.ptr, accOutput.ptr, accWeight.ptr, out_dim, in_dim, batch_size, embed->aggr);
+      accInput.ptr, accOutput.ptr, accWeight.ptr, out_dim, embed_dim,
+      in_dim, batch_size, embed->aggr);
   checkCUDA(cudaDeviceSynchronize());
   if (embed->profiling) {
     print_tensor<2, int64_t>(accInput.ptr, accInput.rect, "[Embedding:forward:input]");
@@ -235,7 +360,7 @@ void Embedding::forward(const FFModel& ff)
   IndexLauncher launcher(EMBED_FWD_TASK_ID, task_is,
                          TaskArgument(this, sizeof(Embedding)), argmap,
                          Predicate::TRUE_PRED, false/*must*/, 0/*mapper_id*/,
-                         FFConfig::get_hash_id(std::string(name)));
+                         ff.config.get_strategy_id(std::string(name)));
   // regions[0]: input
   launcher.add_region_requirement(
       RegionRequirement(input_lps[0], 0/*projection*/,
@@ -259,9 +384,13 @@ void Embedding::backward_task(const Task *task,
                               const std::vector<PhysicalRegion> &regions,
                               Context ctx, Runtime *runtime)
 {
+  const Embedding* embed = (Embedding*) task->args;
+  if (embed->weights[0].sparse_grad) {
+    backward_task_sparse(task, regions, ctx, runtime);
+    return;
+  }
   assert(regions.size() == 3);
   assert(task->regions.size() == 3);
-  const Embedding* embed = (Embedding*) task->args;
   TensorAccessorR<int64_t, 2> accInput(
       regions[0], task->regions[0], FID_DATA, ctx, runtime);
   TensorAccessorR<float, 2> accOutput(
@@ -271,17 +400,22 @@ void Embedding::backward_task(const Task *task,
   // Input matches Output
   assert(accInput.rect.hi[1] == accOutput.rect.hi[1]);
   assert(accInput.rect.lo[1] == accOutput.rect.lo[1]);
-  // WeightGrad matches Output
-  assert(accWeightGrad.rect.hi[1] - accWeightGrad.rect.lo[1] == accOutput.rect.hi[0] - accOutput.rect.lo[0]);
   int in_dim = accInput.rect.hi[0] - accInput.rect.lo[0] + 1;
   int out_dim = accOutput.rect.hi[0] - accOutput.rect.lo[0] + 1;
+  int embed_dim = accWeightGrad.rect.hi[1] - accWeightGrad.rect.lo[1] + 1;
   int batch_size = accOutput.rect.hi[1] - accOutput.rect.lo[1] + 1;
+  // WeightGrad matches Output
+  if (embed->aggr == AGGR_MODE_NONE)
+    assert(out_dim == in_dim * embed_dim);
+  else
+    assert(out_dim == embed_dim);
   // Explicitly initialize accWegihtGrad to zero to aviod calling zero_gradients() before backward()
   // as an optimization for DLRM
   //assign_kernel<<<GET_BLOCKS(accWeightGrad.rect.volume()), CUDA_NUM_THREADS>>>(
   //      accWeightGrad.ptr, accWeightGrad.rect.volume(), 0.0f);
   embed_backward<<<GET_BLOCKS(accOutput.rect.volume()), CUDA_NUM_THREADS>>>(
-      accInput.ptr, accOutput.ptr, accWeightGrad.ptr, out_dim, in_dim, batch_size, embed->aggr);
+      accInput.ptr, accOutput.ptr, accWeightGrad.ptr, out_dim, embed_dim,
+      in_dim, batch_size, embed->aggr);
   checkCUDA(cudaDeviceSynchronize());
   if (embed->profiling) {
     print_tensor<2, float>(accOutput.ptr, accOutput.rect, "[Embedding:backward:output_grad]");
@@ -291,15 +425,87 @@ void Embedding::backward_task(const Task *task,
   }
 }
 
+/*
+  regions[0](I): input
+  regions[1](I): output_grad
+  regions[2](O): sparse_grad_rows
+  regions[3](O): sparse_grad_values
+*/
+__host__
+void Embedding::backward_task_sparse(const Task *task,
+                                     const std::vector<PhysicalRegion> &regions,
+                                     Context ctx, Runtime *runtime)
+{
+  assert(regions.size() == 4);
+  assert(task->regions.size() == 4);
+  const Embedding* embed = (Embedding*) task->args;
+  const EmbeddingMeta* m = *((EmbeddingMeta**) task->local_args);
+  TensorAccessorR<int64_t, 2> accInput(
+      regions[0], task->regions[0], FID_DATA, ctx, runtime);
+  TensorAccessorR<float, 2> accOutput(
+      regions[1], task->regions[1], FID_DATA, ctx, runtime);
+  TensorAccessorW<int64_t, 2> accRows(
+      regions[2], task->regions[2], FID_DATA, ctx, runtime, false/*readOutput*/);
+  TensorAccessorW<float, 2> accValues(
+      regions[3], task->regions[3], FID_DATA, ctx, runtime, false/*readOutput*/);
+  // Input matches Output and the sparse gradients
+  assert(accInput.rect.hi[1] == accOutput.rect.hi[1]);
+  assert(accInput.rect.lo[1] == accOutput.rect.lo[1]);
+  assert(accInput.rect == accRows.rect);
+  int in_dim = accInput.rect.hi[0] - accInput.rect.lo[0] + 1;
+  int out_dim = accOutput.rect.hi[0] - accOutput.rect.lo[0] + 1;
+  int num_slots = accInput.rect.volume();
+  assert(accValues.rect.volume() % num_slots == 0);
+  int embed_dim = accValues.rect.volume() / num_slots;
+  assert(num_slots == m->num_slots);
+#ifndef DISABLE_LEGION_CUDA_HIJACK
+  cudaStream_t stream;
+  checkCUDA(cudaStreamCreate(&stream));
+#else
+  cudaStream_t stream = 0;
+#endif
+  // Deduplicate the indices on the device (same result as
+  // compute_unique_rows), sparse_grad_rows is in zero-copy memory
+  checkCUDA(cudaMemcpyAsync(m->sorted_rows, accInput.ptr,
+                            num_slots * sizeof(int64_t),
+                            cudaMemcpyDeviceToDevice, stream));
+  thrust::sequence(thrust::cuda::par.on(stream),
+                   m->sorted_slots, m->sorted_slots + num_slots);
+  thrust::stable_sort_by_key(thrust::cuda::par.on(stream),
+                             m->sorted_rows, m->sorted_rows + num_slots,
+                             m->sorted_slots);
+  embed_mark_unique<<<GET_BLOCKS(num_slots), CUDA_NUM_THREADS, 0, stream>>>(
+      m->sorted_rows, m->unique_ids, num_slots);
+  thrust::inclusive_scan(thrust::cuda::par.on(stream),
+                         m->unique_ids, m->unique_ids + num_slots,
+                         m->unique_ids);
+  assign_kernel<int64_t><<<GET_BLOCKS(num_slots), CUDA_NUM_THREADS, 0, stream>>>(
+      accRows.ptr, num_slots, -1);
+  embed_scatter_unique<<<GET_BLOCKS(num_slots), CUDA_NUM_THREADS, 0, stream>>>(
+      m->sorted_rows, m->sorted_slots, m->unique_ids, accRows.ptr,
+      m->slot_to_unique, num_slots);
+  assign_kernel<float><<<GET_BLOCKS(accValues.rect.volume()), CUDA_NUM_THREADS, 0, stream>>>(
+      accValues.ptr, accValues.rect.volume(), 0.0f);
+  embed_backward_sparse<<<GET_BLOCKS(num_slots * embed_dim), CUDA_NUM_THREADS, 0, stream>>>(
+      m->slot_to_unique, accOutput.ptr, accValues.ptr, out_dim, embed_dim,
+      in_dim, num_slots, embed->aggr);
+}
+
 void Embedding::backward(const FFModel& ff)
 {
   ArgumentMap argmap;
   Context ctx = ff.config.lg_ctx;
   Runtime* runtime = ff.config.lg_hlr;
+  Rect<2> rect = runtime->get_index_space_domain(ctx, task_is);
+  int idx = 0;
+  for (PointInRectIterator<2> it(rect); it(); it++) {
+    OpMeta* mp = meta[idx++];
+    argmap.set_point(*it, TaskArgument(&mp, sizeof(OpMeta*)));
+  }
   IndexLauncher launcher(EMBED_BWD_TASK_ID, task_is,
                          TaskArgument(this, sizeof(Embedding)), argmap,
                          Predicate::TRUE_PRED, false/*must*/, 0/*mapper_id*/,
-                         FFConfig::get_hash_id(std::string(name)));
+                         ff.config.get_strategy_id(std::string(name)));
   // regions[0]: input
   launcher.add_region_requirement(
       RegionRequirement(input_lps[0], 0/*projection*/,
@@ -311,14 +517,50 @@ void Embedding::backward(const FFModel& ff)
                         READ_ONLY, EXCLUSIVE, outputs[0].region_grad,
                         MAP_TO_ZC_MEMORY));
   launcher.add_field(1, FID_DATA);
-  // regions[2]: weight_grad
-  launcher.add_region_requirement(
-      RegionRequirement(weights[0].part_grad, 0/*projection*/,
-                        READ_WRITE, EXCLUSIVE, weights[0].region_grad));
-  launcher.add_field(2, FID_DATA);
+  if (weights[0].sparse_grad) {
+    // regions[2]: sparse_grad_rows
+    launcher.add_region_requirement(
+        RegionRequirement(weights[0].sparse_grad_rows.part, 0/*projection*/,
+                          WRITE_ONLY, EXCLUSIVE, weights[0].sparse_grad_rows.region,
+                          MAP_TO_ZC_MEMORY));
+    launcher.add_field(2, FID_DATA);
+    // regions[3]: sparse_grad_values
+    launcher.add_region_requirement(
+        RegionRequirement(weights[0].sparse_grad_values.part, 0/*projection*/,
+                          WRITE_ONLY, EXCLUSIVE, weights[0].sparse_grad_values.region));
+    launcher.add_field(3, FID_DATA);
+  } else {
+    // regions[2]: weight_grad
+    launcher.add_region_requirement(
+        RegionRequirement(weights[0].part_grad, 0/*projection*/,
+                          READ_WRITE, EXCLUSIVE, weights[0].region_grad));
+    launcher.add_field(2, FID_DATA);
+  }
   runtime->execute_index_space(ctx, launcher);
 }
 
+EmbeddingMeta::EmbeddingMeta(FFHandler handler, int _num_slots)
+: OpMeta(handler), num_slots(_num_slots), sorted_rows(NULL),
+  sorted_slots(NULL), unique_ids(NULL), slot_to_unique(NULL)
+{
+  if (num_slots > 0) {
+    checkCUDA(cudaMalloc(&sorted_rows, num_slots * sizeof(int64_t)));
+    checkCUDA(cudaMalloc(&sorted_slots, num_slots * sizeof(int)));
+    checkCUDA(cudaMalloc(&unique_ids, num_slots * sizeof(int)));
+    checkCUDA(cudaMalloc(&slot_to_unique, num_slots * sizeof(int)));
+  }
+}
+
+EmbeddingMeta::~EmbeddingMeta(void)
+{
+  if (num_slots > 0) {
+    checkCUDA(cudaFree(sorted_rows));
+    checkCUDA(cudaFree(sorted_slots));
+    checkCUDA(cudaFree(unique_ids));
+    checkCUDA(cudaFree(slot_to_unique));
+  }
+}
+
 bool Embedding::measure_compute_time(Simulator* sim,
                                      const ParallelConfig& pc,
                                      float& forward_time,
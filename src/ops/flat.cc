@@ -0,0 +1,67 @@
+/* Copyright 2020 Stanford
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "model.h"
+#include "cpu_helper.h"
+
+OpMeta* Flat::init_task_cpu(const Task* task,
+                            const std::vector<PhysicalRegion>& regions,
+                            Context ctx, Runtime* runtime)
+{
+  // CPU kernels keep no per-processor state
+  return NULL;
+}
+
+/*
+  regions[0](I): input
+  regions[1](O): output
+*/
+void Flat::forward_task_cpu(const Task* task,
+                            const std::vector<PhysicalRegion>& regions,
+                            Context ctx, Runtime* runtime)
+{
+  assert(regions.size() == 2);
+  assert(task->regions.size() == 2);
+  TensorAccessorR<float, 4> acc_input(
+      regions[0], task->regions[0], FID_DATA, ctx, runtime);
+  TensorAccessorW<float, 2> acc_output(
+      regions[1], task->regions[1], FID_DATA, ctx, runtime,
+      false/*readOutput*/);
+  assert(acc_input.rect.volume() == acc_output.rect.volume());
+  // Both layouts are dense, so flattening is one bulk copy
+  cpu_copy_with_stride(acc_output.ptr, 0, acc_input.ptr, 0,
+                       1, acc_input.rect.volume());
+}
+
+/*
+  regions[0](I/O): input_grad
+  regions[1](I): output_grad
+*/
+void Flat::backward_task_cpu(const Task* task,
+                             const std::vector<PhysicalRegion>& regions,
+                             Context ctx, Runtime* runtime)
+{
+  assert(regions.size() == 2);
+  assert(task->regions.size() == 2);
+  TensorAccessorW<float, 4> acc_input_grad(
+      regions[0], task->regions[0], FID_DATA, ctx, runtime,
+      true/*readOutput*/);
+  TensorAccessorR<float, 2> acc_output_grad(
+      regions[1], task->regions[1], FID_DATA, ctx, runtime);
+  assert(acc_input_grad.rect.volume() == acc_output_grad.rect.volume());
+  cpu_add_with_stride(acc_input_grad.ptr, 0, acc_output_grad.ptr, 0,
+                      1, acc_input_grad.rect.volume());
+}
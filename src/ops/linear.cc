@@ -0,0 +1,272 @@
+/* Copyright 2020 Stanford
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "model.h"
+#include "cpu_helper.h"
+#include <algorithm>
+#include <cmath>
+
+OpMeta* Linear::init_task_cpu(const Task *task,
+                              const std::vector<PhysicalRegion> &regions,
+                              Context ctx, Runtime *runtime)
+{
+  // CPU kernels keep no per-processor state
+  return NULL;
+}
+
+void Linear::forward_task_cpu(const Task *task,
+                              const std::vector<PhysicalRegion> &regions,
+                              Context ctx, Runtime *runtime)
+{
+  Domain in_domain = runtime->get_index_space_domain(
+      ctx, task->regions[0].region.get_index_space());
+  switch (in_domain.get_dim()) {
+#define DIMFUNC(DIM) \
+    case DIM: \
+      return forward_task_cpu_with_dim<DIM>(task, regions, ctx, runtime);
+    LEGION_FOREACH_N(DIMFUNC)
+#undef DIMFUNC
+    default:
+      assert(false);
+  }
+}
+
+/*
+  regions[0](I); input
+  regions[1](O): output
+  regions[2](I): kernel
+  regions[3](I): bias
+*/
+template<int NDIM>
+void Linear::forward_task_cpu_with_dim(const Task *task,
+                                       const std::vector<PhysicalRegion> &regions,
+                                       Context ctx, Runtime *runtime)
+{
+  assert(regions.size() == 4);
+  assert(task->regions.size() == 4);
+  const Linear* linear = (Linear*) task->args;
+  TensorAccessorR<float, NDIM> acc_input(
+      regions[0], task->regions[0], FID_DATA, ctx, runtime);
+  TensorAccessorW<float, NDIM> acc_output(
+      regions[1], task->regions[1], FID_DATA, ctx, runtime,
+      false/*readOutput*/);
+  TensorAccessorR<float, 2> acc_kernel(
+      regions[2], task->regions[2], FID_DATA, ctx, runtime);
+  TensorAccessorR<float, 1> acc_bias(
+      regions[3], task->regions[3], FID_DATA, ctx, runtime);
+  int in_dim = acc_input.rect.hi[0] - acc_input.rect.lo[0] + 1;
+  int out_dim = acc_output.rect.hi[0] - acc_output.rect.lo[0] + 1;
+  int batch_size = acc_output.rect.volume() / out_dim;
+  assert(acc_output.rect.volume() == out_dim * batch_size);
+  assert(acc_input.rect.volume() == in_dim * batch_size);
+  assert(acc_kernel.rect.volume() == in_dim * out_dim);
+  assert(acc_bias.rect.volume() == out_dim);
+  float* output = acc_output.ptr;
+  const float* bias = acc_bias.ptr;
+  // Seed every output column with the bias so that the GEMM accumulates
+  // on top of it instead of making a separate pass over the output
+  CPU_PARALLEL_FOR
+  for (int i = 0; i < batch_size; i++)
+    cpu_copy(output + (size_t)i * out_dim, bias, out_dim);
+  cpu_sgemm(true, false, out_dim, batch_size, in_dim,
+            1.0f, acc_kernel.ptr, in_dim,
+            acc_input.ptr, in_dim,
+            1.0f, output, out_dim);
+  ActiMode activation = linear->activation;
+  if (activation != AC_MODE_NONE) {
+    CPU_PARALLEL_FOR
+    for (int i = 0; i < batch_size; i++) {
+      float* out = output + (size_t)i * out_dim;
+      if (activation == AC_MODE_RELU) {
+        CPU_SIMD
+        for (int j = 0; j < out_dim; j++)
+          out[j] = out[j] > 0.0f ? out[j] : 0.0f;
+      } else if (activation == AC_MODE_SIGMOID) {
+        CPU_SIMD
+        for (int j = 0; j < out_dim; j++)
+          out[j] = cpu_sigmoid(out[j]);
+      } else {
+        // Unsupported activation mode
+        assert(false);
+      }
+    }
+  }
+}
+
+void Linear::backward_task_cpu(const Task *task,
+                               const std::vector<PhysicalRegion> &regions,
+                               Context ctx, Runtime *runtime)
+{
+  Domain in_domain = runtime->get_index_space_domain(
+      ctx, task->regions[0].region.get_index_space());
+  switch (in_domain.get_dim()) {
+#define DIMFUNC(DIM) \
+    case DIM: \
+      return backward_task_cpu_with_dim<DIM>(task, regions, ctx, runtime);
+    LEGION_FOREACH_N(DIMFUNC)
+#undef DIMFUNC
+    default:
+      assert(false);
+  }
+}
+
+/*
+  regions[0](I): input
+  regions[1](I/O): replica_grad or input_grad
+  regions[2](I): output
+  regions[3](I/O): output_grad
+  regions[4](I): filter
+  regions[5](I/O): filter_grad
+  regions[6](I/O): bias_grad
+*/
+template<int NDIM>
+void Linear::backward_task_cpu_with_dim(const Task *task,
+                                        const std::vector<PhysicalRegion> &regions,
+                                        Context ctx, Runtime *runtime)
+{
+  assert(regions.size() == 7);
+  assert(task->regions.size() == 7);
+  const Linear* linear = (Linear*) task->args;
+  TensorAccessorR<float, NDIM> acc_input(
+      regions[0], task->regions[0], FID_DATA, ctx, runtime);
+  TensorAccessorR<float, NDIM> acc_output(
+      regions[2], task->regions[2], FID_DATA, ctx, runtime);
+  int in_dim = acc_input.rect.hi[0] - acc_input.rect.lo[0] + 1;
+  int out_dim = acc_output.rect.hi[0] - acc_output.rect.lo[0] + 1;
+  int batch_size = acc_output.rect.volume() / out_dim;
+  Domain domain = runtime->get_index_space_domain(
+      ctx, task->regions[1].region.get_index_space());
+  // With the output channels split over num_par_c parts, each part writes
+  // its own replica of input_grad, which backward2 then reduces
+  bool replicated = (domain.get_dim() == NDIM+1);
+  if (!replicated)
+    assert(domain.get_dim() == NDIM);
+  float* input_grad = helperGetTensorPointerRW<float>(
+      regions[1], task->regions[1], FID_DATA, ctx, runtime);
+  assert(domain.get_volume() == (size_t)in_dim * batch_size);
+  TensorAccessorW<float, NDIM> acc_output_grad(
+      regions[3], task->regions[3], FID_DATA, ctx, runtime,
+      true/*readOutput*/);
+  TensorAccessorR<float, 2> acc_kernel(
+      regions[4], task->regions[4], FID_DATA, ctx, runtime);
+  TensorAccessorW<float, 2> acc_kernel_grad(
+      regions[5], task->regions[5], FID_DATA, ctx, runtime,
+      true/*readOutput*/);
+  TensorAccessorW<float, 1> acc_bias_grad(
+      regions[6], task->regions[6], FID_DATA, ctx, runtime,
+      true/*readOutput*/);
+  // make sure the sizes match
+  assert(acc_output.rect.volume() == out_dim * batch_size);
+  assert(acc_output_grad.rect.volume() == out_dim * batch_size);
+  assert(acc_kernel.rect.volume() == in_dim * out_dim);
+  assert(acc_kernel_grad.rect.volume() == in_dim * out_dim);
+  assert(acc_bias_grad.rect.volume() == out_dim);
+  const float* output = acc_output.ptr;
+  float* output_grad = acc_output_grad.ptr;
+  float* bias_grad = acc_bias_grad.ptr;
+  ActiMode activation = linear->activation;
+  if (activation != AC_MODE_NONE) {
+    CPU_PARALLEL_FOR
+    for (int i = 0; i < batch_size; i++) {
+      const float* out = output + (size_t)i * out_dim;
+      float* out_grad = output_grad + (size_t)i * out_dim;
+      if (activation == AC_MODE_RELU) {
+        CPU_SIMD
+        for (int j = 0; j < out_dim; j++)
+          out_grad[j] = out[j] > 0.0f ? out_grad[j] : 0.0f;
+      } else if (activation == AC_MODE_SIGMOID) {
+        CPU_SIMD
+        for (int j = 0; j < out_dim; j++)
+          out_grad[j] = out_grad[j] * out[j] * (1.0f - out[j]);
+      } else {
+        // Unsupported activation mode
+        assert(false);
+      }
+    }
+  }
+  // Compute weight gradient
+  cpu_sgemm(false, true, in_dim, out_dim, batch_size,
+            1.0f, acc_input.ptr, in_dim,
+            output_grad, out_dim,
+            1.0f, acc_kernel_grad.ptr, in_dim);
+  // Compute bias gradient, each thread reduces a block of output channels
+  // over the whole batch
+  const int blk_size = 64;
+  int num_blocks = (out_dim + blk_size - 1) / blk_size;
+  CPU_PARALLEL_FOR_IF((coord_t)batch_size * out_dim >= CPU_PARALLEL_MIN_VOLUME)
+  for (int b = 0; b < num_blocks; b++) {
+    int lo = b * blk_size;
+    int len = std::min(blk_size, out_dim - lo);
+    for (int i = 0; i < batch_size; i++)
+      cpu_add(bias_grad + lo, output_grad + (size_t)i * out_dim + lo, len);
+  }
+  // Compute data gradient, replicas are overwritten in every iteration
+  // while input_grad accumulates
+  cpu_sgemm(false, false, in_dim, batch_size, out_dim,
+            1.0f, acc_kernel.ptr, in_dim,
+            output_grad, out_dim,
+            replicated ? 0.0f : 1.0f, input_grad, in_dim);
+}
+
+void Linear::backward2_task_cpu(const Task *task,
+                                const std::vector<PhysicalRegion> &regions,
+                                Context ctx, Runtime *runtime)
+{
+  Domain in_domain = runtime->get_index_space_domain(
+      ctx, task->regions[0].region.get_index_space());
+  switch (in_domain.get_dim()) {
+#define DIMFUNC(DIM) \
+    case DIM: \
+      return backward2_task_cpu_with_dim<DIM>(task, regions, ctx, runtime);
+    LEGION_FOREACH_N(DIMFUNC)
+#undef DIMFUNC
+    default:
+      assert(false);
+  }
+}
+
+/*
+  regions[0](I/O): input_grad
+  regions[1](I): replicas
+*/
+template<int NDIM>
+void Linear::backward2_task_cpu_with_dim(const Task *task,
+                                         const std::vector<PhysicalRegion> &regions,
+                                         Context ctx, Runtime *runtime)
+{
+  TensorAccessorW<float, NDIM> acc_input(
+      regions[0], task->regions[0], FID_DATA, ctx, runtime,
+      true/*readOutput*/);
+  Domain replica_domain = runtime->get_index_space_domain(
+      ctx, task->regions[1].region.get_index_space());
+  assert(replica_domain.get_dim() == NDIM+1);
+  for (int i = 0; i < NDIM; i++) {
+    assert(acc_input.rect.lo[i] == replica_domain.lo()[i]);
+    assert(acc_input.rect.hi[i] == replica_domain.hi()[i]);
+  }
+  const float* replica_ptr = helperGetTensorPointerRO<float>(
+      regions[1], task->regions[1], FID_DATA, ctx, runtime);
+  int num_replica = replica_domain.hi()[NDIM] - replica_domain.lo()[NDIM] + 1;
+  coord_t volume = acc_input.rect.volume();
+  // Sum the replica written by every part of the output channels, the
+  // replicas are laid out one after another along the outermost dimension
+  CPU_PARALLEL_FOR_IF(volume >= CPU_PARALLEL_MIN_VOLUME)
+  for (coord_t j = 0; j < volume; j++) {
+    float sum = 0.0f;
+    for (int i = 0; i < num_replica; i++)
+      sum += replica_ptr[i * volume + j];
+    acc_input.ptr[j] += sum;
+  }
+}
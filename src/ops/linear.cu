@@ -341,7 +341,7 @@ void Linear::init_with_dim(const FFModel& ff)
   IndexLauncher launcher(LINEAR_INIT_TASK_ID, task_is,
                          TaskArgument(this, sizeof(Linear)), argmap,
                          Predicate::TRUE_PRED, false/*must*/, 0/*mapper_id*/,
-                         FFConfig::get_hash_id(std::string(name)));
+                         ff.config.get_strategy_id(std::string(name)));
   //launcher.add_region_requirement(
   //    RegionRequirement(input_lps[0], 0/*projection id*/,
   //                      READ_ONLY, EXCLUSIVE, inputs[0].region));
@@ -505,7 +505,7 @@ void Linear::forward_with_dim(const FFModel& ff)
   IndexLauncher launcher(LINEAR_FWD_TASK_ID, task_is,
                          TaskArgument(this, sizeof(Linear)), argmap,
                          Predicate::TRUE_PRED, false/*must*/, 0/*mapper_id*/,
-                         FFConfig::get_hash_id(std::string(name)));
+                         ff.config.get_strategy_id(std::string(name)));
   launcher.add_region_requirement(
       RegionRequirement(input_lps[0], 0/*projection id*/,
                         READ_ONLY, EXCLUSIVE, inputs[0].region));
@@ -769,7 +769,7 @@ void Linear::backward_with_dim(const FFModel& ff)
     IndexLauncher launcher(LINEAR_BWD_TASK_ID, task_is,
                            TaskArgument(this, sizeof(Linear)), argmap,
                            Predicate::TRUE_PRED, false/*must*/, 0/*mapper_id*/,
-                           FFConfig::get_hash_id(std::string(name)));
+                           ff.config.get_strategy_id(std::string(name)));
     // regions[0](I): input
     launcher.add_region_requirement(
         RegionRequirement(input_lps[0], 0/*projection id*/,
@@ -823,7 +823,7 @@ void Linear::backward_with_dim(const FFModel& ff)
     IndexLauncher launcher(LINEAR_BWD2_TASK_ID, task_is,
                            TaskArgument(this, sizeof(Linear)), argmap,
                            Predicate::TRUE_PRED, false/*must*/, 0/*mapper_id*/,
-                           FFConfig::get_hash_id(std::string(name)));
+                           ff.config.get_strategy_id(std::string(name)));
     launcher.add_region_requirement(
         RegionRequirement(input_grad_lps[0], 0/*projection id*/,
                           READ_WRITE, EXCLUSIVE, inputs[0].region_grad));
@@ -203,7 +203,7 @@ void MSELoss::backward(const FFModel& model)
   IndexLauncher launcher(MSELOSS_BWD_TASK_ID, task_is,
                          TaskArgument(this, sizeof(MSELoss)), argmap,
                          Predicate::TRUE_PRED, false/*must*/, 0/*mapper_id*/,
-                         FFConfig::get_hash_id(std::string(name)));
+                         model.config.get_strategy_id(std::string(name)));
   // regions[0]: _logit
   launcher.add_region_requirement(
       RegionRequirement(inputs[0].part, 0/*projection*/,
@@ -0,0 +1,95 @@
+/* Copyright 2020 Stanford
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "model.h"
+#include "cpu_kernels.h"
+
+static Pool2DShape get_pool2d_shape(const Pool2D* pool,
+                                    const Rect<4>& input_rect,
+                                    const Rect<4>& output_rect)
+{
+  Pool2DShape s;
+  s.input_w = input_rect.hi[0] - input_rect.lo[0] + 1;
+  s.input_h = input_rect.hi[1] - input_rect.lo[1] + 1;
+  s.output_w = output_rect.hi[0] - output_rect.lo[0] + 1;
+  s.output_h = output_rect.hi[1] - output_rect.lo[1] + 1;
+  s.num_planes = input_rect.volume() / (s.input_w * s.input_h);
+  assert(s.num_planes * s.output_w * s.output_h == output_rect.volume());
+  s.kernel_h = pool->kernel_h;
+  s.kernel_w = pool->kernel_w;
+  s.stride_h = pool->stride_h;
+  s.stride_w = pool->stride_w;
+  // Same padding as the cuDNN descriptor in Pool2D::init_task
+  s.pad_h = ((s.output_h - 1) * s.stride_h + s.kernel_h - s.input_h + 1) / 2;
+  s.pad_w = ((s.output_w - 1) * s.stride_w + s.kernel_w - s.input_w + 1) / 2;
+  return s;
+}
+
+OpMeta* Pool2D::init_task_cpu(const Task *task,
+                              const std::vector<PhysicalRegion> &regions,
+                              Context ctx, Runtime *runtime)
+{
+  // CPU kernels keep no per-processor state
+  return NULL;
+}
+
+/*
+  regions[0](I): input
+  regions[1](O): output
+*/
+void Pool2D::forward_task_cpu(const Task *task,
+                              const std::vector<PhysicalRegion> &regions,
+                              Context ctx, Runtime *runtime)
+{
+  assert(regions.size() == 2);
+  assert(task->regions.size() == 2);
+  const Pool2D* pool = (Pool2D*) task->args;
+  TensorAccessorR<float, 4> acc_input(
+      regions[0], task->regions[0], FID_DATA, ctx, runtime);
+  TensorAccessorW<float, 4> acc_output(
+      regions[1], task->regions[1], FID_DATA, ctx, runtime,
+      false/*readOutput*/);
+  Pool2DShape s = get_pool2d_shape(pool, acc_input.rect, acc_output.rect);
+  pool2d_forward_cpu(s, pool->pool_type, acc_input.ptr, acc_output.ptr);
+}
+
+/*
+  regions[0](I): input
+  regions[1](I/O): input_grad
+  regions[2](I): output
+  regions[3](I): output_grad
+*/
+void Pool2D::backward_task_cpu(const Task *task,
+                               const std::vector<PhysicalRegion> &regions,
+                               Context ctx, Runtime *runtime)
+{
+  assert(regions.size() == 4);
+  assert(task->regions.size() == 4);
+  const Pool2D* pool = (Pool2D*) task->args;
+  TensorAccessorR<float, 4> acc_input(
+      regions[0], task->regions[0], FID_DATA, ctx, runtime);
+  TensorAccessorW<float, 4> acc_input_grad(
+      regions[1], task->regions[1], FID_DATA, ctx, runtime,
+      true/*readOutput*/);
+  TensorAccessorR<float, 4> acc_output(
+      regions[2], task->regions[2], FID_DATA, ctx, runtime);
+  TensorAccessorR<float, 4> acc_output_grad(
+      regions[3], task->regions[3], FID_DATA, ctx, runtime);
+  Pool2DShape s = get_pool2d_shape(pool, acc_input.rect, acc_output.rect);
+  assert(acc_input_grad.rect == acc_input.rect);
+  assert(acc_output_grad.rect == acc_output.rect);
+  pool2d_backward_cpu(s, pool->pool_type, acc_input.ptr, acc_input_grad.ptr,
+                      acc_output_grad.ptr);
+}
@@ -193,7 +193,7 @@ void Pool2D::init(const FFModel& ff)
   IndexLauncher init_launcher(POOL2D_INIT_TASK_ID, task_is,
                               TaskArgument(this, sizeof(Pool2D)), argmap,
                               Predicate::TRUE_PRED, false/*must*/, 0/*mapper_id*/,
-                              FFConfig::get_hash_id(std::string(name)));
+                              ff.config.get_strategy_id(std::string(name)));
   init_launcher.add_region_requirement(
       RegionRequirement(input_lps[0], 0/*projection id*/,
                         READ_ONLY, EXCLUSIVE, inputs[0].region));
@@ -252,7 +252,7 @@ void Pool2D::forward(const FFModel& ff)
   IndexLauncher launcher(POOL2D_FWD_TASK_ID, task_is,
                          TaskArgument(this, sizeof(Pool2D)), argmap,
                          Predicate::TRUE_PRED, false/*must*/, 0/*mapper_id*/,
-                         FFConfig::get_hash_id(std::string(name)));
+                         ff.config.get_strategy_id(std::string(name)));
   launcher.add_region_requirement(
       RegionRequirement(input_lps[0], 0/*projection id*/,
                         READ_ONLY, EXCLUSIVE, inputs[0].region));
@@ -331,7 +331,7 @@ void Pool2D::backward(const FFModel& ff)
   IndexLauncher launcher(POOL2D_BWD_TASK_ID, task_is,
                          TaskArgument(this, sizeof(Pool2D)), argmap,
                          Predicate::TRUE_PRED, false/*must*/, 0/*mapper_id*/,
-                         FFConfig::get_hash_id(std::string(name)));
+                         ff.config.get_strategy_id(std::string(name)));
   // regions[0](I): input
   launcher.add_region_requirement(
       RegionRequirement(inputs[0].part, 0/*projection id*/,
@@ -0,0 +1,72 @@
+/* Copyright 2020 Stanford
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "model.h"
+#include "cpu_helper.h"
+
+OpMeta* Reshape::init_task_cpu(const Task* task,
+                               const std::vector<PhysicalRegion>& regions,
+                               Context ctx, Runtime* runtime)
+{
+  // CPU kernels keep no per-processor state
+  return NULL;
+}
+
+/*
+  regions[0](I): input
+  regions[1](O): output
+*/
+void Reshape::forward_task_cpu(const Task* task,
+                               const std::vector<PhysicalRegion>& regions,
+                               Context ctx, Runtime* runtime)
+{
+  assert(regions.size() == 2);
+  assert(task->regions.size() == 2);
+  Domain in_domain = runtime->get_index_space_domain(
+    ctx, task->regions[0].region.get_index_space());
+  Domain out_domain = runtime->get_index_space_domain(
+    ctx, task->regions[1].region.get_index_space());
+  assert(in_domain.get_volume() == out_domain.get_volume());
+  const float* in_ptr = helperGetTensorPointerRO<float>(
+    regions[0], task->regions[0], FID_DATA, ctx, runtime);
+  float* out_ptr = helperGetTensorPointerWO<float>(
+    regions[1], task->regions[1], FID_DATA, ctx, runtime);
+  // Both layouts are dense, so reshaping is one bulk copy
+  cpu_copy_with_stride(out_ptr, 0, in_ptr, 0, 1, in_domain.get_volume());
+}
+
+/*
+  regions[0](I): output_grad
+  regions[1](I/O): input_grad
+*/
+void Reshape::backward_task_cpu(const Task* task,
+                                const std::vector<PhysicalRegion>& regions,
+                                Context ctx, Runtime* runtime)
+{
+  assert(regions.size() == 2);
+  assert(task->regions.size() == 2);
+  Domain out_grad_domain = runtime->get_index_space_domain(
+    ctx, task->regions[0].region.get_index_space());
+  Domain in_grad_domain = runtime->get_index_space_domain(
+    ctx, task->regions[1].region.get_index_space());
+  assert(in_grad_domain.get_volume() == out_grad_domain.get_volume());
+  const float* out_grad_ptr = helperGetTensorPointerRO<float>(
+    regions[0], task->regions[0], FID_DATA, ctx, runtime);
+  float* in_grad_ptr = helperGetTensorPointerRW<float>(
+    regions[1], task->regions[1], FID_DATA, ctx, runtime);
+  cpu_add_with_stride(in_grad_ptr, 0, out_grad_ptr, 0,
+                      1, in_grad_domain.get_volume());
+}
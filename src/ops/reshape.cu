@@ -183,7 +183,7 @@ void Reshape::init(const FFModel& ff)
   IndexLauncher launcher(RESHAPE_INIT_TASK_ID, task_is,
       TaskArgument(this, sizeof(Reshape)), argmap,
       Predicate::TRUE_PRED, false/*must*/, 0/*mapper_id*/,
-      FFConfig::get_hash_id(std::string(name)));
+      ff.config.get_strategy_id(std::string(name)));
   launcher.add_region_requirement(
     RegionRequirement(input_lps[0], 0/*projection id*/,
       READ_ONLY, EXCLUSIVE, inputs[0].region));
@@ -224,7 +224,7 @@ void Reshape::forward(const FFModel& ff)
   IndexLauncher launcher(RESHAPE_FWD_TASK_ID, task_is,
       TaskArgument(this, sizeof(Reshape)), argmap,
       Predicate::TRUE_PRED, false/*must*/, 0/*mapper_id*/,
-      FFConfig::get_hash_id(std::string(name)));
+      ff.config.get_strategy_id(std::string(name)));
   launcher.add_region_requirement(
     RegionRequirement(input_lps[0], 0/*projection id*/,
       READ_ONLY, EXCLUSIVE, inputs[0].region));
@@ -266,7 +266,7 @@ void Reshape::backward(const FFModel& ff)
   IndexLauncher launcher(RESHAPE_BWD_TASK_ID, task_is,
                          TaskArgument(this, sizeof(Reshape)), argmap,
                          Predicate::TRUE_PRED, false/*must*/, 0/*mapper_id*/,
-                         FFConfig::get_hash_id(std::string(name)));
+                         ff.config.get_strategy_id(std::string(name)));
   // regions[0](I): output_grad
   launcher.add_region_requirement(
     RegionRequirement(outputs[0].part_grad, 0/*projection id*/,
@@ -0,0 +1,131 @@
+/* Copyright 2020 Stanford
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "model.h"
+#include "cpu_helper.h"
+
+// Reverses the middle dimension of a [num_out_blks, reverse_dim_size,
+// in_blk_size] tensor, writing or accumulating into dst
+static void reverse_cpu(float* dst, const float* src,
+                        coord_t num_out_blks, coord_t reverse_dim_size,
+                        coord_t in_blk_size, bool accumulate)
+{
+  coord_t num_rows = num_out_blks * reverse_dim_size;
+  bool parallel = num_rows * in_blk_size >= CPU_PARALLEL_MIN_VOLUME;
+  if (in_blk_size == 1) {
+    // Reversing the innermost dimension has no contiguous runs to copy
+    CPU_PARALLEL_FOR_IF(parallel)
+    for (coord_t i = 0; i < num_rows; i++) {
+      coord_t r = i % reverse_dim_size;
+      coord_t j = i - r + (reverse_dim_size - 1 - r);
+      dst[i] = accumulate ? dst[i] + src[j] : src[j];
+    }
+    return;
+  }
+  CPU_PARALLEL_FOR_IF(parallel)
+  for (coord_t i = 0; i < num_rows; i++) {
+    coord_t r = i % reverse_dim_size;
+    coord_t j = i - r + (reverse_dim_size - 1 - r);
+    if (accumulate)
+      cpu_add(dst + i * in_blk_size, src + j * in_blk_size, in_blk_size);
+    else
+      memcpy(dst + i * in_blk_size, src + j * in_blk_size,
+             in_blk_size * sizeof(float));
+  }
+}
+
+// Same blocking as Reverse::forward_task
+static void get_reverse_shape(const Domain& domain, int axis,
+                              coord_t& in_blk_size, coord_t& reverse_dim_size,
+                              coord_t& num_out_blks)
+{
+  in_blk_size = 1;
+  reverse_dim_size = 1;
+  num_out_blks = 1;
+  for (int i = 0; i < domain.get_dim(); i++) {
+    if (i < axis)
+      in_blk_size *= domain.hi()[i] - domain.lo()[i] + 1;
+    else if (i == axis)
+      reverse_dim_size = domain.hi()[i] - domain.lo()[i] + 1;
+    else
+      num_out_blks *= domain.hi()[i] - domain.lo()[i] + 1;
+  }
+}
+
+OpMeta* Reverse::init_task_cpu(const Task* task,
+                               const std::vector<PhysicalRegion>& regions,
+                               Context ctx, Runtime* runtime)
+{
+  // CPU kernels keep no per-processor state
+  return NULL;
+}
+
+/*
+  regions[0](I): input
+  regions[1](O): output
+*/
+void Reverse::forward_task_cpu(const Task* task,
+                               const std::vector<PhysicalRegion>& regions,
+                               Context ctx, Runtime* runtime)
+{
+  assert(regions.size() == 2);
+  assert(task->regions.size() == 2);
+  const Reverse* reverse = (const Reverse*) task->args;
+  Domain in_domain = runtime->get_index_space_domain(
+    ctx, task->regions[0].region.get_index_space());
+  Domain out_domain = runtime->get_index_space_domain(
+    ctx, task->regions[1].region.get_index_space());
+  assert(out_domain == in_domain);
+  const float* in_ptr = helperGetTensorPointerRO<float>(
+    regions[0], task->regions[0], FID_DATA, ctx, runtime);
+  float* out_ptr = helperGetTensorPointerWO<float>(
+    regions[1], task->regions[1], FID_DATA, ctx, runtime);
+  int axis = in_domain.get_dim() - reverse->axis - 1;
+  coord_t in_blk_size, reverse_dim_size, num_out_blks;
+  get_reverse_shape(out_domain, axis, in_blk_size, reverse_dim_size,
+                    num_out_blks);
+  reverse_cpu(out_ptr, in_ptr, num_out_blks, reverse_dim_size, in_blk_size,
+              false/*accumulate*/);
+}
+
+/*
+  regions[0](I): output_grad
+  regions[1](I/O): input_grad
+*/
+void Reverse::backward_task_cpu(const Task* task,
+                                const std::vector<PhysicalRegion>& regions,
+                                Context ctx, Runtime* runtime)
+{
+  assert(regions.size() == 2);
+  assert(task->regions.size() == 2);
+  const Reverse* reverse = (const Reverse*) task->args;
+  Domain out_grad_domain = runtime->get_index_space_domain(
+    ctx, task->regions[0].region.get_index_space());
+  Domain in_grad_domain = runtime->get_index_space_domain(
+    ctx, task->regions[1].region.get_index_space());
+  assert(out_grad_domain == in_grad_domain);
+  const float* out_grad_ptr = helperGetTensorPointerRO<float>(
+    regions[0], task->regions[0], FID_DATA, ctx, runtime);
+  float* in_grad_ptr = helperGetTensorPointerRW<float>(
+    regions[1], task->regions[1], FID_DATA, ctx, runtime);
+  int axis = in_grad_domain.get_dim() - reverse->axis - 1;
+  coord_t in_blk_size, reverse_dim_size, num_out_blks;
+  get_reverse_shape(in_grad_domain, axis, in_blk_size, reverse_dim_size,
+                    num_out_blks);
+  // Reversal is its own inverse, accumulated like every other gradient
+  reverse_cpu(in_grad_ptr, out_grad_ptr, num_out_blks, reverse_dim_size,
+              in_blk_size, true/*accumulate*/);
+}
@@ -104,7 +104,7 @@ void Reverse::init(const FFModel& ff)
   IndexLauncher launcher(REVERSE_INIT_TASK_ID, task_is,
                          TaskArgument(this, sizeof(Reverse)), argmap,
                          Predicate::TRUE_PRED, false/*must*/, 0/*mapper_id*/,
-                         FFConfig::get_hash_id(std::string(name)));
+                         ff.config.get_strategy_id(std::string(name)));
   launcher.add_region_requirement(
     RegionRequirement(input_lps[0], 0/*projection id*/,
       READ_ONLY, EXCLUSIVE, inputs[0].region));
@@ -172,9 +172,9 @@ void Reverse::forward(const FFModel& ff)
   Context ctx = ff.config.lg_ctx;
   Runtime* runtime = ff.config.lg_hlr;
   IndexLauncher launcher(REVERSE_FWD_TASK_ID, task_is,
-                         TaskArgument(this, sizeof(ElementBinary)), argmap,
+                         TaskArgument(this, sizeof(Reverse)), argmap,
                          Predicate::TRUE_PRED, false/*must*/, 0/*mapper_id*/,
-                         FFConfig::get_hash_id(std::string(name)));
+                         ff.config.get_strategy_id(std::string(name)));
   launcher.add_region_requirement(
     RegionRequirement(input_lps[0], 0/*projection id*/,
       READ_ONLY, EXCLUSIVE, inputs[0].region));
@@ -224,9 +224,9 @@ void Reverse::backward(const FFModel& ff)
   Context ctx = ff.config.lg_ctx;
   Runtime* runtime = ff.config.lg_hlr;
   IndexLauncher launcher(REVERSE_BWD_TASK_ID, task_is,
-                         TaskArgument(this, sizeof(Linear)), argmap,
+                         TaskArgument(this, sizeof(Reverse)), argmap,
                          Predicate::TRUE_PRED, false/*must*/, 0/*mapper_id*/,
-                         FFConfig::get_hash_id(std::string(name)));
+                         ff.config.get_strategy_id(std::string(name)));
   // regions[0](I): output_grad
   launcher.add_region_requirement(
     RegionRequirement(outputs[0].part_grad, 0/*projection id*/,
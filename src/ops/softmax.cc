@@ -0,0 +1,89 @@
+/* Copyright 2020 Stanford
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "model.h"
+#include "cpu_helper.h"
+
+OpMeta* Softmax::init_task_cpu(const Task *task,
+                               const std::vector<PhysicalRegion> &regions,
+                               Context ctx, Runtime *runtime)
+{
+  // CPU kernels keep no per-processor state
+  return NULL;
+}
+
+/*
+  regions[0](I): input
+  regions[1](O): output
+*/
+void Softmax::forward_task_cpu(const Task *task,
+                               const std::vector<PhysicalRegion> &regions,
+                               Context ctx, Runtime *runtime)
+{
+  assert(regions.size() == 2);
+  assert(task->regions.size() == 2);
+  TensorAccessorR<float, 2> acc_input(
+      regions[0], task->regions[0], FID_DATA, ctx, runtime);
+  TensorAccessorW<float, 2> acc_output(
+      regions[1], task->regions[1], FID_DATA, ctx, runtime,
+      false/*readOutput*/);
+  assert(acc_input.rect == acc_output.rect);
+  int num_classes = acc_input.rect.hi[0] - acc_input.rect.lo[0] + 1;
+  int num_samples = acc_input.rect.hi[1] - acc_input.rect.lo[1] + 1;
+  const float* input = acc_input.ptr;
+  float* output = acc_output.ptr;
+  // Rows are independent; subtracting the row max keeps exp in range
+  CPU_PARALLEL_FOR
+  for (int i = 0; i < num_samples; i++) {
+    const float* in = input + (size_t)i * num_classes;
+    float* out = output + (size_t)i * num_classes;
+    float max_val = in[0];
+    CPU_SIMD_REDUCTION(max:max_val)
+    for (int j = 0; j < num_classes; j++)
+      max_val = in[j] > max_val ? in[j] : max_val;
+    float sum = 0.0f;
+    CPU_SIMD_REDUCTION(+:sum)
+    for (int j = 0; j < num_classes; j++) {
+      out[j] = cpu_exp(in[j] - max_val);
+      sum += out[j];
+    }
+    cpu_scale(out, num_classes, 1.0f / sum);
+  }
+}
+
+/*
+  regions[0](I/O): input_grad
+  regions[1](I): output_grad
+*/
+void Softmax::backward_task_cpu(const Task *task,
+                                const std::vector<PhysicalRegion> &regions,
+                                Context ctx, Runtime *runtime)
+{
+  assert(regions.size() == 2);
+  assert(task->regions.size() == 2);
+  TensorAccessorW<float, 2> acc_input_grad(
+      regions[0], task->regions[0], FID_DATA, ctx, runtime,
+      true/*readOutput*/);
+  TensorAccessorR<float, 2> acc_output_grad(
+      regions[1], task->regions[1], FID_DATA, ctx, runtime);
+  // make sure the image indices match!
+  assert(acc_input_grad.rect == acc_output_grad.rect);
+  // The loss already produced d(loss)/d(logit) for softmax + cross-entropy,
+  // so this is a copy, same as the GPU variant
+  coord_t volume = acc_input_grad.rect.volume();
+  CPU_PARALLEL_FOR_SIMD
+  for (coord_t i = 0; i < volume; i++)
+    acc_input_grad.ptr[i] = acc_output_grad.ptr[i];
+}
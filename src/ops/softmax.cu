@@ -118,7 +118,7 @@ void Softmax::init(const FFModel& ff)
   IndexLauncher launcher(SOFTMAX_INIT_TASK_ID, task_is,
                          TaskArgument(this, sizeof(Softmax)), argmap,
                          Predicate::TRUE_PRED, false/*must*/, 0/*mapper_id*/,
-                         FFConfig::get_hash_id(std::string(name)));
+                         ff.config.get_strategy_id(std::string(name)));
   launcher.add_region_requirement(
       RegionRequirement(input_lps[0], 0/*projection id*/,
                         READ_ONLY, EXCLUSIVE, inputs[0].region));
@@ -198,7 +198,7 @@ void Softmax::forward(const FFModel& ff)
   IndexLauncher launcher(SOFTMAX_FWD_TASK_ID, task_is,
                          TaskArgument(this, sizeof(Softmax)), argmap,
                          Predicate::TRUE_PRED, false/*must*/, 0/*mapper_id*/,
-                         FFConfig::get_hash_id(std::string(name)));
+                         ff.config.get_strategy_id(std::string(name)));
   launcher.add_region_requirement(
       RegionRequirement(input_lps[0], 0/*projection id*/,
                         READ_ONLY, EXCLUSIVE, inputs[0].region));
@@ -279,7 +279,7 @@ void Softmax::backward(const FFModel& ff)
   IndexLauncher launcher(SOFTMAX_BWD_TASK_ID, task_is,
                          TaskArgument(this, sizeof(Softmax)), argmap,
                          Predicate::TRUE_PRED, false/*must*/, 0/*mapper_id*/,
-                         FFConfig::get_hash_id(std::string(name)));
+                         ff.config.get_strategy_id(std::string(name)));
   launcher.add_region_requirement(
       RegionRequirement(input_grad_lps[0], 0/*projection id*/,
                         READ_WRITE, EXCLUSIVE, inputs[0].region_grad));
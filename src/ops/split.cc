@@ -0,0 +1,109 @@
+/* Copyright 2020 Stanford
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "model.h"
+#include "cpu_helper.h"
+
+// Same blocking as calc_block_size in split.cu
+static void get_split_blocks(const Domain& domain, int axis,
+                             coord_t& num_blks, coord_t& blk_size)
+{
+  num_blks = 1;
+  blk_size = 1;
+  for (int d = 0; d < domain.get_dim(); d++) {
+    if (d <= axis)
+      blk_size *= (domain.hi()[d] - domain.lo()[d] + 1);
+    else
+      num_blks *= (domain.hi()[d] - domain.lo()[d] + 1);
+  }
+}
+
+OpMeta* Split::init_task_cpu(const Task* task,
+                             const std::vector<PhysicalRegion>& regions,
+                             Context ctx, Runtime* runtime)
+{
+  // CPU kernels keep no per-processor state
+  return NULL;
+}
+
+/*
+  regions[0](I): input
+  regions[1..numOutputs](O): outputs
+*/
+void Split::forward_task_cpu(const Task* task,
+                             const std::vector<PhysicalRegion>& regions,
+                             Context ctx, Runtime* runtime)
+{
+  const Split* split = (Split*) task->args;
+  assert(regions.size() == split->numOutputs + 1);
+  assert(task->regions.size() == split->numOutputs + 1);
+  Domain in_domain = runtime->get_index_space_domain(
+    ctx, task->regions[0].region.get_index_space());
+  const float* in_ptr = helperGetTensorPointerRO<float>(
+    regions[0], task->regions[0], FID_DATA, ctx, runtime);
+  coord_t num_blks, in_blk_size;
+  get_split_blocks(in_domain, split->axis, num_blks, in_blk_size);
+  size_t total_volume = 0;
+  // Each output takes a contiguous slice of every input block
+  for (int i = 0; i < split->numOutputs; i++) {
+    Domain out_domain = runtime->get_index_space_domain(
+      ctx, task->regions[i+1].region.get_index_space());
+    float* out_ptr = helperGetTensorPointerWO<float>(
+      regions[i+1], task->regions[i+1], FID_DATA, ctx, runtime);
+    coord_t out_num_blks, out_blk_size;
+    get_split_blocks(out_domain, split->axis, out_num_blks, out_blk_size);
+    assert(out_num_blks == num_blks);
+    total_volume += out_domain.get_volume();
+    cpu_copy_with_stride(out_ptr, out_blk_size, in_ptr, in_blk_size,
+                         num_blks, out_blk_size);
+    in_ptr += out_blk_size;
+  }
+  assert(total_volume == in_domain.get_volume());
+}
+
+/*
+  regions[0](I/O): input_grad
+  regions[1..numOutputs](I): output_grads
+*/
+void Split::backward_task_cpu(const Task* task,
+                              const std::vector<PhysicalRegion>& regions,
+                              Context ctx, Runtime* runtime)
+{
+  const Split* split = (Split*) task->args;
+  assert(regions.size() == split->numOutputs + 1);
+  assert(task->regions.size() == split->numOutputs + 1);
+  Domain in_grad_domain = runtime->get_index_space_domain(
+    ctx, task->regions[0].region.get_index_space());
+  float* in_grad_ptr = helperGetTensorPointerRW<float>(
+    regions[0], task->regions[0], FID_DATA, ctx, runtime);
+  coord_t num_blks, in_blk_size;
+  get_split_blocks(in_grad_domain, split->axis, num_blks, in_blk_size);
+  size_t total_volume = 0;
+  for (int i = 0; i < split->numOutputs; i++) {
+    Domain out_grad_domain = runtime->get_index_space_domain(
+      ctx, task->regions[i+1].region.get_index_space());
+    const float* out_grad_ptr = helperGetTensorPointerRO<float>(
+      regions[i+1], task->regions[i+1], FID_DATA, ctx, runtime);
+    coord_t out_num_blks, out_blk_size;
+    get_split_blocks(out_grad_domain, split->axis, out_num_blks, out_blk_size);
+    assert(out_num_blks == num_blks);
+    total_volume += out_grad_domain.get_volume();
+    cpu_add_with_stride(in_grad_ptr, in_blk_size, out_grad_ptr, out_blk_size,
+                        num_blks, out_blk_size);
+    in_grad_ptr += out_blk_size;
+  }
+  assert(total_volume == in_grad_domain.get_volume());
+}
@@ -120,7 +120,7 @@ void Split::init(const FFModel& ff)
   IndexLauncher launcher(SPLIT_INIT_TASK_ID, task_is,
                          TaskArgument(this, sizeof(Split)), argmap,
                          Predicate::TRUE_PRED, false/*must*/, 0/*mapper_id*/,
-                         FFConfig::get_hash_id(std::string(name)));
+                         ff.config.get_strategy_id(std::string(name)));
   launcher.add_region_requirement(
     RegionRequirement(input_lps[0], 0/*projection id*/,
       READ_ONLY, EXCLUSIVE, inputs[0].region));
@@ -196,7 +196,7 @@ void Split::forward(const FFModel& ff)
   IndexLauncher launcher(SPLIT_FWD_TASK_ID, task_is,
                          TaskArgument(this, sizeof(Split)), argmap,
                          Predicate::TRUE_PRED, false/*must*/, 0/*mapper_id*/,
-                         FFConfig::get_hash_id(std::string(name)));
+                         ff.config.get_strategy_id(std::string(name)));
   launcher.add_region_requirement(
     RegionRequirement(input_lps[0], 0/*projection id*/,
       READ_ONLY, EXCLUSIVE, inputs[0].region));
@@ -257,7 +257,7 @@ void Split::backward(const FFModel& ff)
   IndexLauncher launcher(SPLIT_BWD_TASK_ID, task_is,
                          TaskArgument(this, sizeof(Split)), argmap,
                          Predicate::TRUE_PRED, false/*must*/, 0/*mapper_id*/,
-                         FFConfig::get_hash_id(std::string(name)));
+                         ff.config.get_strategy_id(std::string(name)));
   launcher.add_region_requirement(
     RegionRequirement(input_grad_lps[0], 0/*projection id*/,
       READ_WRITE, EXCLUSIVE, inputs[0].region_grad));
@@ -0,0 +1,173 @@
+/* Copyright 2020 Stanford
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "model.h"
+#include "cpu_helper.h"
+
+// Edge length of the square tiles used when the innermost dimension moves
+#define TRANSPOSE_TILE 32
+
+// Writes (or accumulates) a permuted copy of src into the dense tensor dst.
+// extent[i] is the size of dst dimension i and src_stride[i] the stride of
+// the matching src dimension. When dimension 0 stays innermost, contiguous
+// rows are copied in bulk; otherwise dst dimension 0 and the dimension that
+// is innermost in src are transposed in cache-sized tiles.
+static void transpose_cpu(float* dst, const float* src, int num_dim,
+                          const coord_t* extent, const coord_t* src_stride,
+                          bool accumulate)
+{
+  coord_t dst_stride[MAX_TENSOR_DIM];
+  coord_t volume = 1;
+  for (int i = 0; i < num_dim; i++) {
+    dst_stride[i] = volume;
+    volume *= extent[i];
+  }
+  bool parallel = volume >= CPU_PARALLEL_MIN_VOLUME;
+  if (src_stride[0] == 1) {
+    coord_t row_size = extent[0], num_rows = volume / row_size;
+    CPU_PARALLEL_FOR_IF(parallel)
+    for (coord_t r = 0; r < num_rows; r++) {
+      coord_t idx = r, src_off = 0;
+      for (int i = 1; i < num_dim; i++) {
+        src_off += (idx % extent[i]) * src_stride[i];
+        idx /= extent[i];
+      }
+      if (accumulate)
+        cpu_add(dst + r * row_size, src + src_off, row_size);
+      else
+        memcpy(dst + r * row_size, src + src_off, row_size * sizeof(float));
+    }
+    return;
+  }
+  int b = 1;
+  while (b < num_dim && src_stride[b] != 1)
+    b++;
+  assert(b < num_dim);
+  coord_t tiles_0 = (extent[0] + TRANSPOSE_TILE - 1) / TRANSPOSE_TILE;
+  coord_t tiles_b = (extent[b] + TRANSPOSE_TILE - 1) / TRANSPOSE_TILE;
+  coord_t num_outer = volume / (extent[0] * extent[b]);
+  coord_t num_tiles = num_outer * tiles_0 * tiles_b;
+  CPU_PARALLEL_FOR_IF(parallel)
+  for (coord_t t = 0; t < num_tiles; t++) {
+    coord_t j0 = (t % tiles_b) * TRANSPOSE_TILE;
+    coord_t i0 = (t / tiles_b % tiles_0) * TRANSPOSE_TILE;
+    coord_t idx = t / tiles_b / tiles_0, dst_off = 0, src_off = 0;
+    for (int i = 1; i < num_dim; i++) {
+      if (i == b) continue;
+      coord_t x = idx % extent[i];
+      idx /= extent[i];
+      dst_off += x * dst_stride[i];
+      src_off += x * src_stride[i];
+    }
+    coord_t i1 = std::min(i0 + TRANSPOSE_TILE, extent[0]);
+    coord_t j1 = std::min(j0 + TRANSPOSE_TILE, extent[b]);
+    for (coord_t j = j0; j < j1; j++) {
+      float* d = dst + dst_off + j * dst_stride[b];
+      const float* s = src + src_off + j;
+      if (accumulate) {
+        for (coord_t i = i0; i < i1; i++)
+          d[i] += s[i * src_stride[0]];
+      } else {
+        for (coord_t i = i0; i < i1; i++)
+          d[i] = s[i * src_stride[0]];
+      }
+    }
+  }
+}
+
+OpMeta* Transpose::init_task_cpu(const Task* task,
+                                 const std::vector<PhysicalRegion>& regions,
+                                 Context ctx, Runtime* runtime)
+{
+  // CPU kernels keep no per-processor state
+  return NULL;
+}
+
+/*
+  regions[0](I): input
+  regions[1](O): output
+*/
+void Transpose::forward_task_cpu(const Task* task,
+                                 const std::vector<PhysicalRegion>& regions,
+                                 Context ctx, Runtime* runtime)
+{
+  assert(regions.size() == 2);
+  assert(task->regions.size() == 2);
+  const Transpose* transpose = (const Transpose*) task->args;
+  Domain in_domain = runtime->get_index_space_domain(
+    ctx, task->regions[0].region.get_index_space());
+  Domain out_domain = runtime->get_index_space_domain(
+    ctx, task->regions[1].region.get_index_space());
+  for (int i = 0; i < out_domain.get_dim(); i++) {
+    assert(out_domain.hi()[i] == in_domain.hi()[transpose->perm[i]]);
+    assert(out_domain.lo()[i] == in_domain.lo()[transpose->perm[i]]);
+  }
+  const float* in_ptr = helperGetTensorPointerRO<float>(
+    regions[0], task->regions[0], FID_DATA, ctx, runtime);
+  float* out_ptr = helperGetTensorPointerWO<float>(
+    regions[1], task->regions[1], FID_DATA, ctx, runtime);
+  int num_dim = out_domain.get_dim();
+  coord_t in_strides[MAX_TENSOR_DIM], extent[MAX_TENSOR_DIM];
+  coord_t src_strides[MAX_TENSOR_DIM];
+  for (int i = 0; i < num_dim; i++) {
+    coord_t in_dim_size = in_domain.hi()[i] - in_domain.lo()[i] + 1;
+    in_strides[i] = (i == 0) ? 1 : in_strides[i-1] * in_dim_size;
+    extent[i] = out_domain.hi()[i] - out_domain.lo()[i] + 1;
+  }
+  for (int i = 0; i < num_dim; i++)
+    src_strides[i] = in_strides[transpose->perm[i]];
+  transpose_cpu(out_ptr, in_ptr, num_dim, extent, src_strides,
+                false/*accumulate*/);
+}
+
+/*
+  regions[0](I): output_grad
+  regions[1](I/O): input_grad
+*/
+void Transpose::backward_task_cpu(const Task* task,
+                                  const std::vector<PhysicalRegion>& regions,
+                                  Context ctx, Runtime* runtime)
+{
+  assert(regions.size() == 2);
+  assert(task->regions.size() == 2);
+  const Transpose* transpose = (const Transpose*) task->args;
+  Domain out_grad_domain = runtime->get_index_space_domain(
+    ctx, task->regions[0].region.get_index_space());
+  Domain in_grad_domain = runtime->get_index_space_domain(
+    ctx, task->regions[1].region.get_index_space());
+  for (int i = 0; i < out_grad_domain.get_dim(); i++) {
+    assert(out_grad_domain.hi()[i] == in_grad_domain.hi()[transpose->perm[i]]);
+    assert(out_grad_domain.lo()[i] == in_grad_domain.lo()[transpose->perm[i]]);
+  }
+  const float* out_grad_ptr = helperGetTensorPointerRO<float>(
+    regions[0], task->regions[0], FID_DATA, ctx, runtime);
+  float* in_grad_ptr = helperGetTensorPointerRW<float>(
+    regions[1], task->regions[1], FID_DATA, ctx, runtime);
+  // Scatter through the inverse permutation: input_grad dim perm[i]
+  // reads output_grad dim i
+  int num_dim = in_grad_domain.get_dim();
+  coord_t out_strides[MAX_TENSOR_DIM], extent[MAX_TENSOR_DIM];
+  coord_t src_strides[MAX_TENSOR_DIM];
+  for (int i = 0; i < num_dim; i++) {
+    coord_t out_dim_size = out_grad_domain.hi()[i] - out_grad_domain.lo()[i] + 1;
+    out_strides[i] = (i == 0) ? 1 : out_strides[i-1] * out_dim_size;
+    extent[i] = in_grad_domain.hi()[i] - in_grad_domain.lo()[i] + 1;
+  }
+  for (int i = 0; i < num_dim; i++)
+    src_strides[transpose->perm[i]] = out_strides[i];
+  transpose_cpu(in_grad_ptr, out_grad_ptr, num_dim, extent, src_strides,
+                true/*accumulate*/);
+}
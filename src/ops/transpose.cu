@@ -109,9 +109,9 @@ void Transpose::init(const FFModel& ff)
   Context ctx = ff.config.lg_ctx;
   Runtime* runtime = ff.config.lg_hlr;
   IndexLauncher launcher(TRANSPOSE_INIT_TASK_ID, task_is,
-                         TaskArgument(this, sizeof(ElementBinary)), argmap,
+                         TaskArgument(this, sizeof(Transpose)), argmap,
                          Predicate::TRUE_PRED, false/*must*/, 0/*mapper_id*/,
-                         FFConfig::get_hash_id(std::string(name)));
+                         ff.config.get_strategy_id(std::string(name)));
   launcher.add_region_requirement(
     RegionRequirement(input_lps[0], 0/*projection id*/,
       READ_ONLY, EXCLUSIVE, inputs[0].region));
@@ -190,7 +190,7 @@ void Transpose::forward(const FFModel& ff)
   IndexLauncher launcher(TRANSPOSE_FWD_TASK_ID, task_is,
                          TaskArgument(this, sizeof(Transpose)), argmap,
                          Predicate::TRUE_PRED, false/*must*/, 0/*mapper_id*/,
-                         FFConfig::get_hash_id(std::string(name)));
+                         ff.config.get_strategy_id(std::string(name)));
   launcher.add_region_requirement(
     RegionRequirement(input_lps[0], 0/*projection id*/,
       READ_ONLY, EXCLUSIVE, inputs[0].region));
@@ -243,7 +243,7 @@ void Transpose::backward(const FFModel& ff)
   IndexLauncher launcher(TRANSPOSE_BWD_TASK_ID, task_is,
                          TaskArgument(this, sizeof(Transpose)), argmap,
                          Predicate::TRUE_PRED, false/*must*/, 0/*mapper_id*/,
-                         FFConfig::get_hash_id(std::string(name)));
+                         ff.config.get_strategy_id(std::string(name)));
   // regions[0](I): output_grad
   launcher.add_region_requirement(
     RegionRequirement(outputs[0].part_grad, 0/*projection id*/,
@@ -146,9 +146,11 @@ DT* helperGetTensorPointerWO(PhysicalRegion region,
   template class TensorAccessorR<float, DIM>; \
   template class TensorAccessorR<int32_t, DIM>; \
   template class TensorAccessorR<int64_t, DIM>; \
+  template class TensorAccessorR<uint16_t, DIM>; \
   template class TensorAccessorW<float, DIM>; \
   template class TensorAccessorW<int32_t, DIM>; \
-  template class TensorAccessorW<int64_t, DIM>;
+  template class TensorAccessorW<int64_t, DIM>; \
+  template class TensorAccessorW<uint16_t, DIM>;
   LEGION_FOREACH_N(DIMFUNC)
 #undef DIMFUNC
 
@@ -160,3 +162,23 @@ template float* helperGetTensorPointerRW(
 
 template float* helperGetTensorPointerWO(
   PhysicalRegion region, RegionRequirement req, FieldID fid, Context ctx, Runtime* runtime);
+
+// Integer batches (see BatchPrefetcher::copy_batch_task)
+template const int32_t* helperGetTensorPointerRO(
+  PhysicalRegion region, RegionRequirement req, FieldID fid, Context ctx, Runtime* runtime);
+
+template int32_t* helperGetTensorPointerWO(
+  PhysicalRegion region, RegionRequirement req, FieldID fid, Context ctx, Runtime* runtime);
+
+template const int64_t* helperGetTensorPointerRO(
+  PhysicalRegion region, RegionRequirement req, FieldID fid, Context ctx, Runtime* runtime);
+
+template int64_t* helperGetTensorPointerWO(
+  PhysicalRegion region, RegionRequirement req, FieldID fid, Context ctx, Runtime* runtime);
+
+// 16-bit storage (e.g., fp16/bf16 optimizer state)
+template const uint16_t* helperGetTensorPointerRO(
+  PhysicalRegion region, RegionRequirement req, FieldID fid, Context ctx, Runtime* runtime);
+
+template uint16_t* helperGetTensorPointerRW(
+  PhysicalRegion region, RegionRequirement req, FieldID fid, Context ctx, Runtime* runtime);
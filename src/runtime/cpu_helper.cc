@@ -0,0 +1,269 @@
+/* Copyright 2020 Stanford
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cpu_helper.h"
+#include <algorithm>
+#include <vector>
+#ifdef FF_USE_CBLAS
+#include <cblas.h>
+#endif
+
+// A GEMM_MC x GEMM_KC panel of op(A) (64KB) is packed once and stays in
+// L2 while it is multiplied with every column of op(B); each micro-kernel
+// call updates GEMM_NR columns of C that stay in L1
+const int GEMM_MC = 128;
+const int GEMM_KC = 128;
+const int GEMM_NR = 4;
+
+static inline void gemm_micro_kernel_4(int mc, int kc,
+                                       const float* __restrict__ a,
+                                       const float* b, int b_stride_p,
+                                       int b_stride_j,
+                                       float* __restrict__ c0,
+                                       float* __restrict__ c1,
+                                       float* __restrict__ c2,
+                                       float* __restrict__ c3)
+{
+  for (int p = 0; p < kc; p++) {
+    const float* ap = a + p * mc;
+    const float* bp = b + (size_t)p * b_stride_p;
+    float b0 = bp[0];
+    float b1 = bp[b_stride_j];
+    float b2 = bp[2 * b_stride_j];
+    float b3 = bp[3 * b_stride_j];
+    CPU_SIMD
+    for (int i = 0; i < mc; i++) {
+      float av = ap[i];
+      c0[i] += av * b0;
+      c1[i] += av * b1;
+      c2[i] += av * b2;
+      c3[i] += av * b3;
+    }
+  }
+}
+
+static inline void gemm_micro_kernel_1(int mc, int kc,
+                                       const float* __restrict__ a,
+                                       const float* b, int b_stride_p,
+                                       float* __restrict__ c)
+{
+  for (int p = 0; p < kc; p++) {
+    const float* ap = a + p * mc;
+    float bv = b[(size_t)p * b_stride_p];
+    CPU_SIMD
+    for (int i = 0; i < mc; i++)
+      c[i] += ap[i] * bv;
+  }
+}
+
+void cpu_sgemm(bool trans_a, bool trans_b, int m, int n, int k,
+               float alpha, const float* A, int lda,
+               const float* B, int ldb,
+               float beta, float* C, int ldc)
+{
+#ifdef FF_USE_CBLAS
+  cblas_sgemm(CblasColMajor, trans_a ? CblasTrans : CblasNoTrans,
+              trans_b ? CblasTrans : CblasNoTrans,
+              m, n, k, alpha, A, lda, B, ldb, beta, C, ldc);
+#else
+  CPU_PARALLEL_FOR
+  for (int j = 0; j < n; j++) {
+    float* c = C + (size_t)j * ldc;
+    if (beta == 0.0f)
+      cpu_assign(c, m, 0.0f);
+    else if (beta != 1.0f)
+      cpu_scale(c, m, beta);
+  }
+  if ((alpha == 0.0f) || (k == 0))
+    return;
+  // op(B)(p, j) = B[p * b_stride_p + j * b_stride_j]
+  int b_stride_p = trans_b ? ldb : 1;
+  int b_stride_j = trans_b ? 1 : ldb;
+  int num_blocks = (n + GEMM_NR - 1) / GEMM_NR;
+  std::vector<float> packed(GEMM_MC * GEMM_KC);
+  float* a = packed.data();
+  for (int p0 = 0; p0 < k; p0 += GEMM_KC) {
+    int kc = std::min(GEMM_KC, k - p0);
+    for (int i0 = 0; i0 < m; i0 += GEMM_MC) {
+      int mc = std::min(GEMM_MC, m - i0);
+      // Pack alpha * op(A)[i0:i0+mc, p0:p0+kc] with contiguous columns
+      CPU_PARALLEL_FOR
+      for (int p = 0; p < kc; p++)
+        for (int i = 0; i < mc; i++)
+          a[p * mc + i] = alpha * (trans_a ? A[(size_t)(i0 + i) * lda + p0 + p]
+                                           : A[(size_t)(p0 + p) * lda + i0 + i]);
+      // Column blocks of C are disjoint, so threads need no synchronization
+      CPU_PARALLEL_FOR
+      for (int jb = 0; jb < num_blocks; jb++) {
+        int j0 = jb * GEMM_NR;
+        const float* b = B + (size_t)p0 * b_stride_p + (size_t)j0 * b_stride_j;
+        float* c = C + (size_t)j0 * ldc + i0;
+        if (j0 + GEMM_NR <= n) {
+          gemm_micro_kernel_4(mc, kc, a, b, b_stride_p, b_stride_j,
+                              c, c + ldc, c + 2 * ldc, c + 3 * ldc);
+        } else {
+          for (int j = j0; j < n; j++)
+            gemm_micro_kernel_1(mc, kc, a, b + (size_t)(j - j0) * b_stride_j,
+                                b_stride_p, c + (size_t)(j - j0) * ldc);
+        }
+      }
+    }
+  }
+#endif
+}
+
+void cpu_sgemm_strided_batched(bool trans_a, bool trans_b,
+                               int m, int n, int k, float alpha,
+                               const float* A, int lda, coord_t stride_a,
+                               const float* B, int ldb, coord_t stride_b,
+                               float beta, float* C, int ldc, coord_t stride_c,
+                               int batch)
+{
+  if (batch < cpu_max_threads()) {
+    // Too few GEMMs to keep every thread busy, so each GEMM is
+    // parallelized internally instead
+    for (int i = 0; i < batch; i++)
+      cpu_sgemm(trans_a, trans_b, m, n, k, alpha, A + i * stride_a, lda,
+                B + i * stride_b, ldb, beta, C + i * stride_c, ldc);
+    return;
+  }
+  // One GEMM per thread; the GEMMs' own parallel loops run nested and
+  // therefore sequentially
+  CPU_PARALLEL_FOR
+  for (int i = 0; i < batch; i++)
+    cpu_sgemm(trans_a, trans_b, m, n, k, alpha, A + i * stride_a, lda,
+              B + i * stride_b, ldb, beta, C + i * stride_c, ldc);
+}
+
+// Blocks are split into chunks of this many elements so that a few large
+// blocks still spread across every thread
+const coord_t COPY_CHUNK = 1 << 14;
+
+void cpu_copy_with_stride(float* dst, coord_t dst_stride,
+                          const float* src, coord_t src_stride,
+                          coord_t num_blocks, coord_t blk_size)
+{
+  coord_t chunks_per_blk = (blk_size + COPY_CHUNK - 1) / COPY_CHUNK;
+  coord_t num_chunks = num_blocks * chunks_per_blk;
+  CPU_PARALLEL_FOR_IF(num_blocks * blk_size >= CPU_PARALLEL_MIN_VOLUME)
+  for (coord_t t = 0; t < num_chunks; t++) {
+    coord_t b = t / chunks_per_blk;
+    coord_t lo = (t % chunks_per_blk) * COPY_CHUNK;
+    coord_t len = std::min(COPY_CHUNK, blk_size - lo);
+    memcpy(dst + b * dst_stride + lo, src + b * src_stride + lo,
+           len * sizeof(float));
+  }
+}
+
+void cpu_add_with_stride(float* dst, coord_t dst_stride,
+                         const float* src, coord_t src_stride,
+                         coord_t num_blocks, coord_t blk_size)
+{
+  coord_t chunks_per_blk = (blk_size + COPY_CHUNK - 1) / COPY_CHUNK;
+  coord_t num_chunks = num_blocks * chunks_per_blk;
+  CPU_PARALLEL_FOR_IF(num_blocks * blk_size >= CPU_PARALLEL_MIN_VOLUME)
+  for (coord_t t = 0; t < num_chunks; t++) {
+    coord_t b = t / chunks_per_blk;
+    coord_t lo = (t % chunks_per_blk) * COPY_CHUNK;
+    coord_t len = std::min(COPY_CHUNK, blk_size - lo);
+    cpu_add(dst + b * dst_stride + lo, src + b * src_stride + lo, len);
+  }
+}
+
+// Output positions [lo, hi) of a row whose input index o * stride - pad + k
+// falls inside [0, size)
+static inline void valid_output_range(int size, int kernel_off, int pad,
+                                      int stride, int out_size,
+                                      int& lo, int& hi)
+{
+  int begin = pad - kernel_off;
+  int end = size + pad - kernel_off;
+  lo = begin <= 0 ? 0 : (begin + stride - 1) / stride;
+  hi = end <= 0 ? 0 : (end + stride - 1) / stride;
+  lo = std::min(lo, out_size);
+  hi = std::min(hi, out_size);
+}
+
+void cpu_im2col(const float* im, int channels, int height, int width,
+                int kernel_h, int kernel_w, int pad_h, int pad_w,
+                int stride_h, int stride_w, int out_h, int out_w,
+                float* col)
+{
+  int k_size = channels * kernel_h * kernel_w;
+  // Every row of col is produced independently
+  CPU_PARALLEL_FOR
+  for (int k = 0; k < k_size; k++) {
+    int kx = k % kernel_w;
+    int ky = (k / kernel_w) % kernel_h;
+    int c = k / (kernel_w * kernel_h);
+    const float* im_c = im + (size_t)c * height * width;
+    float* col_k = col + (size_t)k * out_h * out_w;
+    int x_lo, x_hi;
+    valid_output_range(width, kx, pad_w, stride_w, out_w, x_lo, x_hi);
+    for (int oy = 0; oy < out_h; oy++) {
+      int iy = oy * stride_h - pad_h + ky;
+      float* row = col_k + oy * out_w;
+      if (iy < 0 || iy >= height || x_lo >= x_hi) {
+        cpu_assign(row, out_w, 0.0f);
+        continue;
+      }
+      const float* im_row = im_c + (size_t)iy * width
+                          + x_lo * stride_w - pad_w + kx;
+      cpu_assign(row, x_lo, 0.0f);
+      if (stride_w == 1) {
+        cpu_copy(row + x_lo, im_row, x_hi - x_lo);
+      } else {
+        CPU_SIMD
+        for (int ox = x_lo; ox < x_hi; ox++)
+          row[ox] = im_row[(ox - x_lo) * stride_w];
+      }
+      cpu_assign(row + x_hi, out_w - x_hi, 0.0f);
+    }
+  }
+}
+
+void cpu_col2im(const float* col, int channels, int height, int width,
+                int kernel_h, int kernel_w, int pad_h, int pad_w,
+                int stride_h, int stride_w, int out_h, int out_w,
+                float* im)
+{
+  // Rows of col from different channels never touch the same pixel, so
+  // channels are accumulated in parallel without atomics
+  CPU_PARALLEL_FOR
+  for (int c = 0; c < channels; c++) {
+    float* im_c = im + (size_t)c * height * width;
+    for (int ky = 0; ky < kernel_h; ky++)
+      for (int kx = 0; kx < kernel_w; kx++) {
+        int k = (c * kernel_h + ky) * kernel_w + kx;
+        const float* col_k = col + (size_t)k * out_h * out_w;
+        int x_lo, x_hi;
+        valid_output_range(width, kx, pad_w, stride_w, out_w, x_lo, x_hi);
+        for (int oy = 0; oy < out_h; oy++) {
+          int iy = oy * stride_h - pad_h + ky;
+          if (iy < 0 || iy >= height)
+            continue;
+          const float* row = col_k + oy * out_w;
+          float* im_row = im_c + (size_t)iy * width
+                        + x_lo * stride_w - pad_w + kx;
+          if (stride_w == 1) {
+            cpu_add(im_row, row + x_lo, x_hi - x_lo);
+          } else {
+            for (int ox = x_lo; ox < x_hi; ox++)
+              im_row[(ox - x_lo) * stride_w] += row[ox];
+          }
+        }
+      }
+  }
+}
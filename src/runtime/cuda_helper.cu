@@ -189,6 +189,7 @@ template __global__ void assign_kernel<int64_t>(int64_t* ptr, coord_t size, int6
 
 template __global__ void copy_kernel<float>(float* dst, const float* src, coord_t size);
 template __global__ void copy_kernel<int>(int* dst, const int* src, coord_t size);
+template __global__ void copy_kernel<int64_t>(int64_t* dst, const int64_t* src, coord_t size);
 
 template __host__ void print_tensor<1, float>(const float* ptr, Rect<1> rect, const char* prefix);
 template __host__ void print_tensor<2, float>(const float* ptr, Rect<2> rect, const char* prefix);
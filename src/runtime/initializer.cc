@@ -15,6 +15,128 @@
 
 #include "initializer.h"
 #include "model.h"
+#include "accessor.h"
+
+InitIndexMap get_init_index_map(const Task* task, int idx,
+                                Context ctx, Runtime* runtime)
+{
+  Domain domain = runtime->get_index_space_domain(
+      ctx, task->regions[idx].region.get_index_space());
+  Domain parent = runtime->get_index_space_domain(
+      ctx, task->regions[idx].parent.get_index_space());
+  assert(domain.get_dim() == parent.get_dim());
+  assert(domain.get_dim() <= MAX_TENSOR_DIM);
+  InitIndexMap map;
+  map.num_dims = domain.get_dim();
+  map.offset = 0;
+  coord_t stride = 1;
+  for (int d = 0; d < map.num_dims; d++) {
+    map.extents[d] = domain.hi()[d] - domain.lo()[d] + 1;
+    map.strides[d] = stride;
+    map.offset += (domain.lo()[d] - parent.lo()[d]) * stride;
+    stride *= parent.hi()[d] - parent.lo()[d] + 1;
+  }
+  return map;
+}
+
+float get_glorot_scale(const Domain& domain)
+{
+  // reference: tensorflow code for computing fan_in/fan_out
+  // https://github.com/tensorflow/tensorflow/blob/r2.0/tensorflow/python/ops/init_ops.py#L1415-L1439
+  int num_dim = domain.get_dim();
+  assert(num_dim >= 2);
+  coord_t receptive_field_size = 1;
+  for (int i = 0; i < num_dim - 2; i++)
+    receptive_field_size *= (domain.hi()[i] - domain.lo()[i] + 1);
+  coord_t c_in = domain.hi()[num_dim-2] - domain.lo()[num_dim-2] + 1;
+  coord_t c_out = domain.hi()[num_dim-1] - domain.lo()[num_dim-1] + 1;
+  coord_t fan_in = c_in * receptive_field_size;
+  coord_t fan_out = c_out * receptive_field_size;
+  return sqrt(6.0 / (fan_in + fan_out));
+}
+
+struct UniformValue {
+  UniformValue(float _lo, float _hi): lo(_lo), hi(_hi) {}
+  float operator()(const uint32_t r[4], int lane) const
+  {
+    return init_uniform(r[lane], lo, hi);
+  }
+  float lo, hi;
+};
+
+struct NormalValue {
+  NormalValue(float _mean, float _stddev): mean(_mean), stddev(_stddev) {}
+  float operator()(const uint32_t r[4], int lane) const
+  {
+    return init_normal(r, lane, mean, stddev);
+  }
+  float mean, stddev;
+};
+
+// w[i] = value(g = first + i) for i < n, with one Philox call per counter
+template<typename F>
+static void fill_random_run_cpu(float* w, coord_t n, coord_t first,
+                                uint64_t seed, const F& value)
+{
+  coord_t first_ctr = first / 4, last_ctr = (first + n - 1) / 4;
+  CPU_PARALLEL_FOR_IF(n >= CPU_PARALLEL_MIN_VOLUME)
+  for (coord_t c = first_ctr; c <= last_ctr; c++) {
+    uint32_t r[4];
+    cpu_philox4x32(seed, c, 0, r);
+    for (int lane = 0; lane < 4; lane++) {
+      coord_t g = c * 4 + lane;
+      if ((g >= first) && (g < first + n))
+        w[g - first] = value(r, lane);
+    }
+  }
+}
+
+// Rows along dim 0 are contiguous in the weight, so each row is one run;
+// large single-row weights are split inside fill_random_run_cpu instead
+template<typename F>
+static void fill_random_cpu(float* w, const InitIndexMap& map,
+                            int seed, const F& value)
+{
+  coord_t row = map.extents[0], volume = 1;
+  for (int d = 0; d < map.num_dims; d++)
+    volume *= map.extents[d];
+  coord_t num_rows = volume / row;
+  CPU_PARALLEL_FOR_IF((num_rows > 1) && (volume >= CPU_PARALLEL_MIN_VOLUME))
+  for (coord_t r = 0; r < num_rows; r++)
+    fill_random_run_cpu(w + r * row, row, map.global_index(r * row),
+                        (uint64_t)(uint32_t)seed, value);
+}
+
+// Launches an initializer task over the shards of p->part when they are
+// disjoint, and as a single task over p->region otherwise (e.g., for
+// replicated weights and for tensors without a partition)
+static void launch_init_task(Context ctx, Runtime* runtime, const Tensor* p,
+                             TaskID task_id, const TaskArgument& arg,
+                             MappingTagID tag)
+{
+  if ((p->part != LogicalPartition::NO_PART)
+  && runtime->is_index_partition_disjoint(ctx, p->part.get_index_partition())) {
+    IndexSpace task_is = runtime->get_index_partition_color_space_name(
+        ctx, p->part.get_index_partition());
+    ArgumentMap argmap;
+    IndexLauncher launcher(task_id, task_is, arg, argmap,
+                           Predicate::TRUE_PRED, false/*must*/, 0/*mapper_id*/,
+                           tag);
+    // regions[0]: p->part
+    launcher.add_region_requirement(
+        RegionRequirement(p->part, 0/*projection id*/,
+                          WRITE_ONLY, EXCLUSIVE, p->region));
+    launcher.add_field(0, FID_DATA);
+    runtime->execute_index_space(ctx, launcher);
+  } else {
+    TaskLauncher launcher(task_id, arg);
+    // regions[0]: p->region
+    launcher.add_region_requirement(
+        RegionRequirement(p->region, WRITE_ONLY, EXCLUSIVE, p->region));
+    launcher.add_field(0, FID_DATA);
+    runtime->execute_task(ctx, launcher);
+  }
+}
 
 Initializer::Initializer(void)
 {}
@@ -30,16 +152,29 @@ GlorotUniform::~GlorotUniform(void)
 
 void GlorotUniform::init(Context ctx,
                          Runtime* runtime,
-                         const Tensor* p)
+                         const Tensor* p,
+                         MappingTagID tag)
 {
   assert(p->numDim >= 2);
-  TaskLauncher launcher(GLOROT_INIT_TASK_ID,
-                        TaskArgument(this, sizeof(GlorotUniform)));
-  // regions[0]: p->region
-  launcher.add_region_requirement(
-      RegionRequirement(p->region, WRITE_ONLY, EXCLUSIVE, p->region));
-  launcher.add_field(0, FID_DATA);
-  runtime->execute_task(ctx, launcher);
+  launch_init_task(ctx, runtime, p, GLOROT_INIT_TASK_ID,
+                   TaskArgument(this, sizeof(GlorotUniform)), tag);
+}
+
+void GlorotUniform::init_task_cpu(const Task* task,
+                                  const std::vector<PhysicalRegion>& regions,
+                                  Context ctx, Runtime* runtime)
+{
+  assert(regions.size() == 1);
+  assert(task->regions.size() == 1);
+  const GlorotUniform* initializer = (const GlorotUniform*) task->args;
+  // Fans are those of the whole weight, not of this subregion
+  Domain domain = runtime->get_index_space_domain(
+      ctx, task->regions[0].parent.get_index_space());
+  float scale = get_glorot_scale(domain);
+  float* w = helperGetTensorPointerWO<float>(
+      regions[0], task->regions[0], FID_DATA, ctx, runtime);
+  fill_random_cpu(w, get_init_index_map(task, 0, ctx, runtime),
+                  initializer->seed, UniformValue(-scale, scale));
 }
 
 ZeroInitializer::ZeroInitializer(void)
@@ -51,14 +186,11 @@ ZeroInitializer::~ZeroInitializer(void)
 
 void ZeroInitializer::init(Context ctx,
                            Runtime* runtime,
-                           const Tensor* p)
+                           const Tensor* p,
+                           MappingTagID tag)
 {
-  TaskLauncher launcher(ZERO_INIT_TASK_ID, TaskArgument(NULL, 0));
-  // regions[0]: p->region
-  launcher.add_region_requirement(
-      RegionRequirement(p->region, WRITE_ONLY, EXCLUSIVE, p->region));
-  launcher.add_field(0, FID_DATA);
-  runtime->execute_task(ctx, launcher);
+  launch_init_task(ctx, runtime, p, ZERO_INIT_TASK_ID,
+                   TaskArgument(NULL, 0), tag);
 }
 
 void ZeroInitializer::init_task_cpu(const Task* task,
@@ -124,15 +256,25 @@ UniformInitializer::~UniformInitializer(void)
 
 void UniformInitializer::init(Context ctx,
                               Runtime* runtime,
-                              const Tensor* p)
+                              const Tensor* p,
+                              MappingTagID tag)
+{
+  launch_init_task(ctx, runtime, p, UNIFORM_INIT_TASK_ID,
+                   TaskArgument(this, sizeof(UniformInitializer)), tag);
+}
+
+void UniformInitializer::init_task_cpu(const Task* task,
+                                       const std::vector<PhysicalRegion>& regions,
+                                       Context ctx, Runtime* runtime)
 {
-  TaskLauncher launcher(UNIFORM_INIT_TASK_ID,
-                        TaskArgument(this, sizeof(UniformInitializer)));
-  // regions[0]: p->region
-  launcher.add_region_requirement(
-      RegionRequirement(p->region, WRITE_ONLY, EXCLUSIVE, p->region));
-  launcher.add_field(0, FID_DATA);
-  runtime->execute_task(ctx, launcher);
+  assert(regions.size() == 1);
+  assert(task->regions.size() == 1);
+  const UniformInitializer* initializer = (const UniformInitializer*) task->args;
+  float* w = helperGetTensorPointerWO<float>(
+      regions[0], task->regions[0], FID_DATA, ctx, runtime);
+  fill_random_cpu(w, get_init_index_map(task, 0, ctx, runtime),
+                  initializer->seed,
+                  UniformValue(initializer->min_val, initializer->max_val));
 }
 
 NormInitializer::NormInitializer(int _seed, float _mean, float _stddev)
@@ -143,17 +285,26 @@ NormInitializer::~NormInitializer(void)
 
 void NormInitializer::init(Context ctx,
                            Runtime* runtime,
-                           const Tensor* p)
+                           const Tensor* p,
+                           MappingTagID tag)
 {
-  TaskLauncher launcher(NORMAL_INIT_TASK_ID,
-                        TaskArgument(this, sizeof(NormInitializer)));
-  // regions[0]: p->region
-  launcher.add_region_requirement(
-      RegionRequirement(p->region, WRITE_ONLY, EXCLUSIVE, p->region));
-  launcher.add_field(0, FID_DATA);
-  runtime->execute_task(ctx, launcher);
+  launch_init_task(ctx, runtime, p, NORMAL_INIT_TASK_ID,
+                   TaskArgument(this, sizeof(NormInitializer)), tag);
 }
 
+void NormInitializer::init_task_cpu(const Task* task,
+                                    const std::vector<PhysicalRegion>& regions,
+                                    Context ctx, Runtime* runtime)
+{
+  assert(regions.size() == 1);
+  assert(task->regions.size() == 1);
+  const NormInitializer* initializer = (const NormInitializer*) task->args;
+  float* w = helperGetTensorPointerWO<float>(
+      regions[0], task->regions[0], FID_DATA, ctx, runtime);
+  fill_random_cpu(w, get_init_index_map(task, 0, ctx, runtime),
+                  initializer->seed,
+                  NormalValue(initializer->mean, initializer->stddev));
+}
 
 // ConstantInitializer
 ConstantInitializer::ConstantInitializer(float _value)
@@ -165,15 +316,11 @@ ConstantInitializer::~ConstantInitializer(void)
 
 void ConstantInitializer::init(Context ctx,
                                Runtime* runtime,
-                               const Tensor* p)
+                               const Tensor* p,
+                               MappingTagID tag)
 {
-  TaskLauncher launcher(CONSTANT_INIT_TASK_ID,
-                        TaskArgument(this, sizeof(ConstantInitializer)));
-  // regions[0]: p->region
-  launcher.add_region_requirement(
-      RegionRequirement(p->region, WRITE_ONLY, EXCLUSIVE, p->region));
-  launcher.add_field(0, FID_DATA);
-  runtime->execute_task(ctx, launcher);
+  launch_init_task(ctx, runtime, p, CONSTANT_INIT_TASK_ID,
+                   TaskArgument(this, sizeof(ConstantInitializer)), tag);
 }
 
 void ConstantInitializer::init_task_cpu(const Task* task,
@@ -17,179 +17,104 @@
 #include "accessor.h"
 #include "model.h"
 #include "cuda_helper.h"
-#include <curand.h>
-#include <random>
-#include <ctime>
 
-void UniformInitializer::init_task(const Task* task,
-                                   const std::vector<PhysicalRegion>& regions,
-                                   Context ctx, Runtime* runtime)
+__global__
+void init_uniform_kernel(float* ptr, coord_t size, InitIndexMap map,
+                         uint64_t seed, float lo, float hi)
 {
-  assert(regions.size() == 1);
-  assert(task->regions.size() == 1);
-  TensorAccessorW<float, 2> accW(regions[0], task->regions[0],
-      FID_DATA, ctx, runtime, false/*readOutput*/);
-  int inputDim = accW.rect.hi[0] - accW.rect.lo[0] + 1;
-  int outputDim = accW.rect.hi[1] - accW.rect.lo[1] + 1;
-  UniformInitializer* initializer = (UniformInitializer*) task->args;
-  curandGenerator_t gen;
-  curandCreateGenerator(&gen, CURAND_RNG_PSEUDO_DEFAULT);
-  cudaStream_t stream;
-  checkCUDA(cudaStreamCreate(&stream));
-  curandSetStream(gen, stream);
-  //fprintf(stderr, "seed = %d\n", initializer->seed);
+  CUDA_KERNEL_LOOP(i, size)
+  {
+    coord_t g = map.global_index(i);
+    uint32_t r[4];
+    cpu_philox4x32(seed, g / 4, 0, r);
+    ptr[i] = init_uniform(r[g % 4], lo, hi);
+  }
+}
 
-  curandSetPseudoRandomGeneratorSeed(gen, initializer->seed);
-  checkCUDA(curandGenerateUniform(gen, accW.ptr, accW.rect.volume()));
-  scale_kernel<<<GET_BLOCKS(accW.rect.volume()), CUDA_NUM_THREADS>>>(
-      accW.ptr, accW.rect.volume(), initializer->min_val, initializer->max_val);
-  checkCUDA(cudaDeviceSynchronize());
-  curandDestroyGenerator(gen);
+__global__
+void init_normal_kernel(float* ptr, coord_t size, InitIndexMap map,
+                        uint64_t seed, float mean, float stddev)
+{
+  CUDA_KERNEL_LOOP(i, size)
+  {
+    coord_t g = map.global_index(i);
+    uint32_t r[4];
+    cpu_philox4x32(seed, g / 4, 0, r);
+    ptr[i] = init_normal(r, g % 4, mean, stddev);
+  }
 }
 
-void GlorotUniform::init_task(const Task* task,
-                              const std::vector<PhysicalRegion>& regions,
-                              Context ctx, Runtime* runtime)
+static float* get_init_pointer(const Task* task,
+                               const std::vector<PhysicalRegion>& regions,
+                               Context ctx, Runtime* runtime)
 {
   assert(regions.size() == 1);
   assert(task->regions.size() == 1);
   Domain domain = runtime->get_index_space_domain(
       ctx, task->regions[0].region.get_index_space());
-  float* w;
-  float scale = 0;
+  float* w = NULL;
   switch (domain.get_dim()) {
-    case 2:
-    {
-      TensorAccessorW<float, 2> accW(regions[0], task->regions[0],
-          FID_DATA, ctx, runtime, false/*readOutput*/);
-      w = accW.ptr;
-      int outputDim = accW.rect.hi[1] - accW.rect.lo[1] + 1;
-      int inputDim = accW.rect.hi[0] - accW.rect.lo[0] + 1;
-      scale = sqrt(6.0 / (inputDim + outputDim));
-      break;
-    }
-    case 3:
-    {
-      TensorAccessorW<float, 3> accW(regions[0], task->regions[0],
-          FID_DATA, ctx, runtime, false/*readOutput*/);
-      w = accW.ptr;
-      // reference: tensorflow code for computing fan_in/fan_out
-      // https://github.com/tensorflow/tensorflow/blob/r2.0/tensorflow/python/ops/init_ops.py#L1415-L1439
-      int num_dim = domain.get_dim();
-      coord_t receptive_field_size = 1;
-      for (int i = 0; i < num_dim - 2; i++)
-        receptive_field_size *= (accW.rect.hi[i] - accW.rect.lo[i] + 1);
-      coord_t c_in = accW.rect.hi[num_dim-2] - accW.rect.lo[num_dim-2] + 1;
-      coord_t c_out = accW.rect.hi[num_dim-1] - accW.rect.lo[num_dim-1] + 1;
-      coord_t fan_in = c_in * receptive_field_size;
-      coord_t fan_out = c_out * receptive_field_size;
-      scale = sqrt(6.0 / (fan_in + fan_out));
-      break;
-    }
-    case 4:
-    {
-      TensorAccessorW<float, 4> accW(regions[0], task->regions[0],
-          FID_DATA, ctx, runtime, false/*readOutput*/);
-      w = accW.ptr;
-      // reference: tensorflow code for computing fan_in/fan_out
-      // https://github.com/tensorflow/tensorflow/blob/r2.0/tensorflow/python/ops/init_ops.py#L1415-L1439
-      int num_dim = domain.get_dim();
-      coord_t receptive_field_size = 1;
-      for (int i = 0; i < num_dim - 2; i++)
-        receptive_field_size *= (accW.rect.hi[i] - accW.rect.lo[i] + 1);
-      coord_t c_in = accW.rect.hi[num_dim-2] - accW.rect.lo[num_dim-2] + 1;
-      coord_t c_out = accW.rect.hi[num_dim-1] - accW.rect.lo[num_dim-1] + 1;
-      coord_t fan_in = c_in * receptive_field_size;
-      coord_t fan_out = c_out * receptive_field_size;
-      scale = sqrt(6.0 / (fan_in + fan_out));
-      break;
+#define DIMFUNC(DIM) \
+    case DIM: \
+    { \
+      TensorAccessorW<float, DIM> accW( \
+          regions[0], task->regions[0], FID_DATA, ctx, runtime, false/*readOutput*/); \
+      w = accW.ptr; \
+      break; \
     }
+    LEGION_FOREACH_N(DIMFUNC)
+#undef DIMFUNC
     default:
       assert(false);
   }
-  curandGenerator_t gen;
-  curandCreateGenerator(&gen, CURAND_RNG_PSEUDO_DEFAULT);
-#ifndef DISABLE_LEGION_CUDA_HIJACK
-  cudaStream_t stream;
-  checkCUDA(cudaStreamCreate(&stream));
-  checkCURAND(curandSetStream(gen, stream));
-#endif
-  GlorotUniform* initializer = (GlorotUniform*) task->args;
-  curandSetPseudoRandomGeneratorSeed(gen, initializer->seed);
-  fprintf(stderr, "seed = %d scale = %.4lf\n", initializer->seed, scale);
-  checkCUDA(curandGenerateUniform(gen, w, domain.get_volume()));
-  scale_kernel<<<GET_BLOCKS(domain.get_volume()), CUDA_NUM_THREADS>>>(
-      w, domain.get_volume(), -scale, scale);
+  return w;
+}
+
+void UniformInitializer::init_task(const Task* task,
+                                   const std::vector<PhysicalRegion>& regions,
+                                   Context ctx, Runtime* runtime)
+{
+  float* w = get_init_pointer(task, regions, ctx, runtime);
+  InitIndexMap map = get_init_index_map(task, 0, ctx, runtime);
+  coord_t volume = runtime->get_index_space_domain(
+      ctx, task->regions[0].region.get_index_space()).get_volume();
+  const UniformInitializer* initializer = (const UniformInitializer*) task->args;
+  init_uniform_kernel<<<GET_BLOCKS(volume), CUDA_NUM_THREADS>>>(
+      w, volume, map, (uint32_t)initializer->seed,
+      initializer->min_val, initializer->max_val);
   checkCUDA(cudaDeviceSynchronize());
-  curandDestroyGenerator(gen);
 }
 
+void GlorotUniform::init_task(const Task* task,
+                              const std::vector<PhysicalRegion>& regions,
+                              Context ctx, Runtime* runtime)
+{
+  float* w = get_init_pointer(task, regions, ctx, runtime);
+  InitIndexMap map = get_init_index_map(task, 0, ctx, runtime);
+  coord_t volume = runtime->get_index_space_domain(
+      ctx, task->regions[0].region.get_index_space()).get_volume();
+  // Fans are those of the whole weight, not of this subregion
+  float scale = get_glorot_scale(runtime->get_index_space_domain(
+      ctx, task->regions[0].parent.get_index_space()));
+  const GlorotUniform* initializer = (const GlorotUniform*) task->args;
+  init_uniform_kernel<<<GET_BLOCKS(volume), CUDA_NUM_THREADS>>>(
+      w, volume, map, (uint32_t)initializer->seed, -scale, scale);
+  checkCUDA(cudaDeviceSynchronize());
+}
 
 void NormInitializer::init_task(const Task* task,
                                 const std::vector<PhysicalRegion>& regions,
                                 Context ctx, Runtime* runtime)
 {
-  assert(regions.size() == 1);
-  assert(task->regions.size() == 1);
-  Domain domain = runtime->get_index_space_domain(
-      ctx, task->regions[0].region.get_index_space());
-  float* w;
-  switch (domain.get_dim()) {
-    case 1:
-    {
-      TensorAccessorW<float, 1> accW(regions[0], task->regions[0],
-          FID_DATA, ctx, runtime, false/*readOutput*/);
-      w = accW.ptr;
-      break;
-    }
-    case 2:
-    {
-      TensorAccessorW<float, 2> accW(regions[0], task->regions[0],
-          FID_DATA, ctx, runtime, false/*readOutput*/);
-      w = accW.ptr;
-      break;
-    }
-    case 3:
-    {
-      TensorAccessorW<float, 3> accW(regions[0], task->regions[0],
-          FID_DATA, ctx, runtime, false/*readOutput*/);
-      w = accW.ptr;
-      break;
-    }
-    default:
-      assert(false);
-  }
-  curandGenerator_t gen;
-  curandCreateGenerator(&gen, CURAND_RNG_PSEUDO_DEFAULT);
-#ifndef DISABLE_LEGION_CUDA_HIJACK
-  cudaStream_t stream;
-  checkCUDA(cudaStreamCreate(&stream));
-  checkCURAND(curandSetStream(gen, stream));
-#endif
-  NormInitializer* initializer = (NormInitializer*) task->args;
-  //fprintf(stderr, "seed = %d\n", initializer->seed);
-  curandSetPseudoRandomGeneratorSeed(gen, initializer->seed);
-  //fprintf(stderr, "domain.volume() = %zu mean(%.4lf) var(%.4lf)\n",
-  //    domain.get_volume(), initializer->mean, initializer->stddev);
-  // FIXME: it seems curand has an internal bug with volume < 4
-  // double check this later
-  if (domain.get_volume() < 4) {
-    std::default_random_engine generator;
-    std::normal_distribution<float> distribution(
-        initializer->mean, initializer->stddev);
-    float* w_dram = (float*) malloc(domain.get_volume() * sizeof(float));
-    for (size_t i = 0; i < domain.get_volume(); i++)
-      w_dram[i] = distribution(generator);
-    checkCUDA(cudaMemcpy(w, w_dram, sizeof(float) * domain.get_volume(),
-                         cudaMemcpyHostToDevice));
-    checkCUDA(cudaDeviceSynchronize());
-    free(w_dram);
-  } else {
-    checkCURAND(curandGenerateNormal(gen, w, domain.get_volume(),
-        initializer->mean, initializer->stddev));
-    checkCUDA(cudaDeviceSynchronize());
-  }
-  curandDestroyGenerator(gen);
+  float* w = get_init_pointer(task, regions, ctx, runtime);
+  InitIndexMap map = get_init_index_map(task, 0, ctx, runtime);
+  coord_t volume = runtime->get_index_space_domain(
+      ctx, task->regions[0].region.get_index_space()).get_volume();
+  const NormInitializer* initializer = (const NormInitializer*) task->args;
+  init_normal_kernel<<<GET_BLOCKS(volume), CUDA_NUM_THREADS>>>(
+      w, volume, map, (uint32_t)initializer->seed,
+      initializer->mean, initializer->stddev);
+  checkCUDA(cudaDeviceSynchronize());
 }
 
 void ZeroInitializer::init_task(const Task* task,
@@ -16,6 +16,8 @@
 #include "model.h"
 #include "mapper.h"
 #include "dirent.h"
+#include <sstream>
+#include <algorithm>
 
 using namespace std;
 
@@ -286,12 +288,15 @@ void Op::zero_grad(const FFModel& ff)
   IndexLauncher launcher(ZERO_INIT_TASK_ID, task_is,
                          TaskArgument(NULL, 0), argmap,
                          Predicate::TRUE_PRED, false/*must*/, 0/*mapper_id*/,
-                         FFConfig::get_hash_id(std::string(name)));
+                         ff.config.get_strategy_id(std::string(name)));
+  int idx = 0;
   for (int i = 0; i < numWeights; i++) {
+    // Sparse gradients are fully overwritten by backward
+    if (weights[i].sparse_grad) continue;
     launcher.add_region_requirement(
         RegionRequirement(weights[i].part_grad, 0/*projection id*/,
                           WRITE_ONLY, EXCLUSIVE, weights[i].region_grad));
-    launcher.add_field(i, FID_DATA);
+    launcher.add_field(idx++, FID_DATA);
   }
   for (int i = 0; i < numOutputs; i++) {
     launcher.add_region_requirement(
@@ -299,7 +304,7 @@ void Op::zero_grad(const FFModel& ff)
                           WRITE_ONLY, EXCLUSIVE, outputs[i].region_grad));
     //LogicalRegion lr = outputs[i].region_grad;
     //printf("zero_grad:output[%d]: region(%d,%d,%d)\n", i, lr.get_index_space().get_id(), lr.get_field_space().get_id(), lr.get_tree_id());
-    launcher.add_field(i + numWeights, FID_DATA);
+    launcher.add_field(idx++, FID_DATA);
   }
   runtime->execute_index_space(ctx, launcher);
 }
@@ -420,11 +425,16 @@ Domain Op::get_weight_tensor_shape(const ParallelConfig& pc,
 
 FFModel::FFModel(FFConfig& _config)
 : op_global_guid(100), config(_config),
-  optimizer(NULL), loss_op(NULL), metrics_op(NULL)
+  optimizer(NULL), loss_op(NULL), metrics_op(NULL), updates_issued(false)
 {
   Runtime *runtime = config.lg_hlr;
   Context ctx = config.lg_ctx;
-  // Load strategy file
+  // Load strategy file and assign strategy ids to its configs
+  std::map<std::string, ParallelConfig> named_strategies;
+  if (config.import_strategy_file.length() > 0) {
+    load_strategies_from_file(config.import_strategy_file, named_strategies);
+  }
+  assign_strategy_ids(named_strategies, config.strategy_ids, config.strategies);
   int start_dim = FFConfig::DataParallelism_1D, end_dim = FFConfig::DataParallelism_4D;
 #if MAX_TENSOR_DIM >= 5
   end_dim = FFConfig::DataParallelism_5D;
@@ -499,7 +509,8 @@ Tensor FFModel::create_constant(const int dims[],
   ConstantInitializer initializer(value);
   Context ctx = config.lg_ctx;
   Runtime* runtime = config.lg_hlr;
-  initializer.init(ctx, runtime, &tensor);
+  // create_tensor partitions the constant with the default ("") strategy
+  initializer.init(ctx, runtime, &tensor, config.get_strategy_id(""));
   return tensor;
 }
 
@@ -582,7 +593,7 @@ Tensor FFModel::create_tensor(const int dims[],
   IndexLauncher launcher(ZERO_INIT_TASK_ID, part_is,
                          TaskArgument(NULL, 0), argmap,
                          Predicate::TRUE_PRED, false, 0,
-                         FFConfig::get_hash_id(name));
+                         config.get_strategy_id(name));
   launcher.add_region_requirement(
       RegionRequirement(tensor.part, 0/*projection id*/,
                         WRITE_ONLY, EXCLUSIVE, tensor.region));
@@ -732,8 +743,12 @@ Parameter FFModel::create_linear_weight(Op* op,
   // Step 2: initialize region
   if (initializer == NULL) {
     assert(false); // add weight initializer should be set before
+  } else if (config.lazy_weight_init) {
+    // Issued by init_pending_weights unless set_weights comes first
+    pending_weight_inits.push_back(std::make_pair(weight, initializer));
   } else {
-    initializer->init(ctx, runtime, &weight);
+    initializer->init(ctx, runtime, &weight,
+                      config.get_strategy_id(weight.pcname));
   }
   // Step 3: backward region
   if (create_grad) {
@@ -825,8 +840,12 @@ Parameter FFModel::create_conv_weight(Op* op,
   // Step 2: initialize region
   if (initializer == NULL) {
     assert(false); // add weight initializer should be set before
+  } else if (config.lazy_weight_init) {
+    // Issued by init_pending_weights unless set_weights comes first
+    pending_weight_inits.push_back(std::make_pair(weight, initializer));
   } else {
-    initializer->init(ctx, runtime, &weight);
+    initializer->init(ctx, runtime, &weight,
+                      config.get_strategy_id(weight.pcname));
   }
   // Step 3: backwar regin and partition
   if (create_grad) {
@@ -972,6 +991,60 @@ IndexSpace FFModel::get_task_is(const Domain& domain) const
   return it->second;
 }
 
+IndexSpace FFModel::create_load_is(int num_samples, bool local_node)
+{
+  Context ctx = config.lg_ctx;
+  Runtime* runtime = config.lg_hlr;
+  int num_nodes = local_node ? 1 : config.numNodes;
+  int num_parts = std::min(config.loadersPerNode * num_nodes, num_samples);
+  assert(num_parts > 0);
+  // Drop the points whose blocks would be empty
+  int block = (num_samples + num_parts - 1) / num_parts;
+  num_parts = (num_samples + block - 1) / block;
+  Rect<1> rect(Point<1>(0), Point<1>(num_parts-1));
+  return runtime->create_index_space(ctx, rect);
+}
+
+LogicalPartition FFModel::create_sample_partition(const Tensor& tensor,
+                                                  IndexSpace load_is)
+{
+  Context ctx = config.lg_ctx;
+  Runtime* runtime = config.lg_hlr;
+  Domain domain = runtime->get_index_space_domain(
+      ctx, tensor.region.get_index_space());
+  Rect<1> load_rect = runtime->get_index_space_domain(ctx, load_is);
+  int num_parts = load_rect.volume();
+  IndexPartition ip;
+  switch (domain.get_dim()) {
+#define DIMFUNC(DIM) \
+    case DIM: \
+    { \
+      Rect<DIM> rect = domain; \
+      int num_samples = rect.hi[DIM-1] - rect.lo[DIM-1] + 1; \
+      Transform<DIM, 1> transform; \
+      Point<DIM> ext_hi; \
+      for (int i = 0; i < DIM; i++) { \
+        transform[i][0] = 0; \
+        ext_hi[i] = rect.hi[i]; \
+      } \
+      transform[DIM-1][0] = (num_samples + num_parts - 1) / num_parts; \
+      ext_hi[DIM-1] = rect.lo[DIM-1] + transform[DIM-1][0] - 1; \
+      Rect<DIM> extent(rect.lo, ext_hi); \
+      ip = runtime->create_partition_by_restriction(ctx, \
+          IndexSpaceT<DIM>(tensor.region.get_index_space()), \
+          IndexSpaceT<1>(load_is), transform, extent); \
+      break; \
+    }
+    LEGION_FOREACH_N(DIMFUNC)
+#undef DIMFUNC
+    default:
+      assert(false);
+  }
+  assert(runtime->is_index_partition_disjoint(ctx, ip));
+  assert(runtime->is_index_partition_complete(ctx, ip));
+  return runtime->get_logical_partition(ctx, tensor.region, ip);
+}
+
 void FFModel::reset_metrics()
 {
   Context ctx = config.lg_ctx;
@@ -980,8 +1053,31 @@ void FFModel::reset_metrics()
   current_metrics = runtime->execute_task(ctx, launcher);
 }
 
+void FFModel::init_pending_weights() const
+{
+  Context ctx = config.lg_ctx;
+  Runtime* runtime = config.lg_hlr;
+  for (size_t i = 0; i < pending_weight_inits.size(); i++) {
+    const Parameter& weight = pending_weight_inits[i].first;
+    pending_weight_inits[i].second->init(ctx, runtime, &weight,
+        config.get_strategy_id(weight.pcname));
+  }
+  pending_weight_inits.clear();
+}
+
+void FFModel::drop_pending_weight_init(LogicalRegion region) const
+{
+  for (size_t i = 0; i < pending_weight_inits.size(); i++)
+    if (pending_weight_inits[i].first.region == region) {
+      pending_weight_inits.erase(pending_weight_inits.begin() + i);
+      return;
+    }
+}
+
 void FFModel::init_layers()
 {
+  // Op init tasks (e.g., Conv2D's algorithm search) may read weights
+  init_pending_weights();
   for (size_t i = 0; i < layers.size(); i++)
     layers[i]->init(*this);
 }
@@ -1007,6 +1103,24 @@ void FFModel::backward()
   metrics_op->compute(this, &(final_layer->outputs[0]), &label_tensor);
   // Compute the gradients of the final layer wrt loss
   loss_op->backward(this, &(final_layer->outputs[0]), &label_tensor);
+  // With overlap_backward_update, each layer's updates are issued right
+  // after its backward. Clipping by global norm needs all gradients first
+  bool overlap = config.overlap_backward_update && (optimizer != NULL)
+              && (optimizer->clip_grad_norm <= 0.0f);
+  std::vector<size_t> first_param(layers.size(), 0);
+  std::vector<const Parameter*> pending;
+  size_t pending_bytes = 0;
+  // Parameters of each gradient bucket whose backward is not issued yet
+  std::vector<size_t> bucket_pending(grad_buckets.size());
+  if (overlap) {
+    // compile appends the weights of each layer to parameters in order
+    for (size_t l = 1; l < layers.size(); l++)
+      first_param[l] = first_param[l-1] + layers[l-1]->numWeights;
+    for (size_t b = 0; b < grad_buckets.size(); b++)
+      bucket_pending[b] = grad_buckets[b].params.size();
+    optimizer->next();
+    optimizer->grad_norms.clear();
+  }
   // Perform backpropagation
   // std::set<LogicalRegion> resetedInputGrads;
   for (int l = layers.size() - 1; l >= 0; l--) {
@@ -1021,15 +1135,134 @@ void FFModel::backward()
       }
 #endif
     layers[l]->backward(*this);
+    if (overlap) {
+      for (int j = 0; j < layers[l]->numWeights; j++) {
+        Parameter* p = &(parameters[first_param[l] + j]);
+        assert(p->region == layers[l]->weights[j].region);
+        int b = param_buckets[first_param[l] + j];
+        if (b >= 0) {
+          // A bucket is synchronized once all its gradients are issued
+          if (--bucket_pending[b] == 0)
+            optimizer->update_bucket(grad_buckets[b]);
+          continue;
+        }
+        pending.push_back(p);
+        pending_bytes += p->get_volume() * sizeof(float);
+      }
+      // Legion only orders these updates after the backward tasks that
+      // write their gradients, so they overlap with the remaining layers
+      if (!pending.empty() && pending_bytes >= config.grad_bucket_size) {
+        update_params(pending);
+        pending.clear();
+        pending_bytes = 0;
+      }
+    }
   }
+  if (overlap && !pending.empty())
+    update_params(pending);
+  updates_issued = overlap;
+}
+
+// Same choice as FFMapper::select_task_options for update tasks:
+// single-part strategies run on their first device, and the rest are
+// left to the default mapper (-1, -1)
+static std::pair<int, int> get_update_device(FFConfig& config,
+                                             const Parameter* p)
+{
+  std::pair<int, int> device(-1, -1);
+  MappingTagID id = config.get_strategy_id(p->pcname);
+  if ((id >= FFConfig::StrategyID_FIRST) && (id < config.strategies.size())
+  && (config.strategies[id].num_parts() == 1)) {
+    device.first = config.strategies[id].device_type;
+    device.second = config.strategies[id].device_ids[0];
+  }
+  return device;
 }
 
 void FFModel::update()
 {
+  if (updates_issued) {
+    // backward already issued this iteration's updates
+    updates_issued = false;
+    return;
+  }
   optimizer->next();
   //return;
-  for (size_t i = 0; i < parameters.size(); i++) {
-    optimizer->update(&(parameters[i]));
+  // Clipping by global norm: each device group of dense parameters reduces
+  // its squared norm where its gradients live, and every dense update
+  // waits on all partial norms
+  optimizer->grad_norms.clear();
+  if (optimizer->clip_grad_norm > 0.0f) {
+    std::map<std::pair<int, int>, std::vector<const Parameter*> > groups;
+    for (size_t i = 0; i < parameters.size(); i++) {
+      const Parameter* p = &(parameters[i]);
+      if (!p->sparse_grad)
+        groups[get_update_device(config, p)].push_back(p);
+    }
+    std::map<std::pair<int, int>, std::vector<const Parameter*> >::const_iterator it;
+    for (it = groups.begin(); it != groups.end(); it++) {
+      const std::vector<const Parameter*>& group = it->second;
+      for (size_t i = 0; i < group.size(); i += MULTI_TENSOR_MAX_PARAMS) {
+        size_t end = std::min(i + MULTI_TENSOR_MAX_PARAMS, group.size());
+        std::vector<const Parameter*> batch(group.begin() + i,
+                                            group.begin() + end);
+        optimizer->grad_norms.push_back(optimizer->compute_grad_norm(batch));
+      }
+    }
+  }
+  for (size_t b = 0; b < grad_buckets.size(); b++)
+    optimizer->update_bucket(grad_buckets[b]);
+  std::vector<const Parameter*> params;
+  for (size_t i = 0; i < parameters.size(); i++)
+    if (param_buckets[i] < 0)
+      params.push_back(&(parameters[i]));
+  update_params(params);
+}
+
+// Issues the updates of params for the current step of the optimizer,
+// which must be after the launches of optimizer->grad_norms
+void FFModel::update_params(const std::vector<const Parameter*>& params)
+{
+  Context ctx = config.lg_ctx;
+  Runtime* runtime = config.lg_hlr;
+  // Dense parameters grouped by the device that updates them
+  std::map<std::pair<int, int>, std::vector<const Parameter*> > groups;
+  for (size_t i = 0; i < params.size(); i++) {
+    if (!params[i]->sparse_grad)
+      groups[get_update_device(config, params[i])].push_back(params[i]);
+  }
+  std::map<std::pair<int, int>, std::vector<const Parameter*> >::const_iterator it;
+  // Small dense parameters updated on the same device share one launch;
+  // sparse and large parameters keep a launch each
+  for (size_t i = 0; i < params.size(); i++) {
+    const Parameter* p = params[i];
+    Domain domain = runtime->get_index_space_domain(
+        ctx, p->region.get_index_space());
+    if (!config.multi_tensor_apply || p->sparse_grad
+    || domain.get_volume() > MULTI_TENSOR_MAX_VOLUME)
+      optimizer->update(p);
+  }
+  if (!config.multi_tensor_apply)
+    return;
+  for (it = groups.begin(); it != groups.end(); it++) {
+    std::vector<const Parameter*> small;
+    for (size_t i = 0; i < it->second.size(); i++) {
+      const Parameter* p = it->second[i];
+      Domain domain = runtime->get_index_space_domain(
+          ctx, p->region.get_index_space());
+      if (domain.get_volume() <= MULTI_TENSOR_MAX_VOLUME)
+        small.push_back(p);
+    }
+    for (size_t i = 0; i < small.size(); i += MULTI_TENSOR_MAX_PARAMS) {
+      size_t end = std::min(i + MULTI_TENSOR_MAX_PARAMS, small.size());
+      if (end - i == 1) {
+        optimizer->update(small[i]);
+      } else {
+        std::vector<const Parameter*> batch(small.begin() + i,
+                                            small.begin() + end);
+        optimizer->update_multi(batch);
+      }
+    }
   }
 }
 
@@ -1046,9 +1279,6 @@ void FFModel::compile(LossType loss_type,
 {
   Context ctx = config.lg_ctx;
   Runtime* runtime = config.lg_hlr;
-  if (config.import_strategy_file.length() > 0) {
-    load_strategies_from_file(config.import_strategy_file, config.strategies);
-  }
   if (config.search_budget > 0) {
     // Launch the search task
     FFModel* model = this;
@@ -1119,6 +1349,159 @@ void FFModel::compile(LossType loss_type,
   // init optimizer
   assert(optimizer != NULL);
   optimizer->init();
+  create_grad_buckets();
+}
+
+// Offset of subdomain in the column-major layout of domain; the subdomain
+// must be contiguous, i.e. only split along the last dimension
+static coord_t get_linear_offset(const Domain& domain, const Domain& subdomain)
+{
+  assert(domain.get_dim() == subdomain.get_dim());
+  coord_t offset = 0, stride = 1;
+  for (int i = 0; i < domain.get_dim(); i++) {
+    if (i < domain.get_dim() - 1) {
+      assert(subdomain.lo()[i] == domain.lo()[i]);
+      assert(subdomain.hi()[i] == domain.hi()[i]);
+    }
+    offset += (subdomain.lo()[i] - domain.lo()[i]) * stride;
+    stride *= domain.hi()[i] - domain.lo()[i] + 1;
+  }
+  return offset;
+}
+
+static GradBucket create_grad_bucket(const std::vector<const Parameter*>& params,
+                                     Context ctx, Runtime* runtime)
+{
+  GradBucket bucket;
+  bucket.params = params;
+  bucket.task_is = runtime->get_index_partition_color_space_name(
+      ctx, params[0]->part_grad.get_index_partition());
+  Domain color_domain = runtime->get_index_space_domain(ctx, bucket.task_is);
+  bucket.num_colors = color_domain.get_volume();
+  bucket.row_volume = 0;
+  bucket.grad_offsets.resize(params.size() * bucket.num_colors);
+  for (size_t k = 0; k < params.size(); k++) {
+    Domain grad_domain = runtime->get_index_space_domain(
+        ctx, params[k]->region_grad.get_index_space());
+    assert(grad_domain.get_volume() % bucket.num_colors == 0);
+    coord_t slice_volume = grad_domain.get_volume() / bucket.num_colors;
+    bucket.row_offsets.push_back(bucket.row_volume);
+    bucket.slice_volumes.push_back(slice_volume);
+    bucket.row_volume += slice_volume;
+    for (Domain::DomainPointIterator it(color_domain); it; it++) {
+      // Rows follow the column-major order of the colors
+      coord_t row = 0;
+      for (int i = color_domain.get_dim() - 1; i >= 0; i--)
+        row = row * (color_domain.hi()[i] - color_domain.lo()[i] + 1)
+            + it.p[i] - color_domain.lo()[i];
+      LogicalRegion slice = runtime->get_logical_subregion_by_color(
+          ctx, params[k]->part_grad, it.p);
+      Domain slice_domain = runtime->get_index_space_domain(
+          ctx, slice.get_index_space());
+      assert(slice_domain.get_volume() == slice_volume);
+      bucket.grad_offsets[k * bucket.num_colors + row] =
+          get_linear_offset(grad_domain, slice_domain);
+    }
+  }
+  FieldSpace fs = runtime->create_field_space(ctx);
+  FieldAllocator allocator = runtime->create_field_allocator(ctx, fs);
+  allocator.allocate_field(sizeof(float), FID_DATA);
+  Rect<1> rect(Point<1>(0), Point<1>(bucket.num_colors * bucket.row_volume - 1));
+  IndexSpaceT<1> is = runtime->create_index_space(ctx, rect);
+  bucket.region = runtime->create_logical_region(ctx, is, fs);
+  Rect<1> extent(Point<1>(0), Point<1>(bucket.row_volume - 1));
+  IndexPartition ip;
+  switch (color_domain.get_dim()) {
+#define DIMFUNC(DIM) \
+    case DIM: \
+    { \
+      Transform<1, DIM> transform; \
+      coord_t stride = bucket.row_volume; \
+      for (int i = 0; i < DIM; i++) { \
+        assert(color_domain.lo()[i] == 0); \
+        transform[0][i] = stride; \
+        stride *= color_domain.hi()[i] + 1; \
+      } \
+      ip = runtime->create_partition_by_restriction(ctx, is, \
+          IndexSpaceT<DIM>(bucket.task_is), transform, extent); \
+      break; \
+    }
+    LEGION_FOREACH_N(DIMFUNC)
+#undef DIMFUNC
+    default:
+      assert(false);
+  }
+  assert(runtime->is_index_partition_disjoint(ctx, ip));
+  bucket.part = runtime->get_logical_partition(ctx, bucket.region, ip);
+  return bucket;
+}
+
+// Packs the gradients of small replicated dense parameters into buckets of
+// up to config.grad_bucket_size bytes, in the order backward produces them
+void FFModel::create_grad_buckets()
+{
+  Context ctx = config.lg_ctx;
+  Runtime* runtime = config.lg_hlr;
+  param_buckets.assign(parameters.size(), -1);
+  if (config.grad_bucket_size == 0)
+    return;
+  // Parameters can share a bucket if their gradients are partitioned over
+  // the same task index space and devices
+  typedef std::pair<IndexSpace, std::vector<int> > BucketKey;
+  std::map<BucketKey, std::vector<int> > open;
+  std::map<BucketKey, size_t> open_bytes;
+  std::vector<std::vector<int> > buckets;
+  std::vector<size_t> first_param(layers.size(), 0);
+  for (size_t l = 1; l < layers.size(); l++)
+    first_param[l] = first_param[l-1] + layers[l-1]->numWeights;
+  for (int l = layers.size() - 1; l >= 0; l--) {
+    for (int j = 0; j < layers[l]->numWeights; j++) {
+      int k = first_param[l] + j;
+      const Parameter& p = parameters[k];
+      if (p.sparse_grad || (p.region_grad == LogicalRegion::NO_REGION))
+        continue;
+      Domain domain = runtime->get_index_space_domain(
+          ctx, p.region.get_index_space());
+      Domain grad_domain = runtime->get_index_space_domain(
+          ctx, p.region_grad.get_index_space());
+      // Large gradients and gradients without replicas gain nothing
+      if (!use_grad_bucket(config.grad_bucket_size, domain.get_volume(),
+                           grad_domain.get_volume() / domain.get_volume()))
+        continue;
+      BucketKey key;
+      key.first = runtime->get_index_partition_color_space_name(
+          ctx, p.part_grad.get_index_partition());
+      ParallelConfig pc;
+      int ndims = runtime->get_index_space_domain(ctx, key.first).get_dim();
+      if (config.find_parallel_config(ndims, p.pcname, pc))
+        key.second.assign(pc.device_ids, pc.device_ids + pc.num_parts());
+      size_t bytes = grad_domain.get_volume() * sizeof(float);
+      std::vector<int>& bucket = open[key];
+      if (grad_bucket_full(config.grad_bucket_size, open_bytes[key],
+                           bucket.size(), bytes)) {
+        buckets.push_back(bucket);
+        bucket.clear();
+        open_bytes[key] = 0;
+      }
+      bucket.push_back(k);
+      open_bytes[key] += bytes;
+    }
+  }
+  std::map<BucketKey, std::vector<int> >::const_iterator it;
+  for (it = open.begin(); it != open.end(); it++)
+    if (!it->second.empty())
+      buckets.push_back(it->second);
+  for (size_t b = 0; b < buckets.size(); b++) {
+    // A single parameter is synchronized as well without a bucket
+    if (buckets[b].size() < 2)
+      continue;
+    std::vector<const Parameter*> params;
+    for (size_t i = 0; i < buckets[b].size(); i++) {
+      params.push_back(&(parameters[buckets[b][i]]));
+      param_buckets[buckets[b][i]] = grad_buckets.size();
+    }
+    grad_buckets.push_back(create_grad_bucket(params, ctx, runtime));
+  }
 }
 
 void FFModel::rewrite(const std::map<Op*, ParallelConfig>& current,
@@ -1197,7 +1580,7 @@ void FFModel::zero_gradients(void)
     IndexLauncher launcher(ZERO_INIT_TASK_ID, task_is,
                            TaskArgument(NULL, 0), arg_map,
                            Predicate::TRUE_PRED, false/*must*/, 0/*mapper_id*/,
-                           FFConfig::get_hash_id(std::string(parameters[p].pcname)));
+                           config.get_strategy_id(std::string(parameters[p].pcname)));
     launcher.add_region_requirement(
         RegionRequirement(parameters[p].part_grad, 0/*projection*/,
                           WRITE_ONLY, EXCLUSIVE, parameters[p].region_grad));
@@ -1304,6 +1687,102 @@ bool DataLoader::shuffle_samples(void)
 }
 #endif
 
+// ========================================================
+// class BatchPrefetcher
+// ========================================================
+BatchPrefetcher::BatchPrefetcher(void)
+: depth(0), position(0)
+{}
+
+void BatchPrefetcher::init(FFModel& ff, const std::vector<Tensor>& _batches,
+                           const std::vector<std::string>& _pcnames)
+{
+  Context ctx = ff.config.lg_ctx;
+  Runtime* runtime = ff.config.lg_hlr;
+  assert(_batches.size() == _pcnames.size());
+  depth = ff.config.prefetch_depth;
+  assert(depth >= 0);
+  batches = _batches;
+  pcnames = _pcnames;
+  position = 0;
+  slots.resize(depth);
+  staged.assign(depth, -1);
+  for (int s = 0; s < depth; s++)
+    for (size_t i = 0; i < batches.size(); i++) {
+      Tensor tensor = batches[i];
+      tensor.region = runtime->create_logical_region(ctx,
+          batches[i].region.get_index_space(),
+          batches[i].region.get_field_space());
+      tensor.part = runtime->get_logical_partition(ctx, tensor.region,
+          batches[i].part.get_index_partition());
+      tensor.region_grad = LogicalRegion::NO_REGION;
+      tensor.part_grad = LogicalPartition::NO_PART;
+      slots[s].push_back(tensor);
+    }
+}
+
+long long BatchPrefetcher::epoch_batch_key(long long next_index, int ahead,
+                                           int num_samples, int batch_size)
+{
+  long long key = next_index + (long long)ahead * batch_size;
+  if (ahead > 0) {
+    int num_batches = num_samples / batch_size;
+    key = key / batch_size % num_batches * batch_size;
+  }
+  return key;
+}
+
+void BatchPrefetcher::next_batch(FFModel& ff, Source& source)
+{
+  if (depth == 0) {
+    source.load_batch(ff, source.batch_key(ff, 0), batches);
+    return;
+  }
+  // The current batch is not staged after a reset
+  int slot = position % depth;
+  long long key = source.batch_key(ff, 0);
+  if (staged[slot] != key) {
+    source.load_batch(ff, key, slots[slot]);
+    staged[slot] = key;
+  }
+  copy_to_batches(ff, slot);
+  // The batch depth ahead refills the current slot, after the copy above
+  for (int ahead = 1; ahead <= depth; ahead++) {
+    slot = (position + ahead) % depth;
+    key = source.batch_key(ff, ahead);
+    if (staged[slot] != key) {
+      source.load_batch(ff, key, slots[slot]);
+      staged[slot] = key;
+    }
+  }
+  position++;
+}
+
+void BatchPrefetcher::copy_to_batches(FFModel& ff, int slot)
+{
+  Context ctx = ff.config.lg_ctx;
+  Runtime* runtime = ff.config.lg_hlr;
+  for (size_t i = 0; i < batches.size(); i++) {
+    // Same launch domain and mapping as the loader's own launches, so
+    // that each shard is copied within the GPU that staged it
+    IndexSpace task_is = ff.get_or_create_task_is(batches[i].numDim, pcnames[i]);
+    ArgumentMap argmap;
+    IndexLauncher launcher(COPY_BATCH_TASK_ID, task_is,
+                           TaskArgument(&batches[i].data_type, sizeof(DataType)),
+                           argmap, Predicate::TRUE_PRED, false/*must*/,
+                           0/*mapper_id*/, ff.config.get_strategy_id(pcnames[i]));
+    launcher.add_region_requirement(
+        RegionRequirement(slots[slot][i].part, 0/*projection id*/,
+                          READ_ONLY, EXCLUSIVE, slots[slot][i].region));
+    launcher.add_field(0, FID_DATA);
+    launcher.add_region_requirement(
+        RegionRequirement(batches[i].part, 0/*projection id*/,
+                          WRITE_ONLY, EXCLUSIVE, batches[i].region));
+    launcher.add_field(1, FID_DATA);
+    runtime->execute_index_space(ctx, launcher);
+  }
+}
+
 // ========================================================
 // class FFConfig
 // ========================================================
@@ -1327,6 +1806,16 @@ struct DefaultConfig {
   const static bool enableSampleParallel = true;
   const static bool enableParameterParallel = false;
   const static bool enableAttributeParallel = false;
+  const static int cpuStealFamilies = FFConfig::CPU_STEAL_NONE;
+  const static bool sparseEmbeddingGrad = false;
+  const static bool inference = false;
+  const static bool multiTensorApply = false;
+  const static DataType adamMomentType = DT_FLOAT;
+  constexpr static float clipGradNorm = 0.0f;
+  const static bool overlapBackwardUpdate = false;
+  const static size_t gradBucketSize = 0;
+  const static bool lazyWeightInit = false;
+  const static int prefetchDepth = 0;
 };
 
 FFConfig::FFConfig()
@@ -1348,6 +1837,16 @@ FFConfig::FFConfig()
   enable_sample_parallel = DefaultConfig::enableSampleParallel;
   enable_parameter_parallel = DefaultConfig::enableParameterParallel;
   enable_attribute_parallel = DefaultConfig::enableAttributeParallel;
+  cpu_steal_families = DefaultConfig::cpuStealFamilies;
+  sparse_embedding_grad = DefaultConfig::sparseEmbeddingGrad;
+  inference = DefaultConfig::inference;
+  multi_tensor_apply = DefaultConfig::multiTensorApply;
+  adam_moment_type = DefaultConfig::adamMomentType;
+  clip_grad_norm = DefaultConfig::clipGradNorm;
+  overlap_backward_update = DefaultConfig::overlapBackwardUpdate;
+  grad_bucket_size = DefaultConfig::gradBucketSize;
+  lazy_weight_init = DefaultConfig::lazyWeightInit;
+  prefetch_depth = DefaultConfig::prefetchDepth;
 
   import_strategy_file = "";
   export_strategy_file = "";
@@ -1411,6 +1910,78 @@ void FFConfig::parse_args(char **argv, int argc)
       enable_parameter_parallel = true;
       continue;
     }
+    if (!strcmp(argv[i], "--sparse-embedding-grad"))
+    {
+      sparse_embedding_grad = true;
+      continue;
+    }
+    if (!strcmp(argv[i], "--inference"))
+    {
+      inference = true;
+      continue;
+    }
+    if (!strcmp(argv[i], "--multi-tensor-apply"))
+    {
+      multi_tensor_apply = true;
+      continue;
+    }
+    if (!strcmp(argv[i], "--adam-moments"))
+    {
+      std::string type(argv[++i]);
+      if (type == "fp32") adam_moment_type = DT_FLOAT;
+      else if (type == "fp16") adam_moment_type = DT_HALF;
+      else if (type == "bf16") adam_moment_type = DT_BFLOAT16;
+      else {
+        fprintf(stderr, "Unknown --adam-moments type: %s\n", type.c_str());
+        assert(false);
+      }
+      continue;
+    }
+    if (!strcmp(argv[i], "--clip-grad-norm"))
+    {
+      clip_grad_norm = atof(argv[++i]);
+      continue;
+    }
+    if (!strcmp(argv[i], "--overlap-backward-update"))
+    {
+      // Also let the search simulate the overlapped schedule (Step 3a)
+      overlap_backward_update = true;
+      search_overlap_backward_update = true;
+      continue;
+    }
+    if (!strcmp(argv[i], "--grad-bucket-mb"))
+    {
+      grad_bucket_size = (size_t)atoi(argv[++i]) * 1024 * 1024;
+      continue;
+    }
+    if (!strcmp(argv[i], "--lazy-weight-init"))
+    {
+      lazy_weight_init = true;
+      continue;
+    }
+    if (!strcmp(argv[i], "--prefetch-depth"))
+    {
+      prefetch_depth = atoi(argv[++i]);
+      continue;
+    }
+    if (!strcmp(argv[i], "--cpu-steal"))
+    {
+      // Comma-separated list of loader, init, ops, all or none
+      cpu_steal_families = CPU_STEAL_NONE;
+      std::stringstream ss(argv[++i]);
+      std::string family;
+      while (std::getline(ss, family, ',')) {
+        if (family == "loader") cpu_steal_families |= CPU_STEAL_LOADER;
+        else if (family == "init") cpu_steal_families |= CPU_STEAL_INIT;
+        else if (family == "ops") cpu_steal_families |= CPU_STEAL_OPS;
+        else if (family == "all") cpu_steal_families |= CPU_STEAL_ALL;
+        else if (family != "none") {
+          fprintf(stderr, "Unknown --cpu-steal family: %s\n", family.c_str());
+          assert(false);
+        }
+      }
+      continue;
+    }
     if (!strcmp(argv[i], "-ll:gpu"))
     {
       workersPerNode = atoi(argv[++i]);
@@ -1493,6 +2064,27 @@ void register_internal_tasks()
     Runtime::preregister_task_variant<ElementUnary::backward_task>(
         registrar, "ElementWiseUnary Backward Task");
   }
+  {
+    TaskVariantRegistrar registrar(ELEMENTUNARY_INIT_TASK_ID, "ElementWiseUnary Init");
+    registrar.add_constraint(ProcessorConstraint(Processor::LOC_PROC));
+    registrar.set_leaf();
+    Runtime::preregister_task_variant<OpMeta*, ElementUnary::init_task_cpu>(
+        registrar, "ElementWiseUnary Init Task");
+  }
+  {
+    TaskVariantRegistrar registrar(ELEMENTUNARY_FWD_TASK_ID, "ElementWiseUnary Forward");
+    registrar.add_constraint(ProcessorConstraint(Processor::LOC_PROC));
+    registrar.set_leaf();
+    Runtime::preregister_task_variant<ElementUnary::forward_task_cpu>(
+        registrar, "ElementWiseUnary Forward Task");
+  }
+  {
+    TaskVariantRegistrar registrar(ELEMENTUNARY_BWD_TASK_ID, "ElementWiseUnary Backward");
+    registrar.add_constraint(ProcessorConstraint(Processor::LOC_PROC));
+    registrar.set_leaf();
+    Runtime::preregister_task_variant<ElementUnary::backward_task_cpu>(
+        registrar, "ElementWiseUnary Backward Task");
+  }
   // ElementBinary task
   {
     TaskVariantRegistrar registrar(ELEMENTBINARY_INIT_TASK_ID, "ElementWiseBinary Init");
@@ -1515,6 +2107,27 @@ void register_internal_tasks()
     Runtime::preregister_task_variant<ElementBinary::backward_task>(
         registrar, "ElementWiseBinary Backward Task");
   }
+  {
+    TaskVariantRegistrar registrar(ELEMENTBINARY_INIT_TASK_ID, "ElementWiseBinary Init");
+    registrar.add_constraint(ProcessorConstraint(Processor::LOC_PROC));
+    registrar.set_leaf();
+    Runtime::preregister_task_variant<OpMeta*, ElementBinary::init_task_cpu>(
+        registrar, "ElementWiseBinary Init Task");
+  }
+  {
+    TaskVariantRegistrar registrar(ELEMENTBINARY_FWD_TASK_ID, "ElementWiseBinary Forward");
+    registrar.add_constraint(ProcessorConstraint(Processor::LOC_PROC));
+    registrar.set_leaf();
+    Runtime::preregister_task_variant<ElementBinary::forward_task_cpu>(
+        registrar, "ElementWiseBinary Forward Task");
+  }
+  {
+    TaskVariantRegistrar registrar(ELEMENTBINARY_BWD_TASK_ID, "ElementWiseBinary Backward");
+    registrar.add_constraint(ProcessorConstraint(Processor::LOC_PROC));
+    registrar.set_leaf();
+    Runtime::preregister_task_variant<ElementBinary::backward_task_cpu>(
+        registrar, "ElementWiseBinary Backward Task");
+  }
   // Conv2D task
   {
     TaskVariantRegistrar registrar(CONV2D_INIT_TASK_ID, "Conv2D Init");
@@ -1544,6 +2157,27 @@ void register_internal_tasks()
     Runtime::preregister_task_variant<Conv2D::backward_task>(
         registrar, "Conv2D Backward Task");
   }
+  {
+    TaskVariantRegistrar registrar(CONV2D_INIT_TASK_ID, "Conv2D Init");
+    registrar.add_constraint(ProcessorConstraint(Processor::LOC_PROC));
+    registrar.set_leaf();
+    Runtime::preregister_task_variant<OpMeta*, Conv2D::init_task_cpu>(
+        registrar, "Conv2D Init Task");
+  }
+  {
+    TaskVariantRegistrar registrar(CONV2D_FWD_TASK_ID, "Conv2D Forward");
+    registrar.add_constraint(ProcessorConstraint(Processor::LOC_PROC));
+    registrar.set_leaf();
+    Runtime::preregister_task_variant<Conv2D::forward_task_cpu>(
+        registrar, "Conv2D Forward Task");
+  }
+  {
+    TaskVariantRegistrar registrar(CONV2D_BWD_TASK_ID, "Conv2D Backward");
+    registrar.add_constraint(ProcessorConstraint(Processor::LOC_PROC));
+    registrar.set_leaf();
+    Runtime::preregister_task_variant<Conv2D::backward_task_cpu>(
+        registrar, "Conv2D Backward Task");
+  }
   //{
   //  TaskVariantRegistrar registrar(CONV2D_UPD_TASK_ID, "Conv2D Update");
   //  registrar.add_constraint(ProcessorConstraint(Processor::TOC_PROC));
@@ -1573,6 +2207,27 @@ void register_internal_tasks()
     Runtime::preregister_task_variant<Dropout::backward_task>(
         registrar, "Dropout Backward Task");
   }
+  {
+    TaskVariantRegistrar registrar(DROPOUT_INIT_TASK_ID, "Dropout Init");
+    registrar.add_constraint(ProcessorConstraint(Processor::LOC_PROC));
+    registrar.set_leaf();
+    Runtime::preregister_task_variant<OpMeta*, Dropout::init_task_cpu>(
+        registrar, "Dropout Init Task");
+  }
+  {
+    TaskVariantRegistrar registrar(DROPOUT_FWD_TASK_ID, "Dropout Forward");
+    registrar.add_constraint(ProcessorConstraint(Processor::LOC_PROC));
+    registrar.set_leaf();
+    Runtime::preregister_task_variant<Dropout::forward_task_cpu>(
+        registrar, "Dropout Forward Task");
+  }
+  {
+    TaskVariantRegistrar registrar(DROPOUT_BWD_TASK_ID, "Dropout Backward");
+    registrar.add_constraint(ProcessorConstraint(Processor::LOC_PROC));
+    registrar.set_leaf();
+    Runtime::preregister_task_variant<Dropout::backward_task_cpu>(
+        registrar, "Dropout Backward Task");
+  }
   // Embedding task GPU
   {
     TaskVariantRegistrar registrar(EMBED_INIT_TASK_ID, "Embedding Init");
@@ -1596,6 +2251,13 @@ void register_internal_tasks()
         registrar, "Embedding Backward Task");
   }
   // Embedding task CPU
+  {
+    TaskVariantRegistrar registrar(EMBED_INIT_TASK_ID, "Embedding Init");
+    registrar.add_constraint(ProcessorConstraint(Processor::LOC_PROC));
+    registrar.set_leaf();
+    Runtime::preregister_task_variant<OpMeta*, Embedding::init_task_cpu>(
+        registrar, "Embedding Init Task");
+  }
   {
     TaskVariantRegistrar registrar(EMBED_FWD_TASK_ID, "Embedding Forward");
     registrar.add_constraint(ProcessorConstraint(Processor::LOC_PROC));
@@ -1632,19 +2294,40 @@ void register_internal_tasks()
     Runtime::preregister_task_variant<Pool2D::backward_task>(
         registrar, "pool2d_bwd_task");
   }
-  // BatchNorm task
   {
-    TaskVariantRegistrar registrar(BATCHNORM_INIT_TASK_ID, "bn_init_task");
-    registrar.add_constraint(ProcessorConstraint(Processor::TOC_PROC));
+    TaskVariantRegistrar registrar(POOL2D_INIT_TASK_ID, "pool2d_init_task");
+    registrar.add_constraint(ProcessorConstraint(Processor::LOC_PROC));
     registrar.set_leaf();
-    Runtime::preregister_task_variant<OpMeta*, BatchNorm::init_task>(
-        registrar, "bn_init_task");
+    Runtime::preregister_task_variant<OpMeta*, Pool2D::init_task_cpu>(
+        registrar, "pool2d_init_task");
   }
   {
-    TaskVariantRegistrar registrar(BATCHNORM_INIT_PARA_TASK_ID, "bm_init_para_task");
-    registrar.add_constraint(ProcessorConstraint(Processor::TOC_PROC));
+    TaskVariantRegistrar registrar(POOL2D_FWD_TASK_ID, "pool2d_fwd_task");
+    registrar.add_constraint(ProcessorConstraint(Processor::LOC_PROC));
     registrar.set_leaf();
-    Runtime::preregister_task_variant<BatchNorm::init_para_task>(
+    Runtime::preregister_task_variant<Pool2D::forward_task_cpu>(
+        registrar, "pool2d_fwd_task");
+  }
+  {
+    TaskVariantRegistrar registrar(POOL2D_BWD_TASK_ID, "pool2d_bwd_task");
+    registrar.add_constraint(ProcessorConstraint(Processor::LOC_PROC));
+    registrar.set_leaf();
+    Runtime::preregister_task_variant<Pool2D::backward_task_cpu>(
+        registrar, "pool2d_bwd_task");
+  }
+  // BatchNorm task
+  {
+    TaskVariantRegistrar registrar(BATCHNORM_INIT_TASK_ID, "bn_init_task");
+    registrar.add_constraint(ProcessorConstraint(Processor::TOC_PROC));
+    registrar.set_leaf();
+    Runtime::preregister_task_variant<OpMeta*, BatchNorm::init_task>(
+        registrar, "bn_init_task");
+  }
+  {
+    TaskVariantRegistrar registrar(BATCHNORM_INIT_PARA_TASK_ID, "bm_init_para_task");
+    registrar.add_constraint(ProcessorConstraint(Processor::TOC_PROC));
+    registrar.set_leaf();
+    Runtime::preregister_task_variant<BatchNorm::init_para_task>(
         registrar, "bm_init_para_task");
   }
   {
@@ -1661,6 +2344,41 @@ void register_internal_tasks()
     Runtime::preregister_task_variant<BatchNorm::backward_task>(
         registrar, "bn_bwd_task");
   }
+  {
+    TaskVariantRegistrar registrar(BATCHNORM_SET_STATS_TASK_ID, "bn_set_stats_task");
+    registrar.add_constraint(ProcessorConstraint(Processor::TOC_PROC));
+    registrar.set_leaf();
+    Runtime::preregister_task_variant<BatchNorm::set_stats_task>(
+        registrar, "bn_set_stats_task");
+  }
+  {
+    TaskVariantRegistrar registrar(BATCHNORM_INIT_TASK_ID, "bn_init_task");
+    registrar.add_constraint(ProcessorConstraint(Processor::LOC_PROC));
+    registrar.set_leaf();
+    Runtime::preregister_task_variant<OpMeta*, BatchNorm::init_task_cpu>(
+        registrar, "bn_init_task");
+  }
+  {
+    TaskVariantRegistrar registrar(BATCHNORM_FWD_TASK_ID, "bn_fwd_task");
+    registrar.add_constraint(ProcessorConstraint(Processor::LOC_PROC));
+    registrar.set_leaf();
+    Runtime::preregister_task_variant<BatchNorm::forward_task_cpu>(
+        registrar, "bn_fwd_task");
+  }
+  {
+    TaskVariantRegistrar registrar(BATCHNORM_BWD_TASK_ID, "bn_bwd_task");
+    registrar.add_constraint(ProcessorConstraint(Processor::LOC_PROC));
+    registrar.set_leaf();
+    Runtime::preregister_task_variant<BatchNorm::backward_task_cpu>(
+        registrar, "bn_bwd_task");
+  }
+  {
+    TaskVariantRegistrar registrar(BATCHNORM_SET_STATS_TASK_ID, "bn_set_stats_task");
+    registrar.add_constraint(ProcessorConstraint(Processor::LOC_PROC));
+    registrar.set_leaf();
+    Runtime::preregister_task_variant<BatchNorm::set_stats_task_cpu>(
+        registrar, "bn_set_stats_task");
+  }
   // BatchMatmul task
   {
     TaskVariantRegistrar registrar(BATCHMATMUL_INIT_TASK_ID, "BatchMatmul Init");
@@ -1683,6 +2401,27 @@ void register_internal_tasks()
     Runtime::preregister_task_variant<BatchMatmul::backward_task>(
         registrar, "BatchMatmul Backward Task");
   }
+  {
+    TaskVariantRegistrar registrar(BATCHMATMUL_INIT_TASK_ID, "BatchMatmul Init");
+    registrar.add_constraint(ProcessorConstraint(Processor::LOC_PROC));
+    registrar.set_leaf();
+    Runtime::preregister_task_variant<OpMeta*, BatchMatmul::init_task_cpu>(
+        registrar, "BatchMatmul Init Task");
+  }
+  {
+    TaskVariantRegistrar registrar(BATCHMATMUL_FWD_TASK_ID, "BatchMatmul Forward");
+    registrar.add_constraint(ProcessorConstraint(Processor::LOC_PROC));
+    registrar.set_leaf();
+    Runtime::preregister_task_variant<BatchMatmul::forward_task_cpu>(
+        registrar, "BatchMatmul Forward Task");
+  }
+  {
+    TaskVariantRegistrar registrar(BATCHMATMUL_BWD_TASK_ID, "BatchMatmul Backward");
+    registrar.add_constraint(ProcessorConstraint(Processor::LOC_PROC));
+    registrar.set_leaf();
+    Runtime::preregister_task_variant<BatchMatmul::backward_task_cpu>(
+        registrar, "BatchMatmul Backward Task");
+  }
   // Linear task
   {
     TaskVariantRegistrar registrar(LINEAR_INIT_TASK_ID, "Linear Init");
@@ -1713,6 +2452,35 @@ void register_internal_tasks()
     Runtime::preregister_task_variant<Linear::backward2_task>(
         registrar, "Linear Backward Task (Aggregate replica)");
   }
+  {
+    TaskVariantRegistrar registrar(LINEAR_INIT_TASK_ID, "Linear Init");
+    registrar.add_constraint(ProcessorConstraint(Processor::LOC_PROC));
+    registrar.set_leaf();
+    Runtime::preregister_task_variant<OpMeta*, Linear::init_task_cpu>(
+        registrar, "Linear Init Task");
+  }
+  {
+    TaskVariantRegistrar registrar(LINEAR_FWD_TASK_ID, "Linear Forward");
+    registrar.add_constraint(ProcessorConstraint(Processor::LOC_PROC));
+    registrar.set_leaf();
+    Runtime::preregister_task_variant<Linear::forward_task_cpu>(
+        registrar, "Linear Forward Task");
+  }
+  {
+    TaskVariantRegistrar registrar(LINEAR_BWD_TASK_ID, "Linear Backward");
+    registrar.add_constraint(ProcessorConstraint(Processor::LOC_PROC));
+    registrar.set_leaf();
+    Runtime::preregister_task_variant<Linear::backward_task_cpu>(
+        registrar, "Linear Backward Task");
+  }
+  {
+    TaskVariantRegistrar registrar(LINEAR_BWD2_TASK_ID,
+                                   "Linear Backward (Aggregate replica)");
+    registrar.add_constraint(ProcessorConstraint(Processor::LOC_PROC));
+    registrar.set_leaf();
+    Runtime::preregister_task_variant<Linear::backward2_task_cpu>(
+        registrar, "Linear Backward Task (Aggregate replica)");
+  }
   // Flat task
   {
     TaskVariantRegistrar registrar(FLAT_INIT_TASK_ID, "flat_init_task");
@@ -1735,6 +2503,27 @@ void register_internal_tasks()
     Runtime::preregister_task_variant<Flat::backward_task>(
         registrar, "flat_bwd_task");
   }
+  {
+    TaskVariantRegistrar registrar(FLAT_INIT_TASK_ID, "flat_init_task");
+    registrar.add_constraint(ProcessorConstraint(Processor::LOC_PROC));
+    registrar.set_leaf();
+    Runtime::preregister_task_variant<OpMeta*, Flat::init_task_cpu>(
+        registrar, "flat_init_task");
+  }
+  {
+    TaskVariantRegistrar registrar(FLAT_FWD_TASK_ID, "flat_fwd_task");
+    registrar.add_constraint(ProcessorConstraint(Processor::LOC_PROC));
+    registrar.set_leaf();
+    Runtime::preregister_task_variant<Flat::forward_task_cpu>(
+        registrar, "flat_fwd_task");
+  }
+  {
+    TaskVariantRegistrar registrar(FLAT_BWD_TASK_ID, "flat_bwd_task");
+    registrar.add_constraint(ProcessorConstraint(Processor::LOC_PROC));
+    registrar.set_leaf();
+    Runtime::preregister_task_variant<Flat::backward_task_cpu>(
+        registrar, "flat_bwd_task");
+  }
   // Softmax task
   {
     TaskVariantRegistrar registrar(SOFTMAX_INIT_TASK_ID, "softmax_init_task");
@@ -1757,6 +2546,27 @@ void register_internal_tasks()
     Runtime::preregister_task_variant<Softmax::backward_task>(
         registrar, "softmax_bwd_task");
   }
+  {
+    TaskVariantRegistrar registrar(SOFTMAX_INIT_TASK_ID, "softmax_init_task");
+    registrar.add_constraint(ProcessorConstraint(Processor::LOC_PROC));
+    registrar.set_leaf();
+    Runtime::preregister_task_variant<OpMeta*, Softmax::init_task_cpu>(
+        registrar, "softmax_init_task");
+  }
+  {
+    TaskVariantRegistrar registrar(SOFTMAX_FWD_TASK_ID, "softmax_fwd_task");
+    registrar.add_constraint(ProcessorConstraint(Processor::LOC_PROC));
+    registrar.set_leaf();
+    Runtime::preregister_task_variant<Softmax::forward_task_cpu>(
+        registrar, "softmax_fwd_task");
+  }
+  {
+    TaskVariantRegistrar registrar(SOFTMAX_BWD_TASK_ID, "softmax_bwd_task");
+    registrar.add_constraint(ProcessorConstraint(Processor::LOC_PROC));
+    registrar.set_leaf();
+    Runtime::preregister_task_variant<Softmax::backward_task_cpu>(
+        registrar, "softmax_bwd_task");
+  }
   // compute Loss
   {
     TaskVariantRegistrar registrar(LOSS_BWD_TASK_ID, "Loss Backward");
@@ -1765,6 +2575,13 @@ void register_internal_tasks()
     Runtime::preregister_task_variant<Loss::backward_task>(
         registrar, "Loss Backward Task");
   }
+  {
+    TaskVariantRegistrar registrar(LOSS_BWD_TASK_ID, "Loss Backward");
+    registrar.add_constraint(ProcessorConstraint(Processor::LOC_PROC));
+    registrar.set_leaf();
+    Runtime::preregister_task_variant<Loss::backward_task_cpu>(
+        registrar, "Loss Backward Task");
+  }
   // compute Metrics
   {
     TaskVariantRegistrar registrar(METRICS_COMP_TASK_ID, "MSELoss Backward");
@@ -1773,6 +2590,13 @@ void register_internal_tasks()
     Runtime::preregister_task_variant<PerfMetrics, Metrics::compute_task>(
         registrar, "MSELoss Backward Task");
   }
+  {
+    TaskVariantRegistrar registrar(METRICS_COMP_TASK_ID, "Metrics Compute");
+    registrar.add_constraint(ProcessorConstraint(Processor::LOC_PROC));
+    registrar.set_leaf();
+    Runtime::preregister_task_variant<PerfMetrics, Metrics::compute_task_cpu>(
+        registrar, "Metrics Compute Task");
+  }
   // MSELoss
   //{
   //  TaskVariantRegistrar registrar(MSELOSS_BWD_TASK_ID, "MSELoss Backward");
@@ -1811,6 +2635,27 @@ void register_internal_tasks()
     Runtime::preregister_task_variant<Concat::backward_task>(
         registrar, "Concat Backward Task");
   }
+  {
+    TaskVariantRegistrar registrar(CONCAT_INIT_TASK_ID, "Concat Init");
+    registrar.add_constraint(ProcessorConstraint(Processor::LOC_PROC));
+    registrar.set_leaf();
+    Runtime::preregister_task_variant<OpMeta*, Concat::init_task_cpu>(
+        registrar, "Concat Init Task");
+  }
+  {
+    TaskVariantRegistrar registrar(CONCAT_FWD_TASK_ID, "Concat Forward");
+    registrar.add_constraint(ProcessorConstraint(Processor::LOC_PROC));
+    registrar.set_leaf();
+    Runtime::preregister_task_variant<Concat::forward_task_cpu>(
+        registrar, "Concat Forward Task");
+  }
+  {
+    TaskVariantRegistrar registrar(CONCAT_BWD_TASK_ID, "Concat Backward");
+    registrar.add_constraint(ProcessorConstraint(Processor::LOC_PROC));
+    registrar.set_leaf();
+    Runtime::preregister_task_variant<Concat::backward_task_cpu>(
+        registrar, "Concat Backward Task");
+  }
   // Split task
   {
     TaskVariantRegistrar registrar(SPLIT_INIT_TASK_ID, "Split Init");
@@ -1833,6 +2678,27 @@ void register_internal_tasks()
     Runtime::preregister_task_variant<Split::backward_task>(
         registrar, "Split Backward Task");
   }
+  {
+    TaskVariantRegistrar registrar(SPLIT_INIT_TASK_ID, "Split Init");
+    registrar.add_constraint(ProcessorConstraint(Processor::LOC_PROC));
+    registrar.set_leaf();
+    Runtime::preregister_task_variant<OpMeta*, Split::init_task_cpu>(
+        registrar, "Split Init Task");
+  }
+  {
+    TaskVariantRegistrar registrar(SPLIT_FWD_TASK_ID, "Split Forward");
+    registrar.add_constraint(ProcessorConstraint(Processor::LOC_PROC));
+    registrar.set_leaf();
+    Runtime::preregister_task_variant<Split::forward_task_cpu>(
+        registrar, "Split Forward Task");
+  }
+  {
+    TaskVariantRegistrar registrar(SPLIT_BWD_TASK_ID, "Split Backward");
+    registrar.add_constraint(ProcessorConstraint(Processor::LOC_PROC));
+    registrar.set_leaf();
+    Runtime::preregister_task_variant<Split::backward_task_cpu>(
+        registrar, "Split Backward Task");
+  }
   // Reshape task
   {
     TaskVariantRegistrar registrar(RESHAPE_INIT_TASK_ID, "Reshape Init");
@@ -1855,6 +2721,27 @@ void register_internal_tasks()
     Runtime::preregister_task_variant<Reshape::backward_task>(
         registrar, "Reshape Backward Task");
   }
+  {
+    TaskVariantRegistrar registrar(RESHAPE_INIT_TASK_ID, "Reshape Init");
+    registrar.add_constraint(ProcessorConstraint(Processor::LOC_PROC));
+    registrar.set_leaf();
+    Runtime::preregister_task_variant<OpMeta*, Reshape::init_task_cpu>(
+        registrar, "Reshape Init Task");
+  }
+  {
+    TaskVariantRegistrar registrar(RESHAPE_FWD_TASK_ID, "Reshape Forward");
+    registrar.add_constraint(ProcessorConstraint(Processor::LOC_PROC));
+    registrar.set_leaf();
+    Runtime::preregister_task_variant<Reshape::forward_task_cpu>(
+        registrar, "Reshape Forward Task");
+  }
+  {
+    TaskVariantRegistrar registrar(RESHAPE_BWD_TASK_ID, "Reshape Backward");
+    registrar.add_constraint(ProcessorConstraint(Processor::LOC_PROC));
+    registrar.set_leaf();
+    Runtime::preregister_task_variant<Reshape::backward_task_cpu>(
+        registrar, "Reshape Backward Task");
+  }
   // Reverse task
   {
     TaskVariantRegistrar registrar(REVERSE_INIT_TASK_ID, "Reverse Init");
@@ -1877,6 +2764,27 @@ void register_internal_tasks()
     Runtime::preregister_task_variant<Reverse::backward_task>(
         registrar, "Reverse Backward Task");
   }
+  {
+    TaskVariantRegistrar registrar(REVERSE_INIT_TASK_ID, "Reverse Init");
+    registrar.add_constraint(ProcessorConstraint(Processor::LOC_PROC));
+    registrar.set_leaf();
+    Runtime::preregister_task_variant<OpMeta*, Reverse::init_task_cpu>(
+        registrar, "Reverse Init Task");
+  }
+  {
+    TaskVariantRegistrar registrar(REVERSE_FWD_TASK_ID, "Reverse Forward");
+    registrar.add_constraint(ProcessorConstraint(Processor::LOC_PROC));
+    registrar.set_leaf();
+    Runtime::preregister_task_variant<Reverse::forward_task_cpu>(
+        registrar, "Reverse Forward Task");
+  }
+  {
+    TaskVariantRegistrar registrar(REVERSE_BWD_TASK_ID, "Reverse Backward");
+    registrar.add_constraint(ProcessorConstraint(Processor::LOC_PROC));
+    registrar.set_leaf();
+    Runtime::preregister_task_variant<Reverse::backward_task_cpu>(
+        registrar, "Reverse Backward Task");
+  }
   // Transpose task
   {
     TaskVariantRegistrar registrar(TRANSPOSE_INIT_TASK_ID, "Transpose Init");
@@ -1899,6 +2807,27 @@ void register_internal_tasks()
     Runtime::preregister_task_variant<Transpose::backward_task>(
         registrar, "Transpose Backward Task");
   }
+  {
+    TaskVariantRegistrar registrar(TRANSPOSE_INIT_TASK_ID, "Transpose Init");
+    registrar.add_constraint(ProcessorConstraint(Processor::LOC_PROC));
+    registrar.set_leaf();
+    Runtime::preregister_task_variant<OpMeta*, Transpose::init_task_cpu>(
+        registrar, "Transpose Init Task");
+  }
+  {
+    TaskVariantRegistrar registrar(TRANSPOSE_FWD_TASK_ID, "Transpose Forward");
+    registrar.add_constraint(ProcessorConstraint(Processor::LOC_PROC));
+    registrar.set_leaf();
+    Runtime::preregister_task_variant<Transpose::forward_task_cpu>(
+        registrar, "Transpose Forward Task");
+  }
+  {
+    TaskVariantRegistrar registrar(TRANSPOSE_BWD_TASK_ID, "Transpose Backward");
+    registrar.add_constraint(ProcessorConstraint(Processor::LOC_PROC));
+    registrar.set_leaf();
+    Runtime::preregister_task_variant<Transpose::backward_task_cpu>(
+        registrar, "Transpose Backward Task");
+  }
   // MultiHeadAttention task
   {
     TaskVariantRegistrar registrar(ATTENTION_INIT_TASK_ID, "MultiHeadAttention Init");
@@ -1921,6 +2850,27 @@ void register_internal_tasks()
     Runtime::preregister_task_variant<MultiHeadAttention::backward_task>(
         registrar, "MultiHeadAttention Backward Task");
   }
+  {
+    TaskVariantRegistrar registrar(ATTENTION_INIT_TASK_ID, "MultiHeadAttention Init");
+    registrar.add_constraint(ProcessorConstraint(Processor::LOC_PROC));
+    registrar.set_leaf();
+    Runtime::preregister_task_variant<OpMeta*, MultiHeadAttention::init_task_cpu>(
+        registrar, "MultiHeadAttention Init Task");
+  }
+  {
+    TaskVariantRegistrar registrar(ATTENTION_FWD_TASK_ID, "MultiHeadAttention Forward");
+    registrar.add_constraint(ProcessorConstraint(Processor::LOC_PROC));
+    registrar.set_leaf();
+    Runtime::preregister_task_variant<MultiHeadAttention::forward_task_cpu>(
+        registrar, "MultiHeadAttention Forward Task");
+  }
+  {
+    TaskVariantRegistrar registrar(ATTENTION_BWD_TASK_ID, "MultiHeadAttention Backward");
+    registrar.add_constraint(ProcessorConstraint(Processor::LOC_PROC));
+    registrar.set_leaf();
+    Runtime::preregister_task_variant<MultiHeadAttention::backward_task_cpu>(
+        registrar, "MultiHeadAttention Backward Task");
+  }
   // Optimizer
   {
     TaskVariantRegistrar registrar(SGD_UPD_TASK_ID,
@@ -1930,6 +2880,14 @@ void register_internal_tasks()
     Runtime::preregister_task_variant<SGDOptimizer::update_task>(
         registrar, "SGD Update Task");
   }
+  {
+    TaskVariantRegistrar registrar(SGD_UPD_TASK_ID,
+                                   "SGD Update");
+    registrar.add_constraint(ProcessorConstraint(Processor::LOC_PROC));
+    registrar.set_leaf();
+    Runtime::preregister_task_variant<SGDOptimizer::update_task_cpu>(
+        registrar, "SGD Update Task");
+  }
   {
     TaskVariantRegistrar registrar(ADAM_UPD_TASK_ID,
                                    "Adam Update");
@@ -1938,6 +2896,142 @@ void register_internal_tasks()
     Runtime::preregister_task_variant<AdamOptimizer::update_task>(
         registrar, "Adam Update Task");
   }
+  {
+    TaskVariantRegistrar registrar(ADAM_UPD_TASK_ID,
+                                   "Adam Update");
+    registrar.add_constraint(ProcessorConstraint(Processor::LOC_PROC));
+    registrar.set_leaf();
+    Runtime::preregister_task_variant<AdamOptimizer::update_task_cpu>(
+        registrar, "Adam Update Task");
+  }
+  {
+    TaskVariantRegistrar registrar(SGD_SPARSE_UPD_TASK_ID,
+                                   "SGD Sparse Update");
+    registrar.add_constraint(ProcessorConstraint(Processor::TOC_PROC));
+    registrar.set_leaf();
+    Runtime::preregister_task_variant<SGDOptimizer::sparse_update_task>(
+        registrar, "SGD Sparse Update Task");
+  }
+  {
+    TaskVariantRegistrar registrar(SGD_SPARSE_UPD_TASK_ID,
+                                   "SGD Sparse Update");
+    registrar.add_constraint(ProcessorConstraint(Processor::LOC_PROC));
+    registrar.set_leaf();
+    Runtime::preregister_task_variant<SGDOptimizer::sparse_update_task_cpu>(
+        registrar, "SGD Sparse Update Task");
+  }
+  {
+    TaskVariantRegistrar registrar(ADAM_SPARSE_UPD_TASK_ID,
+                                   "Adam Sparse Update");
+    registrar.add_constraint(ProcessorConstraint(Processor::TOC_PROC));
+    registrar.set_leaf();
+    Runtime::preregister_task_variant<AdamOptimizer::sparse_update_task>(
+        registrar, "Adam Sparse Update Task");
+  }
+  {
+    TaskVariantRegistrar registrar(ADAM_SPARSE_UPD_TASK_ID,
+                                   "Adam Sparse Update");
+    registrar.add_constraint(ProcessorConstraint(Processor::LOC_PROC));
+    registrar.set_leaf();
+    Runtime::preregister_task_variant<AdamOptimizer::sparse_update_task_cpu>(
+        registrar, "Adam Sparse Update Task");
+  }
+  {
+    TaskVariantRegistrar registrar(SGD_MULTI_UPD_TASK_ID,
+                                   "SGD Multi-Tensor Update");
+    registrar.add_constraint(ProcessorConstraint(Processor::TOC_PROC));
+    registrar.set_leaf();
+    Runtime::preregister_task_variant<SGDOptimizer::multi_update_task>(
+        registrar, "SGD Multi-Tensor Update Task");
+  }
+  {
+    TaskVariantRegistrar registrar(SGD_MULTI_UPD_TASK_ID,
+                                   "SGD Multi-Tensor Update");
+    registrar.add_constraint(ProcessorConstraint(Processor::LOC_PROC));
+    registrar.set_leaf();
+    Runtime::preregister_task_variant<SGDOptimizer::multi_update_task_cpu>(
+        registrar, "SGD Multi-Tensor Update Task");
+  }
+  {
+    TaskVariantRegistrar registrar(ADAM_MULTI_UPD_TASK_ID,
+                                   "Adam Multi-Tensor Update");
+    registrar.add_constraint(ProcessorConstraint(Processor::TOC_PROC));
+    registrar.set_leaf();
+    Runtime::preregister_task_variant<AdamOptimizer::multi_update_task>(
+        registrar, "Adam Multi-Tensor Update Task");
+  }
+  {
+    TaskVariantRegistrar registrar(ADAM_MULTI_UPD_TASK_ID,
+                                   "Adam Multi-Tensor Update");
+    registrar.add_constraint(ProcessorConstraint(Processor::LOC_PROC));
+    registrar.set_leaf();
+    Runtime::preregister_task_variant<AdamOptimizer::multi_update_task_cpu>(
+        registrar, "Adam Multi-Tensor Update Task");
+  }
+  {
+    TaskVariantRegistrar registrar(GRAD_NORM_TASK_ID,
+                                   "Gradient Norm");
+    registrar.add_constraint(ProcessorConstraint(Processor::TOC_PROC));
+    registrar.set_leaf();
+    Runtime::preregister_task_variant<float, Optimizer::grad_norm_task>(
+        registrar, "Gradient Norm Task");
+  }
+  {
+    TaskVariantRegistrar registrar(GRAD_NORM_TASK_ID,
+                                   "Gradient Norm");
+    registrar.add_constraint(ProcessorConstraint(Processor::LOC_PROC));
+    registrar.set_leaf();
+    Runtime::preregister_task_variant<float, Optimizer::grad_norm_task_cpu>(
+        registrar, "Gradient Norm Task");
+  }
+  {
+    TaskVariantRegistrar registrar(GRAD_BUCKET_PACK_TASK_ID,
+                                   "Gradient Bucket Pack");
+    registrar.add_constraint(ProcessorConstraint(Processor::TOC_PROC));
+    registrar.set_leaf();
+    Runtime::preregister_task_variant<Optimizer::pack_grad_bucket_task>(
+        registrar, "Gradient Bucket Pack Task");
+  }
+  {
+    TaskVariantRegistrar registrar(GRAD_BUCKET_PACK_TASK_ID,
+                                   "Gradient Bucket Pack");
+    registrar.add_constraint(ProcessorConstraint(Processor::LOC_PROC));
+    registrar.set_leaf();
+    Runtime::preregister_task_variant<Optimizer::pack_grad_bucket_task_cpu>(
+        registrar, "Gradient Bucket Pack Task");
+  }
+  {
+    TaskVariantRegistrar registrar(SGD_BUCKET_UPD_TASK_ID,
+                                   "SGD Bucket Update");
+    registrar.add_constraint(ProcessorConstraint(Processor::TOC_PROC));
+    registrar.set_leaf();
+    Runtime::preregister_task_variant<SGDOptimizer::bucket_update_task>(
+        registrar, "SGD Bucket Update Task");
+  }
+  {
+    TaskVariantRegistrar registrar(SGD_BUCKET_UPD_TASK_ID,
+                                   "SGD Bucket Update");
+    registrar.add_constraint(ProcessorConstraint(Processor::LOC_PROC));
+    registrar.set_leaf();
+    Runtime::preregister_task_variant<SGDOptimizer::bucket_update_task_cpu>(
+        registrar, "SGD Bucket Update Task");
+  }
+  {
+    TaskVariantRegistrar registrar(ADAM_BUCKET_UPD_TASK_ID,
+                                   "Adam Bucket Update");
+    registrar.add_constraint(ProcessorConstraint(Processor::TOC_PROC));
+    registrar.set_leaf();
+    Runtime::preregister_task_variant<AdamOptimizer::bucket_update_task>(
+        registrar, "Adam Bucket Update Task");
+  }
+  {
+    TaskVariantRegistrar registrar(ADAM_BUCKET_UPD_TASK_ID,
+                                   "Adam Bucket Update");
+    registrar.add_constraint(ProcessorConstraint(Processor::LOC_PROC));
+    registrar.set_leaf();
+    Runtime::preregister_task_variant<AdamOptimizer::bucket_update_task_cpu>(
+        registrar, "Adam Bucket Update Task");
+  }
   // Initializer
   {
     TaskVariantRegistrar registrar(ZERO_INIT_TASK_ID,
@@ -1979,6 +3073,14 @@ void register_internal_tasks()
     Runtime::preregister_task_variant<UniformInitializer::init_task>(
         registrar, "Uniform Init Task");
   }
+  {
+    TaskVariantRegistrar registrar(UNIFORM_INIT_TASK_ID,
+                                   "Uniform Init");
+    registrar.add_constraint(ProcessorConstraint(Processor::LOC_PROC));
+    registrar.set_leaf();
+    Runtime::preregister_task_variant<UniformInitializer::init_task_cpu>(
+        registrar, "Uniform Init Task");
+  }
   {
     TaskVariantRegistrar registrar(GLOROT_INIT_TASK_ID,
                                    "Glorot Init");
@@ -1987,6 +3089,14 @@ void register_internal_tasks()
     Runtime::preregister_task_variant<GlorotUniform::init_task>(
         registrar, "Glorot Init Task");
   }
+  {
+    TaskVariantRegistrar registrar(GLOROT_INIT_TASK_ID,
+                                   "Glorot Init");
+    registrar.add_constraint(ProcessorConstraint(Processor::LOC_PROC));
+    registrar.set_leaf();
+    Runtime::preregister_task_variant<GlorotUniform::init_task_cpu>(
+        registrar, "Glorot Init Task");
+  }
   {
     TaskVariantRegistrar registrar(NORMAL_INIT_TASK_ID,
                                    "Normalize Init");
@@ -1995,6 +3105,14 @@ void register_internal_tasks()
     Runtime::preregister_task_variant<NormInitializer::init_task>(
         registrar, "Normalize Init Task");
   }
+  {
+    TaskVariantRegistrar registrar(NORMAL_INIT_TASK_ID,
+                                   "Normalize Init");
+    registrar.add_constraint(ProcessorConstraint(Processor::LOC_PROC));
+    registrar.set_leaf();
+    Runtime::preregister_task_variant<NormInitializer::init_task_cpu>(
+        registrar, "Normalize Init Task");
+  }
   // Search
   {
     TaskVariantRegistrar registrar(STRATEGY_SEARCH_TASK_ID,
@@ -2004,6 +3122,14 @@ void register_internal_tasks()
     Runtime::preregister_task_variant<Simulator::strategy_search_task>(
         registrar, "Stretegy Search Task");
   }
+  // Data loader
+  {
+    TaskVariantRegistrar registrar(COPY_BATCH_TASK_ID, "Copy Batch");
+    registrar.add_constraint(ProcessorConstraint(Processor::TOC_PROC));
+    registrar.set_leaf();
+    Runtime::preregister_task_variant<BatchPrefetcher::copy_batch_task>(
+        registrar, "Copy Batch Task");
+  }
   // DUMMY task
   {
     TaskVariantRegistrar registrar(DUMMY_TASK_ID, "dummy_task");
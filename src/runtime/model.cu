@@ -274,6 +274,8 @@ bool Parameter::set_weights(const FFModel& ff,
   }
   Context ctx = ff.config.lg_ctx;
   Runtime* runtime = ff.config.lg_hlr;
+  // The whole weight is overwritten, so a deferred init is not needed
+  ff.drop_pending_weight_init(region);
   RegionRequirement req(region, READ_WRITE, EXCLUSIVE, region);
   req.add_field(FID_DATA);
   InlineLauncher launcher(req);
@@ -309,6 +311,7 @@ bool Parameter::get_weights(const FFModel& ff,
   }
   Context ctx = ff.config.lg_ctx;
   Runtime* runtime = ff.config.lg_hlr;
+  ff.init_pending_weights();
   RegionRequirement req(region, READ_ONLY, EXCLUSIVE, region);
   req.add_field(FID_DATA);
   InlineLauncher launcher(req);
@@ -335,3 +338,54 @@ bool Parameter::get_weights(const FFModel& ff,
 
 template bool Parameter::set_weights<float>(const FFModel& ff, const std::vector<int>& dims, const float* data);
 template bool Parameter::get_weights<float>(const FFModel& ff, float* data);
+
+template<typename DT>
+static void copy_batch(const Task* task,
+                       const std::vector<PhysicalRegion>& regions,
+                       Context ctx, Runtime* runtime)
+{
+  Domain domain = runtime->get_index_space_domain(
+      ctx, task->regions[1].region.get_index_space());
+  const DT* src = helperGetTensorPointerRO<DT>(
+      regions[0], task->regions[0], FID_DATA, ctx, runtime);
+  DT* dst = helperGetTensorPointerWO<DT>(
+      regions[1], task->regions[1], FID_DATA, ctx, runtime);
+#ifndef DISABLE_LEGION_CUDA_HIJACK
+  cudaStream_t stream;
+  checkCUDA(cudaStreamCreate(&stream));
+#else
+  cudaStream_t stream = 0;
+#endif
+  // The copy is ordered with the consumers of the batch through the
+  // task's stream, so the GPU is not drained between batches
+  copy_kernel<<<GET_BLOCKS(domain.get_volume()), CUDA_NUM_THREADS, 0, stream>>>(
+      dst, src, domain.get_volume());
+}
+
+/*
+  regions[0](I): staged batch
+  regions[1](O): batch
+*/
+__host__
+void BatchPrefetcher::copy_batch_task(const Task* task,
+                                      const std::vector<PhysicalRegion>& regions,
+                                      Context ctx, Runtime* runtime)
+{
+  assert(regions.size() == 2);
+  assert(task->regions.size() == 2);
+  assert(task->arglen == sizeof(DataType));
+  DataType data_type = *((const DataType*) task->args);
+  switch (data_type) {
+    case DT_FLOAT:
+      copy_batch<float>(task, regions, ctx, runtime);
+      break;
+    case DT_INT32:
+      copy_batch<int32_t>(task, regions, ctx, runtime);
+      break;
+    case DT_INT64:
+      copy_batch<int64_t>(task, regions, ctx, runtime);
+      break;
+    default:
+      assert(false);
+  }
+}
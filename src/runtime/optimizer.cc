@@ -15,9 +15,105 @@
 
 #include "optimizer.h"
 #include "model.h"
+#include "cpu_helper.h"
+#include <algorithm>
 
 Optimizer::Optimizer(const FFModel* _model)
-: model(_model) {}
+: model(_model), clip_grad_norm(_model->config.clip_grad_norm) {}
+
+Future Optimizer::compute_grad_norm(const std::vector<const Parameter*>& params)
+{
+  Context ctx = model->config.lg_ctx;
+  Runtime* runtime = model->config.lg_hlr;
+  // The weight volumes tell the task how many replicas each gradient has
+  std::vector<coord_t> sizes;
+  for (size_t i = 0; i < params.size(); i++)
+    sizes.push_back(runtime->get_index_space_domain(
+        ctx, params[i]->region.get_index_space()).get_volume());
+  TaskLauncher launcher(GRAD_NORM_TASK_ID,
+                        TaskArgument(sizes.data(), sizes.size() * sizeof(coord_t)),
+                        Predicate::TRUE_PRED, 0/*mapper_id*/,
+                        model->config.get_strategy_id(std::string(params[0]->pcname)));
+  // regions[i]: region_grad of the i-th parameter
+  for (size_t i = 0; i < params.size(); i++) {
+    assert(!params[i]->sparse_grad);
+    launcher.add_region_requirement(
+        RegionRequirement(params[i]->region_grad,
+                          READ_ONLY, EXCLUSIVE, params[i]->region_grad));
+    launcher.add_field(i, FID_DATA);
+  }
+  return runtime->execute_task(ctx, launcher);
+}
+
+float get_grad_clip_scale(const Task* task, float clip_norm)
+{
+  if (clip_norm <= 0.0f || task->futures.size() == 0)
+    return 1.0f;
+  double sum = 0.0;
+  for (size_t i = 0; i < task->futures.size(); i++)
+    sum += task->futures[i].get_result<float>();
+  // Same as torch.nn.utils.clip_grad_norm_
+  float norm = sqrt(sum);
+  return std::min(1.0f, clip_norm / (norm + 1e-6f));
+}
+
+void get_grad_bucket_args(const void* op, size_t op_size,
+                          const GradBucket& bucket, std::vector<char>& args)
+{
+  std::vector<coord_t> layout;
+  layout.push_back(bucket.params.size());
+  layout.push_back(bucket.num_colors);
+  layout.push_back(bucket.row_volume);
+  layout.insert(layout.end(), bucket.row_offsets.begin(), bucket.row_offsets.end());
+  layout.insert(layout.end(), bucket.slice_volumes.begin(), bucket.slice_volumes.end());
+  layout.insert(layout.end(), bucket.grad_offsets.begin(), bucket.grad_offsets.end());
+  // op_size is a multiple of sizeof(coord_t) for both optimizers
+  assert(op_size % sizeof(coord_t) == 0);
+  args.resize(op_size + layout.size() * sizeof(coord_t));
+  memcpy(args.data(), op, op_size);
+  memcpy(args.data() + op_size, layout.data(), layout.size() * sizeof(coord_t));
+}
+
+GradBucketLayout get_grad_bucket_layout(const Task* task, size_t op_size)
+{
+  const coord_t* ptr = (const coord_t*)((const char*)task->args + op_size);
+  GradBucketLayout layout;
+  layout.num_params = ptr[0];
+  layout.num_colors = ptr[1];
+  layout.row_volume = ptr[2];
+  layout.row_offsets = ptr + 3;
+  layout.slice_volumes = layout.row_offsets + layout.num_params;
+  layout.grad_offsets = layout.slice_volumes + layout.num_params;
+  assert(task->arglen == op_size + sizeof(coord_t)
+         * (3 + 2 * layout.num_params + layout.num_params * layout.num_colors));
+  return layout;
+}
+
+void Optimizer::pack_grad_bucket(const GradBucket& bucket)
+{
+  Context ctx = model->config.lg_ctx;
+  Runtime* runtime = model->config.lg_hlr;
+  // Each point packs the gradient slices it produced on its own device
+  ArgumentMap argmap;
+  IndexLauncher launcher(GRAD_BUCKET_PACK_TASK_ID, bucket.task_is,
+                         TaskArgument(NULL, 0), argmap,
+                         Predicate::TRUE_PRED, false/*must*/, 0/*mapper_id*/,
+                         model->config.get_strategy_id(std::string(bucket.params[0]->pcname)));
+  // regions[0]: a row of the bucket
+  launcher.add_region_requirement(
+      RegionRequirement(bucket.part, 0/*projection*/,
+                        WRITE_DISCARD, EXCLUSIVE, bucket.region));
+  launcher.add_field(0, FID_DATA);
+  // regions[1+k]: the gradient slice of the k-th parameter
+  for (size_t k = 0; k < bucket.params.size(); k++) {
+    const Parameter* p = bucket.params[k];
+    launcher.add_region_requirement(
+        RegionRequirement(p->part_grad, 0/*projection*/,
+                          READ_ONLY, EXCLUSIVE, p->region_grad));
+    launcher.add_field(k + 1, FID_DATA);
+  }
+  runtime->execute_index_space(ctx, launcher);
+}
 
 SGDOptimizer::SGDOptimizer(const FFModel* _model,
                            double _lr, double _momentum,
@@ -51,9 +147,13 @@ void SGDOptimizer::init(void)
         if (momentum > 0.0f) {
           v_regions[p.region] = runtime->create_logical_region(
               ctx, p.region.get_index_space(), p.region.get_field_space());
+          // Zeros v_regions shard by shard, like the parameter
           Tensor t;
           t.region = v_regions[p.region];
-          initializer->init(ctx, runtime, &t);
+          t.part = runtime->get_logical_partition(
+              ctx, t.region, p.part.get_index_partition());
+          initializer->init(ctx, runtime, &t, model->config.get_strategy_id(
+              model->parameters[i].pcname));
         }
         break;
       }
@@ -76,10 +176,43 @@ void SGDOptimizer::update(const Parameter* p)
 {
   Context ctx = model->config.lg_ctx;
   Runtime* runtime = model->config.lg_hlr;
+  if (p->sparse_grad) {
+    // Only update the rows touched by the batch
+    TaskLauncher launcher(SGD_SPARSE_UPD_TASK_ID,
+                          TaskArgument(this, sizeof(SGDOptimizer)),
+                          Predicate::TRUE_PRED, 0/*mapper_id*/,
+                          model->config.get_strategy_id(std::string(p->pcname)));
+    // regions[0]: sparse_grad_rows
+    launcher.add_region_requirement(
+        RegionRequirement(p->sparse_grad_rows.region,
+                          READ_ONLY, EXCLUSIVE, p->sparse_grad_rows.region,
+                          MAP_TO_ZC_MEMORY));
+    launcher.add_field(0, FID_DATA);
+    // regions[1]: sparse_grad_values
+    launcher.add_region_requirement(
+        RegionRequirement(p->sparse_grad_values.region,
+                          READ_ONLY, EXCLUSIVE, p->sparse_grad_values.region));
+    launcher.add_field(1, FID_DATA);
+    // regions[2]: region
+    launcher.add_region_requirement(
+        RegionRequirement(p->region,
+                          READ_WRITE, EXCLUSIVE, p->region));
+    launcher.add_field(2, FID_DATA);
+    if (momentum > 0.0f) {
+      // regions[3]: v_region
+      assert(v_regions.find(p->region) != v_regions.end());
+      launcher.add_region_requirement(
+          RegionRequirement(v_regions[p->region],
+                            READ_WRITE, EXCLUSIVE, v_regions[p->region]));
+      launcher.add_field(3, FID_DATA);
+    }
+    runtime->execute_task(ctx, launcher);
+    return;
+  }
   TaskLauncher launcher(SGD_UPD_TASK_ID,
                         TaskArgument(this, sizeof(SGDOptimizer)),
                         Predicate::TRUE_PRED, 0/*mapper_id*/,
-                        FFConfig::get_hash_id(std::string(p->pcname)));
+                        model->config.get_strategy_id(std::string(p->pcname)));
   // regions[0]: region_grad
   launcher.add_region_requirement(
       RegionRequirement(p->region_grad,
@@ -98,6 +231,79 @@ void SGDOptimizer::update(const Parameter* p)
                           READ_WRITE, EXCLUSIVE, v_regions[p->region]));
     launcher.add_field(2, FID_DATA);
   }
+  for (size_t i = 0; i < grad_norms.size(); i++)
+    launcher.add_future(grad_norms[i]);
+  runtime->execute_task(ctx, launcher);
+}
+
+void SGDOptimizer::update_multi(const std::vector<const Parameter*>& params)
+{
+  Context ctx = model->config.lg_ctx;
+  Runtime* runtime = model->config.lg_hlr;
+  TaskLauncher launcher(SGD_MULTI_UPD_TASK_ID,
+                        TaskArgument(this, sizeof(SGDOptimizer)),
+                        Predicate::TRUE_PRED, 0/*mapper_id*/,
+                        model->config.get_strategy_id(std::string(params[0]->pcname)));
+  // Each parameter adds region_grad, region and v_region (with momentum)
+  // in the same order as SGDOptimizer::update
+  unsigned idx = 0;
+  for (size_t i = 0; i < params.size(); i++) {
+    const Parameter* p = params[i];
+    assert(!p->sparse_grad);
+    launcher.add_region_requirement(
+        RegionRequirement(p->region_grad,
+                          READ_ONLY, EXCLUSIVE, p->region_grad));
+    launcher.add_field(idx++, FID_DATA);
+    launcher.add_region_requirement(
+        RegionRequirement(p->region,
+                          READ_WRITE, EXCLUSIVE, p->region));
+    launcher.add_field(idx++, FID_DATA);
+    if (momentum > 0.0f) {
+      assert(v_regions.find(p->region) != v_regions.end());
+      launcher.add_region_requirement(
+          RegionRequirement(v_regions[p->region],
+                            READ_WRITE, EXCLUSIVE, v_regions[p->region]));
+      launcher.add_field(idx++, FID_DATA);
+    }
+  }
+  for (size_t i = 0; i < grad_norms.size(); i++)
+    launcher.add_future(grad_norms[i]);
+  runtime->execute_task(ctx, launcher);
+}
+
+void SGDOptimizer::update_bucket(const GradBucket& bucket)
+{
+  Context ctx = model->config.lg_ctx;
+  Runtime* runtime = model->config.lg_hlr;
+  pack_grad_bucket(bucket);
+  std::vector<char> args;
+  get_grad_bucket_args(this, sizeof(SGDOptimizer), bucket, args);
+  TaskLauncher launcher(SGD_BUCKET_UPD_TASK_ID,
+                        TaskArgument(args.data(), args.size()),
+                        Predicate::TRUE_PRED, 0/*mapper_id*/,
+                        model->config.get_strategy_id(std::string(bucket.params[0]->pcname)));
+  // regions[0]: the packed gradients
+  launcher.add_region_requirement(
+      RegionRequirement(bucket.region, READ_ONLY, EXCLUSIVE, bucket.region));
+  launcher.add_field(0, FID_DATA);
+  // Each parameter adds region and v_region (with momentum)
+  unsigned idx = 1;
+  for (size_t i = 0; i < bucket.params.size(); i++) {
+    const Parameter* p = bucket.params[i];
+    launcher.add_region_requirement(
+        RegionRequirement(p->region,
+                          READ_WRITE, EXCLUSIVE, p->region));
+    launcher.add_field(idx++, FID_DATA);
+    if (momentum > 0.0f) {
+      assert(v_regions.find(p->region) != v_regions.end());
+      launcher.add_region_requirement(
+          RegionRequirement(v_regions[p->region],
+                            READ_WRITE, EXCLUSIVE, v_regions[p->region]));
+      launcher.add_field(idx++, FID_DATA);
+    }
+  }
+  for (size_t i = 0; i < grad_norms.size(); i++)
+    launcher.add_future(grad_norms[i]);
   runtime->execute_task(ctx, launcher);
 }
 
@@ -111,16 +317,27 @@ AdamOptimizer::AdamOptimizer(const FFModel* _model,
                              double _epsilon)
 : Optimizer(_model), alpha(_alpha), beta1(_beta1), beta2(_beta2),
   weight_decay(_weight_decay),
-  epsilon(_epsilon), alpha_t(_alpha), beta1_t(1.0f), beta2_t(1.0f)
-{}
+  epsilon(_epsilon), alpha_t(_alpha), beta1_t(1.0f), beta2_t(1.0f),
+  moment_type(_model->config.adam_moment_type)
+{
+  assert(moment_type == DT_FLOAT || moment_type == DT_HALF
+         || moment_type == DT_BFLOAT16);
+}
 
 void AdamOptimizer::init(void)
 {
   Context ctx = model->config.lg_ctx;
   Runtime* runtime = model->config.lg_hlr;
   Initializer* initializer = new ZeroInitializer();
+  // Reduced-precision moments of dense parameters share one 16-bit field
+  FieldSpace moment_fs = FieldSpace::NO_SPACE;
+  if (moment_type != DT_FLOAT) {
+    moment_fs = runtime->create_field_space(ctx);
+    FieldAllocator allocator = runtime->create_field_allocator(ctx, moment_fs);
+    allocator.allocate_field(sizeof(uint16_t), FID_DATA);
+  }
   for (size_t i = 0; i < model->parameters.size(); i++) {
-    Tensor p = model->parameters[i];
+    const Parameter& p = model->parameters[i];
     Domain domain = runtime->get_index_space_domain(
         ctx, p.region.get_index_space());
     switch (domain.get_dim()) {
@@ -136,16 +353,33 @@ void AdamOptimizer::init(void)
       case 4:
       case 5:
       {
+        if (moment_type != DT_FLOAT && !p.sparse_grad) {
+          LogicalRegion v = runtime->create_logical_region(
+              ctx, p.region.get_index_space(), moment_fs);
+          LogicalRegion m = runtime->create_logical_region(
+              ctx, p.region.get_index_space(), moment_fs);
+          // +0.0 is all zero bits in both fp16 and bf16
+          runtime->fill_field<uint16_t>(ctx, v, v, FID_DATA, 0);
+          runtime->fill_field<uint16_t>(ctx, m, m, FID_DATA, 0);
+          v_regions[p.region] = v;
+          m_regions[p.region] = m;
+          break;
+        }
         v_regions[p.region] = runtime->create_logical_region(
             ctx, p.region.get_index_space(), p.region.get_field_space());
         m_regions[p.region] = runtime->create_logical_region(
             ctx, p.region.get_index_space(), p.region.get_field_space());
         Tensor t;
-        // Zeros v_regions and m_regions
+        // Zeros v_regions and m_regions shard by shard, like the parameter
+        MappingTagID tag = model->config.get_strategy_id(p.pcname);
         t.region = v_regions[p.region];
-        initializer->init(ctx, runtime, &t);
+        t.part = runtime->get_logical_partition(
+            ctx, t.region, p.part.get_index_partition());
+        initializer->init(ctx, runtime, &t, tag);
         t.region = m_regions[p.region];
-        initializer->init(ctx, runtime, &t);
+        t.part = runtime->get_logical_partition(
+            ctx, t.region, p.part.get_index_partition());
+        initializer->init(ctx, runtime, &t, tag);
         break;
       }
       default:
@@ -178,10 +412,45 @@ void AdamOptimizer::update(const Parameter* p)
   Runtime* runtime = model->config.lg_hlr;
   assert(v_regions.find(p->region) != v_regions.end());
   assert(m_regions.find(p->region) != m_regions.end());
+  if (p->sparse_grad) {
+    // Lazy Adam: only the rows touched by the batch update their moments
+    TaskLauncher launcher(ADAM_SPARSE_UPD_TASK_ID,
+                          TaskArgument(this, sizeof(AdamOptimizer)),
+                          Predicate::TRUE_PRED, 0/*mapper_id*/,
+                          model->config.get_strategy_id(std::string(p->pcname)));
+    // regions[0]: sparse_grad_rows
+    launcher.add_region_requirement(
+        RegionRequirement(p->sparse_grad_rows.region,
+                          READ_ONLY, EXCLUSIVE, p->sparse_grad_rows.region,
+                          MAP_TO_ZC_MEMORY));
+    launcher.add_field(0, FID_DATA);
+    // regions[1]: sparse_grad_values
+    launcher.add_region_requirement(
+        RegionRequirement(p->sparse_grad_values.region,
+                          READ_ONLY, EXCLUSIVE, p->sparse_grad_values.region));
+    launcher.add_field(1, FID_DATA);
+    // regions[2]: region
+    launcher.add_region_requirement(
+        RegionRequirement(p->region,
+                          READ_WRITE, EXCLUSIVE, p->region));
+    launcher.add_field(2, FID_DATA);
+    // regions[3]: w_region
+    launcher.add_region_requirement(
+        RegionRequirement(v_regions[p->region],
+                          READ_WRITE, EXCLUSIVE, v_regions[p->region]));
+    launcher.add_field(3, FID_DATA);
+    // regions[4]: m_region
+    launcher.add_region_requirement(
+        RegionRequirement(m_regions[p->region],
+                          READ_WRITE, EXCLUSIVE, m_regions[p->region]));
+    launcher.add_field(4, FID_DATA);
+    runtime->execute_task(ctx, launcher);
+    return;
+  }
   TaskLauncher launcher(ADAM_UPD_TASK_ID,
                         TaskArgument(this, sizeof(AdamOptimizer)),
                         Predicate::TRUE_PRED, 0/*mapper_id*/,
-                        FFConfig::get_hash_id(std::string(p->pcname)));
+                        model->config.get_strategy_id(std::string(p->pcname)));
   // regions[0]: region_grad
   launcher.add_region_requirement(
       RegionRequirement(p->region_grad,
@@ -202,5 +471,668 @@ void AdamOptimizer::update(const Parameter* p)
       RegionRequirement(m_regions[p->region],
                         READ_WRITE, EXCLUSIVE, m_regions[p->region]));
   launcher.add_field(3, FID_DATA);
+  for (size_t i = 0; i < grad_norms.size(); i++)
+    launcher.add_future(grad_norms[i]);
+  runtime->execute_task(ctx, launcher);
+}
+
+void AdamOptimizer::update_multi(const std::vector<const Parameter*>& params)
+{
+  Context ctx = model->config.lg_ctx;
+  Runtime* runtime = model->config.lg_hlr;
+  TaskLauncher launcher(ADAM_MULTI_UPD_TASK_ID,
+                        TaskArgument(this, sizeof(AdamOptimizer)),
+                        Predicate::TRUE_PRED, 0/*mapper_id*/,
+                        model->config.get_strategy_id(std::string(params[0]->pcname)));
+  // Each parameter adds region_grad, region, w_region and m_region in the
+  // same order as AdamOptimizer::update
+  unsigned idx = 0;
+  for (size_t i = 0; i < params.size(); i++) {
+    const Parameter* p = params[i];
+    assert(!p->sparse_grad);
+    assert(v_regions.find(p->region) != v_regions.end());
+    assert(m_regions.find(p->region) != m_regions.end());
+    launcher.add_region_requirement(
+        RegionRequirement(p->region_grad,
+                          READ_ONLY, EXCLUSIVE, p->region_grad));
+    launcher.add_field(idx++, FID_DATA);
+    launcher.add_region_requirement(
+        RegionRequirement(p->region,
+                          READ_WRITE, EXCLUSIVE, p->region));
+    launcher.add_field(idx++, FID_DATA);
+    launcher.add_region_requirement(
+        RegionRequirement(v_regions[p->region],
+                          READ_WRITE, EXCLUSIVE, v_regions[p->region]));
+    launcher.add_field(idx++, FID_DATA);
+    launcher.add_region_requirement(
+        RegionRequirement(m_regions[p->region],
+                          READ_WRITE, EXCLUSIVE, m_regions[p->region]));
+    launcher.add_field(idx++, FID_DATA);
+  }
+  for (size_t i = 0; i < grad_norms.size(); i++)
+    launcher.add_future(grad_norms[i]);
   runtime->execute_task(ctx, launcher);
 }
+
+void AdamOptimizer::update_bucket(const GradBucket& bucket)
+{
+  Context ctx = model->config.lg_ctx;
+  Runtime* runtime = model->config.lg_hlr;
+  pack_grad_bucket(bucket);
+  std::vector<char> args;
+  get_grad_bucket_args(this, sizeof(AdamOptimizer), bucket, args);
+  TaskLauncher launcher(ADAM_BUCKET_UPD_TASK_ID,
+                        TaskArgument(args.data(), args.size()),
+                        Predicate::TRUE_PRED, 0/*mapper_id*/,
+                        model->config.get_strategy_id(std::string(bucket.params[0]->pcname)));
+  // regions[0]: the packed gradients
+  launcher.add_region_requirement(
+      RegionRequirement(bucket.region, READ_ONLY, EXCLUSIVE, bucket.region));
+  launcher.add_field(0, FID_DATA);
+  // Each parameter adds region, w_region and m_region
+  unsigned idx = 1;
+  for (size_t i = 0; i < bucket.params.size(); i++) {
+    const Parameter* p = bucket.params[i];
+    assert(v_regions.find(p->region) != v_regions.end());
+    assert(m_regions.find(p->region) != m_regions.end());
+    launcher.add_region_requirement(
+        RegionRequirement(p->region,
+                          READ_WRITE, EXCLUSIVE, p->region));
+    launcher.add_field(idx++, FID_DATA);
+    launcher.add_region_requirement(
+        RegionRequirement(v_regions[p->region],
+                          READ_WRITE, EXCLUSIVE, v_regions[p->region]));
+    launcher.add_field(idx++, FID_DATA);
+    launcher.add_region_requirement(
+        RegionRequirement(m_regions[p->region],
+                          READ_WRITE, EXCLUSIVE, m_regions[p->region]));
+    launcher.add_field(idx++, FID_DATA);
+  }
+  for (size_t i = 0; i < grad_norms.size(); i++)
+    launcher.add_future(grad_norms[i]);
+  runtime->execute_task(ctx, launcher);
+}
+
+void merge_sparse_grad_rows(const int64_t* rows, size_t num_slots,
+                            std::vector<int64_t>& unique_rows,
+                            std::vector<int>& offsets,
+                            std::vector<int>& slots)
+{
+  // Different sample partitions may touch the same row
+  std::vector<std::pair<int64_t, int> > sorted;
+  for (size_t i = 0; i < num_slots; i++)
+    if (rows[i] >= 0)
+      sorted.push_back(std::make_pair(rows[i], (int)i));
+  std::sort(sorted.begin(), sorted.end());
+  unique_rows.clear();
+  offsets.clear();
+  slots.resize(sorted.size());
+  for (size_t i = 0; i < sorted.size(); i++) {
+    if (i == 0 || sorted[i].first != sorted[i-1].first) {
+      unique_rows.push_back(sorted[i].first);
+      offsets.push_back(i);
+    }
+    slots[i] = sorted[i].second;
+  }
+  offsets.push_back(sorted.size());
+}
+
+// Sums the sparse gradients of each unique row into grads
+static void gather_sparse_grads(const std::vector<int>& offsets,
+                                const std::vector<int>& slots,
+                                const float* values, coord_t dim,
+                                std::vector<float>& grads)
+{
+  int num_rows = offsets.size() - 1;
+  grads.resize(num_rows * dim);
+  CPU_PARALLEL_FOR
+  for (int i = 0; i < num_rows; i++) {
+    float* g = grads.data() + i * dim;
+    cpu_assign(g, dim, 0.0f);
+    for (int j = offsets[i]; j < offsets[i+1]; j++)
+      cpu_add(g, values + slots[j] * dim, dim);
+  }
+}
+
+/*
+  regions[0](I): sparse_grad_rows
+  regions[1](I): sparse_grad_values
+  regions[2](I/O): weight
+  regions[3](I/O): v (only with momentum)
+*/
+void SGDOptimizer::sparse_update_task_cpu(const Task* task,
+                                          const std::vector<PhysicalRegion>& regions,
+                                          Context ctx, Runtime* runtime)
+{
+  const SGDOptimizer* op = (SGDOptimizer*) task->args;
+  assert(regions.size() == (op->momentum > 0.0f ? 4 : 3));
+  assert(task->regions.size() == regions.size());
+  const AccessorRO<int64_t, 2> acc_rows(regions[0], FID_DATA);
+  const AccessorRO<float, 2> acc_values(regions[1], FID_DATA);
+  const AccessorRW<float, 2> acc_w(regions[2], FID_DATA);
+  Rect<2> rect_rows = runtime->get_index_space_domain(
+      ctx, task->regions[0].region.get_index_space());
+  Rect<2> rect_values = runtime->get_index_space_domain(
+      ctx, task->regions[1].region.get_index_space());
+  Rect<2> rect_w = runtime->get_index_space_domain(
+      ctx, task->regions[2].region.get_index_space());
+  coord_t num_entries = rect_w.hi[0] - rect_w.lo[0] + 1;
+  coord_t dim = rect_w.hi[1] - rect_w.lo[1] + 1;
+  assert(rect_values.volume() == rect_rows.volume() * dim);
+  float* w = acc_w.ptr(rect_w);
+  float* v = NULL;
+  if (op->momentum > 0.0f) {
+    const AccessorRW<float, 2> acc_v(regions[3], FID_DATA);
+    assert(rect_w == runtime->get_index_space_domain(
+        ctx, task->regions[3].region.get_index_space()));
+    v = acc_v.ptr(rect_w);
+  }
+  std::vector<int64_t> rows;
+  std::vector<int> offsets, slots;
+  merge_sparse_grad_rows(acc_rows.ptr(rect_rows), rect_rows.volume(),
+                         rows, offsets, slots);
+  std::vector<float> grads;
+  gather_sparse_grads(offsets, slots, acc_values.ptr(rect_values), dim, grads);
+  float lr = op->lr, weight_decay = op->weight_decay, momentum = op->momentum;
+  bool nesterov = op->nesterov;
+  CPU_PARALLEL_FOR
+  for (size_t i = 0; i < rows.size(); i++) {
+    coord_t row = rows[i] - rect_w.lo[0];
+    assert(row >= 0 && row < num_entries);
+    const float* g = grads.data() + i * dim;
+    float* wr = w + row * dim;
+    float* vr = (v == NULL) ? NULL : v + row * dim;
+    CPU_SIMD
+    for (coord_t j = 0; j < dim; j++) {
+      float gt = g[j] + weight_decay * wr[j];
+      if (momentum > 0.0f) {
+        vr[j] = vr[j] * momentum + gt;
+        if (nesterov)
+          gt = gt + momentum * vr[j];
+        else
+          gt = vr[j];
+      }
+      wr[j] -= lr * gt;
+    }
+  }
+}
+
+/*
+  regions[0](I): sparse_grad_rows
+  regions[1](I): sparse_grad_values
+  regions[2](I/O): weight
+  regions[3](I/O): v
+  regions[4](I/O): m
+*/
+void AdamOptimizer::sparse_update_task_cpu(const Task* task,
+                                           const std::vector<PhysicalRegion>& regions,
+                                           Context ctx, Runtime* runtime)
+{
+  assert(regions.size() == 5);
+  assert(task->regions.size() == 5);
+  const AdamOptimizer* op = (AdamOptimizer*) task->args;
+  const AccessorRO<int64_t, 2> acc_rows(regions[0], FID_DATA);
+  const AccessorRO<float, 2> acc_values(regions[1], FID_DATA);
+  const AccessorRW<float, 2> acc_w(regions[2], FID_DATA);
+  const AccessorRW<float, 2> acc_v(regions[3], FID_DATA);
+  const AccessorRW<float, 2> acc_m(regions[4], FID_DATA);
+  Rect<2> rect_rows = runtime->get_index_space_domain(
+      ctx, task->regions[0].region.get_index_space());
+  Rect<2> rect_values = runtime->get_index_space_domain(
+      ctx, task->regions[1].region.get_index_space());
+  Rect<2> rect_w = runtime->get_index_space_domain(
+      ctx, task->regions[2].region.get_index_space());
+  coord_t num_entries = rect_w.hi[0] - rect_w.lo[0] + 1;
+  coord_t dim = rect_w.hi[1] - rect_w.lo[1] + 1;
+  assert(rect_values.volume() == rect_rows.volume() * dim);
+  float* w = acc_w.ptr(rect_w);
+  float* v = acc_v.ptr(rect_w);
+  float* m = acc_m.ptr(rect_w);
+  std::vector<int64_t> rows;
+  std::vector<int> offsets, slots;
+  merge_sparse_grad_rows(acc_rows.ptr(rect_rows), rect_rows.volume(),
+                         rows, offsets, slots);
+  std::vector<float> grads;
+  gather_sparse_grads(offsets, slots, acc_values.ptr(rect_values), dim, grads);
+  float alpha_t = op->alpha_t, beta1 = op->beta1, beta2 = op->beta2;
+  float weight_decay = op->weight_decay, epsilon = op->epsilon;
+  CPU_PARALLEL_FOR
+  for (size_t i = 0; i < rows.size(); i++) {
+    coord_t row = rows[i] - rect_w.lo[0];
+    assert(row >= 0 && row < num_entries);
+    const float* g = grads.data() + i * dim;
+    float* wr = w + row * dim;
+    float* vr = v + row * dim;
+    float* mr = m + row * dim;
+    CPU_SIMD
+    for (coord_t j = 0; j < dim; j++) {
+      float gt = g[j] + weight_decay * wr[j];
+      float mt = beta1 * mr[j] + (1 - beta1) * gt;
+      float vt = beta2 * vr[j] + (1 - beta2) * gt * gt;
+      mr[j] = mt;
+      vr[j] = vt;
+      wr[j] -= alpha_t * mt / (sqrtf(vt) + epsilon);
+    }
+  }
+}
+
+// ------------------------------------------------------------------
+//                  Dense updates on CPUs
+// ------------------------------------------------------------------
+
+// Elements per unit of work in the dense CPU updates
+#define UPDATE_CHUNK 4096
+
+// A dense parameter and its optimizer state. w_grad holds num_replicas
+// copies of the gradient, which are summed while updating. v and m are
+// float, or uint16_t for Adam moments stored in fp16/bf16
+struct UpdateTensor {
+  const float* w_grad;
+  float* w;
+  void *v, *m;
+  coord_t size, num_replicas;
+};
+
+static void* get_moment_pointer(const PhysicalRegion& region,
+                                const RegionRequirement& req,
+                                DataType moment_type,
+                                Context ctx, Runtime* runtime)
+{
+  if (moment_type == DT_FLOAT)
+    return helperGetTensorPointerRW<float>(region, req, FID_DATA, ctx, runtime);
+  return helperGetTensorPointerRW<uint16_t>(region, req, FID_DATA, ctx, runtime);
+}
+
+// regions[first] is region_grad and regions[first+1] the weight; v and m
+// follow when has_v and has_m, stored as moment_type
+static UpdateTensor get_update_tensor(const Task* task,
+                                      const std::vector<PhysicalRegion>& regions,
+                                      int first, bool has_v, bool has_m,
+                                      DataType moment_type,
+                                      Context ctx, Runtime* runtime)
+{
+  UpdateTensor t;
+  Domain grad_domain = runtime->get_index_space_domain(
+      ctx, task->regions[first].region.get_index_space());
+  Domain w_domain = runtime->get_index_space_domain(
+      ctx, task->regions[first+1].region.get_index_space());
+  t.size = w_domain.get_volume();
+  assert(grad_domain.get_volume() % t.size == 0);
+  t.num_replicas = grad_domain.get_volume() / t.size;
+  t.w_grad = helperGetTensorPointerRO<float>(
+      regions[first], task->regions[first], FID_DATA, ctx, runtime);
+  t.w = helperGetTensorPointerRW<float>(
+      regions[first+1], task->regions[first+1], FID_DATA, ctx, runtime);
+  t.v = t.m = NULL;
+  int next = first + 2;
+  if (has_v) {
+    assert(w_domain == runtime->get_index_space_domain(
+        ctx, task->regions[next].region.get_index_space()));
+    t.v = get_moment_pointer(regions[next], task->regions[next],
+                             moment_type, ctx, runtime);
+    next++;
+  }
+  if (has_m) {
+    assert(w_domain == runtime->get_index_space_domain(
+        ctx, task->regions[next].region.get_index_space()));
+    t.m = get_moment_pointer(regions[next], task->regions[next],
+                             moment_type, ctx, runtime);
+  }
+  return t;
+}
+
+// Splits all tensors into chunks of UPDATE_CHUNK elements; chunk c belongs
+// to the tensor t with first_chunk[t] <= c < first_chunk[t+1]
+static coord_t split_update_chunks(const std::vector<UpdateTensor>& tensors,
+                                   std::vector<coord_t>& first_chunk)
+{
+  first_chunk.resize(tensors.size() + 1);
+  first_chunk[0] = 0;
+  for (size_t t = 0; t < tensors.size(); t++)
+    first_chunk[t+1] = first_chunk[t]
+                     + (tensors[t].size + UPDATE_CHUNK - 1) / UPDATE_CHUNK;
+  return first_chunk.back();
+}
+
+// Same math as sgd_update in optimizer_kernel.cu. The gradient replicas
+// are summed on the fly rather than into the read-only first replica, and
+// all tensors share one parallel loop over their chunks
+static void sgd_update_cpu(const SGDOptimizer* op, float grad_scale,
+                           const std::vector<UpdateTensor>& tensors)
+{
+  std::vector<coord_t> first_chunk;
+  coord_t num_chunks = split_update_chunks(tensors, first_chunk);
+  float lr = op->lr, weight_decay = op->weight_decay, momentum = op->momentum;
+  bool nesterov = op->nesterov;
+  CPU_PARALLEL_FOR_IF(num_chunks * UPDATE_CHUNK >= CPU_PARALLEL_MIN_VOLUME)
+  for (coord_t c = 0; c < num_chunks; c++) {
+    size_t t = std::upper_bound(first_chunk.begin(), first_chunk.end(), c)
+             - first_chunk.begin() - 1;
+    const UpdateTensor& u = tensors[t];
+    coord_t lo = (c - first_chunk[t]) * UPDATE_CHUNK;
+    coord_t hi = std::min(lo + UPDATE_CHUNK, u.size);
+    const float* w_grad = u.w_grad;
+    float *w = u.w, *v = (float*) u.v;
+    CPU_SIMD
+    for (coord_t i = lo; i < hi; i++) {
+      float gt = 0.0f;
+      for (coord_t r = 0; r < u.num_replicas; r++)
+        gt += w_grad[r * u.size + i];
+      gt = grad_scale * gt + weight_decay * w[i];
+      if (momentum > 0.0f) {
+        v[i] = v[i] * momentum + gt;
+        if (nesterov)
+          gt = gt + momentum * v[i];
+        else
+          gt = v[i];
+      }
+      w[i] -= lr * gt;
+    }
+  }
+}
+
+// Storage of Adam moments; the update math is always fp32
+struct FloatMoment {
+  typedef float T;
+  static inline float load(float x) { return x; }
+  static inline float store(float x) { return x; }
+};
+
+struct HalfMoment {
+  typedef uint16_t T;
+  static inline float load(uint16_t x) { return cpu_half_to_float(x); }
+  static inline uint16_t store(float x) { return cpu_float_to_half(x); }
+};
+
+struct BF16Moment {
+  typedef uint16_t T;
+  static inline float load(uint16_t x) { return cpu_bf16_to_float(x); }
+  static inline uint16_t store(float x) { return cpu_float_to_bf16(x); }
+};
+
+// Same math as adam_update in optimizer_kernel.cu
+template<typename MS>
+static void adam_update_cpu(const AdamOptimizer* op, float grad_scale,
+                            const std::vector<UpdateTensor>& tensors)
+{
+  typedef typename MS::T MT;
+  std::vector<coord_t> first_chunk;
+  coord_t num_chunks = split_update_chunks(tensors, first_chunk);
+  float alpha_t = op->alpha_t, beta1 = op->beta1, beta2 = op->beta2;
+  float weight_decay = op->weight_decay, epsilon = op->epsilon;
+  CPU_PARALLEL_FOR_IF(num_chunks * UPDATE_CHUNK >= CPU_PARALLEL_MIN_VOLUME)
+  for (coord_t c = 0; c < num_chunks; c++) {
+    size_t t = std::upper_bound(first_chunk.begin(), first_chunk.end(), c)
+             - first_chunk.begin() - 1;
+    const UpdateTensor& u = tensors[t];
+    coord_t lo = (c - first_chunk[t]) * UPDATE_CHUNK;
+    coord_t hi = std::min(lo + UPDATE_CHUNK, u.size);
+    const float* w_grad = u.w_grad;
+    float* w = u.w;
+    MT *v = (MT*) u.v, *m = (MT*) u.m;
+    CPU_SIMD
+    for (coord_t i = lo; i < hi; i++) {
+      float gt = 0.0f;
+      for (coord_t r = 0; r < u.num_replicas; r++)
+        gt += w_grad[r * u.size + i];
+      gt = grad_scale * gt + weight_decay * w[i];
+      float mt = beta1 * MS::load(m[i]) + (1 - beta1) * gt;
+      float vt = beta2 * MS::load(v[i]) + (1 - beta2) * gt * gt;
+      m[i] = MS::store(mt);
+      v[i] = MS::store(vt);
+      w[i] -= alpha_t * mt / (sqrtf(vt) + epsilon);
+    }
+  }
+}
+
+static void adam_update_cpu(const AdamOptimizer* op, float grad_scale,
+                            const std::vector<UpdateTensor>& tensors)
+{
+  switch (op->moment_type) {
+    case DT_FLOAT:
+      adam_update_cpu<FloatMoment>(op, grad_scale, tensors);
+      break;
+    case DT_HALF:
+      adam_update_cpu<HalfMoment>(op, grad_scale, tensors);
+      break;
+    case DT_BFLOAT16:
+      adam_update_cpu<BF16Moment>(op, grad_scale, tensors);
+      break;
+    default:
+      assert(false);
+  }
+}
+
+/*
+  regions[i](I): region_grad of the i-th parameter
+  task->args: the weight volume of each parameter
+*/
+float Optimizer::grad_norm_task_cpu(const Task* task,
+                                    const std::vector<PhysicalRegion>& regions,
+                                    Context ctx, Runtime* runtime)
+{
+  assert(task->regions.size() == regions.size());
+  assert(task->arglen == regions.size() * sizeof(coord_t));
+  const coord_t* sizes = (const coord_t*) task->args;
+  std::vector<UpdateTensor> tensors(regions.size());
+  for (size_t i = 0; i < regions.size(); i++) {
+    Domain grad_domain = runtime->get_index_space_domain(
+        ctx, task->regions[i].region.get_index_space());
+    tensors[i].size = sizes[i];
+    assert(grad_domain.get_volume() % sizes[i] == 0);
+    tensors[i].num_replicas = grad_domain.get_volume() / sizes[i];
+    tensors[i].w_grad = helperGetTensorPointerRO<float>(
+        regions[i], task->regions[i], FID_DATA, ctx, runtime);
+  }
+  std::vector<coord_t> first_chunk;
+  coord_t num_chunks = split_update_chunks(tensors, first_chunk);
+  // Partial sums in double so that the norm does not depend on the
+  // number of parameters and threads
+  double sum = 0.0;
+  CPU_PARALLEL_FOR_REDUCTION(+:sum)
+  for (coord_t c = 0; c < num_chunks; c++) {
+    size_t t = std::upper_bound(first_chunk.begin(), first_chunk.end(), c)
+             - first_chunk.begin() - 1;
+    const UpdateTensor& u = tensors[t];
+    coord_t lo = (c - first_chunk[t]) * UPDATE_CHUNK;
+    coord_t hi = std::min(lo + UPDATE_CHUNK, u.size);
+    float chunk_sum = 0.0f;
+    CPU_SIMD_REDUCTION(+:chunk_sum)
+    for (coord_t i = lo; i < hi; i++) {
+      float gt = 0.0f;
+      for (coord_t r = 0; r < u.num_replicas; r++)
+        gt += u.w_grad[r * u.size + i];
+      chunk_sum += gt * gt;
+    }
+    sum += chunk_sum;
+  }
+  return (float) sum;
+}
+
+/*
+  regions[0](O): a row of the bucket
+  regions[1+k](I): the gradient slice of the k-th parameter
+*/
+void Optimizer::pack_grad_bucket_task_cpu(const Task* task,
+                                          const std::vector<PhysicalRegion>& regions,
+                                          Context ctx, Runtime* runtime)
+{
+  assert(regions.size() == task->regions.size());
+  Domain row_domain = runtime->get_index_space_domain(
+      ctx, task->regions[0].region.get_index_space());
+  float* row = helperGetTensorPointerWO<float>(
+      regions[0], task->regions[0], FID_DATA, ctx, runtime);
+  coord_t offset = 0;
+  for (size_t k = 1; k < regions.size(); k++) {
+    Domain slice_domain = runtime->get_index_space_domain(
+        ctx, task->regions[k].region.get_index_space());
+    const float* slice = helperGetTensorPointerRO<float>(
+        regions[k], task->regions[k], FID_DATA, ctx, runtime);
+    cpu_copy(row + offset, slice, slice_domain.get_volume());
+    offset += slice_domain.get_volume();
+  }
+  assert(offset == (coord_t) row_domain.get_volume());
+}
+
+// Unpacks the bucket in regions[0] into grads, with the gradient of each
+// parameter in its region_grad layout, and returns the update tensors of
+// the parameters whose weight, v and m follow from regions[1]
+static std::vector<UpdateTensor> get_bucket_update_tensors(
+    const Task* task, const std::vector<PhysicalRegion>& regions,
+    const GradBucketLayout& layout, bool has_v, bool has_m,
+    DataType moment_type, std::vector<float>& grads,
+    Context ctx, Runtime* runtime)
+{
+  int regions_per_param = 1 + (has_v ? 1 : 0) + (has_m ? 1 : 0);
+  assert(regions.size() == 1 + (size_t) layout.num_params * regions_per_param);
+  assert(task->regions.size() == regions.size());
+  const float* bucket = helperGetTensorPointerRO<float>(
+      regions[0], task->regions[0], FID_DATA, ctx, runtime);
+  std::vector<coord_t> grad_base(layout.num_params + 1, 0);
+  for (int k = 0; k < layout.num_params; k++)
+    grad_base[k+1] = grad_base[k] + layout.slice_volumes[k] * layout.num_colors;
+  grads.resize(grad_base.back());
+  CPU_PARALLEL_FOR_IF((coord_t) grads.size() >= CPU_PARALLEL_MIN_VOLUME)
+  for (coord_t i = 0; i < layout.num_params * layout.num_colors; i++) {
+    coord_t k = i / layout.num_colors, c = i % layout.num_colors;
+    cpu_copy(grads.data() + grad_base[k] + layout.grad_offsets[i],
+             bucket + c * layout.row_volume + layout.row_offsets[k],
+             layout.slice_volumes[k]);
+  }
+  std::vector<UpdateTensor> tensors(layout.num_params);
+  for (int k = 0; k < layout.num_params; k++) {
+    int first = 1 + k * regions_per_param;
+    UpdateTensor& t = tensors[k];
+    Domain w_domain = runtime->get_index_space_domain(
+        ctx, task->regions[first].region.get_index_space());
+    t.size = w_domain.get_volume();
+    assert((grad_base[k+1] - grad_base[k]) % t.size == 0);
+    t.num_replicas = (grad_base[k+1] - grad_base[k]) / t.size;
+    t.w_grad = grads.data() + grad_base[k];
+    t.w = helperGetTensorPointerRW<float>(
+        regions[first], task->regions[first], FID_DATA, ctx, runtime);
+    t.v = has_v ? get_moment_pointer(regions[first+1], task->regions[first+1],
+                                     moment_type, ctx, runtime) : NULL;
+    t.m = has_m ? get_moment_pointer(regions[first+2], task->regions[first+2],
+                                     moment_type, ctx, runtime) : NULL;
+  }
+  return tensors;
+}
+
+/*
+  regions[0](I): region_grad
+  regions[1](I/O): weight
+  regions[2](I/O): v (only with momentum)
+*/
+void SGDOptimizer::update_task_cpu(const Task* task,
+                                   const std::vector<PhysicalRegion>& regions,
+                                   Context ctx, Runtime* runtime)
+{
+  const SGDOptimizer* op = (SGDOptimizer*) task->args;
+  bool has_v = op->momentum > 0.0f;
+  assert(regions.size() == (has_v ? 3 : 2));
+  assert(task->regions.size() == regions.size());
+  std::vector<UpdateTensor> tensors(1, get_update_tensor(
+      task, regions, 0, has_v, false/*has_m*/, DT_FLOAT, ctx, runtime));
+  sgd_update_cpu(op, get_grad_clip_scale(task, op->clip_grad_norm), tensors);
+}
+
+/*
+  regions[3*i](I): region_grad of the i-th parameter
+  regions[3*i+1](I/O): weight of the i-th parameter
+  regions[3*i+2](I/O): v of the i-th parameter
+  (2 regions per parameter without momentum)
+*/
+void SGDOptimizer::multi_update_task_cpu(const Task* task,
+                                         const std::vector<PhysicalRegion>& regions,
+                                         Context ctx, Runtime* runtime)
+{
+  const SGDOptimizer* op = (SGDOptimizer*) task->args;
+  bool has_v = op->momentum > 0.0f;
+  int regions_per_param = has_v ? 3 : 2;
+  assert(regions.size() % regions_per_param == 0);
+  assert(task->regions.size() == regions.size());
+  std::vector<UpdateTensor> tensors;
+  for (size_t i = 0; i < regions.size(); i += regions_per_param)
+    tensors.push_back(get_update_tensor(
+        task, regions, i, has_v, false/*has_m*/, DT_FLOAT, ctx, runtime));
+  sgd_update_cpu(op, get_grad_clip_scale(task, op->clip_grad_norm), tensors);
+}
+
+/*
+  regions[0](I): the packed gradients of a bucket
+  regions[1+2*k](I/O): weight of the k-th parameter
+  regions[2+2*k](I/O): v of the k-th parameter
+  (1 region per parameter without momentum)
+*/
+void SGDOptimizer::bucket_update_task_cpu(const Task* task,
+                                          const std::vector<PhysicalRegion>& regions,
+                                          Context ctx, Runtime* runtime)
+{
+  const SGDOptimizer* op = (SGDOptimizer*) task->args;
+  GradBucketLayout layout = get_grad_bucket_layout(task, sizeof(SGDOptimizer));
+  std::vector<float> grads;
+  std::vector<UpdateTensor> tensors = get_bucket_update_tensors(
+      task, regions, layout, op->momentum > 0.0f, false/*has_m*/, DT_FLOAT,
+      grads, ctx, runtime);
+  sgd_update_cpu(op, get_grad_clip_scale(task, op->clip_grad_norm), tensors);
+}
+
+/*
+  regions[0](I): region_grad
+  regions[1](I/O): weight
+  regions[2](I/O): v
+  regions[3](I/O): m
+*/
+void AdamOptimizer::update_task_cpu(const Task* task,
+                                    const std::vector<PhysicalRegion>& regions,
+                                    Context ctx, Runtime* runtime)
+{
+  assert(regions.size() == 4);
+  assert(task->regions.size() == 4);
+  const AdamOptimizer* op = (AdamOptimizer*) task->args;
+  std::vector<UpdateTensor> tensors(1, get_update_tensor(
+      task, regions, 0, true/*has_v*/, true/*has_m*/, op->moment_type,
+      ctx, runtime));
+  adam_update_cpu(op, get_grad_clip_scale(task, op->clip_grad_norm), tensors);
+}
+
+/*
+  regions[4*i](I): region_grad of the i-th parameter
+  regions[4*i+1](I/O): weight of the i-th parameter
+  regions[4*i+2](I/O): v of the i-th parameter
+  regions[4*i+3](I/O): m of the i-th parameter
+*/
+void AdamOptimizer::multi_update_task_cpu(const Task* task,
+                                          const std::vector<PhysicalRegion>& regions,
+                                          Context ctx, Runtime* runtime)
+{
+  assert(regions.size() % 4 == 0);
+  assert(task->regions.size() == regions.size());
+  const AdamOptimizer* op = (AdamOptimizer*) task->args;
+  std::vector<UpdateTensor> tensors;
+  for (size_t i = 0; i < regions.size(); i += 4)
+    tensors.push_back(get_update_tensor(
+        task, regions, i, true/*has_v*/, true/*has_m*/, op->moment_type,
+        ctx, runtime));
+  adam_update_cpu(op, get_grad_clip_scale(task, op->clip_grad_norm), tensors);
+}
+
+/*
+  regions[0](I): the packed gradients of a bucket
+  regions[1+3*k](I/O): weight of the k-th parameter
+  regions[2+3*k](I/O): v of the k-th parameter
+  regions[3+3*k](I/O): m of the k-th parameter
+*/
+void AdamOptimizer::bucket_update_task_cpu(const Task* task,
+                                           const std::vector<PhysicalRegion>& regions,
+                                           Context ctx, Runtime* runtime)
+{
+  const AdamOptimizer* op = (AdamOptimizer*) task->args;
+  GradBucketLayout layout = get_grad_bucket_layout(task, sizeof(AdamOptimizer));
+  std::vector<float> grads;
+  std::vector<UpdateTensor> tensors = get_bucket_update_tensors(
+      task, regions, layout, true/*has_v*/, true/*has_m*/, op->moment_type,
+      grads, ctx, runtime);
+  adam_update_cpu(op, get_grad_clip_scale(task, op->clip_grad_norm), tensors);
+}
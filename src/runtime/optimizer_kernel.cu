@@ -17,18 +17,23 @@
 #include "accessor.h"
 #include "model.h"
 #include "cuda_helper.h"
+#include <cuda_fp16.h>
+#include <mutex>
+#include <thrust/execution_policy.h>
+#include <thrust/sequence.h>
+#include <thrust/sort.h>
 
 LegionRuntime::Logger::Category log_optimizer("optimizer");
 
 __global__
 void sgd_update(int count, float lr, float weight_decay,
-                float momentum, bool nesterov,
+                float momentum, bool nesterov, float grad_scale,
                 const float* WGrad, float* V, float* W)
 {
   // Refernce https://pytorch.org/docs/stable/_modules/torch/optim/sgd.html#SGD
   CUDA_KERNEL_LOOP(i, count)
   {
-    float gt = WGrad[i] + weight_decay * W[i];
+    float gt = grad_scale * WGrad[i] + weight_decay * W[i];
     if (momentum > 0.0f) {
       V[i] = V[i] * momentum + gt;
       if (nesterov)
@@ -40,6 +45,29 @@ void sgd_update(int count, float lr, float weight_decay,
   }
 }
 
+// Sums the gradients of all replicas into the first one, reading each
+// replica once; shared by every SGD and Adam update path
+__global__
+void sum_replicas_kernel(size_t size, size_t num_replicas, float* WGrad)
+{
+  CUDA_KERNEL_LOOP(i, size)
+  {
+    float gt = WGrad[i];
+    for (size_t r = 1; r < num_replicas; r++)
+      gt += WGrad[r * size + i];
+    WGrad[i] = gt;
+  }
+}
+
+__host__
+static void sum_grad_replicas(float* w_grad_ptr, size_t size,
+                              size_t num_replicas)
+{
+  if (num_replicas > 1)
+    sum_replicas_kernel<<<GET_BLOCKS(size), CUDA_NUM_THREADS>>>(
+        size, num_replicas, w_grad_ptr);
+}
+
 __host__
 void SGDOptimizer::update_task(const Task* task,
                                const std::vector<PhysicalRegion>& regions,
@@ -94,33 +122,60 @@ void SGDOptimizer::update_task(const Task* task,
     }
   }
   // Step 1: gather gradients in the first replica
-  for (int i = 1; i < num_replicas; i++) {
-    const float* src = w_grad_ptr + i * size;
-    apply_add_with_scale<<<GET_BLOCKS(size), CUDA_NUM_THREADS>>>(
-        (float*) w_grad_ptr, src, size, 1.0f);
-  }
+  sum_grad_replicas((float*) w_grad_ptr, size, num_replicas);
   checkCUDA(cudaDeviceSynchronize());
   // Step 2: SGD update
+  float grad_scale = get_grad_clip_scale(task, op->clip_grad_norm);
   sgd_update<<<GET_BLOCKS(size), CUDA_NUM_THREADS>>>(
       size, op->lr, op->weight_decay, op->momentum, op->nesterov,
-      w_grad_ptr, v_ptr, w_ptr);
+      grad_scale, w_grad_ptr, v_ptr, w_ptr);
   checkCUDA(cudaDeviceSynchronize());
 }
 
-// ==================================================================
-//                        Adam Optimizer
-// ==================================================================
-__global__
-void add_kernel(int count, float scale,
-                const float* src,
-                float* dst)
+/*
+  regions[3*i](I): region_grad of the i-th parameter
+  regions[3*i+1](I/O): weight of the i-th parameter
+  regions[3*i+2](I/O): v of the i-th parameter
+  (2 regions per parameter without momentum)
+*/
+__host__
+void SGDOptimizer::multi_update_task(const Task* task,
+                                     const std::vector<PhysicalRegion>& regions,
+                                     Context ctx, Runtime* runtime)
 {
-  CUDA_KERNEL_LOOP(i, count)
-  {
-    dst[i] += src[i] * scale;
+  const SGDOptimizer* op = (SGDOptimizer*) task->args;
+  int regions_per_param = op->momentum > 0.0f ? 3 : 2;
+  assert(regions.size() % regions_per_param == 0);
+  assert(task->regions.size() == regions.size());
+  float grad_scale = get_grad_clip_scale(task, op->clip_grad_norm);
+  // One task for all parameters, with the kernels queued back to back
+  for (size_t p = 0; p < regions.size(); p += regions_per_param) {
+    Domain grad_domain = runtime->get_index_space_domain(ctx,
+        task->regions[p].region.get_index_space());
+    Domain w_domain = runtime->get_index_space_domain(ctx,
+        task->regions[p+1].region.get_index_space());
+    size_t size = w_domain.get_volume();
+    assert(grad_domain.get_volume() % size == 0);
+    size_t num_replicas = grad_domain.get_volume() / size;
+    float* w_grad_ptr = (float*) helperGetTensorPointerRO<float>(
+        regions[p], task->regions[p], FID_DATA, ctx, runtime);
+    float* w_ptr = helperGetTensorPointerRW<float>(
+        regions[p+1], task->regions[p+1], FID_DATA, ctx, runtime);
+    float* v_ptr = NULL;
+    if (op->momentum > 0.0f)
+      v_ptr = helperGetTensorPointerRW<float>(
+          regions[p+2], task->regions[p+2], FID_DATA, ctx, runtime);
+    sum_grad_replicas(w_grad_ptr, size, num_replicas);
+    sgd_update<<<GET_BLOCKS(size), CUDA_NUM_THREADS>>>(
+        size, op->lr, op->weight_decay, op->momentum, op->nesterov,
+        grad_scale, w_grad_ptr, v_ptr, w_ptr);
   }
+  checkCUDA(cudaDeviceSynchronize());
 }
 
+// ==================================================================
+//                        Adam Optimizer
+// ==================================================================
 __global__
 void scale_kernel(int count, float a, float b,
                   float* ptr)
@@ -131,12 +186,49 @@ void scale_kernel(int count, float a, float b,
   }
 }
 
+// Storage of Adam moments; the update math is always fp32
+struct FloatMoment {
+  typedef float T;
+  __device__ static float load(float x) { return x; }
+  __device__ static float store(float x) { return x; }
+};
+
+struct HalfMoment {
+  typedef uint16_t T;
+  __device__ static float load(uint16_t x)
+  {
+    return __half2float(__ushort_as_half(x));
+  }
+  __device__ static uint16_t store(float x)
+  {
+    return __half_as_ushort(__float2half_rn(x));
+  }
+};
+
+// Same rounding as cpu_float_to_bf16
+struct BF16Moment {
+  typedef uint16_t T;
+  __device__ static float load(uint16_t x)
+  {
+    return __uint_as_float((unsigned int) x << 16);
+  }
+  __device__ static uint16_t store(float x)
+  {
+    unsigned int u = __float_as_uint(x);
+    if ((u & 0x7fffffffu) > 0x7f800000u)
+      return (uint16_t)((u >> 16) | 0x40);
+    u += 0x7fffu + ((u >> 16) & 1);
+    return (uint16_t)(u >> 16);
+  }
+};
+
+template<typename MS>
 __global__
 void adam_update(int count, float alpha_t,
                  float beta1, float beta2,
                  float weight_decay, float epsilon,
-                 const float *WGrad, float *M,
-                 float *V, float *W)
+                 float grad_scale, const float *WGrad,
+                 typename MS::T *M, typename MS::T *V, float *W)
 {
   // Reference for weight decay
   // https://www.fast.ai/2018/07/02/adam-weight-decay/
@@ -144,15 +236,50 @@ void adam_update(int count, float alpha_t,
   {
     //W[i] -= weight_decay * alpha_t * W[i];
     //float gt = WGrad[i];
-    float gt = WGrad[i] + weight_decay * W[i];
-    float mt = beta1 * M[i] + (1 - beta1) * gt;
-    float vt = beta2 * V[i] + (1 - beta2) * gt * gt;
-    M[i] = mt;
-    V[i] = vt;
+    float gt = grad_scale * WGrad[i] + weight_decay * W[i];
+    float mt = beta1 * MS::load(M[i]) + (1 - beta1) * gt;
+    float vt = beta2 * MS::load(V[i]) + (1 - beta2) * gt * gt;
+    M[i] = MS::store(mt);
+    V[i] = MS::store(vt);
     W[i] -= alpha_t * mt / (sqrt(vt) + epsilon);
   }
 }
 
+__host__
+static void launch_adam_update(const AdamOptimizer* op, size_t size,
+                               float grad_scale, const float* w_grad_ptr,
+                               void* m_ptr, void* v_ptr, float* w_ptr)
+{
+  switch (op->moment_type) {
+#define ADAM_MOMENT(DT, MS) \
+    case DT: \
+    { \
+      adam_update<MS><<<GET_BLOCKS(size), CUDA_NUM_THREADS>>>( \
+          size, op->alpha_t, op->beta1, op->beta2, \
+          op->weight_decay, op->epsilon, grad_scale, w_grad_ptr, \
+          (MS::T*) m_ptr, (MS::T*) v_ptr, w_ptr); \
+      break; \
+    }
+    ADAM_MOMENT(DT_FLOAT, FloatMoment)
+    ADAM_MOMENT(DT_HALF, HalfMoment)
+    ADAM_MOMENT(DT_BFLOAT16, BF16Moment)
+#undef ADAM_MOMENT
+    default:
+      assert(false);
+  }
+}
+
+__host__
+static void* get_moment_pointer(const PhysicalRegion& region,
+                                const RegionRequirement& req,
+                                DataType moment_type,
+                                Context ctx, Runtime* runtime)
+{
+  if (moment_type == DT_FLOAT)
+    return helperGetTensorPointerRW<float>(region, req, FID_DATA, ctx, runtime);
+  return helperGetTensorPointerRW<uint16_t>(region, req, FID_DATA, ctx, runtime);
+}
+
 __host__
 void AdamOptimizer::update_task(const Task* task,
                                 const std::vector<PhysicalRegion>& regions,
@@ -164,7 +291,7 @@ void AdamOptimizer::update_task(const Task* task,
   Domain domain = runtime->get_index_space_domain(ctx,
       task->regions[1].region.get_index_space());
   const float *w_grad_ptr = NULL;
-  float *w_ptr = NULL, *v_ptr = NULL, *m_ptr = NULL;
+  float *w_ptr = NULL;
   size_t size = 0, num_replicas = 0;
   switch(domain.get_dim()) {
 #define DIMFUNC(DIM) \
@@ -175,19 +302,11 @@ void AdamOptimizer::update_task(const Task* task,
       TensorAccessorW<float, DIM> accW( \
           regions[1], task->regions[1], FID_DATA, ctx, runtime, \
           true/*readOutput*/); \
-      TensorAccessorW<float, DIM> accV( \
-          regions[2], task->regions[2], FID_DATA, ctx, runtime, \
-          true/*readOutput*/); \
-      TensorAccessorW<float, DIM> accM( \
-          regions[3], task->regions[3], FID_DATA, ctx, runtime, \
-          true/*readOutput*/); \
       size = accW.rect.volume(); \
       assert(accWGrad.rect.volume() % accW.rect.volume() == 0); \
       num_replicas = accWGrad.rect.volume() / accW.rect.volume(); \
       w_grad_ptr = accWGrad.ptr; \
       w_ptr = accW.ptr; \
-      v_ptr = accV.ptr; \
-      m_ptr = accM.ptr; \
       break; \
     }
     LEGION_FOREACH_N(DIMFUNC)
@@ -198,20 +317,472 @@ void AdamOptimizer::update_task(const Task* task,
       assert(false);
     }
   }
+  // v and m are float or 16-bit depending on op->moment_type
+  void* v_ptr = get_moment_pointer(regions[2], task->regions[2],
+                                   op->moment_type, ctx, runtime);
+  void* m_ptr = get_moment_pointer(regions[3], task->regions[3],
+                                   op->moment_type, ctx, runtime);
   // Step 1: gather gradients in the first replica
-  for (int i = 1; i < num_replicas; i++) {
-    const float* src = w_grad_ptr + i * size;
-    add_kernel<<<GET_BLOCKS(size), CUDA_NUM_THREADS>>>(
-        size, 1.0f, src, (float*)w_grad_ptr);
-  }
+  sum_grad_replicas((float*) w_grad_ptr, size, num_replicas);
   checkCUDA(cudaDeviceSynchronize());
   //fprintf(stderr, "alpha = %.8lf alpha_t = %.8lf decay = %.8lf\n",
   //        op->alpha, op->alpha_t, op->weight_decay);
   // Step 2: Adam update
-  adam_update<<<GET_BLOCKS(size), CUDA_NUM_THREADS>>>(
-      size, op->alpha_t, op->beta1, op->beta2,
-      op->weight_decay, op->epsilon,
-      w_grad_ptr, m_ptr, v_ptr, w_ptr);
+  launch_adam_update(op, size, get_grad_clip_scale(task, op->clip_grad_norm),
+                     w_grad_ptr, m_ptr, v_ptr, w_ptr);
   checkCUDA(cudaDeviceSynchronize());
 }
 
+
+/*
+  regions[4*i](I): region_grad of the i-th parameter
+  regions[4*i+1](I/O): weight of the i-th parameter
+  regions[4*i+2](I/O): v of the i-th parameter
+  regions[4*i+3](I/O): m of the i-th parameter
+*/
+__host__
+void AdamOptimizer::multi_update_task(const Task* task,
+                                      const std::vector<PhysicalRegion>& regions,
+                                      Context ctx, Runtime* runtime)
+{
+  assert(regions.size() % 4 == 0);
+  assert(task->regions.size() == regions.size());
+  const AdamOptimizer* op = (AdamOptimizer*) task->args;
+  float grad_scale = get_grad_clip_scale(task, op->clip_grad_norm);
+  // One task for all parameters, with the kernels queued back to back
+  for (size_t p = 0; p < regions.size(); p += 4) {
+    Domain grad_domain = runtime->get_index_space_domain(ctx,
+        task->regions[p].region.get_index_space());
+    Domain w_domain = runtime->get_index_space_domain(ctx,
+        task->regions[p+1].region.get_index_space());
+    size_t size = w_domain.get_volume();
+    assert(grad_domain.get_volume() % size == 0);
+    size_t num_replicas = grad_domain.get_volume() / size;
+    float* w_grad_ptr = (float*) helperGetTensorPointerRO<float>(
+        regions[p], task->regions[p], FID_DATA, ctx, runtime);
+    float* w_ptr = helperGetTensorPointerRW<float>(
+        regions[p+1], task->regions[p+1], FID_DATA, ctx, runtime);
+    void* v_ptr = get_moment_pointer(regions[p+2], task->regions[p+2],
+                                     op->moment_type, ctx, runtime);
+    void* m_ptr = get_moment_pointer(regions[p+3], task->regions[p+3],
+                                     op->moment_type, ctx, runtime);
+    sum_grad_replicas(w_grad_ptr, size, num_replicas);
+    launch_adam_update(op, size, grad_scale, w_grad_ptr, m_ptr, v_ptr, w_ptr);
+  }
+  checkCUDA(cudaDeviceSynchronize());
+}
+
+// ==================================================================
+//                  Gradient buckets
+// ==================================================================
+
+/*
+  regions[0](O): a row of the bucket
+  regions[1+k](I): the gradient slice of the k-th parameter
+*/
+__host__
+void Optimizer::pack_grad_bucket_task(const Task* task,
+                                      const std::vector<PhysicalRegion>& regions,
+                                      Context ctx, Runtime* runtime)
+{
+  assert(regions.size() == task->regions.size());
+  Domain row_domain = runtime->get_index_space_domain(ctx,
+      task->regions[0].region.get_index_space());
+  float* row = helperGetTensorPointerWO<float>(
+      regions[0], task->regions[0], FID_DATA, ctx, runtime);
+  size_t offset = 0;
+  for (size_t k = 1; k < regions.size(); k++) {
+    Domain slice_domain = runtime->get_index_space_domain(ctx,
+        task->regions[k].region.get_index_space());
+    const float* slice = helperGetTensorPointerRO<float>(
+        regions[k], task->regions[k], FID_DATA, ctx, runtime);
+    checkCUDA(cudaMemcpyAsync(row + offset, slice,
+                              slice_domain.get_volume() * sizeof(float),
+                              cudaMemcpyDeviceToDevice));
+    offset += slice_domain.get_volume();
+  }
+  assert(offset == row_domain.get_volume());
+  checkCUDA(cudaDeviceSynchronize());
+}
+
+// Unpacks the bucket in regions[0] into the processor's bucket_grads, with
+// the gradient of each parameter in its region_grad layout; grad_ptrs[k]
+// is the gradient of the k-th parameter
+__host__
+static void unpack_grad_bucket(const Task* task,
+                               const std::vector<PhysicalRegion>& regions,
+                               const GradBucketLayout& layout,
+                               std::vector<float*>& grad_ptrs,
+                               Context ctx, Runtime* runtime)
+{
+  const float* bucket = helperGetTensorPointerRO<float>(
+      regions[0], task->regions[0], FID_DATA, ctx, runtime);
+  size_t total = 0;
+  for (int k = 0; k < layout.num_params; k++)
+    total += layout.slice_volumes[k] * layout.num_colors;
+  OptimizerMeta* m = OptimizerMeta::get(runtime->get_executing_processor(ctx));
+  m->reserve_bucket_grads(total);
+  grad_ptrs.resize(layout.num_params);
+  float* ptr = m->bucket_grads;
+  for (int k = 0; k < layout.num_params; k++) {
+    grad_ptrs[k] = ptr;
+    for (coord_t c = 0; c < layout.num_colors; c++)
+      checkCUDA(cudaMemcpyAsync(
+          ptr + layout.grad_offsets[k * layout.num_colors + c],
+          bucket + c * layout.row_volume + layout.row_offsets[k],
+          layout.slice_volumes[k] * sizeof(float), cudaMemcpyDeviceToDevice));
+    ptr += layout.slice_volumes[k] * layout.num_colors;
+  }
+}
+
+/*
+  regions[0](I): the packed gradients of a bucket
+  regions[1+2*k](I/O): weight of the k-th parameter
+  regions[2+2*k](I/O): v of the k-th parameter
+  (1 region per parameter without momentum)
+*/
+__host__
+void SGDOptimizer::bucket_update_task(const Task* task,
+                                      const std::vector<PhysicalRegion>& regions,
+                                      Context ctx, Runtime* runtime)
+{
+  const SGDOptimizer* op = (SGDOptimizer*) task->args;
+  GradBucketLayout layout = get_grad_bucket_layout(task, sizeof(SGDOptimizer));
+  int regions_per_param = op->momentum > 0.0f ? 2 : 1;
+  assert(regions.size() == 1 + (size_t) layout.num_params * regions_per_param);
+  assert(task->regions.size() == regions.size());
+  std::vector<float*> grad_ptrs;
+  unpack_grad_bucket(task, regions, layout, grad_ptrs, ctx, runtime);
+  float grad_scale = get_grad_clip_scale(task, op->clip_grad_norm);
+  for (int k = 0; k < layout.num_params; k++) {
+    int p = 1 + k * regions_per_param;
+    Domain w_domain = runtime->get_index_space_domain(ctx,
+        task->regions[p].region.get_index_space());
+    size_t size = w_domain.get_volume();
+    size_t num_replicas = layout.slice_volumes[k] * layout.num_colors / size;
+    float* w_grad_ptr = grad_ptrs[k];
+    float* w_ptr = helperGetTensorPointerRW<float>(
+        regions[p], task->regions[p], FID_DATA, ctx, runtime);
+    float* v_ptr = NULL;
+    if (op->momentum > 0.0f)
+      v_ptr = helperGetTensorPointerRW<float>(
+          regions[p+1], task->regions[p+1], FID_DATA, ctx, runtime);
+    sum_grad_replicas(w_grad_ptr, size, num_replicas);
+    sgd_update<<<GET_BLOCKS(size), CUDA_NUM_THREADS>>>(
+        size, op->lr, op->weight_decay, op->momentum, op->nesterov,
+        grad_scale, w_grad_ptr, v_ptr, w_ptr);
+  }
+  checkCUDA(cudaDeviceSynchronize());
+}
+
+/*
+  regions[0](I): the packed gradients of a bucket
+  regions[1+3*k](I/O): weight of the k-th parameter
+  regions[2+3*k](I/O): v of the k-th parameter
+  regions[3+3*k](I/O): m of the k-th parameter
+*/
+__host__
+void AdamOptimizer::bucket_update_task(const Task* task,
+                                       const std::vector<PhysicalRegion>& regions,
+                                       Context ctx, Runtime* runtime)
+{
+  const AdamOptimizer* op = (AdamOptimizer*) task->args;
+  GradBucketLayout layout = get_grad_bucket_layout(task, sizeof(AdamOptimizer));
+  assert(regions.size() == 1 + (size_t) layout.num_params * 3);
+  assert(task->regions.size() == regions.size());
+  std::vector<float*> grad_ptrs;
+  unpack_grad_bucket(task, regions, layout, grad_ptrs, ctx, runtime);
+  float grad_scale = get_grad_clip_scale(task, op->clip_grad_norm);
+  for (int k = 0; k < layout.num_params; k++) {
+    int p = 1 + k * 3;
+    Domain w_domain = runtime->get_index_space_domain(ctx,
+        task->regions[p].region.get_index_space());
+    size_t size = w_domain.get_volume();
+    size_t num_replicas = layout.slice_volumes[k] * layout.num_colors / size;
+    float* w_grad_ptr = grad_ptrs[k];
+    float* w_ptr = helperGetTensorPointerRW<float>(
+        regions[p], task->regions[p], FID_DATA, ctx, runtime);
+    void* v_ptr = get_moment_pointer(regions[p+1], task->regions[p+1],
+                                     op->moment_type, ctx, runtime);
+    void* m_ptr = get_moment_pointer(regions[p+2], task->regions[p+2],
+                                     op->moment_type, ctx, runtime);
+    sum_grad_replicas(w_grad_ptr, size, num_replicas);
+    launch_adam_update(op, size, grad_scale, w_grad_ptr, m_ptr, v_ptr, w_ptr);
+  }
+  checkCUDA(cudaDeviceSynchronize());
+}
+
+// ==================================================================
+//                  Global gradient norm
+// ==================================================================
+__global__
+void grad_sqr_sum(size_t size, size_t num_replicas,
+                  const float* WGrad, float* sum)
+{
+  __shared__ float partial[CUDA_NUM_THREADS];
+  float local = 0.0f;
+  CUDA_KERNEL_LOOP(i, size)
+  {
+    float gt = 0.0f;
+    for (size_t r = 0; r < num_replicas; r++)
+      gt += WGrad[r * size + i];
+    local += gt * gt;
+  }
+  partial[threadIdx.x] = local;
+  __syncthreads();
+  for (unsigned int s = blockDim.x / 2; s > 0; s >>= 1) {
+    if (threadIdx.x < s)
+      partial[threadIdx.x] += partial[threadIdx.x + s];
+    __syncthreads();
+  }
+  if (threadIdx.x == 0)
+    atomicAdd(sum, partial[0]);
+}
+
+/*
+  regions[i](I): region_grad of the i-th parameter
+  task->args: the weight volume of each parameter
+*/
+__host__
+float Optimizer::grad_norm_task(const Task* task,
+                                const std::vector<PhysicalRegion>& regions,
+                                Context ctx, Runtime* runtime)
+{
+  assert(task->regions.size() == regions.size());
+  assert(task->arglen == regions.size() * sizeof(coord_t));
+  const coord_t* sizes = (const coord_t*) task->args;
+  float* sum_ptr = OptimizerMeta::get(
+      runtime->get_executing_processor(ctx))->norm_sum;
+  checkCUDA(cudaMemset(sum_ptr, 0, sizeof(float)));
+  for (size_t p = 0; p < regions.size(); p++) {
+    Domain grad_domain = runtime->get_index_space_domain(ctx,
+        task->regions[p].region.get_index_space());
+    size_t size = sizes[p];
+    assert(grad_domain.get_volume() % size == 0);
+    size_t num_replicas = grad_domain.get_volume() / size;
+    const float* w_grad_ptr = helperGetTensorPointerRO<float>(
+        regions[p], task->regions[p], FID_DATA, ctx, runtime);
+    // The shared-memory reduction assumes full blocks of CUDA_NUM_THREADS
+    grad_sqr_sum<<<GET_BLOCKS(size), CUDA_NUM_THREADS>>>(
+        size, num_replicas, w_grad_ptr, sum_ptr);
+  }
+  float sum;
+  checkCUDA(cudaMemcpy(&sum, sum_ptr, sizeof(float), cudaMemcpyDeviceToHost));
+  return sum;
+}
+
+// ==================================================================
+//                  Sparse (row-wise) updates
+// ==================================================================
+OptimizerMeta::OptimizerMeta(void)
+: sorted_rows(NULL), sorted_slots(NULL), sparse_capacity(0),
+  bucket_grads(NULL), bucket_capacity(0)
+{
+  checkCUDA(cudaMalloc(&norm_sum, sizeof(float)));
+}
+
+OptimizerMeta* OptimizerMeta::get(Processor proc)
+{
+  // Tasks of different GPUs may look up their meta concurrently
+  static std::mutex lock;
+  static std::map<Processor, OptimizerMeta*> metas;
+  std::lock_guard<std::mutex> guard(lock);
+  OptimizerMeta*& m = metas[proc];
+  if (m == NULL)
+    m = new OptimizerMeta();
+  return m;
+}
+
+void OptimizerMeta::reserve_sparse_rows(size_t num_slots)
+{
+  if (num_slots <= sparse_capacity)
+    return;
+  if (sparse_capacity > 0) {
+    checkCUDA(cudaFree(sorted_rows));
+    checkCUDA(cudaFree(sorted_slots));
+  }
+  checkCUDA(cudaMalloc(&sorted_rows, num_slots * sizeof(int64_t)));
+  checkCUDA(cudaMalloc(&sorted_slots, num_slots * sizeof(int)));
+  sparse_capacity = num_slots;
+}
+
+void OptimizerMeta::reserve_bucket_grads(size_t volume)
+{
+  if (volume <= bucket_capacity)
+    return;
+  if (bucket_capacity > 0)
+    checkCUDA(cudaFree(bucket_grads));
+  checkCUDA(cudaMalloc(&bucket_grads, volume * sizeof(float)));
+  bucket_capacity = volume;
+}
+
+// Sorts the slots of sparse_grad_rows by row on the device (same order as
+// merge_sparse_grad_rows), sparse_grad_rows is in zero-copy memory
+__host__
+static void sort_sparse_grad_rows(OptimizerMeta* m, const int64_t* rows,
+                                  int num_slots, cudaStream_t stream)
+{
+  m->reserve_sparse_rows(num_slots);
+  checkCUDA(cudaMemcpyAsync(m->sorted_rows, rows, num_slots * sizeof(int64_t),
+                            cudaMemcpyDeviceToDevice, stream));
+  thrust::sequence(thrust::cuda::par.on(stream),
+                   m->sorted_slots, m->sorted_slots + num_slots);
+  thrust::stable_sort_by_key(thrust::cuda::par.on(stream),
+                             m->sorted_rows, m->sorted_rows + num_slots,
+                             m->sorted_slots);
+}
+
+// The thread of the first sorted slot of each row sums the gradients of
+// all slots of that row; other slots and unused slots (row -1) return false
+__device__ __forceinline__
+bool sum_sparse_grad(const int64_t* sorted_rows, const int* sorted_slots,
+                     int num_slots, const float* values, int i, int off,
+                     int dim, float& gt)
+{
+  int64_t row = sorted_rows[i];
+  if (row < 0 || (i > 0 && sorted_rows[i-1] == row))
+    return false;
+  gt = 0.0f;
+  for (int j = i; j < num_slots && sorted_rows[j] == row; j++)
+    gt += values[sorted_slots[j] * dim + off];
+  return true;
+}
+
+__global__
+void sgd_sparse_update(const int64_t* sorted_rows, const int* sorted_slots,
+                       int num_slots, int dim, float lr,
+                       float weight_decay, float momentum, bool nesterov,
+                       const float* values, float* V, float* W)
+{
+  CUDA_KERNEL_LOOP(i, num_slots * dim)
+  {
+    int off = i % dim;
+    float gt;
+    if (!sum_sparse_grad(sorted_rows, sorted_slots, num_slots, values,
+                         i / dim, off, dim, gt))
+      continue;
+    coord_t idx = sorted_rows[i / dim] * dim + off;
+    gt += weight_decay * W[idx];
+    if (momentum > 0.0f) {
+      V[idx] = V[idx] * momentum + gt;
+      if (nesterov)
+        gt = gt + momentum * V[idx];
+      else
+        gt = V[idx];
+    }
+    W[idx] -= lr * gt;
+  }
+}
+
+/*
+  regions[0](I): sparse_grad_rows
+  regions[1](I): sparse_grad_values
+  regions[2](I/O): weight
+  regions[3](I/O): v (only with momentum)
+*/
+__host__
+void SGDOptimizer::sparse_update_task(const Task* task,
+                                      const std::vector<PhysicalRegion>& regions,
+                                      Context ctx, Runtime* runtime)
+{
+  const SGDOptimizer* op = (SGDOptimizer*) task->args;
+  assert(regions.size() == (op->momentum > 0.0f ? 4 : 3));
+  assert(task->regions.size() == regions.size());
+  TensorAccessorR<int64_t, 2> accRows(
+      regions[0], task->regions[0], FID_DATA, ctx, runtime);
+  TensorAccessorR<float, 2> accValues(
+      regions[1], task->regions[1], FID_DATA, ctx, runtime);
+  TensorAccessorW<float, 2> accW(
+      regions[2], task->regions[2], FID_DATA, ctx, runtime, true/*readOutput*/);
+  int dim = accW.rect.hi[1] - accW.rect.lo[1] + 1;
+  assert(accW.rect.lo[0] == 0);
+  assert(accValues.rect.volume() == accRows.rect.volume() * dim);
+  float* v_ptr = NULL;
+  if (op->momentum > 0.0f) {
+    TensorAccessorW<float, 2> accV(
+        regions[3], task->regions[3], FID_DATA, ctx, runtime, true/*readOutput*/);
+    assert(accW.rect == accV.rect);
+    v_ptr = accV.ptr;
+  }
+#ifndef DISABLE_LEGION_CUDA_HIJACK
+  cudaStream_t stream;
+  checkCUDA(cudaStreamCreate(&stream));
+#else
+  cudaStream_t stream = 0;
+#endif
+  OptimizerMeta* m = OptimizerMeta::get(runtime->get_executing_processor(ctx));
+  int num_slots = accRows.rect.volume();
+  sort_sparse_grad_rows(m, accRows.ptr, num_slots, stream);
+  sgd_sparse_update<<<GET_BLOCKS(num_slots * dim), CUDA_NUM_THREADS, 0, stream>>>(
+      m->sorted_rows, m->sorted_slots, num_slots, dim, op->lr,
+      op->weight_decay, op->momentum, op->nesterov,
+      accValues.ptr, v_ptr, accW.ptr);
+}
+
+__global__
+void adam_sparse_update(const int64_t* sorted_rows, const int* sorted_slots,
+                        int num_slots, int dim, float alpha_t,
+                        float beta1, float beta2,
+                        float weight_decay, float epsilon,
+                        const float* values, float *M,
+                        float *V, float *W)
+{
+  CUDA_KERNEL_LOOP(i, num_slots * dim)
+  {
+    int off = i % dim;
+    float gt;
+    if (!sum_sparse_grad(sorted_rows, sorted_slots, num_slots, values,
+                         i / dim, off, dim, gt))
+      continue;
+    coord_t idx = sorted_rows[i / dim] * dim + off;
+    gt += weight_decay * W[idx];
+    float mt = beta1 * M[idx] + (1 - beta1) * gt;
+    float vt = beta2 * V[idx] + (1 - beta2) * gt * gt;
+    M[idx] = mt;
+    V[idx] = vt;
+    W[idx] -= alpha_t * mt / (sqrt(vt) + epsilon);
+  }
+}
+
+/*
+  regions[0](I): sparse_grad_rows
+  regions[1](I): sparse_grad_values
+  regions[2](I/O): weight
+  regions[3](I/O): v
+  regions[4](I/O): m
+*/
+__host__
+void AdamOptimizer::sparse_update_task(const Task* task,
+                                       const std::vector<PhysicalRegion>& regions,
+                                       Context ctx, Runtime* runtime)
+{
+  assert(regions.size() == 5);
+  assert(task->regions.size() == 5);
+  const AdamOptimizer* op = (AdamOptimizer*) task->args;
+  TensorAccessorR<int64_t, 2> accRows(
+      regions[0], task->regions[0], FID_DATA, ctx, runtime);
+  TensorAccessorR<float, 2> accValues(
+      regions[1], task->regions[1], FID_DATA, ctx, runtime);
+  TensorAccessorW<float, 2> accW(
+      regions[2], task->regions[2], FID_DATA, ctx, runtime, true/*readOutput*/);
+  TensorAccessorW<float, 2> accV(
+      regions[3], task->regions[3], FID_DATA, ctx, runtime, true/*readOutput*/);
+  TensorAccessorW<float, 2> accM(
+      regions[4], task->regions[4], FID_DATA, ctx, runtime, true/*readOutput*/);
+  int dim = accW.rect.hi[1] - accW.rect.lo[1] + 1;
+  assert(accW.rect.lo[0] == 0);
+  assert(accValues.rect.volume() == accRows.rect.volume() * dim);
+#ifndef DISABLE_LEGION_CUDA_HIJACK
+  cudaStream_t stream;
+  checkCUDA(cudaStreamCreate(&stream));
+#else
+  cudaStream_t stream = 0;
+#endif
+  OptimizerMeta* m = OptimizerMeta::get(runtime->get_executing_processor(ctx));
+  int num_slots = accRows.rect.volume();
+  sort_sparse_grad_rows(m, accRows.ptr, num_slots, stream);
+  adam_sparse_update<<<GET_BLOCKS(num_slots * dim), CUDA_NUM_THREADS, 0, stream>>>(
+      m->sorted_rows, m->sorted_slots, num_slots, dim, op->alpha_t,
+      op->beta1, op->beta2, op->weight_decay, op->epsilon,
+      accValues.ptr, accM.ptr, accV.ptr, accW.ptr);
+}
@@ -155,6 +155,10 @@ void* Simulator::allocate(size_t num_elements, DataType type)
     case DT_BOOLEAN:
       element_size = sizeof(bool);
       break;
+    case DT_HALF:
+    case DT_BFLOAT16:
+      element_size = sizeof(uint16_t);
+      break;
     default:
       assert(false);
   }
@@ -199,7 +203,8 @@ Device* Simulator::get_inter_node_comm_device_by_ids(int src_id,
 
 void Simulator::add_task_dependencies_with_xfer(SimTask* src_task,
                                                 SimTask* dst_task,
-                                                size_t intersect)
+                                                size_t intersect,
+                                                float latency)
 {
   if (src_task->device == dst_task->device) {
     src_task->add_next_task(dst_task);
@@ -208,7 +213,7 @@ void Simulator::add_task_dependencies_with_xfer(SimTask* src_task,
     SimTask* task = task_manager->new_comm_task();
     task->device = get_inter_gpu_comm_device_by_ids(src_task->device->gpu_id,
                                                     dst_task->device->gpu_id);
-    task->run_time = (float)intersect * sizeof(float) / task->device->bandwidth;
+    task->run_time = latency + (float)intersect * sizeof(float) / task->device->bandwidth;
     //printf("Comm task: run_time(%.4lf) size(%zu) bandwidth(%.4lf)\n",
     //       task->run_time, intersect * sizeof(float), task->device->bandwidth);
     src_task->add_next_task(task);
@@ -217,7 +222,7 @@ void Simulator::add_task_dependencies_with_xfer(SimTask* src_task,
     // Inter-node communication
     SimTask* gpu_to_dram = task_manager->new_comm_task();
     gpu_to_dram->device = get_gpu_to_dram_comm_device_by_id(src_task->device->gpu_id);
-    gpu_to_dram->run_time = (float)intersect * sizeof(float) / gpu_to_dram->device->bandwidth;
+    gpu_to_dram->run_time = latency + (float)intersect * sizeof(float) / gpu_to_dram->device->bandwidth;
     SimTask* dram_to_dram = task_manager->new_comm_task();
     dram_to_dram->device = get_inter_node_comm_device_by_ids(src_task->device->node_id,
                                                              dst_task->device->node_id);
@@ -272,6 +277,73 @@ float Simulator::measure_op_backward_time(Op* op, const ParallelConfig& config)
   }
 }
 
+void Simulator::flush_grad_bucket(SimGradBucket& bucket)
+{
+  std::map<int, SimTask*>::const_iterator it;
+  for (it = bucket.packs.begin(); it != bucket.packs.end(); it++)
+    add_task_dependencies_with_xfer(it->second, bucket.update_task,
+        bucket.volumes[it->first], SYNC_XFER_LATENCY);
+  bucket.update_task = NULL;
+  bucket.packs.clear();
+  bucket.volumes.clear();
+  bucket.bytes = 0;
+  bucket.num_params = 0;
+}
+
+// Adds the update of a weight on update_device, whose replicas on other
+// devices are produced by srcs. barrier (if any) precedes the update
+void Simulator::add_weight_sync(std::map<std::vector<int>, SimGradBucket>& buckets,
+                                size_t bucket_size, int update_device,
+                                const std::vector<SimTask*>& srcs,
+                                size_t volume, SimTask* barrier)
+{
+  size_t bytes = volume * sizeof(float) * (srcs.size() + 1);
+  if (!use_grad_bucket(bucket_size, volume, srcs.size() + 1)) {
+    // Add a compute task for parameter update
+    SimTask* updateT = task_manager->new_update_task();
+    updateT->device = get_compute_device_by_id(update_device);
+    updateT->run_time = 0.0f; // Assume update task takes no time
+    if (barrier != NULL)
+      barrier->add_next_task(updateT);
+    // Add comm. tasks from srcs to updateT; the per-transfer latency is
+    // only modeled when bucketing is on, so that the estimates without
+    // --grad-bucket-mb are unchanged
+    for (size_t i = 0; i < srcs.size(); i++)
+      add_task_dependencies_with_xfer(srcs[i], updateT, 2*volume,
+                                      bucket_size > 0 ? SYNC_XFER_LATENCY : 0.0f);
+    return;
+  }
+  // Weights replicated on the same devices share a bucket: each source
+  // device packs its gradients and sends them with one transfer
+  std::vector<int> key(1, update_device);
+  for (size_t i = 0; i < srcs.size(); i++)
+    key.push_back(srcs[i]->device->gpu_id);
+  SimGradBucket& bucket = buckets[key];
+  if (grad_bucket_full(bucket_size, bucket.bytes, bucket.num_params, bytes))
+    flush_grad_bucket(bucket);
+  if (bucket.update_task == NULL) {
+    bucket.update_task = task_manager->new_update_task();
+    bucket.update_task->device = get_compute_device_by_id(update_device);
+    bucket.update_task->run_time = 0.0f;
+    if (barrier != NULL)
+      barrier->add_next_task(bucket.update_task);
+  }
+  for (size_t i = 0; i < srcs.size(); i++) {
+    int device = srcs[i]->device->gpu_id;
+    if (bucket.packs.find(device) == bucket.packs.end()) {
+      SimTask* packT = task_manager->new_barrier_task();
+      packT->device = srcs[i]->device;
+      packT->run_time = 0.0f; // Assume packing takes no time
+      bucket.packs[device] = packT;
+      bucket.volumes[device] = 0;
+    }
+    srcs[i]->add_next_task(bucket.packs[device]);
+    bucket.volumes[device] += 2*volume;
+  }
+  bucket.bytes += bytes;
+  bucket.num_params ++;
+}
+
 float Simulator::simulate_runtime(const FFModel* model,
                                   const std::map<Op*, ParallelConfig>& global)
 {
@@ -324,6 +396,9 @@ float Simulator::simulate_runtime(const FFModel* model,
       }
     }
   }
+  // Gradients of small weights are synchronized through buckets when
+  // grad_bucket_size is set, as in FFModel::create_grad_buckets
+  std::map<std::vector<int>, SimGradBucket> buckets;
   if (model->config.search_overlap_backward_update) {
     // Step 3a: consider backpropagation and weight update are overlapped
     for (int l = model->layers.size()-1; l >= 0; l--) {
@@ -335,10 +410,7 @@ float Simulator::simulate_runtime(const FFModel* model,
           if (synched.find(firstId) == synched.end()) {
             synched.insert(firstId);
             Domain firstR = op->get_weight_tensor_shape(pc, j, firstId);
-            // Add a compute task for parameter update
-            SimTask* updateT = task_manager->new_update_task();
-            updateT->device = get_compute_device_by_id(pc.device_ids[firstId]);
-            updateT->run_time = 0.0f; // Assume update task takes no time
+            std::vector<SimTask*> srcs;
             for (int nextId = firstId+1; nextId < pc.num_parts(); nextId++) {
               Domain nextR = op->get_weight_tensor_shape(pc, j, nextId);
               if (firstR.intersection(nextR).get_volume() > 0) {
@@ -347,11 +419,12 @@ float Simulator::simulate_runtime(const FFModel* model,
                 assert(firstR == nextR);
                 assert(synched.find(nextId) == synched.end());
                 synched.insert(nextId);
-                // Add comm. tasks from nextId to 
-                SimTask* workerT = task_manager->get_backward_task(op, nextId);
-                add_task_dependencies_with_xfer(workerT, updateT, 2*firstR.get_volume());
+                srcs.push_back(task_manager->get_backward_task(op, nextId));
               }
             }
+            add_weight_sync(buckets, model->config.grad_bucket_size,
+                            pc.device_ids[firstId], srcs,
+                            firstR.get_volume(), NULL/*barrier*/);
           }
       }
     }
@@ -382,11 +455,7 @@ float Simulator::simulate_runtime(const FFModel* model,
           if (synched.find(firstId) == synched.end()) {
             synched.insert(firstId);
             Domain firstR = op->get_weight_tensor_shape(pc, j, firstId);
-            // Add a compute task for parameter update
-            SimTask* updateT = task_manager->new_update_task();
-            updateT->device = get_compute_device_by_id(pc.device_ids[firstId]);
-            updateT->run_time = 0.0f; // Assume update task takes no time
-            barriers[updateT->device->gpu_id]->add_next_task(updateT);
+            std::vector<SimTask*> srcs;
             for (int nextId = firstId+1; nextId < pc.num_parts(); nextId++) {
               Domain nextR = op->get_weight_tensor_shape(pc, j, nextId);
               if (firstR.intersection(nextR).get_volume() > 0) {
@@ -397,15 +466,20 @@ float Simulator::simulate_runtime(const FFModel* model,
                 synched.insert(nextId);
                 SimTask* backT = task_manager->get_backward_task(op, nextId);
                 assert(backT->device->gpu_id == pc.device_ids[nextId]);
-                SimTask* barrierT = barriers[backT->device->gpu_id];
-                // Add comm. tasks from barrierT to updateT
-                add_task_dependencies_with_xfer(barrierT, updateT, 2*firstR.get_volume());
+                srcs.push_back(barriers[backT->device->gpu_id]);
               }
             }
+            add_weight_sync(buckets, model->config.grad_bucket_size,
+                            pc.device_ids[firstId], srcs,
+                            firstR.get_volume(),
+                            barriers[pc.device_ids[firstId]]);
           }
       }
     }
   }
+  std::map<std::vector<int>, SimGradBucket>::iterator it;
+  for (it = buckets.begin(); it != buckets.end(); it++)
+    flush_grad_bucket(it->second);
 
   // Step 4: add ready tasks into ready_queue
   std::priority_queue<SimTask*, std::vector<SimTask*>, SimTaskCompare> ready_queue;
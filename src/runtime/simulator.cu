@@ -121,15 +121,15 @@ void Simulator::strategy_search_task(const Task *task,
   if (model->config.import_strategy_file.length() > 0) {
     // Load the strategy from config.strategies
     for (size_t l = 0; l < model->layers.size(); l++) {
-      MappingTagID key = FFConfig::get_hash_id(std::string(model->layers[l]->name));
-      std::map<MappingTagID, ParallelConfig>::const_iterator iter;
-      iter = model->config.strategies.find(key);
-      if (iter == model->config.strategies.end()) {
+      MappingTagID key = model->config.get_strategy_id(std::string(model->layers[l]->name));
+      if (key == FFConfig::DataParallelism_ND) {
         fprintf(stderr, "ERROR: Cannot find strategy for operator %s in "
                 "strategy file %s\n", model->layers[l]->name,
                 model->config.import_strategy_file.c_str());
+        strategies[model->layers[l]] = model->layers[l]->get_data_parallel_config(*model);
+        continue;
       }
-      strategies[model->layers[l]] = iter->second;
+      strategies[model->layers[l]] = model->config.strategies[key];
     }
   } else {
     // Start from data parallel
@@ -19,81 +19,53 @@
 #include <iostream>
 #include <string>
 
-MappingTagID FFConfig::get_hash_id(const std::string& pcname)
+MappingTagID FFConfig::get_strategy_id(const std::string& pcname) const
 {
-  return std::hash<std::string>{}(pcname);
+  std::map<std::string, MappingTagID>::const_iterator iter;
+  iter = strategy_ids.find(pcname);
+  if (iter == strategy_ids.end())
+    return DataParallelism_ND;
+  return iter->second;
 }
 
 bool FFConfig::find_parallel_config(int ndims,
                                     const std::string& pcname,
                                     ParallelConfig& config) const
 {
-  MappingTagID hash = get_hash_id(pcname);
-  std::map<MappingTagID, ParallelConfig>::const_iterator iter;
-  if (strategies.find(hash) == strategies.end()) {
+  MappingTagID id = get_strategy_id(pcname);
+  if (id == DataParallelism_ND) {
     // No strategy found, use default data parallelism
-    switch (ndims) {
-      case 1:
-      {
-        iter = strategies.find(DataParallelism_1D);
-        assert(iter != strategies.end());
-        config = iter->second;
-        break;
-      }
-      case 2:
-      {
-        iter = strategies.find(DataParallelism_2D);
-        assert(iter != strategies.end());
-        config = iter->second;
-        break;
-      }
-      case 3:
-      {
-        iter = strategies.find(DataParallelism_3D);
-        assert(iter != strategies.end());
-        config = iter->second;
-        break;
-      }
-      case 4:
-      {
-        iter = strategies.find(DataParallelism_4D);
-        assert(iter != strategies.end());
-        config = iter->second;
-        break;
-      }
-#if MAX_TENSOR_DIM >= 5
-      case 5:
-      {
-        iter = strategies.find(DataParallelism_5D);
-        assert(iter != strategies.end());
-        config = iter->second;
-        break;
-      }
-#endif
-      //case 6:
-      //{
-      //  assert(strategies.find(DataParallelism_6D) != strategies.end());
-      //  config = strategies[DataParallelism_6D];
-      //  break;
-      //}
-      default:
-      {
-        // Unsupported dimension for data parallelism
-        assert(false);
-      }
-    }
-    return true;
-  } else {
-    iter = strategies.find(hash);
-    config = iter->second;
-    // Check that the returned config matches what we are looking for
-    assert(config.nDims == ndims);
-    return true;
+    id = DataParallelism_1D - 1 + ndims;
+    // Unsupported dimension for data parallelism
+    assert(ndims >= 1 && id <= DataParallelism_5D);
+  }
+  assert(id < strategies.size());
+  config = strategies[id];
+  // Check that the returned config matches what we are looking for
+  assert(config.nDims == ndims);
+  return true;
+}
+
+void assign_strategy_ids(const std::map<std::string, ParallelConfig>& named_strategies,
+                         std::map<std::string, MappingTagID>& strategy_ids,
+                         std::vector<ParallelConfig>& strategies)
+{
+  // Preserved ids without a config yet are marked with nDims = 0
+  ParallelConfig unset;
+  unset.nDims = 0;
+  strategies.resize(FFConfig::StrategyID_FIRST, unset);
+  strategy_ids.clear();
+  // Assign ids in name order so that every process loading the same
+  // strategy file (e.g., the model and the mappers) agrees on them
+  std::map<std::string, ParallelConfig>::const_iterator it;
+  for (it = named_strategies.begin(); it != named_strategies.end(); it++) {
+    strategy_ids[it->first] = strategies.size();
+    strategies.push_back(it->second);
   }
 }
 
 bool load_strategies_from_file(const std::string& filename,
-                               std::map<MappingTagID, ParallelConfig>& strategies)
+                               std::map<std::string, ParallelConfig>& strategies)
 {
   std::fstream input(filename, std::ios::in);
   if (!input) {
@@ -138,9 +110,8 @@ bool load_strategies_from_file(const std::string& filename,
       //printf("%d\t", config.device_ids[j]);
     }
     //printf("\n");
-    MappingTagID hash = FFConfig::get_hash_id(op_name);
-    assert(strategies.find(hash) == strategies.end());
-    strategies[hash] = config;
+    assert(strategies.find(op_name) == strategies.end());
+    strategies[op_name] = config;
   }
   input.close();
   printf("strategies.size() = %zu\n", strategies.size());
@@ -0,0 +1,266 @@
+/* Copyright 2020 Stanford
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Checks cpu_sgemm, cpu_im2col, cpu_col2im and the conv2d/pool2d CPU
+// kernels against naive loops on small shapes, including padding,
+// strides, groups and both transposes
+
+#include "cpu_kernels.h"
+#include <cfloat>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+static int num_failures = 0;
+
+static void fill_random(std::vector<float>& v)
+{
+  for (size_t i = 0; i < v.size(); i++)
+    v[i] = ((float)std::rand()) / RAND_MAX - 0.5f;
+}
+
+static void check_close(const char* name, const std::vector<float>& a,
+                        const std::vector<float>& b)
+{
+  for (size_t i = 0; i < a.size(); i++) {
+    if (std::fabs(a[i] - b[i]) > 1e-4f * (1.0f + std::fabs(b[i]))) {
+      fprintf(stderr, "%s: mismatch at %zu (%f vs %f)\n", name, i, a[i], b[i]);
+      num_failures ++;
+      return;
+    }
+  }
+}
+
+static void check_sgemm(bool trans_a, bool trans_b, int m, int n, int k,
+                        float alpha, float beta)
+{
+  // Column-major, with leading dimensions larger than the matrices
+  int lda = (trans_a ? k : m) + 3;
+  int ldb = (trans_b ? n : k) + 1;
+  int ldc = m + 2;
+  std::vector<float> A(lda * (trans_a ? m : k)), B(ldb * (trans_b ? k : n));
+  std::vector<float> C(ldc * n);
+  fill_random(A);
+  fill_random(B);
+  fill_random(C);
+  std::vector<float> ref(C);
+  for (int j = 0; j < n; j++)
+    for (int i = 0; i < m; i++) {
+      double sum = 0.0;
+      for (int l = 0; l < k; l++) {
+        float a = trans_a ? A[i * lda + l] : A[l * lda + i];
+        float b = trans_b ? B[l * ldb + j] : B[j * ldb + l];
+        sum += (double)a * b;
+      }
+      ref[j * ldc + i] = alpha * sum + beta * C[j * ldc + i];
+    }
+  cpu_sgemm(trans_a, trans_b, m, n, k, alpha, A.data(), lda,
+            B.data(), ldb, beta, C.data(), ldc);
+  char name[128];
+  snprintf(name, sizeof(name), "cpu_sgemm(%c%c, %d, %d, %d)",
+           trans_a ? 'T' : 'N', trans_b ? 'T' : 'N', m, n, k);
+  check_close(name, C, ref);
+}
+
+static void check_im2col(int channels, int height, int width,
+                         int kernel_h, int kernel_w, int pad_h, int pad_w,
+                         int stride_h, int stride_w)
+{
+  int out_h = (height + 2 * pad_h - kernel_h) / stride_h + 1;
+  int out_w = (width + 2 * pad_w - kernel_w) / stride_w + 1;
+  int rows = channels * kernel_h * kernel_w, cols = out_h * out_w;
+  std::vector<float> im(channels * height * width);
+  fill_random(im);
+  std::vector<float> col(rows * cols), ref(rows * cols, 0.0f);
+  for (int c = 0; c < channels; c++)
+    for (int kh = 0; kh < kernel_h; kh++)
+      for (int kw = 0; kw < kernel_w; kw++)
+        for (int oh = 0; oh < out_h; oh++)
+          for (int ow = 0; ow < out_w; ow++) {
+            int h = oh * stride_h - pad_h + kh;
+            int w = ow * stride_w - pad_w + kw;
+            int row = (c * kernel_h + kh) * kernel_w + kw;
+            if (h >= 0 && h < height && w >= 0 && w < width)
+              ref[row * cols + oh * out_w + ow] = im[(c * height + h) * width + w];
+          }
+  cpu_im2col(im.data(), channels, height, width, kernel_h, kernel_w,
+             pad_h, pad_w, stride_h, stride_w, out_h, out_w, col.data());
+  check_close("cpu_im2col", col, ref);
+  // col2im accumulates every column entry back into its image position
+  std::vector<float> grad(im.size()), grad_ref(im.size());
+  fill_random(grad);
+  grad_ref = grad;
+  for (int c = 0; c < channels; c++)
+    for (int kh = 0; kh < kernel_h; kh++)
+      for (int kw = 0; kw < kernel_w; kw++)
+        for (int oh = 0; oh < out_h; oh++)
+          for (int ow = 0; ow < out_w; ow++) {
+            int h = oh * stride_h - pad_h + kh;
+            int w = ow * stride_w - pad_w + kw;
+            int row = (c * kernel_h + kh) * kernel_w + kw;
+            if (h >= 0 && h < height && w >= 0 && w < width)
+              grad_ref[(c * height + h) * width + w] += col[row * cols + oh * out_w + ow];
+          }
+  cpu_col2im(col.data(), channels, height, width, kernel_h, kernel_w,
+             pad_h, pad_w, stride_h, stride_w, out_h, out_w, grad.data());
+  check_close("cpu_col2im", grad, grad_ref);
+}
+
+static void check_conv2d(int n, int in_c, int out_c, int height, int width,
+                         int kernel_h, int kernel_w, int pad_h, int pad_w,
+                         int stride_h, int stride_w, int groups, bool relu)
+{
+  Conv2DShape s;
+  s.input_n = n; s.input_c = in_c; s.input_h = height; s.input_w = width;
+  s.output_c = out_c;
+  s.output_h = (height + 2 * pad_h - kernel_h) / stride_h + 1;
+  s.output_w = (width + 2 * pad_w - kernel_w) / stride_w + 1;
+  s.kernel_h = kernel_h; s.kernel_w = kernel_w;
+  s.stride_h = stride_h; s.stride_w = stride_w;
+  s.pad_h = pad_h; s.pad_w = pad_w; s.groups = groups;
+  int in_c_g = in_c / groups, out_c_g = out_c / groups;
+  std::vector<float> input(n * in_c * height * width);
+  std::vector<float> kernel(out_c * in_c_g * kernel_h * kernel_w);
+  std::vector<float> bias(out_c);
+  fill_random(input);
+  fill_random(kernel);
+  fill_random(bias);
+  std::vector<float> output(n * out_c * s.output_h * s.output_w);
+  std::vector<float> ref(output.size());
+  for (int b = 0; b < n; b++)
+    for (int oc = 0; oc < out_c; oc++)
+      for (int oh = 0; oh < s.output_h; oh++)
+        for (int ow = 0; ow < s.output_w; ow++) {
+          int g = oc / out_c_g;
+          double sum = bias[oc];
+          for (int ic = 0; ic < in_c_g; ic++)
+            for (int kh = 0; kh < kernel_h; kh++)
+              for (int kw = 0; kw < kernel_w; kw++) {
+                int h = oh * stride_h - pad_h + kh;
+                int w = ow * stride_w - pad_w + kw;
+                if (h < 0 || h >= height || w < 0 || w >= width)
+                  continue;
+                int c = g * in_c_g + ic;
+                sum += (double)input[((b * in_c + c) * height + h) * width + w]
+                     * kernel[((oc * in_c_g + ic) * kernel_h + kh) * kernel_w + kw];
+              }
+          if (relu && sum < 0.0)
+            sum = 0.0;
+          ref[((b * out_c + oc) * s.output_h + oh) * s.output_w + ow] = sum;
+        }
+  conv2d_forward_cpu(s, input.data(), output.data(), kernel.data(),
+                     bias.data(), relu);
+  char name[128];
+  snprintf(name, sizeof(name), "conv2d_forward_cpu(%dx%d, stride %d, pad %d, groups %d)",
+           kernel_h, kernel_w, stride_h, pad_h, groups);
+  check_close(name, output, ref);
+}
+
+static void check_pool2d(PoolType type, int planes, int height, int width,
+                         int kernel_h, int kernel_w, int pad_h, int pad_w,
+                         int stride_h, int stride_w)
+{
+  Pool2DShape s;
+  s.num_planes = planes; s.input_h = height; s.input_w = width;
+  s.output_h = (height + 2 * pad_h - kernel_h) / stride_h + 1;
+  s.output_w = (width + 2 * pad_w - kernel_w) / stride_w + 1;
+  s.kernel_h = kernel_h; s.kernel_w = kernel_w;
+  s.stride_h = stride_h; s.stride_w = stride_w;
+  s.pad_h = pad_h; s.pad_w = pad_w;
+  int out_hw = s.output_h * s.output_w;
+  std::vector<float> input(planes * height * width);
+  std::vector<float> output_grad(planes * out_hw);
+  fill_random(input);
+  fill_random(output_grad);
+  std::vector<float> output(planes * out_hw), ref(output.size());
+  std::vector<float> input_grad(input.size()), grad_ref(input.size());
+  fill_random(input_grad);
+  grad_ref = input_grad;
+  for (int p = 0; p < planes; p++)
+    for (int oh = 0; oh < s.output_h; oh++)
+      for (int ow = 0; ow < s.output_w; ow++) {
+        // Windows clipped to the image; the average excludes padding
+        float max_val = -FLT_MAX, sum = 0.0f;
+        int max_idx = -1, count = 0;
+        for (int kh = 0; kh < kernel_h; kh++)
+          for (int kw = 0; kw < kernel_w; kw++) {
+            int h = oh * stride_h - pad_h + kh;
+            int w = ow * stride_w - pad_w + kw;
+            if (h < 0 || h >= height || w < 0 || w >= width)
+              continue;
+            int idx = (p * height + h) * width + w;
+            if (max_idx < 0 || input[idx] > max_val) {
+              max_val = input[idx];
+              max_idx = idx;
+            }
+            sum += input[idx];
+            count ++;
+          }
+        int o = p * out_hw + oh * s.output_w + ow;
+        float grad = output_grad[o];
+        if (type == POOL_MAX) {
+          ref[o] = max_val;
+          grad_ref[max_idx] += grad;
+        } else {
+          ref[o] = sum / count;
+          for (int kh = 0; kh < kernel_h; kh++)
+            for (int kw = 0; kw < kernel_w; kw++) {
+              int h = oh * stride_h - pad_h + kh;
+              int w = ow * stride_w - pad_w + kw;
+              if (h >= 0 && h < height && w >= 0 && w < width)
+                grad_ref[(p * height + h) * width + w] += grad / count;
+            }
+        }
+      }
+  pool2d_forward_cpu(s, type, input.data(), output.data());
+  pool2d_backward_cpu(s, type, input.data(), input_grad.data(),
+                      output_grad.data());
+  char name[128];
+  snprintf(name, sizeof(name), "pool2d_%s_cpu(%dx%d, stride %d, pad %d)",
+           type == POOL_MAX ? "max" : "avg", kernel_h, kernel_w,
+           stride_h, pad_h);
+  check_close(name, output, ref);
+  check_close(name, input_grad, grad_ref);
+}
+
+int main(void)
+{
+  std::srand(0);
+  const int shapes[][3] = {{1, 1, 1}, {7, 5, 3}, {33, 17, 129}, {130, 9, 257}};
+  for (int s = 0; s < 4; s++)
+    for (int t = 0; t < 4; t++)
+      check_sgemm(t & 1, t & 2, shapes[s][0], shapes[s][1], shapes[s][2],
+                  1.5f, (s % 2) ? 0.0f : 0.5f);
+  check_im2col(3, 8, 8, 3, 3, 1, 1, 1, 1);
+  check_im2col(2, 9, 7, 3, 2, 2, 0, 2, 3);
+  check_im2col(4, 5, 5, 1, 1, 0, 0, 1, 1);
+  check_conv2d(2, 3, 4, 8, 8, 3, 3, 1, 1, 1, 1, 1, false);
+  check_conv2d(2, 4, 6, 9, 7, 3, 2, 1, 0, 2, 3, 2, true);
+  check_conv2d(1, 6, 6, 7, 7, 5, 5, 2, 2, 2, 2, 3, false);
+  // 1x1, unit stride and no padding takes the direct (no im2col) path
+  check_conv2d(3, 4, 8, 5, 6, 1, 1, 0, 0, 1, 1, 1, true);
+  check_conv2d(2, 4, 4, 5, 5, 1, 1, 0, 0, 1, 1, 4, false);
+  check_pool2d(POOL_MAX, 3, 8, 8, 2, 2, 0, 0, 2, 2);
+  check_pool2d(POOL_MAX, 2, 7, 9, 3, 3, 1, 1, 2, 2);
+  check_pool2d(POOL_AVG, 3, 8, 8, 2, 2, 0, 0, 2, 2);
+  check_pool2d(POOL_AVG, 2, 7, 9, 3, 3, 1, 1, 2, 2);
+  check_pool2d(POOL_AVG, 2, 6, 5, 3, 2, 1, 0, 1, 1);
+  if (num_failures > 0) {
+    fprintf(stderr, "%d checks failed\n", num_failures);
+    return 1;
+  }
+  printf("All CPU kernel checks passed\n");
+  return 0;
+}
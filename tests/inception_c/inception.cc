@@ -283,7 +283,7 @@ DataLoader::DataLoader(FFModel& ff,
     IndexLauncher launcher(CUSTOM_GPU_TASK_ID_1, task_is,
                            TaskArgument(NULL, 0), argmap,
                            Predicate::TRUE_PRED, false/*must*/, 0/*mapper_id*/,
-                           FFConfig::get_hash_id(std::string("")));
+                           ff.config.get_strategy_id(std::string("")));
     launcher.add_region_requirement(
         RegionRequirement(input.part, 0/*projection id*/,
                           WRITE_ONLY, EXCLUSIVE, input.region));
@@ -297,7 +297,7 @@ DataLoader::DataLoader(FFModel& ff,
     IndexLauncher launcher(CUSTOM_GPU_TASK_ID_1, task_is,
                            TaskArgument(NULL, 0), argmap,
                            Predicate::TRUE_PRED, false/*must*/, 0/*mapper_id*/,
-                           FFConfig::get_hash_id(std::string("")));
+                           ff.config.get_strategy_id(std::string("")));
     launcher.add_region_requirement(
         RegionRequirement(label.part, 0/*projection id*/,
                           WRITE_ONLY, EXCLUSIVE, label.region));